@@ -0,0 +1,195 @@
+/**
+ *  \file bench.h
+ *  \brief Benchmarks for the message codecs and the network layer. Results
+ *         can be printed as a table, CSV or JSON so runs can be compared.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "messages.h"
+#include "msgtypes.h"
+#include "network.h"
+#include "evloop.h"
+#include "timing.h"
+
+
+/******************************
+**
+** #defines
+**
+******************************/
+
+#ifndef TRUE
+#define TRUE 1
+#endif /* TRUE */
+
+#ifndef FALSE
+#define FALSE 0
+#endif /* FALSE */
+
+/** @name Number of times each codec operation is timed. */
+//@{
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 1000000
+#endif /* BENCH_ITERATIONS */
+//@}
+
+/** @name Number of round trips timed for each client in the loopback test. */
+//@{
+#ifndef BENCH_ROUNDS
+#define BENCH_ROUNDS 1000
+#endif /* BENCH_ROUNDS */
+//@}
+
+/** @name Largest number of clients in the loopback test. */
+//@{
+#ifndef BENCH_MAX_CLIENTS
+#define BENCH_MAX_CLIENTS 10
+#endif /* BENCH_MAX_CLIENTS */
+//@}
+
+/** @name Port used by the loopback server. */
+//@{
+#ifndef BENCH_PORT
+#define BENCH_PORT 24500
+#endif /* BENCH_PORT */
+//@}
+
+/** @name Longest time to wait for a loopback client to connect in ms. */
+//@{
+#ifndef BENCH_CONNECT_TIMEOUT
+#define BENCH_CONNECT_TIMEOUT 1000
+#endif /* BENCH_CONNECT_TIMEOUT */
+//@}
+
+/** @name Longest time to wait for a reply or for room to send in ms. */
+//@{
+#ifndef BENCH_REPLY_TIMEOUT
+#define BENCH_REPLY_TIMEOUT 100
+#endif /* BENCH_REPLY_TIMEOUT */
+//@}
+
+/** @name Number of results that can be kept for printing. */
+//@{
+#ifndef BENCH_MAX_RESULTS
+#define BENCH_MAX_RESULTS 256
+#endif /* BENCH_MAX_RESULTS */
+//@}
+
+/** @name Output formats. */
+//@{
+#ifndef BENCH_FORMATS
+#define BENCH_FORMATS
+#define BENCH_TABLE	0
+#define BENCH_CSV	1
+#define BENCH_JSON	2
+#endif /* BENCH_FORMATS */
+//@}
+
+/** @name Kinds of result. */
+//@{
+#ifndef BENCH_TESTS
+#define BENCH_TESTS
+#define BENCH_CODEC	0
+#define BENCH_RTT	1
+#endif /* BENCH_TESTS */
+//@}
+
+
+/******************************
+**
+** Data types
+**
+******************************/
+
+#ifndef _BENCH_
+#define _BENCH_
+/*! A message type to benchmark. */
+typedef struct _BENCH_MSG {
+	int msgid;			//!< Message ID
+	const char *name;	//!< Name to print
+	int struct_size;	//!< Size of the message struct
+} BENCH_MSG;
+
+/*! One line of results. Codec results fill in the sizes and times per
+ * message. Loopback results fill in the clients and round trip times. */
+typedef struct _BENCH_RESULT {
+	int test;			//!< BENCH_CODEC or BENCH_RTT
+	const BENCH_MSG *msg;	//!< Message type
+	int wire_size;		//!< Size of the packed message
+	double encode;		//!< messages_encode() time in ns
+	double decode;		//!< messages_decode() time in ns
+	double send;		//!< messages_send() time over loopback TCP in ns
+	int clients;		//!< Number of clients sending at once
+	int lost;			//!< Replies that did not arrive
+	double p50;			//!< Median round trip in us
+	double p90;			//!< 90th percentile round trip in us
+	double p99;			//!< 99th percentile round trip in us
+	double max;			//!< Longest round trip in us
+} BENCH_RESULT;
+#endif /* _BENCH_ */
+
+
+/******************************
+**
+** Function prototypes
+**
+******************************/
+
+//! Times encoding and decoding of one message type.
+//! \param bm Message type.
+//! \param iterations Number of times to run each operation.
+//! \param result Filled in with the sizes and times.
+void bench_codec(const BENCH_MSG *bm, int iterations, BENCH_RESULT *result);
+
+//! Starts a loopback server in a child process. The server decodes every
+//! message it gets and, if echo is set, sends the same message ID back.
+//! \param port Port to listen on.
+//! \param msgid Message ID to send back.
+//! \param echo TRUE to reply to each message.
+//! \return Process ID of the server, -1 on error.
+int bench_server(short port, int msgid, int echo);
+
+//! Stops a loopback server.
+//! \param pid Process ID from bench_server().
+void bench_server_stop(int pid);
+
+//! Connects a client to the loopback server and waits until it is up.
+//! \param port Port of the server.
+//! \return Client file descriptor, -1 on error.
+int bench_connect(short port);
+
+//! Times messages_send() over loopback TCP to a server that decodes
+//! everything it gets.
+//! \param bm Message type.
+//! \param port Port for the loopback server.
+//! \param iterations Number of messages to send.
+//! \param result Filled in with the time per message.
+void bench_send(const BENCH_MSG *bm, short port, int iterations, BENCH_RESULT *result);
+
+//! Times round trips to an echo server with several clients sending at once.
+//! \param bm Message type.
+//! \param port Port for the loopback server.
+//! \param clients Number of clients.
+//! \param rounds Number of round trips for each client.
+//! \param result Filled in with the round trip percentiles.
+void bench_rtt(const BENCH_MSG *bm, short port, int clients, int rounds,
+	BENCH_RESULT *result);
+
+//! Prints results.
+//! \param results Results to print.
+//! \param count Number of results.
+//! \param format BENCH_TABLE, BENCH_CSV or BENCH_JSON.
+void bench_print(const BENCH_RESULT *results, int count, int format);
+
+
+#endif /* _BENCH_H_ */
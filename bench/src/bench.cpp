@@ -0,0 +1,489 @@
+/******************************************************************************
+ *
+ *  Title:        bench.c
+ *
+ *  Description:  Benchmarks for the message codecs and the network layer.
+ *
+ *****************************************************************************/
+
+#include "bench.h"
+
+/// Message types to benchmark.
+static const BENCH_MSG msgs[] = {
+	{OPEN_MSGID,		"open",		sizeof(OPEN_MSG)},
+	{MSTRAIN_MSGID,		"mstrain",	sizeof(MSTRAIN_MSG)},
+	{SERVO_MSGID,		"servo",	sizeof(SERVO_MSG)},
+	{CLIENT_MSGID,		"client",	sizeof(CLIENT_MSG)},
+	{TARGET_MSGID,		"target",	sizeof(TARGET_MSG)},
+	{GAIN_MSGID,		"gain",		sizeof(GAIN_MSG)},
+	{STATUS_MSGID,		"status",	sizeof(STATUS_MSG)},
+	{VISION_MSGID,		"vision",	sizeof(VISION_MSG)},
+	{STOP_MSGID,		"stop",		sizeof(STOP_MSG)},
+	{TASK_MSGID,		"task",		sizeof(TASK_MSG)},
+	{VSETTING_MSGID,	"vsetting",	sizeof(VSETTING_MSG)},
+	{LJ_MSGID,			"lj",		sizeof(LJ_MSG)},
+	{TELEOP_MSGID,		"teleop",	sizeof(TELEOP_MSG)},
+	{DIAG_MSGID,		"diag",		sizeof(DIAG_MSG)}
+};
+
+/// Results kept until the end so they can be printed in one format.
+static BENCH_RESULT results[BENCH_MAX_RESULTS];
+
+/// Message ID the loopback server sends back.
+static int echo_msgid;
+
+
+/*------------------------------------------------------------------------------
+ * void bench_codec()
+ * Times encoding and decoding of one message type.
+ *----------------------------------------------------------------------------*/
+
+void bench_codec(const BENCH_MSG *bm, int iterations, BENCH_RESULT *result)
+{
+	MSG_DATA msg;
+	MSG_DATA out;
+	char buf[MSG_WIRE_SIZE];
+	unsigned long long start = 0;
+	int len = 0;
+	int ii;
+
+	/// Fill the message with something other than zeros.
+	for (ii = 0; ii < (int)sizeof(MSG_DATA); ii++) {
+		((unsigned char *)&msg)[ii] = ii * 37;
+	}
+	messages_init(&msg);
+	memset(&out, 0, sizeof(MSG_DATA));
+
+	result->test = BENCH_CODEC;
+	result->msg = bm;
+
+	start = timing_now();
+	for (ii = 0; ii < iterations; ii++) {
+		len = messages_encode(bm->msgid, &msg, buf, MSG_WIRE_SIZE);
+	}
+	result->encode = (double)timing_elapsed(start) / iterations;
+	result->wire_size = len;
+
+	/// A descriptor of -1 decodes whole messages without a reassembly buffer.
+	start = timing_now();
+	for (ii = 0; ii < iterations; ii++) {
+		messages_decode(-1, buf, &out, len);
+	}
+	result->decode = (double)timing_elapsed(start) / iterations;
+} /* end bench_codec() */
+
+
+/*------------------------------------------------------------------------------
+ * void bench_echo_cb()
+ * Loopback server callback. Sends the message back to the client.
+ *----------------------------------------------------------------------------*/
+
+static void bench_echo_cb(int fd, MSG_DATA *msg, void *arg)
+{
+	messages_send(fd, echo_msgid, msg);
+} /* end bench_echo_cb() */
+
+
+/*------------------------------------------------------------------------------
+ * int bench_server()
+ * Starts a loopback server in a child process. The socket is set up before
+ * the fork so clients can connect as soon as this returns.
+ *----------------------------------------------------------------------------*/
+
+int bench_server(short port, int msgid, int echo)
+{
+	static char buf[MAX_MSG_SIZE];
+	static MSG_DATA msg;
+	NET_SERVER server;
+	EVLOOP loop;
+	int pid = -1;
+
+	if (net_server_setup(&server, port) == -1) {
+		return -1;
+	}
+
+	if ((pid = fork()) == -1) {
+		perror("fork");
+		close(server.fd);
+		return -1;
+	}
+	if (pid > 0) {
+		close(server.fd);
+		return pid;
+	}
+
+	/// Child. Runs until it is killed.
+	echo_msgid = msgid;
+	memset(&msg, 0, sizeof(MSG_DATA));
+	messages_init(&msg);
+	if (evloop_init(&loop) == -1 ||
+		net_server_add(&loop, &server, buf, &msg, 0, echo ? bench_echo_cb : NULL, NULL) == -1) {
+		_exit(1);
+	}
+	evloop_run(&loop);
+	_exit(0);
+} /* end bench_server() */
+
+
+/*------------------------------------------------------------------------------
+ * void bench_server_stop()
+ * Stops a loopback server.
+ *----------------------------------------------------------------------------*/
+
+void bench_server_stop(int pid)
+{
+	if (pid > 0) {
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+	}
+} /* end bench_server_stop() */
+
+
+/*------------------------------------------------------------------------------
+ * int bench_connect()
+ * Connects a client to the loopback server and waits until it is up.
+ *----------------------------------------------------------------------------*/
+
+int bench_connect(short port)
+{
+	unsigned long long deadline = timing_now() + timing_s2ns(BENCH_CONNECT_TIMEOUT * 0.001);
+	int fd = -1;
+
+	if ((fd = net_client_setup((char *)"127.0.0.1", port)) == -1) {
+		return -1;
+	}
+	while (!net_client_check(fd)) {
+		if (timing_deadline_passed(deadline)) {
+			printf("BENCH_CONNECT: WARNING!!! Could not connect to port %d.\n", port);
+			net_close(fd);
+			return -1;
+		}
+		usleep(1000);
+	}
+
+	return fd;
+} /* end bench_connect() */
+
+
+/*------------------------------------------------------------------------------
+ * void bench_send()
+ * Times messages_send() over loopback TCP. The server decodes every message
+ * so the time includes the receiving side keeping up.
+ *----------------------------------------------------------------------------*/
+
+void bench_send(const BENCH_MSG *bm, short port, int iterations, BENCH_RESULT *result)
+{
+	struct pollfd pfd;
+	MSG_DATA msg;
+	unsigned long long start = 0;
+	int pid = -1;
+	int fd = -1;
+	int ii;
+
+	result->send = 0;
+	memset(&msg, 0, sizeof(MSG_DATA));
+	messages_init(&msg);
+
+	if ((pid = bench_server(port, bm->msgid, FALSE)) == -1) {
+		return;
+	}
+	if ((fd = bench_connect(port)) == -1) {
+		bench_server_stop(pid);
+		return;
+	}
+
+	start = timing_now();
+	pfd.fd = fd;
+	pfd.events = POLLOUT;
+	for (ii = 0; ii < iterations; ii++) {
+		messages_send(fd, bm->msgid, &msg);
+
+		/// Client sends are queued when the socket is full. Wait for room
+		/// so that every message reaches the server instead of the queue
+		/// dropping them.
+		while (net_flush(fd) > 0) {
+			pfd.revents = 0;
+			if (poll(&pfd, 1, BENCH_REPLY_TIMEOUT) <= 0) {
+				break;
+			}
+		}
+	}
+	result->send = (double)timing_elapsed(start) / iterations;
+
+	net_close(fd);
+	bench_server_stop(pid);
+} /* end bench_send() */
+
+
+/*------------------------------------------------------------------------------
+ * int bench_cmp()
+ * Compares two round trip times for qsort().
+ *----------------------------------------------------------------------------*/
+
+static int bench_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+} /* end bench_cmp() */
+
+
+/*------------------------------------------------------------------------------
+ * double bench_pct()
+ * Gets a percentile from sorted samples.
+ *----------------------------------------------------------------------------*/
+
+static double bench_pct(const double *samples, int count, double pct)
+{
+	int ii = (int)(pct / 100. * (count - 1) + 0.5);
+
+	if (count == 0) {
+		return 0;
+	}
+
+	return samples[ii];
+} /* end bench_pct() */
+
+
+/*------------------------------------------------------------------------------
+ * void bench_rtt()
+ * Times round trips to an echo server. In each round every client sends one
+ * message and then each reply is read, so the server sees all of the clients
+ * at once.
+ *----------------------------------------------------------------------------*/
+
+void bench_rtt(const BENCH_MSG *bm, short port, int clients, int rounds,
+	BENCH_RESULT *result)
+{
+	static char buf[MAX_MSG_SIZE];
+	struct pollfd pfd;
+	unsigned long long sent[BENCH_MAX_CLIENTS];
+	double *samples = NULL;
+	MSG_DATA msg;
+	int fds[BENCH_MAX_CLIENTS];
+	int len = messages_size(bm->msgid);
+	int count = 0;
+	int bytes = 0;
+	int n = 0;
+	int pid = -1;
+	int ii;
+	int jj;
+
+	memset(result, 0, sizeof(BENCH_RESULT));
+	result->test = BENCH_RTT;
+	result->msg = bm;
+	result->wire_size = len;
+	result->clients = clients;
+
+	/// A zeroed OPEN message does not subscribe so it is answered like any
+	/// other request.
+	memset(&msg, 0, sizeof(MSG_DATA));
+	messages_init(&msg);
+
+	if ((samples = (double *)malloc(clients * rounds * sizeof(double))) == NULL) {
+		perror("malloc");
+		return;
+	}
+	if ((pid = bench_server(port, bm->msgid, TRUE)) == -1) {
+		free(samples);
+		return;
+	}
+	for (ii = 0; ii < clients; ii++) {
+		if ((fds[ii] = bench_connect(port)) == -1) {
+			clients = ii;
+			break;
+		}
+	}
+
+	for (jj = 0; jj < rounds; jj++) {
+		for (ii = 0; ii < clients; ii++) {
+			sent[ii] = timing_now();
+			messages_send(fds[ii], bm->msgid, &msg);
+		}
+		for (ii = 0; ii < clients; ii++) {
+			/// Read until the whole reply is in. Replies are never merged
+			/// since each client has one message outstanding.
+			bytes = 0;
+			pfd.fd = fds[ii];
+			pfd.events = POLLIN;
+			while (bytes < len) {
+				/// Client sockets do not block so wait for the reply here.
+				pfd.revents = 0;
+				if (poll(&pfd, 1, BENCH_REPLY_TIMEOUT) <= 0 ||
+					(n = net_recv(fds[ii], buf)) <= 0) {
+					break;
+				}
+				bytes += n;
+			}
+			if (bytes < len) {
+				result->lost++;
+				continue;
+			}
+			samples[count++] = timing_elapsed(sent[ii]) / 1000.;
+		}
+	}
+
+	qsort(samples, count, sizeof(double), bench_cmp);
+	result->p50 = bench_pct(samples, count, 50);
+	result->p90 = bench_pct(samples, count, 90);
+	result->p99 = bench_pct(samples, count, 99);
+	result->max = (count > 0) ? samples[count - 1] : 0;
+
+	for (ii = 0; ii < clients; ii++) {
+		net_close(fds[ii]);
+	}
+	bench_server_stop(pid);
+	free(samples);
+} /* end bench_rtt() */
+
+
+/*------------------------------------------------------------------------------
+ * void bench_print()
+ * Prints results as a table, CSV or JSON.
+ *----------------------------------------------------------------------------*/
+
+void bench_print(const BENCH_RESULT *results, int count, int format)
+{
+	const BENCH_RESULT *r = NULL;
+	int ii;
+
+	if (format == BENCH_CSV) {
+		printf("test,msgid,message,struct_bytes,wire_bytes,encode_ns,decode_ns,"
+			"send_ns,clients,lost,rtt_p50_us,rtt_p90_us,rtt_p99_us,rtt_max_us\n");
+		for (ii = 0; ii < count; ii++) {
+			r = &results[ii];
+			if (r->test == BENCH_CODEC) {
+				printf("codec,%d,%s,%d,%d,%.1f,%.1f,%.1f,,,,,,\n", r->msg->msgid,
+					r->msg->name, r->msg->struct_size, r->wire_size, r->encode,
+					r->decode, r->send);
+			}
+			else {
+				printf("rtt,%d,%s,%d,%d,,,,%d,%d,%.1f,%.1f,%.1f,%.1f\n", r->msg->msgid,
+					r->msg->name, r->msg->struct_size, r->wire_size, r->clients,
+					r->lost, r->p50, r->p90, r->p99, r->max);
+			}
+		}
+	}
+	else if (format == BENCH_JSON) {
+		printf("[\n");
+		for (ii = 0; ii < count; ii++) {
+			r = &results[ii];
+			if (r->test == BENCH_CODEC) {
+				printf("  {\"test\": \"codec\", \"msgid\": %d, \"message\": \"%s\", "
+					"\"struct_bytes\": %d, \"wire_bytes\": %d, \"encode_ns\": %.1f, "
+					"\"decode_ns\": %.1f, \"send_ns\": %.1f}", r->msg->msgid,
+					r->msg->name, r->msg->struct_size, r->wire_size, r->encode,
+					r->decode, r->send);
+			}
+			else {
+				printf("  {\"test\": \"rtt\", \"msgid\": %d, \"message\": \"%s\", "
+					"\"wire_bytes\": %d, \"clients\": %d, \"lost\": %d, "
+					"\"rtt_p50_us\": %.1f, \"rtt_p90_us\": %.1f, \"rtt_p99_us\": %.1f, "
+					"\"rtt_max_us\": %.1f}", r->msg->msgid, r->msg->name, r->wire_size,
+					r->clients, r->lost, r->p50, r->p90, r->p99, r->max);
+			}
+			printf("%s\n", (ii < count - 1) ? "," : "");
+		}
+		printf("]\n");
+	}
+	else {
+		printf("%-10s %6s %6s %10s %10s %10s\n", "message", "struct", "wire",
+			"enc ns", "dec ns", "send ns");
+		for (ii = 0; ii < count; ii++) {
+			r = &results[ii];
+			if (r->test == BENCH_CODEC) {
+				printf("%-10s %6d %6d %10.1f %10.1f %10.1f\n", r->msg->name,
+					r->msg->struct_size, r->wire_size, r->encode, r->decode, r->send);
+			}
+		}
+		printf("\n%-10s %7s %6s %10s %10s %10s %10s\n", "message", "clients", "lost",
+			"p50 us", "p90 us", "p99 us", "max us");
+		for (ii = 0; ii < count; ii++) {
+			r = &results[ii];
+			if (r->test == BENCH_RTT) {
+				printf("%-10s %7d %6d %10.1f %10.1f %10.1f %10.1f\n", r->msg->name,
+					r->clients, r->lost, r->p50, r->p90, r->p99, r->max);
+			}
+		}
+	}
+} /* end bench_print() */
+
+
+/*------------------------------------------------------------------------------
+ * int main()
+ * Runs each benchmark and prints the results.
+ *----------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+	int iterations = BENCH_ITERATIONS;
+	int rounds = BENCH_ROUNDS;
+	int max_clients = BENCH_MAX_CLIENTS;
+	int format = BENCH_TABLE;
+	int port = BENCH_PORT;
+	int nmsgs = sizeof(msgs) / sizeof(BENCH_MSG);
+	int count = 0;
+	int opt = 0;
+	int ii;
+	int jj;
+
+	while ((opt = getopt(argc, argv, "n:r:c:p:f:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'c':
+			max_clients = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'f':
+			if (strcmp(optarg, "csv") == 0) {
+				format = BENCH_CSV;
+			}
+			else if (strcmp(optarg, "json") == 0) {
+				format = BENCH_JSON;
+			}
+			else {
+				format = BENCH_TABLE;
+			}
+			break;
+		default:
+			iterations = 0;
+			break;
+		}
+	}
+	if (iterations <= 0 || rounds < 0 || max_clients < 0 ||
+		max_clients > BENCH_MAX_CLIENTS) {
+		printf("Usage: %s [-n iterations] [-r rounds] [-c clients] [-p port] "
+			"[-f table|csv|json]\n", argv[0]);
+		printf("  -c is 0 to %d, 0 skips the network tests.\n", BENCH_MAX_CLIENTS);
+		return 1;
+	}
+
+	/// Keep the output clean when a server child closes its socket.
+	signal(SIGPIPE, SIG_IGN);
+
+	for (ii = 0; ii < nmsgs; ii++) {
+		bench_codec(&msgs[ii], iterations, &results[count]);
+		if (max_clients > 0) {
+			bench_send(&msgs[ii], port, iterations / 10 + 1, &results[count]);
+		}
+		count++;
+	}
+
+	for (ii = 0; ii < nmsgs && rounds > 0; ii++) {
+		for (jj = 1; jj <= max_clients && count < BENCH_MAX_RESULTS; jj++) {
+			bench_rtt(&msgs[ii], port, jj, rounds, &results[count++]);
+		}
+	}
+
+	bench_print(results, count, format);
+
+	return 0;
+} /* end main() */
@@ -0,0 +1,164 @@
+/**
+ *  \file evloop.h
+ *  \brief Event loop built on epoll and timerfd. Sockets, serial ports and
+ *         periodic timers are registered with the loop so that a daemon can
+ *         block until there is work to do instead of polling.
+ */
+
+#ifndef _EVLOOP_H_
+#define _EVLOOP_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+
+/******************************
+**
+** #defines
+**
+******************************/
+
+#ifndef TRUE
+#define TRUE 1
+#endif /* TRUE */
+
+#ifndef FALSE
+#define FALSE 0
+#endif /* FALSE */
+
+/** @name Maximum number of descriptors and timers a loop can watch. */
+//@{
+#ifndef EVLOOP_MAX_HANDLERS
+#define EVLOOP_MAX_HANDLERS 64
+#endif /* EVLOOP_MAX_HANDLERS */
+//@}
+
+/** @name Maximum number of events handled per call to epoll_wait(). */
+//@{
+#ifndef EVLOOP_MAX_EVENTS
+#define EVLOOP_MAX_EVENTS 16
+#endif /* EVLOOP_MAX_EVENTS */
+//@}
+
+/** @name Event flags that can be requested for a descriptor. */
+//@{
+#ifndef EVLOOP_EVENTS
+#define EVLOOP_EVENTS
+#define EVLOOP_READ		EPOLLIN
+#define EVLOOP_WRITE	EPOLLOUT
+#define EVLOOP_ERROR	(EPOLLERR | EPOLLHUP)
+#endif /* EVLOOP_EVENTS */
+//@}
+
+/** @name Timeout value to block until an event arrives. */
+//@{
+#ifndef EVLOOP_FOREVER
+#define EVLOOP_FOREVER -1
+#endif /* EVLOOP_FOREVER */
+//@}
+
+
+/******************************
+**
+** Data types
+**
+******************************/
+
+//! Callback for a registered descriptor. For descriptors events holds the
+//! epoll flags that fired. For timers events holds the number of expirations
+//! since the last callback, which is more than 1 when the loop fell behind.
+typedef void (*EVLOOP_CB)(int fd, unsigned int events, void *arg);
+
+#ifndef _EVLOOP_
+#define _EVLOOP_
+/*! A descriptor or timer registered with the loop. */
+typedef struct _EVLOOP_HANDLER {
+	int fd;					//!< Descriptor to watch, -1 if slot is unused
+	unsigned int events;	//!< Requested epoll flags
+	int timer;				//!< TRUE if fd is a timerfd owned by the loop
+	EVLOOP_CB cb;			//!< Function to call when fd is ready
+	void *arg;				//!< User data passed to cb
+} EVLOOP_HANDLER;
+
+/*! Event loop state. */
+typedef struct _EVLOOP {
+	int epfd;									//!< epoll instance
+	int running;								//!< Cleared by evloop_stop()
+	EVLOOP_HANDLER handlers[EVLOOP_MAX_HANDLERS];	//!< Registered handlers
+} EVLOOP;
+#endif /* _EVLOOP_ */
+
+
+/******************************
+**
+** Function prototypes
+**
+******************************/
+
+//! Creates the epoll instance for an event loop.
+//! \param loop Pointer to event loop.
+//! \return 0 on success, -1 on error.
+int evloop_init(EVLOOP *loop);
+
+//! Closes the epoll instance and any timers owned by the loop.
+//! \param loop Pointer to event loop.
+void evloop_close(EVLOOP *loop);
+
+//! Watches a descriptor. Sockets, serial ports and pipes all work.
+//! \param loop Pointer to event loop.
+//! \param fd Descriptor to watch.
+//! \param events EVLOOP_READ and/or EVLOOP_WRITE.
+//! \param cb Function to call when the descriptor is ready.
+//! \param arg User data passed to cb.
+//! \return 0 on success, -1 on error.
+int evloop_add_fd(EVLOOP *loop, int fd, unsigned int events, EVLOOP_CB cb, void *arg);
+
+//! Changes the events watched for a descriptor.
+//! \param loop Pointer to event loop.
+//! \param fd Descriptor already added with evloop_add_fd().
+//! \param events EVLOOP_READ and/or EVLOOP_WRITE.
+//! \return 0 on success, -1 on error.
+int evloop_mod_fd(EVLOOP *loop, int fd, unsigned int events);
+
+//! Stops watching a descriptor. Timers are also closed.
+//! \param loop Pointer to event loop.
+//! \param fd Descriptor to remove.
+//! \return 0 on success, -1 on error.
+int evloop_del_fd(EVLOOP *loop, int fd);
+
+//! Creates a periodic timer. The first expiration is one period from now.
+//! \param loop Pointer to event loop.
+//! \param period Timer period in seconds.
+//! \param cb Function to call when the timer expires.
+//! \param arg User data passed to cb.
+//! \return The timer descriptor, -1 on error.
+int evloop_add_timer(EVLOOP *loop, float period, EVLOOP_CB cb, void *arg);
+
+//! Changes the period of a timer. A period of 0 disarms the timer.
+//! \param fd Timer descriptor from evloop_add_timer().
+//! \param period Timer period in seconds.
+//! \return 0 on success, -1 on error.
+int evloop_set_timer(int fd, float period);
+
+//! Waits for events and dispatches callbacks.
+//! \param loop Pointer to event loop.
+//! \param timeout Maximum time to block in milliseconds, EVLOOP_FOREVER to
+//!                block until an event arrives or 0 to poll.
+//! \return Number of events dispatched, -1 on error.
+int evloop_run_once(EVLOOP *loop, int timeout);
+
+//! Dispatches events until evloop_stop() is called.
+//! \param loop Pointer to event loop.
+void evloop_run(EVLOOP *loop);
+
+//! Makes evloop_run() return after the current iteration.
+//! \param loop Pointer to event loop.
+void evloop_stop(EVLOOP *loop);
+
+
+#endif /* _EVLOOP_H_ */
@@ -10,9 +10,13 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <string.h>
+#include <stddef.h>
+#include <signal.h>
+#include <time.h>
 
-#include "network.h"
 #include "msgtypes.h"
+#include "hist.h"
+#include "timing.h"
 
 
 /******************************
@@ -63,9 +67,18 @@
 #define VSETTING_MSGID      11
 #define LJ_MSGID            12
 #define TELEOP_MSGID		13
+#define DELTA_MSGID			14
+#define DIAG_MSGID			15
 //@}
 #endif /* API_MSGID */
 
+/** @name Bit for a message ID in a subscription topic mask. */
+//@{
+#ifndef MSG_TOPIC
+#define MSG_TOPIC(msgid) (1 << (msgid))
+#endif /* MSG_TOPIC */
+//@}
+
 /* Operating modes. */
 #ifndef OPERATING_MODES
 /** @name Valid operational modes for the uuv. */
@@ -91,6 +104,190 @@
 #define MSG_END 'Z'
 #endif /* MSG_END */
 
+/** @name Size of the reassembly buffer kept for each connection. Must be
+ * larger than the largest message. */
+//@{
+#ifndef MSG_BUF_SIZE
+#define MSG_BUF_SIZE 4096
+#endif /* MSG_BUF_SIZE */
+//@}
+
+/** @name Size of the packed header and footer on the wire. The header is the
+ * start character, the message ID, the 16 bit message length, the 16 bit
+ * producer ID, the 32 bit sequence number and the 64 bit timestamp. Values
+ * are in network byte order. The sequence number is filled in by the network
+ * code for each connection the message is sent on. */
+//@{
+#ifndef MSG_WIRE_HDR
+#define MSG_WIRE_HDR
+#define MSG_HDR_SIZE	18
+#define MSG_FTR_SIZE	1
+#define MSG_SEQ_OFFSET	6
+#endif /* MSG_WIRE_HDR */
+//@}
+
+/** @name Message ID of a packed message. */
+//@{
+#ifndef MSG_WIRE_ID
+#define MSG_WIRE_ID(buf) (((const unsigned char *)(buf))[1])
+#endif /* MSG_WIRE_ID */
+//@}
+
+/** @name Producer IDs sent in the header of every message. */
+//@{
+#ifndef MSG_PRODUCERS
+#define MSG_PRODUCERS
+#define MSG_PRODUCER_NONE		0
+#define MSG_PRODUCER_NAV		1
+#define MSG_PRODUCER_PLANNER	2
+#define MSG_PRODUCER_VISIOND	3
+#define MSG_PRODUCER_LABJACKD	4
+#define MSG_PRODUCER_GUI		5
+#define MSG_PRODUCER_JOYDRIVE	6
+#define MSG_PRODUCER_ESTIMATE	7
+#define MSG_MAX_PRODUCERS		8
+#endif /* MSG_PRODUCERS */
+//@}
+
+/** @name Number of message IDs that statistics are kept for. */
+//@{
+#ifndef MSG_NUM_IDS
+#define MSG_NUM_IDS 16
+#endif /* MSG_NUM_IDS */
+//@}
+
+/** @name Largest packed message. Used for encode scratch buffers. */
+//@{
+#ifndef MSG_WIRE_SIZE
+#define MSG_WIRE_SIZE 512
+#endif /* MSG_WIRE_SIZE */
+//@}
+
+/** @name Largest number of messages sent together by messages_send_batch(). */
+//@{
+#ifndef MSG_BATCH_MAX
+#define MSG_BATCH_MAX 16
+#endif /* MSG_BATCH_MAX */
+//@}
+
+/** @name Field types used to describe messages for the codecs. */
+//@{
+#ifndef MSG_FIELD_TYPES
+#define MSG_FIELD_TYPES
+#define MSG_CHAR	1
+#define MSG_SHORT	2
+#define MSG_INT		3
+#define MSG_FLOAT	4
+#define MSG_DOUBLE	5
+#endif /* MSG_FIELD_TYPES */
+//@}
+
+/** @name Helpers to build the codec tables. A field is described by its type,
+ * its offset in the data struct and the number of values. A codec lists the
+ * fields of one message and where that message lives in MSG_DATA. */
+//@{
+#ifndef MSG_FIELD_DEF
+#define MSG_FIELD_DEF(type, st, member, count) \
+	{ type, count, offsetof(st, member) }
+#endif /* MSG_FIELD_DEF */
+
+#ifndef MSG_CODEC_DEF
+#define MSG_CODEC_DEF(msgid, member, st, fields) \
+	{ msgid, offsetof(MSG_DATA, member), \
+	  offsetof(MSG_DATA, member) + offsetof(st, data), \
+	  fields, sizeof(fields) / sizeof(MSG_FIELD) }
+#endif /* MSG_CODEC_DEF */
+//@}
+
+/** @name Delta encoding. A delta message carries the ID of the message it
+ * stands for, its index since the last keyframe and a bit mask of the fields
+ * that changed, followed by those fields. Index 0 is a keyframe with every
+ * field. A keyframe is sent after MSG_DELTA_KEYFRAME deltas so a receiver that
+ * lost its place can pick the stream up again. Only messages with up to
+ * MSG_DELTA_FIELDS field entries can be delta encoded. */
+//@{
+#ifndef MSG_DELTA_SIZES
+#define MSG_DELTA_SIZES
+#define MSG_DELTA_HDR_SIZE	(MSG_HDR_SIZE + 10)
+#define MSG_DELTA_FIELDS	64
+#define MSG_DELTA_KEYFRAME	50
+#endif /* MSG_DELTA_SIZES */
+//@}
+
+/** @name Number of file descriptors that get a reassembly buffer. */
+//@{
+#ifndef MSG_MAX_FDS
+#define MSG_MAX_FDS 64
+#endif /* MSG_MAX_FDS */
+//@}
+
+
+/******************************
+**
+** Data types
+**
+******************************/
+
+#ifndef _MSG_BUF_
+#define _MSG_BUF_
+/*! Reassembly buffer for the byte stream from one connection. */
+typedef struct _MSG_BUF {
+	int len;					//!< Number of bytes waiting to be decoded
+	char data[MSG_BUF_SIZE];	//!< Partial message data
+} MSG_BUF;
+#endif /* _MSG_BUF_ */
+
+#ifndef _MSG_CODEC_
+#define _MSG_CODEC_
+/*! One field, or array of fields, of a message. */
+typedef struct _MSG_FIELD {
+	unsigned char type;		//!< MSG_CHAR, MSG_SHORT, MSG_INT, MSG_FLOAT or MSG_DOUBLE
+	unsigned char count;	//!< Number of values
+	unsigned short offset;	//!< Offset of the first value in the data struct
+} MSG_FIELD;
+
+/*! Description of one message used to pack and unpack it. */
+typedef struct _MSG_CODEC {
+	int msgid;					//!< Message ID
+	int msg;					//!< Offset of the message in MSG_DATA
+	int offset;					//!< Offset of the message data in MSG_DATA
+	const MSG_FIELD *fields;	//!< Fields in wire order
+	int nfields;				//!< Number of entries in fields
+} MSG_CODEC;
+#endif /* _MSG_CODEC_ */
+
+#ifndef _MSG_DELTA_
+#define _MSG_DELTA_
+/*! One end of a stream of delta encoded messages. Both the sender and the
+ * receiver keep the last full message so they agree on what changed. */
+typedef struct _MSG_DELTA {
+	int msgid;					//!< Message ID carried by the stream
+	int index;					//!< Deltas since the last keyframe
+	int len;					//!< Length of image, 0 until a keyframe
+	char image[MSG_WIRE_SIZE];	//!< Last full message in network format
+} MSG_DELTA;
+#endif /* _MSG_DELTA_ */
+
+#ifndef _MSG_STATS_
+#define _MSG_STATS_
+/*! Statistics for one message type received by this process. */
+typedef struct _MSG_STATS {
+	unsigned int received;						//!< Messages decoded
+	unsigned int dropped;						//!< Gaps in sequence numbers
+	unsigned long long last_arrival;			//!< Time the last message arrived in ns
+	HIST age;									//!< Time from stamp to arrival
+	HIST interval;								//!< Time between arrivals
+	HIST used;									//!< Time from stamp to messages_used()
+} MSG_STATS;
+#endif /* _MSG_STATS_ */
+
+//! Called after each message of one type is decoded, before a later message
+//! of the same type in the same read is decoded over it.
+typedef void (*MSG_HOOK)(int fd, MSG_DATA *msg, void *arg);
+
+/* Included after the types above because network.h uses them. */
+#include "network.h"
+
 
 /******************************
 **
@@ -98,20 +295,98 @@
 **
 ******************************/
 
-//! Send the API message to the server.
+//! Send the API message to the server. The message is packed into a scratch
+//! buffer so msg is not changed.
 //! \param fd Socket to send message to.
 //! \param msg_id Message ID.
 //! \param msg Pointer to message data.
-void messages_send(int fd, int msg_id, MSG_DATA *msg);
+void messages_send(int fd, int msg_id, const MSG_DATA *msg);
 
-//! Decode received API messages.
-//! \param fd Network file descriptor.
+//! Sends several messages to the same peer with a single write so they
+//! arrive together.
+//! \param fd Socket to send messages to.
+//! \param msgids Message IDs to send, in order.
+//! \param count Number of message IDs, up to MSG_BATCH_MAX.
+//! \param msg Pointer to message data.
+//! \return Number of bytes sent, -1 on error.
+int messages_send_batch(int fd, const int *msgids, int count, const MSG_DATA *msg);
+
+//! Packs a message into its wire format. Fields are written one after another
+//! in network byte order with no padding. Floats and doubles are sent as
+//! their IEEE 754 bit patterns.
+//! \param msgid Message ID.
+//! \param msg Pointer to message data.
+//! \param buf Buffer for the packed message.
+//! \param size Size of buf.
+//! \return Length of the packed message, -1 if the ID is not known or buf
+//!         is too small.
+int messages_encode(int msgid, const MSG_DATA *msg, char *buf, int size);
+
+//! Turns a packed message into a delta against the last message sent on the
+//! same stream. The header of the delta keeps the timestamp of the message
+//! and is given a sequence number in the count of the message it carries
+//! when it is sent. messages_decode() rebuilds the full message
+//! from the deltas that arrive on each file descriptor.
+//! \param delta Pointer to the sender state for the stream. Set len to 0
+//!              to force a keyframe, for example after a delta was dropped.
+//! \param frame Message packed by messages_encode().
+//! \param buf Buffer for the delta.
+//! \param size Size of buf.
+//! \return Length of the delta, -1 if the message cannot be delta encoded
+//!         or buf is too small.
+int messages_encode_delta(MSG_DELTA *delta, const char *frame, char *buf, int size);
+
+//! Gets the size of a packed message.
+//! \param msgid Message ID.
+//! \return Size in bytes including header and footer, 0 if the ID is not
+//!         known.
+int messages_size(int msgid);
+
+//! Decode received API messages. The bytes are appended to the reassembly
+//! buffer for fd and every complete message is decoded. A partial message is
+//! kept until the rest of it arrives in a later call.
+//! \param fd Network file descriptor the bytes were read from.
 //! \param buf A buffer to store network data.
 //! \param msg Pointer to message data.
 //! \param bytes Number of bytes in buffer.
-//! \return Number of bytes remaining in buffer.
+//! \return Number of bytes kept for the next call.
 int messages_decode(int fd, char *buf, MSG_DATA *msg, int bytes);
 
+//! Discard any partial message and delta stream kept for a file descriptor.
+//! Called when the connection is closed so a new connection on the same fd
+//! starts clean.
+//! \param fd Network file descriptor.
+void messages_reset(int fd);
+
+//! Sets the producer ID sent in the header of every message from this
+//! process. Also makes the process print its message statistics when it gets
+//! SIGUSR1, for example from "kill -USR1 <pid>".
+//! \param id One of the MSG_PRODUCER_* values.
+void messages_set_producer(int id);
+
+//! Records how old a message was when this process acted on it. Ages are only
+//! meaningful for messages produced on the same host.
+//! \param hdr Header of the message that was used.
+void messages_used(const HEADER *hdr);
+
+//! Sets a function to call after each message of a type is decoded. A
+//! process that keeps every message, rather than only the latest, copies them
+//! out here since several can arrive in one read.
+//! \param msgid Message ID.
+//! \param hook Function to call, NULL for none.
+//! \param arg User data passed to hook.
+//! \return 0 on success, -1 if msgid is out of range.
+int messages_set_hook(int msgid, MSG_HOOK hook, void *arg);
+
+//! Gets the statistics for a message type.
+//! \param msgid Message ID.
+//! \param stats Pointer to the statistics to fill in.
+//! \return 0 on success, -1 if msgid is out of range.
+int messages_get_stats(int msgid, MSG_STATS *stats);
+
+//! Prints the statistics for every message type that has been received.
+void messages_print_stats();
+
 //! Updates status data with current data.
 //! \param msg Pointer to message data.
 void messages_update(MSG_DATA *msg);
@@ -7,6 +7,35 @@
 #define _MSGTYPES_H_
 
 
+/******************************
+**
+** #defines
+**
+******************************/
+
+/** @name Number of message IDs a subscription can set a rate for. */
+//@{
+#ifndef OPEN_MAX_TOPICS
+#define OPEN_MAX_TOPICS 16
+#endif /* OPEN_MAX_TOPICS */
+//@}
+
+/** @name Number of histogram bins in a diagnostics message. Bin i counts times
+ * from 2^(i-1) up to 2^i microseconds, the same as HIST. */
+//@{
+#ifndef DIAG_BINS
+#define DIAG_BINS 24
+#endif /* DIAG_BINS */
+//@}
+
+/** @name Size of a table of diagnostics indexed by PID axis. */
+//@{
+#ifndef DIAG_AXES
+#define DIAG_AXES 5
+#endif /* DIAG_AXES */
+//@}
+
+
 /******************************
 **
 ** Data types
@@ -17,8 +46,13 @@
 #define _HEADER_
 /*! Header for API messages. */
 typedef struct _HEADER {
-	unsigned char msgstart;	//!< Beginning of message character
-    unsigned char msgid;	//!< Message ID for decoding on other end of connection
+	unsigned char msgstart;		//!< Beginning of message character
+    unsigned char msgid;		//!< Message ID for decoding on other end of connection
+	unsigned short msglen;		//!< Length of whole message on the wire in bytes
+	unsigned short producer;	//!< ID of the process that sent the message
+	unsigned int seq;			//!< Count of messages of this type on the connection, 0 on the bus
+	unsigned long long stamp;	//!< Monotonic time in ns when the data was produced.
+								//!< Leave at 0 to stamp the message when it is sent.
 } HEADER;
 #endif /* _HEADER_ */
 
@@ -32,9 +66,21 @@ typedef struct _FOOTER {
 
 #ifndef _OPEN_MSG_
 #define _OPEN_MSG_
+/*! Subscription request. A client that sets topics is sent those messages
+ * whenever the server produces them instead of having to poll. Each topic can
+ * have its own rate limit and decimation. */
+typedef struct _OPEN {
+	int topics;									//!< Bit mask of MSG_TOPIC(msgid) values, 0 to poll instead
+	int period;									//!< Minimum time between messages of one type in ms
+	unsigned short periods[OPEN_MAX_TOPICS];	//!< Period for each message ID in ms, 0 to use period
+	unsigned char decimate[OPEN_MAX_TOPICS];	//!< Send every Nth message of each ID, 0 or 1 for all
+	int delta;									//!< Message ID to send as deltas, 0 for none
+} OPEN;
+
 /*! Default message to send to API server. */
 typedef struct _OPEN_MSG {
     HEADER hdr; //!< Header struct
+	OPEN data;	//!< Subscription data
 	FOOTER ftr; //!< Footer struct
 } OPEN_MSG;
 #endif /* _OPEN_MSG_ */
@@ -145,6 +191,28 @@ typedef struct _TELEOP_MSG {
 } TELEOP_MSG;
 #endif /* _TELEOP_MSG_ */
 
+#ifndef _DIAG_MSG_
+#define _DIAG_MSG_
+/*! Loop timing histograms for one PID axis. Counts are totals since nav
+ * started. */
+typedef struct _DIAG {
+	int axis;						//!< PID axis, one of PID_PITCH etc.
+	unsigned int runs;				//!< Number of times the loop has run
+	unsigned int overruns;			//!< Runs that finished after their deadline
+	unsigned int skipped;			//!< Periods skipped to catch up
+	unsigned int period[DIAG_BINS];	//!< Time between runs
+	unsigned int error[DIAG_BINS];	//!< Difference between the time between runs and the period
+	unsigned int exec[DIAG_BINS];	//!< Time spent running the loop
+	unsigned int age[DIAG_BINS];	//!< Age of the IMU sample used by the loop
+} DIAG;
+
+typedef struct _DIAG_MSG {
+	HEADER hdr;	//!< Header struct
+	DIAG data;	//!< Diagnostics struct
+	FOOTER ftr;	//!< Footer struct
+} DIAG_MSG;
+#endif /* _DIAG_MSG_ */
+
 #ifndef _TARGET_MSG_
 #define _TARGET_MSG_
 /*! Operational mode and target pose and motion values. */
@@ -372,6 +440,7 @@ typedef struct _MSG_DATA {
     LJ_MSG lj;
     VSETTING_MSG vsetting;
     TELEOP_MSG teleop;
+    DIAG_MSG diag;
 } MSG_DATA;
 #endif /* _MSG_DATA_ */
 
@@ -19,9 +19,14 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <poll.h>
 
 #include "messages.h"
 #include "msgtypes.h"
+#include "evloop.h"
+#include "shmbus.h"
 
 /******************************
 **
@@ -50,8 +55,79 @@
 #define MODE_STATUS		5
 #define MODE_JOY		6
 #define MODE_OPEN		7
+#define MODE_PUSH		8
 #endif /* NET_MODES */
 
+/** @name Number of file descriptors that can hold a subscription, queue or
+ * client connection. */
+//@{
+#ifndef NET_MAX_FDS
+#define NET_MAX_FDS 64
+#endif /* NET_MAX_FDS */
+//@}
+
+/** @name Outbound queue size for each server connection. A frame must hold
+ * the largest message. */
+//@{
+#ifndef NET_QUEUE_SIZES
+#define NET_QUEUE_SIZES
+#define NET_QUEUE_LEN	16
+#define NET_FRAME_SIZE	512
+#endif /* NET_QUEUE_SIZES */
+//@}
+
+/** @name Number of shared message buffers. Every queued frame holds one and a
+ * few more are kept for messages being published. */
+//@{
+#ifndef NET_BUF_COUNT
+#define NET_BUF_COUNT (NET_MAX_FDS * NET_QUEUE_LEN + 16)
+#endif /* NET_BUF_COUNT */
+//@}
+
+/** @name Queue policies. With LATEST a queued message that has not started
+ * sending is replaced by a newer message of the same type. With FIFO every
+ * message is queued and new messages are dropped when the queue is full. */
+//@{
+#ifndef NET_POLICIES
+#define NET_POLICIES
+#define NET_POLICY_DEFAULT	0
+#define NET_POLICY_FIFO		1
+#define NET_POLICY_LATEST	2
+#endif /* NET_POLICIES */
+//@}
+
+/** @name Client connection states. */
+//@{
+#ifndef NET_STATES
+#define NET_STATES
+#define NET_DOWN		0
+#define NET_CONNECTING	1
+#define NET_UP			2
+#endif /* NET_STATES */
+//@}
+
+/** @name Client reconnect timing. The wait between attempts starts at
+ * NET_BACKOFF_MIN ms and doubles after each failure up to NET_BACKOFF_MAX ms.
+ * A connect that has not finished after NET_CONNECT_TIMEOUT ms is retried.
+ * Clients registered with net_client_watch() are checked every
+ * NET_RETRY_PERIOD seconds while they are not connected. */
+//@{
+#ifndef NET_RECONNECT
+#define NET_RECONNECT
+#define NET_BACKOFF_MIN		10
+#define NET_BACKOFF_MAX		500
+#define NET_CONNECT_TIMEOUT	1000
+#define NET_RETRY_PERIOD	0.01
+#endif /* NET_RECONNECT */
+//@}
+
+/** @name Number of message IDs that can be subscribed to. */
+//@{
+#ifndef NET_MAX_MSGID
+#define NET_MAX_MSGID 16
+#endif /* NET_MAX_MSGID */
+//@}
+
 
 /******************************
 **
@@ -59,6 +135,101 @@
 **
 ******************************/
 
+#ifndef _NET_SUB_
+#define _NET_SUB_
+/*! Subscription held by a server for one client connection. */
+typedef struct _NET_SUB {
+	int topics;							//!< Bit mask of MSG_TOPIC(msgid) values
+	int period[NET_MAX_MSGID];			//!< Minimum time between messages in ms
+	int decimate[NET_MAX_MSGID];		//!< Send at most every Nth message
+	int count[NET_MAX_MSGID];			//!< Messages produced since the last send
+	unsigned long long last[NET_MAX_MSGID];	//!< timing_now() each message was last sent, 0 for never
+	int delta;							//!< Message ID sent as deltas, 0 for none
+	MSG_DELTA stream;					//!< Sender state for the deltas
+} NET_SUB;
+#endif /* _NET_SUB_ */
+
+#ifndef _NET_CONN_
+#define _NET_CONN_
+/*! Client connection that is reconnected when it is lost. */
+typedef struct _NET_CONN {
+	int active;						//!< TRUE for fds from net_client_setup()
+	int state;						//!< NET_DOWN, NET_CONNECTING or NET_UP
+	struct sockaddr_in addr;		//!< Server address, resolved once
+	int backoff;					//!< Wait before the next attempt in ms
+	unsigned long long next_try;	//!< Time of next attempt or connect deadline in ns
+	OPEN sub;						//!< Subscription to send after connecting
+	EVLOOP *loop;					//!< Event loop set by net_client_watch()
+	EVLOOP_CB cb;					//!< Read callback set by net_client_watch()
+	void *arg;						//!< User data for cb
+	int timer;						//!< Retry timer while not connected
+	unsigned int connects;			//!< Number of successful connects
+	unsigned int failures;			//!< Number of failed or lost connections
+} NET_CONN;
+#endif /* _NET_CONN_ */
+
+#ifndef _NET_QUEUE_
+#define _NET_QUEUE_
+/*! Encoded message shared by every queue it is sent to. It is returned to
+ * the pool when the last reference is released. */
+typedef struct _NET_BUF {
+	int refs;					//!< Number of holders, 0 if free
+	char data[NET_FRAME_SIZE];	//!< Message in network format
+} NET_BUF;
+
+/*! One queued message. */
+typedef struct _NET_FRAME {
+	int msgid;					//!< Message ID
+	int len;					//!< Length of message
+	unsigned int seq;			//!< Sequence number it is sent with
+	NET_BUF *buf;				//!< Shared buffer holding the message
+} NET_FRAME;
+
+/*! Counters for an outbound queue. */
+typedef struct _NET_STATS {
+	int depth;				//!< Messages waiting to be sent
+	int max_depth;			//!< Largest depth seen
+	unsigned int sent;		//!< Messages sent
+	unsigned int dropped;	//!< Messages dropped because the queue was full
+	unsigned int replaced;	//!< Messages replaced by a newer one
+} NET_STATS;
+
+/*! Outbound queue for a server connection. */
+typedef struct _NET_QUEUE {
+	int active;							//!< TRUE for accepted connections
+	int error;							//!< TRUE after a send error
+	int head;							//!< Index of the oldest frame
+	int offset;							//!< Bytes of the head frame already sent
+	EVLOOP *loop;						//!< Event loop of the owning server, or NULL
+	NET_FRAME frames[NET_QUEUE_LEN];	//!< Ring of frames
+	NET_STATS stats;					//!< Counters
+} NET_QUEUE;
+#endif /* _NET_QUEUE_ */
+
+//! Callback for messages received by an event loop server. Called after the
+//! request has been decoded into msg and before the reply is sent.
+typedef void (*NET_RECV_CB)(int fd, MSG_DATA *msg, void *arg);
+
+#ifndef _NET_SERVER_
+#define _NET_SERVER_
+/*! State for one TCP server. A process can run as many servers as it has
+ * ports, each from its own thread if needed, as long as every server and its
+ * client connections are only used by one thread. */
+typedef struct _NET_SERVER {
+	int fd;							//!< Listening socket
+	int fdmax;						//!< Largest fd in master
+	fd_set master;					//!< Listening socket and client connections
+	fd_set read_fds;				//!< Readable fds from the last net_select()
+	fd_set write_fds;				//!< Writable fds from the last net_select()
+	EVLOOP *loop;					//!< Event loop set by net_server_add()
+	void *buf;						//!< Receive buffer for the event loop
+	MSG_DATA *msg;					//!< Decoded requests for the event loop
+	int mode;						//!< Server mode for the event loop
+	NET_RECV_CB cb;					//!< Request callback for the event loop
+	void *arg;						//!< User data for cb
+	NET_SUB subs[NET_MAX_FDS];		//!< Subscriptions indexed by client fd
+} NET_SERVER;
+#endif /* _NET_SERVER_ */
 
 
 /******************************
@@ -108,7 +279,9 @@ int net_accept(int fd_orig);
 //! \param fd A network file descriptor.
 void net_close(int fd);
 
-//! Sends data on a TCP socket connection.
+//! Sends data on a TCP socket connection. Connections accepted by a server
+//! and clients from net_client_setup() never block. Data that cannot be sent right away is put in the
+//! connection's queue and sent when the socket is writable.
 //! Returns the number of bytes sent.
 //! \param fd A network file descriptor.
 //! \param msg The message to send.
@@ -118,54 +291,195 @@ int net_send(int fd, const void *msg, int len);
 
 //! Selects a TCP port to communicate with.
 //! Returns the value of the select call.
+//! \param srv A pointer to the server.
 //! \param tv A timeval struct that is modified by select().
-//! \return Fills in read_fds struct with file descriptors waiting to be read
-//!         from using select() system call.
-int net_select(struct timeval tv);
-
-//! Gets the hostname of a specified IP address.
-//! \param address A pointer to the an IP address.
-void net_gethostbyname(char *address);
-
-//! Connects to an existing TCP socket.
-//! \param fd A network file descriptor.
-//! \param port Port to connect to.
-//! \return 1 on success, -1 on failure.
-int net_connect(int fd, short port);
-
-//! Receives data on a TCP socket connection.
-//! Returns the number of bytes received.
+//! \return Fills in the server's read_fds and write_fds structs with file
+//!         descriptors ready to be read from or written to using select()
+//!         system call.
+int net_select(NET_SERVER *srv, struct timeval tv);
+
+//! Looks up the address of a server.
+//! \param address Host name or IP address.
+//! \param port Port of the server.
+//! \param addr Filled in with the server address.
+//! \return 0 on success, -1 on failure.
+int net_resolve(char *address, short port, struct sockaddr_in *addr);
+
+//! Starts a non-blocking connect for a client created by net_client_setup().
+//! \param fd A client file descriptor.
+//! \return The new state of the connection.
+int net_connect(int fd);
+
+//! Makes progress on a client connection without blocking. Finishes a connect
+//! that is under way, or starts a new one if the connection is down and the
+//! backoff time has passed. A subscription made with net_subscribe() is sent
+//! again after each connect. Called by net_client(), net_send(), net_recv()
+//! and net_poll() so most callers never need to call it directly.
+//! \param fd A file descriptor from net_client_setup().
+//! \return TRUE if the connection is up, else FALSE.
+int net_client_check(int fd);
+
+//! Gets the state of a client connection.
+//! \param fd A file descriptor from net_client_setup().
+//! \return NET_DOWN, NET_CONNECTING or NET_UP. Bus handles and other fds
+//!         are always NET_UP.
+int net_client_state(int fd);
+
+//! Keeps a client registered with an event loop. cb is called when data
+//! arrives. While the connection is down the fd is removed from the loop and
+//! a timer retries the connection.
+//! \param loop Pointer to event loop.
+//! \param fd A file descriptor from net_client_setup().
+//! \param cb Function to call when the fd is readable.
+//! \param arg User data passed to cb.
+//! \return 0 on success, -1 on error.
+int net_client_watch(EVLOOP *loop, int fd, EVLOOP_CB cb, void *arg);
+
+//! Receives data on a TCP socket connection. Client connections do not block
+//! so a reply that has not arrived yet is read on a later call.
 //! \param fd A file descriptor for the network connection.
 //! \param buf A pointer to a buffer for network data.
-//! \return The number of bytes received.
+//! \return The number of bytes received, -1 if nothing is waiting.
 int net_recv(int fd, void *buf);
 
 //! Create a TCP server.
 //! Returns a file descriptor for the API server.
+//! \param srv A pointer to the server state to fill in.
 //! \param port Port to use for server.
 //! \return File descriptor for the server.
-int net_server_setup(short port);
-
-//! Create a TCP client.
-//! \param address A pointer to the IP address of the server.
+int net_server_setup(NET_SERVER *srv, short port);
+
+//! Closes a TCP server and all of its client connections.
+//! \param srv A pointer to the server.
+void net_server_close(NET_SERVER *srv);
+
+//! Closes one client connection of a TCP server.
+//! \param srv A pointer to the server.
+//! \param fd A file descriptor for the client connection.
+void net_server_drop(NET_SERVER *srv, int fd);
+
+//! Create a TCP client. If address is SHMBUS_ADDRESS the shared memory bus is
+//! opened instead and the bus file descriptor is returned. The connect does
+//! not block. If the server is not up yet, or goes away later, the client
+//! keeps trying in the background and the file descriptor stays the same.
+//! \param address A pointer to the host name or IP address of the server.
 //! \param port Port to use for client.
-//! \return File descriptor for the client.
+//! \return File descriptor for the client, -1 if the address is not valid.
 int net_client_setup(char *address, short port);
 
-//! Send and receive data for a TCP server.
-//! \param fd A file descriptor for the server.
+//! Send and receive data for a TCP server. Requests from each client are
+//! decoded into msg before the reply is sent.
+//! \param srv A pointer to the server.
+//! \param buf A pointer to a buffer for network data.
+//! \param msg A pointer to message data.
+//! \param mode Mode for the server to act in.
+//! \return Number of bytes received from the last client read.
+int net_server(NET_SERVER *srv, void *buf, MSG_DATA *msg, int mode);
+
+//! Sends the reply for a server mode to a client.
+//! \param fd A file descriptor for the client connection.
+//! \param msg A pointer to message data.
+//! \param mode Mode for the server to act in.
+void net_server_reply(int fd, MSG_DATA *msg, int mode);
+
+//! Registers a TCP server with an event loop. New connections are accepted
+//! and requests are decoded and answered when their sockets are ready.
+//! \param loop Pointer to event loop.
+//! \param srv A pointer to the server.
 //! \param buf A pointer to a buffer for network data.
 //! \param msg A pointer to message data.
 //! \param mode Mode for the server to act in.
-//! \return Number of bytes received.
-int net_server(int fd, void *buf, MSG_DATA *msg, int mode);
+//! \param cb Function to call after a request is decoded, can be NULL.
+//! \param arg User data passed to cb.
+//! \return 0 on success, -1 on error.
+int net_server_add(EVLOOP *loop, NET_SERVER *srv, void *buf, MSG_DATA *msg, int mode,
+    NET_RECV_CB cb, void *arg);
+
+//! Subscribes a client to messages pushed by the server. The server sends each
+//! subscribed message when it calls net_server_publish() instead of replying
+//! to requests. Read pushed data with net_client() in MODE_PUSH. Any rates set
+//! with net_subscribe_topic() are cleared.
+//! \param fd A file descriptor for the client.
+//! \param topics Bit mask of MSG_TOPIC(msgid) values, 0 to go back to polling.
+//! \param period Minimum time between messages of one type in ms.
+void net_subscribe(int fd, int topics, int period);
 
-//! Send and receive data for a TCP client.
+//! Adds one message to the subscription of a client from net_client_setup()
+//! with its own rate, leaving the other topics as they are. For example a GUI
+//! can take STATUS at 5 Hz while another client takes every IMU message.
+//! \param fd A file descriptor for the client.
+//! \param msgid Message ID to subscribe to.
+//! \param period Minimum time between messages in ms, 0 to use the period
+//!               given to net_subscribe().
+//! \param decimate Send at most every Nth message produced, 0 or 1 for all.
+//! \return 0 on success, -1 if fd is not a TCP client or msgid is not valid.
+int net_subscribe_topic(int fd, int msgid, int period, int decimate);
+
+//! Asks for one subscribed message to be pushed as deltas that only carry
+//! the fields that changed, with a full keyframe every MSG_DELTA_KEYFRAME
+//! messages. messages_decode() rebuilds the full message so readers do not
+//! change. Meant for STATUS, which is large and mostly changes slowly.
+//! \param fd A file descriptor from net_client_setup().
+//! \param msgid Message ID to send as deltas, 0 to send full messages.
+//! \return 0 on success, -1 if fd is not a TCP client or msgid is not valid.
+int net_subscribe_delta(int fd, int msgid);
+
+//! Pushes a message to every client of a server subscribed to it. Messages
+//! produced faster than a client's period are skipped for that client. The
+//! message is encoded once and the same buffer is queued to every client.
+//! \param srv A pointer to the server.
+//! \param msgid Message ID.
+//! \param msg A pointer to message data.
+void net_server_publish(NET_SERVER *srv, int msgid, MSG_DATA *msg);
+
+//! Sends several messages with one system call. Server and client
+//! connections queue whatever the socket cannot take, the same as
+//! net_send().
+//! \param fd A file descriptor to send on.
+//! \param iov One entry per packed message.
+//! \param count Number of entries in iov.
+//! \return The number of bytes sent or queued, -1 on error.
+int net_sendv(int fd, const struct iovec *iov, int count);
+
+//! Sends as much queued data as the socket will take without blocking.
+//! \param fd A file descriptor for a server or client connection.
+//! \return Number of messages still queued.
+int net_flush(int fd);
+
+//! Sets the queue policy for a message type. By default STATUS, LJ, VISION
+//! and MSTRAIN use NET_POLICY_LATEST and other messages use NET_POLICY_FIFO.
+//! \param msgid Message ID.
+//! \param policy One of the NET_POLICY_* values.
+void net_set_policy(int msgid, int policy);
+
+//! Gets the queue counters for a connection.
+//! \param fd A file descriptor for a server or client connection.
+//! \param stats A pointer to the counters to fill in.
+//! \return 0 on success, -1 if fd has no queue.
+int net_get_stats(int fd, NET_STATS *stats);
+
+//! Prints the queue counters for every connection and the number of
+//! shared buffers in use.
+void net_print_stats();
+
+//! Receives data without blocking.
+//! \param fd A file descriptor for the network connection.
+//! \param buf A pointer to a buffer for network data.
+//! \return The number of bytes received, 0 if no data is waiting.
+int net_poll(int fd, void *buf);
+
+//! Send and receive data for a TCP client. In MODE_PUSH nothing is sent and
+//! data already pushed by the server is read. In MODE_PLANNER TARGET, GAIN
+//! and LJ are sent in one write and the server replies with STATUS and LJ in
+//! one write. Nothing blocks, so a reply that has not arrived yet is read on
+//! a later call.
 //! \param fd A file descriptor for the client.
 //! \param buf A pointer to a buffer for network data.
 //! \param msg A pointer to message data.
 //! \param mode Mode for the client to act in.
-//! \return Number of bytes received.
+//! \return Number of bytes received, 0 if the connection is down or in
+//!         MODE_PUSH nothing is waiting, -1 if no data has arrived yet. buf
+//!         is only written when the return is greater than 0.
 int net_client(int fd, void *buf, MSG_DATA *msg, int mode);
 
 
@@ -52,8 +52,58 @@
 #define PID_ROLL	2
 #define PID_YAW		3
 #define PID_DEPTH	4
+#define PID_SWAY	5
+#define PID_SURGE	6
 #endif /* PID_MODE */
 
+/** @name Size of the per axis arrays. Axes are numbered from 1 so index 0 is
+ * not used. */
+//@{
+#ifndef PID_AXES
+#define PID_AXES 7
+#endif /* PID_AXES */
+//@}
+
+/** @name Bit for an axis in the due mask passed to pid_loop(). */
+//@{
+#ifndef PID_AXIS_BIT
+#define PID_AXIS_BIT(axis) (1 << (axis))
+#endif /* PID_AXIS_BIT */
+//@}
+
+/** @name Anti-windup methods. Clamp bounds the integral term. Conditional
+ * also stops integrating while the output is saturated and the error would
+ * push it further. */
+//@{
+#ifndef PID_WINDUP
+#define PID_WINDUP
+#define PID_WINDUP_CLAMP		0
+#define PID_WINDUP_CONDITIONAL	1
+#endif /* PID_WINDUP */
+//@}
+
+/** @name Gains of an axis, in the order they are kept in the schedule. */
+//@{
+#ifndef PID_GAIN_INDEX
+#define PID_GAIN_INDEX
+#define PID_KP		0
+#define PID_KI		1
+#define PID_KD		2
+#define PID_GAINS	3
+#endif /* PID_GAIN_INDEX */
+//@}
+
+/** @name Gain schedule sizes. */
+//@{
+#ifndef PID_SCHED_TASKS
+#define PID_SCHED_TASKS 8
+#endif /* PID_SCHED_TASKS */
+
+#ifndef PID_SCHED_BREAKS
+#define PID_SCHED_BREAKS PARSE_SCHED_BREAKS
+#endif /* PID_SCHED_BREAKS */
+//@}
+
 
 /******************************
 **
@@ -64,25 +114,43 @@
 #ifndef _PID_DATA_
 #define _PID_DATA_
 
-typedef struct _PID_DATA {
-	float ref;	//!< Reference, desired, or target value.
-	float kp;	//!< Proportional gain.
-	float ki;	//!< Intgral gain.
-	float kd;	//!< Derivative gain.
-	float cval;	//!< Current value of measurement.
-	float perr;	//!< Proportional error.
-	float ierr;	//!< Integral error.
-	float derr;	//!< Derivative error.
-	int period;	//!< Desired period to run PID loop at.
-} PID_DATA;
-
+/*! Gain schedule. For each task with a row, gains are kept at every depth and
+ * speed on the grid for the scheduled axes, all in one block so a tick reads
+ * four neighbouring points with no lookups beyond finding the row. */
+typedef struct _PID_SCHED {
+	float depth[PID_SCHED_BREAKS];	//!< Depths of the grid, increasing.
+	float speed[PID_SCHED_BREAKS];	//!< Speeds of the grid, increasing.
+	int depths;						//!< Number of depths, at least 1.
+	int speeds;						//!< Number of speeds, at least 1.
+	int tasks;						//!< Number of rows in use.
+	int task[PID_SCHED_TASKS];		//!< Task of each row.
+	unsigned int axes[PID_SCHED_TASKS];	//!< PID_AXIS_BIT() of the scheduled axes of each row.
+	float gain[PID_SCHED_TASKS][PID_SCHED_BREAKS][PID_SCHED_BREAKS][PID_AXES][PID_GAINS];	//!< Gains by row, depth, speed and axis.
+} PID_SCHED;
+
+/*! PID state for all axes. Each value is kept in an array indexed by axis so
+ * that the due axes are updated in one loop. */
 typedef struct _PID {
-	PID_DATA pitch;				//!< PID values for pitch.
-	PID_DATA roll;				//!< PID values for roll.
-	PID_DATA yaw;				//!< PID values for yaw.
-	PID_DATA depth;				//!< PID values for depth.
-	PID_DATA fx;				//!< PID values for fx.
-	PID_DATA fy;				//!< PID values for fy.
+	float ref[PID_AXES];		//!< Reference, desired, or target value.
+	float cval[PID_AXES];		//!< Current value of measurement.
+	float rate[PID_AXES];		//!< Measured rate, used as the derivative when has_rate is set.
+	float kp[PID_AXES];			//!< Proportional gain.
+	float ki[PID_AXES];			//!< Integral gain.
+	float kd[PID_AXES];			//!< Derivative gain.
+	float base[PID_AXES][PID_GAINS];	//!< Gains used where the schedule has none.
+	float perr[PID_AXES];		//!< Proportional error.
+	float ierr[PID_AXES];		//!< Integral error.
+	float derr[PID_AXES];		//!< Filtered derivative error.
+	float ff[PID_AXES];			//!< Term added to the output, used for coupling between axes.
+	float out[PID_AXES];		//!< Bounded controller output.
+	float ilimit[PID_AXES];		//!< Bound on the integral term.
+	float olimit[PID_AXES];		//!< Bound on the output.
+	int sat[PID_AXES];			//!< Set when the output was bounded.
+	int angle[PID_AXES];		//!< Set for axes measured in degrees.
+	int has_rate[PID_AXES];		//!< Set for axes with a measured rate.
+	int period[PID_AXES];		//!< Desired period to run PID loop at.
+	float dfilter;				//!< Derivative low pass coefficient, 0 for none.
+	int windup;					//!< Anti-windup method.
 	float voith_angle;			//!< The angle for the thrust vector.
 	int voith_speed;			//!< The rotational speed for the Voith motors.
 	int voith_thrust;			//!< The thrust for the Voith motors.
@@ -95,6 +163,7 @@ typedef struct _PID {
 	double kp_roll_lateral;		//!< Proportional gain for coupling between roll and lateral thrust
     double kp_depth_forward;	//!< Proportional gain for coupling between depth and forward thrust
     double kp_place_holder;		//!< Proportional gain place holder
+	PID_SCHED sched;			//!< Gain schedule by task, depth and speed.
 } PID;
 
 #endif /* _PID_DATA_ */
@@ -112,20 +181,34 @@ typedef struct _PID {
 //! \return 0 on success, -1 on error.
 int pid_init(PID *pid, CONF_VARS *cf);
 
-//! Runs through one iteration of a PID controller.
-//! \param pololu_fd Pololu file descriptor.
-//! \param pid PID struct.
+//! Builds the gain schedule from the configuration. Points are snapped to
+//! the nearest depth and speed of the grid. The first point of an axis for a
+//! task fills the whole grid so one point gives constant gains.
+//! \param pid Pointer to PID data.
+//! \param cf Pointer to configuration variables.
+//! \return 0 on success, -1 if the grid is not increasing.
+int pid_sched_init(PID *pid, CONF_VARS *cf);
+
+//! Loads the gains used where the schedule has none. Only needs to be called
+//! when a new gain or target message arrives since the yaw gains depend on the
+//! task. The schedule is applied by pid_loop() every tick.
+//! \param pid Pointer to PID data.
 //! \param cf Pointer to configuration variables.
 //! \param msg Pointer to message data.
-//! \param dt Time difference from last loop in seconds.
-//! \param mode Which PID loop to run.
+void pid_set_gains(PID *pid, CONF_VARS *cf, MSG_DATA *msg);
+
+//! Runs through one iteration of the PID controllers for the due axes.
+//! \param pololu_out Pololu output stage to queue the actuator commands on.
+//! \param pid PID struct.
+//! \param msg Pointer to message data.
+//! \param due Mask of PID_AXIS_BIT() for the axes to run.
+//! \param dt Time difference from last loop in seconds, indexed by axis.
 //! \param motor_init Boolean for whether motor controller is initialized.
-void pid_loop(int pololu_fd,
+void pid_loop(POLOLU_OUT *pololu_out,
                PID *pid,
-               CONF_VARS *cf,
                MSG_DATA *msg,
-               float dt,
-               int mode,
+               unsigned int due,
+               const float *dt,
 			   int motor_init
             );
 
@@ -0,0 +1,136 @@
+/**
+ *  \file rtexec.h
+ *  \brief Periodic executor for control loops. Tasks run on their own thread
+ *         at fixed rates with absolute deadlines so that their timing does not
+ *         depend on the I/O done by the rest of the daemon.
+ */
+
+#ifndef _RTEXEC_H_
+#define _RTEXEC_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "hist.h"
+#include "timing.h"
+
+
+/******************************
+**
+** #defines
+**
+******************************/
+
+#ifndef TRUE
+#define TRUE 1
+#endif /* TRUE */
+
+#ifndef FALSE
+#define FALSE 0
+#endif /* FALSE */
+
+/** @name Maximum number of tasks an executor can run. */
+//@{
+#ifndef RTEXEC_MAX_TASKS
+#define RTEXEC_MAX_TASKS 8
+#endif /* RTEXEC_MAX_TASKS */
+//@}
+
+
+/******************************
+**
+** Data types
+**
+******************************/
+
+//! Callback for a periodic task. periods holds the number of periods since the
+//! last call, which is more than 1 when releases were skipped.
+typedef void (*RTEXEC_CB)(unsigned int periods, void *arg);
+
+#ifndef _RTEXEC_
+#define _RTEXEC_
+/*! A periodic task. Times are CLOCK_MONOTONIC in nanoseconds. */
+typedef struct _RTEXEC_TASK {
+	const char *name;			//!< Name to print with the statistics
+	RTEXEC_CB cb;				//!< Function to call each period
+	void *arg;					//!< User data passed to cb
+	unsigned long long period;	//!< Period
+	unsigned long long next;	//!< Next release, which is also the deadline
+	unsigned long long start;	//!< Time the last run started
+	unsigned int runs;			//!< Number of calls to cb
+	unsigned int overruns;		//!< Calls that finished after their deadline
+	unsigned int skipped;		//!< Releases dropped to catch up
+	unsigned long long late;	//!< Longest wakeup latency since the last print
+	unsigned long long exec;	//!< Longest call to cb since the last print
+	HIST hist_period;			//!< Time between runs
+	HIST hist_error;			//!< Difference between the time between runs and the period
+	HIST hist_exec;				//!< Time spent in cb
+} RTEXEC_TASK;
+
+/*! Executor state. */
+typedef struct _RTEXEC {
+	RTEXEC_TASK tasks[RTEXEC_MAX_TASKS];	//!< Tasks, shortest period first
+	int count;								//!< Number of tasks
+	int running;							//!< Cleared by rtexec_stop()
+	int priority;							//!< SCHED_FIFO priority, 0 for none
+	int cpu;								//!< CPU to run on, -1 for any
+	pthread_t thread;						//!< Executor thread
+} RTEXEC;
+#endif /* _RTEXEC_ */
+
+
+/******************************
+**
+** Function prototypes
+**
+******************************/
+
+//! Clears an executor.
+//! \param ex Pointer to executor.
+void rtexec_init(RTEXEC *ex);
+
+//! Adds a periodic task. Tasks must be added before rtexec_start(). When
+//! several tasks are due at once the one with the shortest period runs first.
+//! \param ex Pointer to executor.
+//! \param name Name to print with the statistics.
+//! \param period Task period in seconds.
+//! \param cb Function to call each period.
+//! \param arg User data passed to cb.
+//! \return 0 on success, -1 on error.
+int rtexec_add(RTEXEC *ex, const char *name, float period, RTEXEC_CB cb, void *arg);
+
+//! Locks the current and future pages of the process into memory so that the
+//! tasks never wait on a page fault.
+//! \return 0 on success, -1 on error.
+int rtexec_lock_memory();
+
+//! Starts the executor thread. Scheduling settings that cannot be applied,
+//! usually for lack of privileges, are reported and the tasks run anyway.
+//! \param ex Pointer to executor.
+//! \param priority SCHED_FIFO priority from 1 to 99, 0 for normal scheduling.
+//! \param cpu CPU to pin the thread to, -1 for any.
+//! \return 0 on success, -1 on error.
+int rtexec_start(RTEXEC *ex, int priority, int cpu);
+
+//! Stops the executor thread and waits for it to exit.
+//! \param ex Pointer to executor.
+void rtexec_stop(RTEXEC *ex);
+
+//! Finds a task by name.
+//! \param ex Pointer to executor.
+//! \param name Name given to rtexec_add().
+//! \return Pointer to the task, NULL if there is none.
+RTEXEC_TASK *rtexec_find(RTEXEC *ex, const char *name);
+
+//! Prints the run counts, overruns and worst latencies of each task. The worst
+//! latencies are reset.
+//! \param ex Pointer to executor.
+void rtexec_print_stats(RTEXEC *ex);
+
+
+#endif /* _RTEXEC_H_ */
@@ -0,0 +1,170 @@
+/**
+ *  \file shmbus.h
+ *  \brief Shared memory publish/subscribe bus for daemons on the same host.
+ *         Each topic is a seqlock protected snapshot of the latest message
+ *         of one type, stored exactly as it would be sent on the network.
+ *         A bus file descriptor is used in place of a socket so the existing
+ *         net_send(), net_recv() and messages_decode() calls work unchanged.
+ */
+
+#ifndef _SHMBUS_H_
+#define _SHMBUS_H_
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "msgtypes.h"
+
+
+/******************************
+**
+** #defines
+**
+******************************/
+
+#ifndef TRUE
+#define TRUE 1
+#endif /* TRUE */
+
+#ifndef FALSE
+#define FALSE 0
+#endif /* FALSE */
+
+/** @name Name of the shared memory object in /dev/shm. */
+//@{
+#ifndef SHMBUS_NAME
+#define SHMBUS_NAME "/stingray_bus"
+#endif /* SHMBUS_NAME */
+//@}
+
+/** @name Address given to net_client_setup() to use the bus instead of TCP. */
+//@{
+#ifndef SHMBUS_ADDRESS
+#define SHMBUS_ADDRESS "shm"
+#endif /* SHMBUS_ADDRESS */
+//@}
+
+/** @name Topics carried on the bus. */
+//@{
+#ifndef SHMBUS_TOPICS
+#define SHMBUS_TOPICS
+#define SHMBUS_STATUS		0
+#define SHMBUS_LJ			1
+#define SHMBUS_TARGET		2
+#define SHMBUS_GAIN			3
+#define SHMBUS_VISION		4
+#define SHMBUS_TASK			5
+#define SHMBUS_NUM_TOPICS	6
+#define SHMBUS_ALL			((1 << SHMBUS_NUM_TOPICS) - 1)
+#endif /* SHMBUS_TOPICS */
+//@}
+
+/** @name Largest message a topic slot can hold. */
+//@{
+#ifndef SHMBUS_SLOT_SIZE
+#define SHMBUS_SLOT_SIZE 512
+#endif /* SHMBUS_SLOT_SIZE */
+//@}
+
+/** @name Number of file descriptors that can be bus handles. */
+//@{
+#ifndef SHMBUS_MAX_FDS
+#define SHMBUS_MAX_FDS 64
+#endif /* SHMBUS_MAX_FDS */
+//@}
+
+/** @name Number of times a reader retries while a writer is updating. */
+//@{
+#ifndef SHMBUS_RETRIES
+#define SHMBUS_RETRIES 100
+#endif /* SHMBUS_RETRIES */
+//@}
+
+
+/******************************
+**
+** Data types
+**
+******************************/
+
+#ifndef _SHMBUS_
+#define _SHMBUS_
+/*! One topic in shared memory. seq is odd while the writer is copying. */
+typedef struct _SHMBUS_SLOT {
+	unsigned int seq;				//!< Sequence count for the seqlock
+	int owner;						//!< Process ID of the only writer
+	int len;						//!< Length of the message in data
+	char data[SHMBUS_SLOT_SIZE];	//!< Message in network format
+} SHMBUS_SLOT;
+
+/*! Layout of the shared memory object. */
+typedef struct _SHMBUS {
+	SHMBUS_SLOT slots[SHMBUS_NUM_TOPICS];	//!< One slot per topic
+} SHMBUS;
+
+/*! State for one bus handle in this process. */
+typedef struct _SHMBUS_CONN {
+	int open;							//!< TRUE if the fd is a bus handle
+	unsigned int topics;				//!< Bit mask of subscribed topics
+	unsigned int seq[SHMBUS_NUM_TOPICS];	//!< Last sequence count read
+} SHMBUS_CONN;
+#endif /* _SHMBUS_ */
+
+
+/******************************
+**
+** Function prototypes
+**
+******************************/
+
+//! Opens the bus, creating it if this is the first process to use it.
+//! \return A bus file descriptor, -1 on error.
+int shmbus_open();
+
+//! Closes a bus file descriptor.
+//! \param fd Bus file descriptor.
+void shmbus_close(int fd);
+
+//! Checks whether a file descriptor is a bus handle.
+//! \param fd File descriptor.
+//! \return TRUE if fd was returned by shmbus_open(), else FALSE.
+int shmbus_is_bus(int fd);
+
+//! Sets the topics read by a bus handle. By default every topic that this
+//! process does not publish is read.
+//! \param fd Bus file descriptor.
+//! \param topics Bit mask of (1 << SHMBUS_*) values.
+//! \return 0 on success, -1 on error.
+int shmbus_subscribe(int fd, unsigned int topics);
+
+//! Gets the topic that carries a message ID.
+//! \param msgid Message ID.
+//! \return Topic number, -1 if the message is not carried on the bus.
+int shmbus_topic(int msgid);
+
+//! Publishes a message. The first process to publish a topic becomes its
+//! only writer until it exits. Messages that are not carried on the bus or
+//! that belong to another writer are dropped.
+//! \param fd Bus file descriptor.
+//! \param buf Message in network format, starting with a HEADER.
+//! \param len Length of the message.
+//! \return len if the message was published or dropped, -1 on error.
+int shmbus_write(int fd, const void *buf, int len);
+
+//! Copies every subscribed topic that changed since the last read into buf,
+//! one message after another, ready for messages_decode().
+//! \param fd Bus file descriptor.
+//! \param buf Buffer for messages.
+//! \param size Size of buf.
+//! \return Number of bytes copied, 0 if nothing changed.
+int shmbus_read(int fd, void *buf, int size);
+
+
+#endif /* _SHMBUS_H_ */
@@ -0,0 +1,85 @@
+/**
+ *  \file tribuf.h
+ *  \brief Lock-free triple buffer for passing the latest copy of some state
+ *         from one thread to another. The writer never waits for the reader
+ *         and the reader always gets the newest complete copy.
+ */
+
+#ifndef _TRIBUF_H_
+#define _TRIBUF_H_
+
+#include <stdio.h>
+#include <string.h>
+
+
+/******************************
+**
+** #defines
+**
+******************************/
+
+#ifndef TRUE
+#define TRUE 1
+#endif /* TRUE */
+
+#ifndef FALSE
+#define FALSE 0
+#endif /* FALSE */
+
+/** @name Flag set in the spare index when it holds data the reader has not
+ * seen. */
+//@{
+#ifndef TRIBUF_NEW
+#define TRIBUF_NEW 0x4
+#endif /* TRIBUF_NEW */
+//@}
+
+
+/******************************
+**
+** Data types
+**
+******************************/
+
+#ifndef _TRIBUF_
+#define _TRIBUF_
+/*! A triple buffer. There must be only one writer thread and one reader
+ * thread. Each side owns one of the three buffers and they swap through the
+ * spare. */
+typedef struct _TRIBUF {
+	char *data;		//!< Storage for three buffers of size bytes
+	int size;		//!< Size of one buffer
+	int write;		//!< Buffer being filled, only used by the writer
+	int read;		//!< Buffer being read, only used by the reader
+	int spare;		//!< Buffer between the two, with TRIBUF_NEW if unread
+} TRIBUF;
+#endif /* _TRIBUF_ */
+
+
+/******************************
+**
+** Function prototypes
+**
+******************************/
+
+//! Sets up a triple buffer.
+//! \param tb Pointer to triple buffer.
+//! \param data Storage for three buffers, at least 3 * size bytes.
+//! \param size Size of one buffer.
+void tribuf_init(TRIBUF *tb, void *data, int size);
+
+//! Copies in a new value and hands it to the reader. Only call from the
+//! writer thread.
+//! \param tb Pointer to triple buffer.
+//! \param src Value to copy, size bytes.
+void tribuf_put(TRIBUF *tb, const void *src);
+
+//! Copies out the newest value if the writer has put one since the last
+//! call. Only call from the reader thread.
+//! \param tb Pointer to triple buffer.
+//! \param dst Filled in with the value if there is a new one.
+//! \return TRUE if dst was filled in, FALSE if there was nothing new.
+int tribuf_get(TRIBUF *tb, void *dst);
+
+
+#endif /* _TRIBUF_H_ */
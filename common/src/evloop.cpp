@@ -0,0 +1,291 @@
+/******************************************************************************
+ *
+ *  Title:        evloop.c
+ *
+ *  Description:  Event loop built on epoll and timerfd.
+ *
+ *****************************************************************************/
+
+#include "evloop.h"
+
+
+/*------------------------------------------------------------------------------
+ * EVLOOP_HANDLER *evloop_find()
+ * Finds the handler registered for a descriptor.
+ *----------------------------------------------------------------------------*/
+
+static EVLOOP_HANDLER *evloop_find(EVLOOP *loop, int fd)
+{
+	int ii;
+
+	for (ii = 0; ii < EVLOOP_MAX_HANDLERS; ii++) {
+		if (loop->handlers[ii].fd == fd) {
+			return &loop->handlers[ii];
+		}
+	}
+
+	return NULL;
+} /* end evloop_find() */
+
+
+/*------------------------------------------------------------------------------
+ * int evloop_init()
+ * Creates the epoll instance and clears the handler table.
+ *----------------------------------------------------------------------------*/
+
+int evloop_init(EVLOOP *loop)
+{
+	int ii;
+
+	memset(loop, 0, sizeof(EVLOOP));
+	for (ii = 0; ii < EVLOOP_MAX_HANDLERS; ii++) {
+		loop->handlers[ii].fd = -1;
+	}
+
+	if ((loop->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+		perror("epoll_create1");
+		return -1;
+	}
+	loop->running = TRUE;
+
+	return 0;
+} /* end evloop_init() */
+
+
+/*------------------------------------------------------------------------------
+ * void evloop_close()
+ * Closes the epoll instance and the timers owned by the loop. Other
+ * descriptors belong to the caller and are left open.
+ *----------------------------------------------------------------------------*/
+
+void evloop_close(EVLOOP *loop)
+{
+	int ii;
+
+	for (ii = 0; ii < EVLOOP_MAX_HANDLERS; ii++) {
+		if (loop->handlers[ii].fd >= 0 && loop->handlers[ii].timer) {
+			close(loop->handlers[ii].fd);
+		}
+		loop->handlers[ii].fd = -1;
+	}
+
+	if (loop->epfd > 0) {
+		close(loop->epfd);
+	}
+	loop->epfd = -1;
+} /* end evloop_close() */
+
+
+/*------------------------------------------------------------------------------
+ * int evloop_add_fd()
+ * Adds a descriptor to the epoll set. The handler pointer is stored with the
+ * event so dispatch does not need to search the table.
+ *----------------------------------------------------------------------------*/
+
+int evloop_add_fd(EVLOOP *loop, int fd, unsigned int events, EVLOOP_CB cb, void *arg)
+{
+	EVLOOP_HANDLER *h = NULL;
+	struct epoll_event ev;
+
+	if (fd < 0 || evloop_find(loop, fd) != NULL) {
+		return -1;
+	}
+	if ((h = evloop_find(loop, -1)) == NULL) {
+		printf("EVLOOP_ADD_FD: WARNING!!! No free handler for fd %d.\n", fd);
+		return -1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = h;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		perror("epoll_ctl");
+		return -1;
+	}
+
+	h->fd = fd;
+	h->events = events;
+	h->timer = FALSE;
+	h->cb = cb;
+	h->arg = arg;
+
+	return 0;
+} /* end evloop_add_fd() */
+
+
+/*------------------------------------------------------------------------------
+ * int evloop_mod_fd()
+ * Changes the events watched for a descriptor.
+ *----------------------------------------------------------------------------*/
+
+int evloop_mod_fd(EVLOOP *loop, int fd, unsigned int events)
+{
+	EVLOOP_HANDLER *h = NULL;
+	struct epoll_event ev;
+
+	if ((h = evloop_find(loop, fd)) == NULL) {
+		return -1;
+	}
+	if (h->events == events) {
+		return 0;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = h;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+		perror("epoll_ctl");
+		return -1;
+	}
+	h->events = events;
+
+	return 0;
+} /* end evloop_mod_fd() */
+
+
+/*------------------------------------------------------------------------------
+ * int evloop_del_fd()
+ * Removes a descriptor from the epoll set. Must be called before the caller
+ * closes the descriptor.
+ *----------------------------------------------------------------------------*/
+
+int evloop_del_fd(EVLOOP *loop, int fd)
+{
+	EVLOOP_HANDLER *h = NULL;
+
+	if ((h = evloop_find(loop, fd)) == NULL) {
+		return -1;
+	}
+
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+	if (h->timer) {
+		close(fd);
+	}
+	h->fd = -1;
+	h->cb = NULL;
+	h->arg = NULL;
+
+	return 0;
+} /* end evloop_del_fd() */
+
+
+/*------------------------------------------------------------------------------
+ * int evloop_set_timer()
+ * Arms a timerfd with a period given in seconds.
+ *----------------------------------------------------------------------------*/
+
+int evloop_set_timer(int fd, float period)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_interval.tv_sec  = (time_t)period;
+	its.it_interval.tv_nsec = (long)((period - (time_t)period) * 1000000000.);
+	its.it_value = its.it_interval;
+
+	if (timerfd_settime(fd, 0, &its, NULL) == -1) {
+		perror("timerfd_settime");
+		return -1;
+	}
+
+	return 0;
+} /* end evloop_set_timer() */
+
+
+/*------------------------------------------------------------------------------
+ * int evloop_add_timer()
+ * Creates a periodic timer on the monotonic clock and adds it to the loop.
+ *----------------------------------------------------------------------------*/
+
+int evloop_add_timer(EVLOOP *loop, float period, EVLOOP_CB cb, void *arg)
+{
+	int fd = -1;
+
+	if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1) {
+		perror("timerfd_create");
+		return -1;
+	}
+
+	if (evloop_set_timer(fd, period) == -1 ||
+		evloop_add_fd(loop, fd, EVLOOP_READ, cb, arg) == -1) {
+		close(fd);
+		return -1;
+	}
+	evloop_find(loop, fd)->timer = TRUE;
+
+	return fd;
+} /* end evloop_add_timer() */
+
+
+/*------------------------------------------------------------------------------
+ * int evloop_run_once()
+ * Blocks in epoll_wait() for up to timeout ms and calls the handler for each
+ * ready descriptor. Timers are drained before their callback is called.
+ *----------------------------------------------------------------------------*/
+
+int evloop_run_once(EVLOOP *loop, int timeout)
+{
+	struct epoll_event events[EVLOOP_MAX_EVENTS];
+	EVLOOP_HANDLER *h = NULL;
+	uint64_t expirations = 0;
+	int nfds = 0;
+	int fd = -1;
+	int ii;
+
+	nfds = epoll_wait(loop->epfd, events, EVLOOP_MAX_EVENTS, timeout);
+	if (nfds == -1) {
+		if (errno != EINTR) {
+			perror("epoll_wait");
+			return -1;
+		}
+		return 0;
+	}
+
+	for (ii = 0; ii < nfds; ii++) {
+		h = (EVLOOP_HANDLER *)events[ii].data.ptr;
+		/// A previous callback in this batch may have removed the handler.
+		if (h->fd < 0 || h->cb == NULL) {
+			continue;
+		}
+		fd = h->fd;
+
+		if (h->timer) {
+			if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+				continue;
+			}
+			h->cb(fd, (unsigned int)expirations, h->arg);
+		}
+		else {
+			h->cb(fd, events[ii].events, h->arg);
+		}
+	}
+
+	return nfds;
+} /* end evloop_run_once() */
+
+
+/*------------------------------------------------------------------------------
+ * void evloop_run()
+ * Dispatches events until evloop_stop() is called.
+ *----------------------------------------------------------------------------*/
+
+void evloop_run(EVLOOP *loop)
+{
+	loop->running = TRUE;
+	while (loop->running) {
+		if (evloop_run_once(loop, EVLOOP_FOREVER) == -1) {
+			break;
+		}
+	}
+} /* end evloop_run() */
+
+
+/*------------------------------------------------------------------------------
+ * void evloop_stop()
+ * Makes evloop_run() return after the current iteration.
+ *----------------------------------------------------------------------------*/
+
+void evloop_stop(EVLOOP *loop)
+{
+	loop->running = FALSE;
+} /* end evloop_stop() */
@@ -7,396 +7,927 @@
  *****************************************************************************/
 
 #include "messages.h"
+#include "trace.h"
+
+/// Reassembly buffers, delta streams and the last sequence number of each
+/// message being received indexed by file descriptor.
+static MSG_BUF msg_bufs[MSG_MAX_FDS];
+static MSG_DELTA deltas[MSG_MAX_FDS];
+static unsigned int last_seqs[MSG_MAX_FDS][MSG_NUM_IDS];
+
+/// Header values for messages sent by this process and statistics for
+/// messages received.
+static int producer;
+static MSG_STATS stats[MSG_NUM_IDS];
+static MSG_HOOK hooks[MSG_NUM_IDS];
+static void *hook_args[MSG_NUM_IDS];
+static volatile sig_atomic_t print_stats;
+
+/// Field tables for each message. Every field is listed in order with its
+/// type and the number of values so the wire format is packed, in network
+/// byte order and does not depend on the compiler's struct padding.
+static const MSG_FIELD open_fields[] = {
+	MSG_FIELD_DEF(MSG_INT,		OPEN,	topics,		1),
+	MSG_FIELD_DEF(MSG_INT,		OPEN,	period,		1),
+	MSG_FIELD_DEF(MSG_SHORT,	OPEN,	periods,	OPEN_MAX_TOPICS),
+	MSG_FIELD_DEF(MSG_CHAR,		OPEN,	decimate,	OPEN_MAX_TOPICS),
+	MSG_FIELD_DEF(MSG_INT,		OPEN,	delta,		1)
+};
+
+static const MSG_FIELD mstrain_fields[] = {
+	MSG_FIELD_DEF(MSG_INT,		MSTRAIN_DATA,	serial_number,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	temp,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	ticks,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	mag,			3),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	accel,			3),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	ang_rate,		3),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	quat,			4),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	transform,		9),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	orient,			9),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	pitch,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	roll,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	MSTRAIN_DATA,	yaw,			1),
+	MSG_FIELD_DEF(MSG_SHORT,	MSTRAIN_DATA,	eeprom_address,	1),
+	MSG_FIELD_DEF(MSG_SHORT,	MSTRAIN_DATA,	eeprom_value,	1),
+	MSG_FIELD_DEF(MSG_SHORT,	MSTRAIN_DATA,	accel_gain,		1),
+	MSG_FIELD_DEF(MSG_SHORT,	MSTRAIN_DATA,	mag_gain,		1),
+	MSG_FIELD_DEF(MSG_SHORT,	MSTRAIN_DATA,	bias_gain,		1)
+};
+
+static const MSG_FIELD servo_fields[] = {
+	MSG_FIELD_DEF(MSG_CHAR,		SERVO,	sync,		1),
+	MSG_FIELD_DEF(MSG_CHAR,		SERVO,	servo,		1),
+	MSG_FIELD_DEF(MSG_CHAR,		SERVO,	position,	1)
+};
+
+static const MSG_FIELD client_fields[] = {
+	MSG_FIELD_DEF(MSG_INT,		CLIENT,	enable_servos,	1),
+	MSG_FIELD_DEF(MSG_INT,		CLIENT,	enable_log,		1),
+	MSG_FIELD_DEF(MSG_INT,		CLIENT,	enable_imu,		1),
+	MSG_FIELD_DEF(MSG_INT,		CLIENT,	imu_stab,		1),
+	MSG_FIELD_DEF(MSG_INT,		CLIENT,	debug_level,	1),
+	MSG_FIELD_DEF(MSG_INT,		CLIENT,	dropper,		1)
+};
+
+static const MSG_FIELD target_fields[] = {
+	MSG_FIELD_DEF(MSG_INT,		TARGET,	mode,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TARGET,	pitch,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TARGET,	roll,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TARGET,	yaw,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TARGET,	yaw_previous,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TARGET,	yaw_detected,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TARGET,	depth,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TARGET,	fx,				1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TARGET,	fy,				1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TARGET,	speed,			1),
+	MSG_FIELD_DEF(MSG_INT,		TARGET,	task,			1),
+	MSG_FIELD_DEF(MSG_INT,		TARGET,	vision_status,	1)
+};
+
+static const MSG_FIELD gain_fields[] = {
+	MSG_FIELD_DEF(MSG_CHAR,		GAIN,	mode,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_yaw,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	ki_yaw,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kd_yaw,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_pitch,			1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	ki_pitch,			1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kd_pitch,			1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_roll,			1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	ki_roll,			1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kd_roll,			1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_depth,			1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	ki_depth,			1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kd_depth,			1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_fx,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	ki_fx,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kd_fx,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_fy,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	ki_fy,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kd_fy,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_ax,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	ki_ax,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kd_ax,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_ay,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	ki_ay,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kd_ay,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_az,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	ki_az,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kd_az,				1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_roll_lateral,	1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_depth_forward,	1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	GAIN,	kp_place_holder,	1)
+};
+
+static const MSG_FIELD status_fields[] = {
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	mag,			3),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	accel,			3),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	ang_rate,		3),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	quat,			4),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	pitch,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	roll,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	yaw,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	depth,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	fx,				1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	fy,				1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	pitch_perr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	pitch_ierr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	pitch_derr,		1),
+	MSG_FIELD_DEF(MSG_INT,		STAT,	pitch_period,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	roll_perr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	roll_ierr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	roll_derr,		1),
+	MSG_FIELD_DEF(MSG_INT,		STAT,	roll_period,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	yaw_perr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	yaw_ierr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	yaw_derr,		1),
+	MSG_FIELD_DEF(MSG_INT,		STAT,	yaw_period,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	depth_perr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	depth_ierr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	depth_derr,		1),
+	MSG_FIELD_DEF(MSG_INT,		STAT,	depth_period,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	fx_perr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	fx_ierr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	fx_derr,		1),
+	MSG_FIELD_DEF(MSG_INT,		STAT,	fx_period,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	fy_perr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	fy_ierr,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	STAT,	fy_derr,		1),
+	MSG_FIELD_DEF(MSG_INT,		STAT,	fy_period,		1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	STAT,	fps,			1)
+};
+
+static const MSG_FIELD vision_fields[] = {
+	MSG_FIELD_DEF(MSG_INT,		VISION,	front_x,	1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	front_y,	1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	bottom_x,	1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	bottom_y,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	VISION,	bearing,	1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	box1_x,		1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	box1_y,		1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	box2_x,		1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	box2_y,		1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	suitcase_x,	1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	suitcase_y,	1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	status,		1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	confidence,	1),
+	MSG_FIELD_DEF(MSG_INT,		VISION,	mode,		1),
+	MSG_FIELD_DEF(MSG_DOUBLE,	VISION,	fps,		1)
+};
+
+static const MSG_FIELD stop_fields[] = {
+	MSG_FIELD_DEF(MSG_CHAR,		STOP,	state,	1)
+};
+
+static const MSG_FIELD task_fields[] = {
+	MSG_FIELD_DEF(MSG_INT,		TASK,	task,			1),
+	MSG_FIELD_DEF(MSG_INT,		TASK,	subtask,		1),
+	MSG_FIELD_DEF(MSG_INT,		TASK,	course,			1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TASK,	time_forward,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TASK,	time_left,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TASK,	time_reverse,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TASK,	time_right,		1)
+};
+
+static const MSG_FIELD vsetting_fields[] = {
+	MSG_FIELD_DEF(MSG_FLOAT,	VSETTING,	pipe_hsv,		6),
+	MSG_FIELD_DEF(MSG_FLOAT,	VSETTING,	buoy_hsv,		6),
+	MSG_FIELD_DEF(MSG_FLOAT,	VSETTING,	fence_hsv,		6),
+	MSG_FIELD_DEF(MSG_INT,		VSETTING,	save_bframe,	1),
+	MSG_FIELD_DEF(MSG_INT,		VSETTING,	save_fframe,	1),
+	MSG_FIELD_DEF(MSG_INT,		VSETTING,	save_bvideo,	1),
+	MSG_FIELD_DEF(MSG_INT,		VSETTING,	save_fvideo,	1),
+	MSG_FIELD_DEF(MSG_INT,		VSETTING,	vision_angle,	1)
+};
+
+static const MSG_FIELD lj_fields[] = {
+	MSG_FIELD_DEF(MSG_FLOAT,	LJ_DATA,	battery1,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	LJ_DATA,	battery2,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	LJ_DATA,	pressure,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	LJ_DATA,	water,		1)
+};
+
+static const MSG_FIELD teleop_fields[] = {
+	MSG_FIELD_DEF(MSG_FLOAT,	TELEOP,	pitch,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TELEOP,	roll,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TELEOP,	yaw,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TELEOP,	depth,	1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TELEOP,	fx,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TELEOP,	fy,		1),
+	MSG_FIELD_DEF(MSG_FLOAT,	TELEOP,	speed,	1)
+};
+
+static const MSG_FIELD diag_fields[] = {
+	MSG_FIELD_DEF(MSG_INT,	DIAG,	axis,		1),
+	MSG_FIELD_DEF(MSG_INT,	DIAG,	runs,		1),
+	MSG_FIELD_DEF(MSG_INT,	DIAG,	overruns,	1),
+	MSG_FIELD_DEF(MSG_INT,	DIAG,	skipped,	1),
+	MSG_FIELD_DEF(MSG_INT,	DIAG,	period,		DIAG_BINS),
+	MSG_FIELD_DEF(MSG_INT,	DIAG,	error,		DIAG_BINS),
+	MSG_FIELD_DEF(MSG_INT,	DIAG,	exec,		DIAG_BINS),
+	MSG_FIELD_DEF(MSG_INT,	DIAG,	age,		DIAG_BINS)
+};
+
+/// Codecs indexed by message ID.
+static const MSG_CODEC codecs[] = {
+	{0, 0, 0, NULL, 0},
+	MSG_CODEC_DEF(OPEN_MSGID,		open,		OPEN_MSG,		open_fields),
+	MSG_CODEC_DEF(MSTRAIN_MSGID,	mstrain,	MSTRAIN_MSG,	mstrain_fields),
+	MSG_CODEC_DEF(SERVO_MSGID,		servo,		SERVO_MSG,		servo_fields),
+	MSG_CODEC_DEF(CLIENT_MSGID,		client,		CLIENT_MSG,		client_fields),
+	MSG_CODEC_DEF(TARGET_MSGID,		target,		TARGET_MSG,		target_fields),
+	MSG_CODEC_DEF(GAIN_MSGID,		gain,		GAIN_MSG,		gain_fields),
+	MSG_CODEC_DEF(STATUS_MSGID,		status,		STATUS_MSG,		status_fields),
+	MSG_CODEC_DEF(VISION_MSGID,		vision,		VISION_MSG,		vision_fields),
+	MSG_CODEC_DEF(STOP_MSGID,		stop,		STOP_MSG,		stop_fields),
+	MSG_CODEC_DEF(TASK_MSGID,		task,		TASK_MSG,		task_fields),
+	MSG_CODEC_DEF(VSETTING_MSGID,	vsetting,	VSETTING_MSG,	vsetting_fields),
+	MSG_CODEC_DEF(LJ_MSGID,			lj,			LJ_MSG,			lj_fields),
+	MSG_CODEC_DEF(TELEOP_MSGID,		teleop,		TELEOP_MSG,		teleop_fields),
+	{0, 0, 0, NULL, 0},	/* DELTA_MSGID wraps other messages. */
+	MSG_CODEC_DEF(DIAG_MSGID,		diag,		DIAG_MSG,		diag_fields)
+};
+
+/// Size on the wire of each field type, indexed by MSG_CHAR etc.
+static const int field_sizes[] = {0, 1, 2, 4, 4, 8};
+
 
 /*------------------------------------------------------------------------------
- * void messages_send()
- * Sends message based on the message ID. Only integer types need conversion from hex
- * to network byte ordering. Use ntohs() for short int and ntohl() for int.
+ * const MSG_CODEC *messages_codec()
+ * Finds the codec for a message ID. Returns NULL if the ID is not known.
  *----------------------------------------------------------------------------*/
 
-void messages_send(int fd, int msg_id, MSG_DATA *msg)
+static const MSG_CODEC *messages_codec(int msgid)
 {
-    switch (msg_id) {
-        case OPEN_MSGID:
-            msg->open.hdr.msgid = OPEN_MSGID;
-
-            /// Actually send message here.
-            net_send(fd, &msg->open, sizeof(OPEN_MSG));
-            break;
-
-        case MSTRAIN_MSGID:
-            msg->mstrain.hdr.msgid = MSTRAIN_MSGID;
-
-            /// Use network byte order.
-            msg->mstrain.data.serial_number   = htonl(msg->mstrain.data.serial_number);
-            msg->mstrain.data.eeprom_address  = htons(msg->mstrain.data.eeprom_address);
-            msg->mstrain.data.eeprom_value    = htons(msg->mstrain.data.eeprom_value);
-
-            /// Actually send message here.
-            net_send(fd, &msg->mstrain, sizeof(MSTRAIN_MSG));
-
-            /// Convert the values back to host byte order.
-            msg->mstrain.data.serial_number   = ntohl(msg->mstrain.data.serial_number);
-            msg->mstrain.data.eeprom_address  = ntohs(msg->mstrain.data.eeprom_address);
-            msg->mstrain.data.eeprom_value    = ntohs(msg->mstrain.data.eeprom_value);
-            break;
-
-        case STOP_MSGID:
-            msg->stop.hdr.msgid = STOP_MSGID;
-
-            /// Actually send message here.
-            net_send(fd, &msg->stop, sizeof(STOP_MSG));
-            break;
-
-        case SERVO_MSGID:
-            msg->servo.hdr.msgid = SERVO_MSGID;
-            msg->servo.data.sync = SSC_SYNC;
-
-            /// Actually send message here.
-            net_send(fd, &msg->servo, sizeof(SERVO_MSG));
-            break;
-
-        case CLIENT_MSGID:
-            msg->client.hdr.msgid = CLIENT_MSGID;
-
-            /// Use network byte order.
-            msg->client.data.enable_servos  = htonl(msg->client.data.enable_servos);
-            msg->client.data.enable_log     = htonl(msg->client.data.enable_log);
-            msg->client.data.enable_imu     = htonl(msg->client.data.enable_imu);
-            msg->client.data.imu_stab       = htonl(msg->client.data.imu_stab);
-            msg->client.data.debug_level    = htonl(msg->client.data.debug_level);
-            msg->client.data.dropper        = htonl(msg->client.data.dropper);
-
-            /// Actually send message here.
-            net_send(fd, &msg->client, sizeof(CLIENT_MSG));
-
-            /// Convert the values back to host byte order.
-            msg->client.data.enable_servos  = ntohl(msg->client.data.enable_servos);
-            msg->client.data.enable_log     = ntohl(msg->client.data.enable_log);
-            msg->client.data.enable_imu     = ntohl(msg->client.data.enable_imu);
-            msg->client.data.imu_stab       = ntohl(msg->client.data.imu_stab);
-            msg->client.data.debug_level    = ntohl(msg->client.data.debug_level);
-            msg->client.data.dropper        = ntohl(msg->client.data.dropper);
-            break;
-
-        case TARGET_MSGID:
-            msg->target.hdr.msgid = TARGET_MSGID;
-
-            /// Use network byte order.
-            msg->target.data.mode  = htonl(msg->target.data.mode);
-            msg->target.data.task  = htonl(msg->target.data.task);
-            msg->target.data.vision_status  = htonl(msg->target.data.vision_status);
-
-            /// Actually send message here.
-            net_send(fd, &msg->target, sizeof(TARGET_MSG));
-
-            /// Convert the values back to host byte order.
-            msg->target.data.mode  = ntohl(msg->target.data.mode);
-            msg->target.data.task  = ntohl(msg->target.data.task);
-            msg->target.data.vision_status = ntohl(msg->target.data.vision_status);
-            break;
-
-        case GAIN_MSGID:
-            msg->gain.hdr.msgid = GAIN_MSGID;
-
-            /// Actually send message here.
-            net_send(fd, &msg->gain, sizeof(GAIN_MSG));
-            break;
-
-        case STATUS_MSGID:
-            msg->status.hdr.msgid = STATUS_MSGID;
-
-            /// Use network byte order.
-            msg->status.data.pitch_period   = htonl(msg->status.data.pitch_period);
-            msg->status.data.roll_period    = htonl(msg->status.data.roll_period);
-            msg->status.data.yaw_period     = htonl(msg->status.data.yaw_period);
-            msg->status.data.depth_period   = htonl(msg->status.data.depth_period);
-            msg->status.data.fx_period   	= htonl(msg->status.data.fx_period);
-            msg->status.data.fy_period   	= htonl(msg->status.data.fy_period);
-
-            /// Actually send message here.
-            net_send(fd, &msg->status, sizeof(STATUS_MSG));
-
-            /// Convert the values back to host byte order.
-            msg->status.data.pitch_period   = ntohl(msg->status.data.pitch_period);
-            msg->status.data.roll_period    = ntohl(msg->status.data.roll_period);
-            msg->status.data.yaw_period     = ntohl(msg->status.data.yaw_period);
-            msg->status.data.depth_period   = ntohl(msg->status.data.depth_period);
-            msg->status.data.fx_period   	= ntohl(msg->status.data.fx_period);
-            msg->status.data.fy_period   	= ntohl(msg->status.data.fy_period);
-            break;
-
-        case VISION_MSGID:
-            msg->vision.hdr.msgid = VISION_MSGID;
-
-            /// Use network byte order.
-            msg->vision.data.front_x    = htonl(msg->vision.data.front_x);
-            msg->vision.data.front_y    = htonl(msg->vision.data.front_y);
-            msg->vision.data.bottom_x   = htonl(msg->vision.data.bottom_x);
-            msg->vision.data.bottom_y   = htonl(msg->vision.data.bottom_y);
-			msg->vision.data.box1_x		= htonl(msg->vision.data.box1_x);
-			msg->vision.data.box1_y		= htonl(msg->vision.data.box1_y);
-			msg->vision.data.box2_x		= htonl(msg->vision.data.box2_x);
-			msg->vision.data.box2_y		= htonl(msg->vision.data.box2_y);
-			msg->vision.data.suitcase_x	= htonl(msg->vision.data.suitcase_x);
-			msg->vision.data.suitcase_y	= htonl(msg->vision.data.suitcase_y);
-			msg->vision.data.status		= htonl(msg->vision.data.status);
-			msg->vision.data.confidence	= htonl(msg->vision.data.confidence);
-			msg->vision.data.mode		= htonl(msg->vision.data.mode);
-
-            /// Actually send message here.
-            net_send(fd, &msg->vision, sizeof(VISION_MSG));
-
-            /// Convert the values back to host byte order.
-            msg->vision.data.front_x    = ntohl(msg->vision.data.front_x);
-            msg->vision.data.front_y    = ntohl(msg->vision.data.front_y);
-            msg->vision.data.bottom_x   = ntohl(msg->vision.data.bottom_x);
-            msg->vision.data.bottom_y   = ntohl(msg->vision.data.bottom_y);
-			msg->vision.data.box1_x		= ntohl(msg->vision.data.box1_x);
-			msg->vision.data.box1_y		= ntohl(msg->vision.data.box1_y);
-			msg->vision.data.box2_x		= ntohl(msg->vision.data.box2_x);
-			msg->vision.data.box2_y		= ntohl(msg->vision.data.box2_y);
-			msg->vision.data.suitcase_x	= ntohl(msg->vision.data.suitcase_x);
-			msg->vision.data.suitcase_y	= ntohl(msg->vision.data.suitcase_y);
-			msg->vision.data.status		= ntohl(msg->vision.data.status);
-			msg->vision.data.confidence	= ntohl(msg->vision.data.confidence);
-			msg->vision.data.mode		= ntohl(msg->vision.data.mode);
-            break;
-
-        case TASK_MSGID:
-            msg->task.hdr.msgid = TASK_MSGID;
-
-			/// Use network byte order.
-			msg->task.data.task = htonl(msg->task.data.task);
-			msg->task.data.subtask = htonl(msg->task.data.subtask);
-			msg->task.data.course = htonl(msg->task.data.course);
-
-            /// Actually send message here.
-            net_send(fd, &msg->task, sizeof(TASK_MSG));
-
-			/// Convert the values back to host byte order.
-			msg->task.data.task = ntohl(msg->task.data.task);
-			msg->task.data.subtask = ntohl(msg->task.data.subtask);
-			msg->task.data.course = ntohl(msg->task.data.course);
-            break;
-
-        case LJ_MSGID:
-            msg->lj.hdr.msgid = LJ_MSGID;
-
-            /// Actually send message here.
-            net_send(fd, &msg->lj, sizeof(LJ_MSG));
-            break;
-
-        case VSETTING_MSGID:
-            msg->vsetting.hdr.msgid = VSETTING_MSGID;
-
-            /// Use network byte order.
-            msg->vsetting.data.save_bframe = htonl(msg->vsetting.data.save_bframe);
-            msg->vsetting.data.save_fframe = htonl(msg->vsetting.data.save_fframe);
-            msg->vsetting.data.save_bvideo = htonl(msg->vsetting.data.save_bvideo);
-            msg->vsetting.data.save_fvideo = htonl(msg->vsetting.data.save_fvideo);
-
-            /// Actually send message here.
-            net_send(fd, &msg->vsetting, sizeof(VSETTING_MSG));
-
-            /// Convert the values back to host byte order.
-            msg->vsetting.data.save_bframe = ntohl(msg->vsetting.data.save_bframe);
-            msg->vsetting.data.save_fframe = ntohl(msg->vsetting.data.save_fframe);
-            msg->vsetting.data.save_bvideo = ntohl(msg->vsetting.data.save_bvideo);
-            msg->vsetting.data.save_fvideo = ntohl(msg->vsetting.data.save_fvideo);
-
-        case TELEOP_MSGID:
-            msg->teleop.hdr.msgid = TELEOP_MSGID;
-
-            /// Actually send message here.
-            net_send(fd, &msg->teleop, sizeof(TELEOP_MSG));
-            break;
-    }
-} /* end messages_send() */
+	if (msgid <= 0 || msgid >= (int)(sizeof(codecs) / sizeof(MSG_CODEC)) ||
+		codecs[msgid].msgid != msgid) {
+		return NULL;
+	}
+
+	return &codecs[msgid];
+} /* end messages_codec() */
 
 
 /*------------------------------------------------------------------------------
- * int messages_decode()
- * Called if data is received on the network buffer. The network data is decoded
- * here and the appropriate variables are set.
+ * int messages_size()
+ * Returns the size of a message on the wire, including the header and footer.
+ * Returns 0 if the message ID is not known.
  *----------------------------------------------------------------------------*/
 
-int messages_decode(int fd, char *buf, MSG_DATA *msg, int bytes)
+int messages_size(int msgid)
 {
-	/// Check that a full message is available in the buffer.
-	int ii = 0;
-	int jj = 0;
-	int found_header = FALSE;
-	int found_footer = FALSE;
-	int num_footers = 0;
-
-	/// Decode messages in buffer.
-	while (bytes > 0) {
-		/// Look for header.
-		for (ii = jj; ii < bytes; ii++) {
-			if (buf[ii] == MSG_START) {
-				found_header = TRUE;
-				break;
+	const MSG_CODEC *codec = NULL;
+	int size = MSG_HDR_SIZE + MSG_FTR_SIZE;
+	int ii;
+
+	if ((codec = messages_codec(msgid)) == NULL) {
+		return 0;
+	}
+
+	for (ii = 0; ii < codec->nfields; ii++) {
+		size += field_sizes[codec->fields[ii].type] * codec->fields[ii].count;
+	}
+
+	return size;
+} /* end messages_size() */
+
+
+/*------------------------------------------------------------------------------
+ * int messages_encode()
+ * Packs a message into buf in network byte order. The message data is only
+ * read so the same MSG_DATA can be encoded from more than one thread.
+ *----------------------------------------------------------------------------*/
+
+int messages_encode(int msgid, const MSG_DATA *msg, char *buf, int size)
+{
+	const MSG_CODEC *codec = NULL;
+	const MSG_FIELD *f = NULL;
+	const HEADER *hdr = NULL;
+	unsigned long long stamp = 0;
+	const char *in = NULL;
+	unsigned char *out = (unsigned char *)buf;
+	unsigned short u16 = 0;
+	unsigned int u32 = 0;
+	unsigned int u64[2];
+	int len = 0;
+	int ii;
+	int jj;
+
+	if ((len = messages_size(msgid)) == 0 || len > size) {
+		return -1;
+	}
+	codec = messages_codec(msgid);
+
+	/// Header. Data that was produced elsewhere and is being passed on keeps
+	/// its original timestamp.
+	hdr = (const HEADER *)((const char *)msg + codec->msg);
+	stamp = (hdr->stamp != 0) ? hdr->stamp : timing_now();
+	*out++ = MSG_START;
+	*out++ = msgid;
+	*out++ = (len >> 8) & 0xff;
+	*out++ = len & 0xff;
+	*out++ = (producer >> 8) & 0xff;
+	*out++ = producer & 0xff;
+	/// The sequence number is filled in for each connection it is sent on.
+	for (ii = 0; ii < 4; ii++) {
+		*out++ = 0;
+	}
+	for (ii = 7; ii >= 0; ii--) {
+		*out++ = (stamp >> (8 * ii)) & 0xff;
+	}
+
+	/// Fields.
+	for (ii = 0; ii < codec->nfields; ii++) {
+		f = &codec->fields[ii];
+		in = (const char *)msg + codec->offset + f->offset;
+		switch (f->type) {
+		case MSG_CHAR:
+			memcpy(out, in, f->count);
+			break;
+		case MSG_SHORT:
+			for (jj = 0; jj < f->count; jj++) {
+				memcpy(&u16, in + 2 * jj, sizeof(u16));
+				u16 = htons(u16);
+				memcpy(out + 2 * jj, &u16, sizeof(u16));
 			}
+			break;
+		case MSG_INT:
+		case MSG_FLOAT:
+			for (jj = 0; jj < f->count; jj++) {
+				memcpy(&u32, in + 4 * jj, sizeof(u32));
+				u32 = htonl(u32);
+				memcpy(out + 4 * jj, &u32, sizeof(u32));
+			}
+			break;
+		case MSG_DOUBLE:
+			/// Send the most significant word first.
+			for (jj = 0; jj < f->count; jj++) {
+				memcpy(u64, in + 8 * jj, sizeof(u64));
+				if (htonl(1) != 1) {
+					u32 = htonl(u64[0]);
+					u64[0] = htonl(u64[1]);
+					u64[1] = u32;
+				}
+				memcpy(out + 8 * jj, u64, sizeof(u64));
+			}
+			break;
 		}
+		in += field_sizes[f->type] * f->count;
+		out += field_sizes[f->type] * f->count;
+	}
 
-		/// Look for footer.
-		for (jj = ii; jj < bytes; jj++) {
-			if (buf[jj] == MSG_END) {
-				found_footer = TRUE;
-				num_footers++;
-				break;
-			}
+	/// Footer.
+	*out = MSG_END;
+
+	/// The sync byte for the servo controller is always the same.
+	if (msgid == SERVO_MSGID) {
+		buf[MSG_HDR_SIZE] = SSC_SYNC;
+	}
+
+	return len;
+} /* end messages_encode() */
+
+
+/*------------------------------------------------------------------------------
+ * int messages_encode_delta()
+ * Builds a delta from a packed message. The bytes of each field entry are
+ * compared with the last message sent on the stream and only the entries
+ * that differ are copied.
+ *----------------------------------------------------------------------------*/
+
+int messages_encode_delta(MSG_DELTA *delta, const char *frame, char *buf, int size)
+{
+	const MSG_CODEC *codec = NULL;
+	const unsigned char *wire = (const unsigned char *)frame;
+	unsigned char *out = (unsigned char *)buf;
+	unsigned long long mask = 0;
+	int msgid = MSG_WIRE_ID(frame);
+	int len = (wire[2] << 8) | wire[3];
+	int dlen = MSG_DELTA_HDR_SIZE;
+	int pos = MSG_HDR_SIZE;
+	int key = FALSE;
+	int n = 0;
+	int ii;
+
+	if ((codec = messages_codec(msgid)) == NULL || codec->nfields > MSG_DELTA_FIELDS ||
+		len != messages_size(msgid) || len > MSG_WIRE_SIZE ||
+		len + MSG_DELTA_HDR_SIZE - MSG_HDR_SIZE > size) {
+		return -1;
+	}
+
+	/// Start over with a keyframe when the receiver may have lost its place.
+	key = (delta->len != len || delta->msgid != msgid ||
+		delta->index + 1 >= MSG_DELTA_KEYFRAME);
+	delta->index = key ? 0 : delta->index + 1;
+
+	for (ii = 0; ii < codec->nfields; ii++) {
+		n = field_sizes[codec->fields[ii].type] * codec->fields[ii].count;
+		if (key || memcmp(frame + pos, delta->image + pos, n) != 0) {
+			mask |= 1ULL << ii;
+			memcpy(buf + dlen, frame + pos, n);
+			dlen += n;
 		}
+		pos += n;
+	}
+	buf[dlen++] = MSG_END;
+
+	/// The header is the one from the full message apart from its ID and
+	/// length.
+	memcpy(buf, frame, MSG_HDR_SIZE);
+	out[1] = DELTA_MSGID;
+	out[2] = (dlen >> 8) & 0xff;
+	out[3] = dlen & 0xff;
+	out[MSG_HDR_SIZE] = msgid;
+	out[MSG_HDR_SIZE + 1] = delta->index;
+	for (ii = 0; ii < 8; ii++) {
+		out[MSG_HDR_SIZE + 2 + ii] = (mask >> (8 * (7 - ii))) & 0xff;
+	}
+
+	memcpy(delta->image, frame, len);
+	delta->len = len;
+	delta->msgid = msgid;
+
+	return dlen;
+} /* end messages_encode_delta() */
+
 
-		/// Return if a header OR a footer are NOT found.
-		if (!found_header || !found_footer) {
-			return bytes;
+/*------------------------------------------------------------------------------
+ * void messages_send()
+ * Encodes a message into a scratch buffer and sends it.
+ *----------------------------------------------------------------------------*/
+
+void messages_send(int fd, int msg_id, const MSG_DATA *msg)
+{
+	char buf[MSG_WIRE_SIZE];
+	int len = 0;
+
+	if (print_stats) {
+		messages_print_stats();
+	}
+
+	if ((len = messages_encode(msg_id, msg, buf, MSG_WIRE_SIZE)) > 0) {
+		net_send(fd, buf, len);
+	}
+} /* end messages_send() */
+
+
+/*------------------------------------------------------------------------------
+ * int messages_send_batch()
+ * Encodes several messages into scratch buffers and sends them with one
+ * gathered write.
+ *----------------------------------------------------------------------------*/
+
+int messages_send_batch(int fd, const int *msgids, int count, const MSG_DATA *msg)
+{
+	char bufs[MSG_BATCH_MAX][MSG_WIRE_SIZE];
+	struct iovec iov[MSG_BATCH_MAX];
+	int len = 0;
+	int n = 0;
+	int ii;
+
+	if (print_stats) {
+		messages_print_stats();
+	}
+
+	if (count > MSG_BATCH_MAX) {
+		printf("MESSAGES_SEND_BATCH: WARNING!!! Only sending %d of %d messages.\n",
+			MSG_BATCH_MAX, count);
+		count = MSG_BATCH_MAX;
+	}
+
+	for (ii = 0; ii < count; ii++) {
+		if ((len = messages_encode(msgids[ii], msg, bufs[n], MSG_WIRE_SIZE)) > 0) {
+			iov[n].iov_base = bufs[n];
+			iov[n].iov_len = len;
+			n++;
 		}
+	}
+	if (n == 0) {
+		return 0;
+	}
 
-		/// Determine what message type was received.
-		switch (((HEADER *)buf)->msgid) {
-		case OPEN_MSGID:
-			msg->open.hdr.msgid = ((HEADER *)buf)->msgid;
+	return net_sendv(fd, iov, n);
+} /* end messages_send_batch() */
 
-			bytes -= sizeof(OPEN_MSG);
-			memmove(msg, msg, sizeof(OPEN_MSG));
-			break;
 
-		case MSTRAIN_MSGID:
-			msg->mstrain.data = ((MSTRAIN_MSG *)buf)->data;
+/*------------------------------------------------------------------------------
+ * void messages_sigusr1()
+ * Asks for the statistics to be printed. Printing is not safe in a signal
+ * handler so it is done on the next send or decode.
+ *----------------------------------------------------------------------------*/
 
-			/// Convert from network to host byte order.
-			msg->mstrain.data.serial_number  = ntohl(msg->mstrain.data.serial_number);
-			msg->mstrain.data.eeprom_address = ntohs(msg->mstrain.data.eeprom_address);
-			msg->mstrain.data.eeprom_value   = ntohs(msg->mstrain.data.eeprom_value);
+static void messages_sigusr1(int signal)
+{
+	print_stats = TRUE;
+} /* end messages_sigusr1() */
 
-			bytes -= sizeof(MSTRAIN_MSG);
-			memmove(msg, msg, sizeof(MSTRAIN_MSG));
-			break;
 
-		case STOP_MSGID:
-			msg->stop.data = ((STOP_MSG *)buf)->data;
+/*------------------------------------------------------------------------------
+ * void messages_set_producer()
+ * Sets the producer ID for messages sent by this process.
+ *----------------------------------------------------------------------------*/
 
-			bytes -= sizeof(STOP_MSG);
-			memmove(msg, msg, sizeof(STOP_MSG));
-			break;
+void messages_set_producer(int id)
+{
+	struct sigaction sigusr1_action;
 
-		case SERVO_MSGID:
-			msg->servo.data = ((SERVO_MSG *)buf)->data;
+	producer = id;
 
-			bytes -= sizeof(SERVO_MSG);
-			memmove(msg, msg, sizeof(SERVO_MSG));
-			break;
+	memset(&sigusr1_action, 0, sizeof(sigusr1_action));
+	sigusr1_action.sa_handler = messages_sigusr1;
+	sigusr1_action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &sigusr1_action, NULL);
+} /* end messages_set_producer() */
 
-		case CLIENT_MSGID:
-			msg->client.data = ((CLIENT_MSG *)buf)->data;
 
-			/// Convert from network to host byte order.
-			msg->client.data.enable_servos = ntohl(msg->client.data.enable_servos);
-			msg->client.data.enable_log    = ntohl(msg->client.data.enable_log);
-			msg->client.data.enable_imu    = ntohl(msg->client.data.enable_imu);
-			msg->client.data.imu_stab      = ntohl(msg->client.data.imu_stab);
-			msg->client.data.debug_level   = ntohl(msg->client.data.debug_level);
-			msg->client.data.dropper       = ntohl(msg->client.data.dropper);
+/*------------------------------------------------------------------------------
+ * void messages_stats_update()
+ * Updates the statistics for a message that has just been decoded from fd.
+ *----------------------------------------------------------------------------*/
 
-			bytes -= sizeof(CLIENT_MSG);
-			memmove(msg, msg, sizeof(CLIENT_MSG));
-			break;
+static void messages_stats_update(int fd, const HEADER *hdr)
+{
+	MSG_STATS *st = NULL;
+	unsigned long long now = timing_now();
+	unsigned int last = 0;
 
-		case TARGET_MSGID:
-			msg->target.data = ((TARGET_MSG *)buf)->data;
+	if (hdr->msgid >= MSG_NUM_IDS) {
+		return;
+	}
+	st = &stats[hdr->msgid];
+	st->received++;
+
+	/// Sequence numbers count the messages sent on this connection, so a gap
+	/// is a message the sender dropped. They are 0 on the shared memory bus,
+	/// which only keeps the latest of each message.
+	if (fd >= 0 && fd < MSG_MAX_FDS && hdr->seq != 0) {
+		last = last_seqs[fd][hdr->msgid];
+		if (last != 0 && hdr->seq > last + 1) {
+			st->dropped += hdr->seq - last - 1;
+		}
+		last_seqs[fd][hdr->msgid] = hdr->seq;
+	}
 
-			/// Convert from network to host byte order.
-			msg->target.data.mode  = ntohl(msg->target.data.mode);
-			msg->target.data.task  = ntohl(msg->target.data.task);
-			msg->target.data.vision_status  = ntohl(msg->target.data.vision_status);
+	if (hdr->stamp != 0 && now >= hdr->stamp) {
+		hist_add(&st->age, now - hdr->stamp);
+	}
+	if (st->last_arrival != 0) {
+		hist_add(&st->interval, now - st->last_arrival);
+	}
+	st->last_arrival = now;
+} /* end messages_stats_update() */
 
-			bytes -= sizeof(TARGET_MSG);
-			memmove(msg, msg, sizeof(TARGET_MSG));
-			break;
 
-		case GAIN_MSGID:
-			msg->gain.data = ((GAIN_MSG *)buf)->data;
+/*------------------------------------------------------------------------------
+ * void messages_used()
+ * Records how old a message was when it was acted on.
+ *----------------------------------------------------------------------------*/
 
-			bytes -= sizeof(GAIN_MSG);
-			memmove(msg, msg, sizeof(GAIN_MSG));
-			break;
+void messages_used(const HEADER *hdr)
+{
+	unsigned long long now = timing_now();
+
+	if (hdr->msgid < MSG_NUM_IDS && hdr->stamp != 0 && now >= hdr->stamp) {
+		hist_add(&stats[hdr->msgid].used, now - hdr->stamp);
+	}
+} /* end messages_used() */
 
-		case STATUS_MSGID:
-			msg->status.data = ((STATUS_MSG *)buf)->data;
 
-			bytes -= sizeof(STATUS_MSG);
-			memmove(msg, msg, sizeof(STATUS_MSG));
-			break;
+/*------------------------------------------------------------------------------
+ * int messages_set_hook()
+ * Sets a function to call after each message of a type is decoded.
+ *----------------------------------------------------------------------------*/
 
-		case VISION_MSGID:
-			msg->vision.data = ((VISION_MSG *)buf)->data;
-
-			/// Convert from network to host byte order.
-			msg->vision.data.front_x    = ntohl(msg->vision.data.front_x);
-			msg->vision.data.front_y    = ntohl(msg->vision.data.front_y);
-			msg->vision.data.bottom_x   = ntohl(msg->vision.data.bottom_x);
-			msg->vision.data.bottom_y   = ntohl(msg->vision.data.bottom_y);
-			msg->vision.data.box1_x		= ntohl(msg->vision.data.box1_x);
-			msg->vision.data.box1_y		= ntohl(msg->vision.data.box1_y);
-			msg->vision.data.box2_x		= ntohl(msg->vision.data.box2_x);
-			msg->vision.data.box2_y		= ntohl(msg->vision.data.box2_y);
-			msg->vision.data.suitcase_x	= ntohl(msg->vision.data.suitcase_x);
-			msg->vision.data.suitcase_y	= ntohl(msg->vision.data.suitcase_y);
-			msg->vision.data.status		= ntohl(msg->vision.data.status);
-			msg->vision.data.confidence = ntohl(msg->vision.data.confidence);
-			msg->vision.data.mode		= ntohl(msg->vision.data.mode);
-
-			bytes -= sizeof(VISION_MSG);
-			memmove(msg, msg, sizeof(VISION_MSG));
-			break;
+int messages_set_hook(int msgid, MSG_HOOK hook, void *arg)
+{
+	if (msgid < 0 || msgid >= MSG_NUM_IDS) {
+		return -1;
+	}
 
-		case TASK_MSGID:
-			msg->task.data = ((TASK_MSG *)buf)->data;
+	hooks[msgid] = hook;
+	hook_args[msgid] = arg;
 
-			/// Convert from network to host byte order.
-			msg->task.data.task = ntohl(msg->task.data.task);
-			msg->task.data.subtask = ntohl(msg->task.data.subtask);
-			msg->task.data.course = ntohl(msg->task.data.course);
+	return 0;
+} /* end messages_set_hook() */
 
-			bytes -= sizeof(TASK_MSG);
-			memmove(msg, msg, sizeof(TASK_MSG));
-			break;
 
-		case LJ_MSGID:
-			msg->lj.data = ((LJ_MSG *)buf)->data;
+/*------------------------------------------------------------------------------
+ * int messages_get_stats()
+ * Gets the statistics for a message type.
+ *----------------------------------------------------------------------------*/
 
-			bytes -= sizeof(LJ_MSG);
-			memmove(msg, msg, sizeof(LJ_MSG));
-			break;
+int messages_get_stats(int msgid, MSG_STATS *st)
+{
+	if (msgid < 0 || msgid >= MSG_NUM_IDS) {
+		return -1;
+	}
 
-		case VSETTING_MSGID:
-			msg->vsetting.data = ((VSETTING_MSG *)buf)->data;
+	*st = stats[msgid];
 
-			/// Convert from network to host byte order.
-			msg->vsetting.data.save_bframe = ntohl(msg->vsetting.data.save_bframe);
-			msg->vsetting.data.save_fframe = ntohl(msg->vsetting.data.save_fframe);
-			msg->vsetting.data.save_bvideo = ntohl(msg->vsetting.data.save_bvideo);
-			msg->vsetting.data.save_fvideo = ntohl(msg->vsetting.data.save_fvideo);
+	return 0;
+} /* end messages_get_stats() */
+
+
+/*------------------------------------------------------------------------------
+ * void messages_print_stats()
+ * Prints the statistics for every message type that has been received. Times
+ * are in microseconds.
+ *----------------------------------------------------------------------------*/
+
+void messages_print_stats()
+{
+	MSG_STATS *st = NULL;
+	int ii;
+
+	print_stats = FALSE;
+
+	printf("MSG: id   recv   drop  age p50    p99    max  gap mean  used p50    p99\n");
+	for (ii = 0; ii < MSG_NUM_IDS; ii++) {
+		st = &stats[ii];
+		if (st->received == 0 && st->used.count == 0) {
+			continue;
+		}
+		printf("MSG: %2d %6u %6u %8llu %6llu %6llu %9llu %9llu %6llu\n",
+			ii, st->received, st->dropped,
+			hist_pct(&st->age, 50), hist_pct(&st->age, 99),
+			st->age.max,
+			(st->interval.count > 0) ? st->interval.sum / st->interval.count : 0,
+			hist_pct(&st->used, 50), hist_pct(&st->used, 99));
+	}
+} /* end messages_print_stats() */
 
-			bytes -= sizeof(VSETTING_MSG);
-			memmove(msg, msg, sizeof(VSETTING_MSG));
-			break;
 
-		case TELEOP_MSGID:
-			msg->teleop.data = ((TELEOP_MSG *)buf)->data;
+/*------------------------------------------------------------------------------
+ * void messages_decode_frame()
+ * Unpacks one complete message into the appropriate variables.
+ *----------------------------------------------------------------------------*/
+
+static void messages_decode_frame(int fd, const char *frame, MSG_DATA *msg)
+{
+	const MSG_CODEC *codec = NULL;
+	const MSG_FIELD *f = NULL;
+	HEADER *hdr = NULL;
+	const unsigned char *wire = (const unsigned char *)frame;
+	const unsigned char *in = wire + MSG_HDR_SIZE;
+	char *out = NULL;
+	unsigned short u16 = 0;
+	unsigned int u32 = 0;
+	unsigned int u64[2];
+	int ii;
+	int jj;
+
+	if ((codec = messages_codec(MSG_WIRE_ID(frame))) == NULL) {
+		return;
+	}
 
-			bytes -= sizeof(TELEOP_MSG);
-			memmove(msg, msg, sizeof(TELEOP_MSG));
+	/// Unpack the header and record which message arrived.
+	hdr = (HEADER *)((char *)msg + codec->msg);
+	hdr->msgid = codec->msgid;
+	hdr->msglen = (wire[2] << 8) | wire[3];
+	hdr->producer = (wire[4] << 8) | wire[5];
+	hdr->seq = 0;
+	for (ii = 6; ii < 10; ii++) {
+		hdr->seq = (hdr->seq << 8) | wire[ii];
+	}
+	hdr->stamp = 0;
+	for (ii = 10; ii < MSG_HDR_SIZE; ii++) {
+		hdr->stamp = (hdr->stamp << 8) | wire[ii];
+	}
+	messages_stats_update(fd, hdr);
+
+	for (ii = 0; ii < codec->nfields; ii++) {
+		f = &codec->fields[ii];
+		out = (char *)msg + codec->offset + f->offset;
+		switch (f->type) {
+		case MSG_CHAR:
+			memcpy(out, in, f->count);
+			break;
+		case MSG_SHORT:
+			for (jj = 0; jj < f->count; jj++) {
+				memcpy(&u16, in + 2 * jj, sizeof(u16));
+				u16 = ntohs(u16);
+				memcpy(out + 2 * jj, &u16, sizeof(u16));
+			}
+			break;
+		case MSG_INT:
+		case MSG_FLOAT:
+			for (jj = 0; jj < f->count; jj++) {
+				memcpy(&u32, in + 4 * jj, sizeof(u32));
+				u32 = ntohl(u32);
+				memcpy(out + 4 * jj, &u32, sizeof(u32));
+			}
+			break;
+		case MSG_DOUBLE:
+			/// The most significant word comes first.
+			for (jj = 0; jj < f->count; jj++) {
+				memcpy(u64, in + 8 * jj, sizeof(u64));
+				if (htonl(1) != 1) {
+					u32 = ntohl(u64[0]);
+					u64[0] = ntohl(u64[1]);
+					u64[1] = u32;
+				}
+				memcpy(out + 8 * jj, u64, sizeof(u64));
+			}
 			break;
 		}
+		in += field_sizes[f->type] * f->count;
+		out += field_sizes[f->type] * f->count;
+	}
+
+	if (codec->msgid < MSG_NUM_IDS && hooks[codec->msgid] != NULL) {
+		hooks[codec->msgid](fd, msg, hook_args[codec->msgid]);
+	}
+} /* end messages_decode_frame() */
+
+
+/*------------------------------------------------------------------------------
+ * void messages_decode_delta()
+ * Applies a delta to the last full message received on a connection and
+ * decodes the result. Deltas that do not follow on from the last one are
+ * ignored until the next keyframe.
+ *----------------------------------------------------------------------------*/
+
+static void messages_decode_delta(int fd, const char *frame, MSG_DATA *msg)
+{
+	const MSG_CODEC *codec = NULL;
+	const unsigned char *wire = (const unsigned char *)frame;
+	MSG_DELTA scratch;
+	MSG_DELTA *delta = NULL;
+	unsigned long long mask = 0;
+	int len = (wire[2] << 8) | wire[3];
+	int msgid = wire[MSG_HDR_SIZE];
+	int index = wire[MSG_HDR_SIZE + 1];
+	int in = MSG_DELTA_HDR_SIZE;
+	int pos = MSG_HDR_SIZE;
+	int n = 0;
+	int ii;
+
+	/// Descriptors without a stream can only decode keyframes.
+	if (fd >= 0 && fd < MSG_MAX_FDS) {
+		delta = &deltas[fd];
+	}
+	else {
+		scratch.len = 0;
+		delta = &scratch;
 	}
 
-	return bytes;
+	if ((codec = messages_codec(msgid)) == NULL || codec->nfields > MSG_DELTA_FIELDS) {
+		return;
+	}
+	for (ii = 0; ii < 8; ii++) {
+		mask = (mask << 8) | wire[MSG_HDR_SIZE + 2 + ii];
+	}
+
+	if (index == 0) {
+		delta->msgid = msgid;
+		delta->len = messages_size(msgid);
+	}
+	else if (delta->len == 0 || delta->msgid != msgid || index != delta->index + 1) {
+		delta->len = 0;
+		return;
+	}
+	delta->index = index;
+
+	for (ii = 0; ii < codec->nfields; ii++) {
+		n = field_sizes[codec->fields[ii].type] * codec->fields[ii].count;
+		if (mask & (1ULL << ii)) {
+			if (in + n > len - MSG_FTR_SIZE) {
+				delta->len = 0;
+				return;
+			}
+			memcpy(delta->image + pos, frame + in, n);
+			in += n;
+		}
+		else if (index == 0) {
+			/// A keyframe must have every field.
+			delta->len = 0;
+			return;
+		}
+		pos += n;
+	}
+
+	/// Use the header from the delta so the sequence number and timestamp are
+	/// those it was sent with.
+	memcpy(delta->image, frame, MSG_HDR_SIZE);
+	delta->image[1] = msgid;
+	delta->image[2] = (delta->len >> 8) & 0xff;
+	delta->image[3] = delta->len & 0xff;
+	delta->image[delta->len - MSG_FTR_SIZE] = MSG_END;
+
+	messages_decode_frame(fd, delta->image, msg);
+} /* end messages_decode_delta() */
+
+
+/*------------------------------------------------------------------------------
+ * int messages_decode()
+ * Called if data is received on the network buffer. The data is appended to
+ * the reassembly buffer for the connection and each complete message is
+ * decoded. Every message starts with a header holding its length, so messages
+ * that arrive together in one read are all decoded and a message split across
+ * reads is kept until the rest arrives. If the stream gets out of sync the
+ * buffer is scanned one byte at a time for the next valid message.
+ *----------------------------------------------------------------------------*/
+
+int messages_decode(int fd, char *buf, MSG_DATA *msg, int bytes)
+{
+	MSG_BUF scratch;
+	MSG_BUF *mb = NULL;
+	unsigned char *hdr = NULL;
+	unsigned long long span = trace_begin();
+	int copied = 0;
+	int offset = 0;
+	int len = 0;
+	int size = 0;
+	int n = 0;
+
+	if (print_stats) {
+		messages_print_stats();
+	}
+
+	/// Use the buffer for this connection. Descriptors without a buffer can
+	/// only decode messages that arrive whole.
+	if (fd >= 0 && fd < MSG_MAX_FDS) {
+		mb = &msg_bufs[fd];
+	}
+	else {
+		scratch.len = 0;
+		mb = &scratch;
+	}
+
+	while (copied < bytes) {
+		/// Append as much new data as fits.
+		n = bytes - copied;
+		if (n > MSG_BUF_SIZE - mb->len) {
+			n = MSG_BUF_SIZE - mb->len;
+		}
+		memcpy(mb->data + mb->len, buf + copied, n);
+		mb->len += n;
+		copied += n;
+
+		/// Decode every complete message in the buffer.
+		offset = 0;
+		while (mb->len - offset >= MSG_HDR_SIZE) {
+			hdr = (unsigned char *)mb->data + offset;
+			len = (hdr[2] << 8) | hdr[3];
+			size = messages_size(hdr[1]);
+
+			/// Deltas only carry the fields that changed so their length
+			/// varies.
+			if (hdr[1] == DELTA_MSGID && len >= MSG_DELTA_HDR_SIZE + MSG_FTR_SIZE &&
+				len <= MSG_DELTA_HDR_SIZE + MSG_WIRE_SIZE) {
+				size = len;
+			}
+
+			/// Skip a byte if this is not the start of a valid message.
+			if (hdr[0] != MSG_START || size == 0 || len != size) {
+				offset++;
+				continue;
+			}
+
+			/// Wait for the rest of the message.
+			if (mb->len - offset < len) {
+				break;
+			}
+
+			if (mb->data[offset + len - MSG_FTR_SIZE] != MSG_END) {
+				offset++;
+				continue;
+			}
+
+			if (hdr[1] == DELTA_MSGID) {
+				messages_decode_delta(fd, mb->data + offset, msg);
+			}
+			else {
+				messages_decode_frame(fd, mb->data + offset, msg);
+			}
+			offset += len;
+		}
+
+		/// Keep the partial message at the start of the buffer.
+		mb->len -= offset;
+		memmove(mb->data, mb->data + offset, mb->len);
+	}
+
+	trace_end("messages_decode", span);
+
+	return mb->len;
 } /* end messages_decode() */
 
 
+/*------------------------------------------------------------------------------
+ * void messages_reset()
+ * Discards any partial message kept for a connection.
+ *----------------------------------------------------------------------------*/
+
+void messages_reset(int fd)
+{
+	if (fd >= 0 && fd < MSG_MAX_FDS) {
+		msg_bufs[fd].len = 0;
+		deltas[fd].len = 0;
+		memset(last_seqs[fd], 0, sizeof(last_seqs[fd]));
+	}
+} /* end messages_reset() */
+
+
 /*------------------------------------------------------------------------------
  * void messages_update()
  * Updates the status variables.
@@ -444,6 +975,7 @@ void messages_init(MSG_DATA *msg)
 	msg->lj.hdr.msgstart		= MSG_START;
 	msg->vsetting.hdr.msgstart	= MSG_START;
 	msg->teleop.hdr.msgstart	= MSG_START;
+	msg->diag.hdr.msgstart		= MSG_START;
 	msg->open.ftr.msgend		= MSG_END;
 	msg->mstrain.ftr.msgend		= MSG_END;
 	msg->servo.ftr.msgend		= MSG_END;
@@ -457,4 +989,5 @@ void messages_init(MSG_DATA *msg)
 	msg->lj.ftr.msgend			= MSG_END;
 	msg->vsetting.ftr.msgend	= MSG_END;
 	msg->teleop.ftr.msgend		= MSG_END;
+	msg->diag.ftr.msgend		= MSG_END;
 } /* end messages_init() */
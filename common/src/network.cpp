@@ -9,33 +9,54 @@
 
 #include "network.h"
 
-static int fdmax;
-static fd_set master;
-static fd_set read_fds;
-static struct hostent *hent;
+/// Outbound queues indexed by file descriptor. A descriptor is only used by
+/// the server or thread that owns it so these need no locking.
+static NET_QUEUE queues[NET_MAX_FDS];
+static int policies[NET_MAX_MSGID];
 
-/* This variable is in here as a hack. Planner is supposed to send 2 messages
- * to GUI but only 1 is making it through most of the time. Rarely the second
- * message gets to GUI as well. This will send STATUS one time, LJ the next.
- * messages_decode() should fix this but it's not working yet. */
-static int hack_msg_num;
-static int hack_msg_num_client;
+/// Sequence numbers of the messages sent on each connection.
+static unsigned int seqs[NET_MAX_FDS][NET_MAX_MSGID];
+
+/// Pool of shared message buffers. Buffers are claimed and released with
+/// atomic reference counts so servers on different threads can share it.
+static NET_BUF bufs[NET_BUF_COUNT];
+static unsigned int buf_next;
+
+static NET_BUF *net_buf_get();
+static void net_buf_put(NET_BUF *b);
+static void net_queue_clear(NET_QUEUE *q);
+static int net_queue_send(int fd, const void *msg, int len, NET_BUF *b);
+static unsigned int net_seq(int fd, const void *msg, int len);
+static int net_stamp(const void *msg, int len, int offset, unsigned int seq,
+    unsigned char *hdr, struct iovec *iov);
+static int net_send_stamped(int fd, const void *msg, int len, int offset,
+    unsigned int seq, int flags);
+
+/// Client connections indexed by file descriptor.
+static NET_CONN conns[NET_MAX_FDS];
+
+/// Messages exchanged in MODE_PLANNER.
+static const int planner_request[] = {TARGET_MSGID, GAIN_MSGID, LJ_MSGID};
+static const int planner_reply[] = {STATUS_MSGID, LJ_MSGID};
 
 
 /*------------------------------------------------------------------------------
  * int net_server_setup()
- * Creates a TCP server. Establishes a socket with file descriptor server_fd to
+ * Creates a TCP server. Establishes a socket with file descriptor srv->fd to
  * be used in subsequent network calls.
  *----------------------------------------------------------------------------*/
 
-int net_server_setup(short port)
+int net_server_setup(NET_SERVER *srv, short port)
 {
     int fd = -1;
 
     /// Zero out the file descriptor sets. Used to keep track of fd's available to
     /// read data from. Basically a list of clients that are connected.
-    FD_ZERO(&read_fds);
-    FD_ZERO(&master);
+    memset(srv, 0, sizeof(NET_SERVER));
+    FD_ZERO(&srv->read_fds);
+    FD_ZERO(&srv->write_fds);
+    FD_ZERO(&srv->master);
+    srv->fd = -1;
 
     /// Make each system call. Error checking is done within the following functions.
     fd = net_socket();
@@ -48,13 +69,90 @@ int net_server_setup(short port)
     /// Set the maximum file descriptor number to look for data to read. Also add
     /// fd to the master set. The master set is necessary because read_fds
     /// gets modified by the FD_ISSET() system call inside the net_server() function.
-    fdmax = fd;
-    FD_SET(fd, &master);
+    srv->fd = fd;
+    srv->fdmax = fd;
+    if (fd >= 0) {
+        FD_SET(fd, &srv->master);
+    }
 
     return fd;
 } /* end net_server_setup() */
 
 
+/*------------------------------------------------------------------------------
+ * void net_server_close()
+ * Closes every client connection of a server and then the server socket.
+ *----------------------------------------------------------------------------*/
+
+void net_server_close(NET_SERVER *srv)
+{
+    int ii;
+
+    for (ii = 0; ii <= srv->fdmax && ii < NET_MAX_FDS; ii++) {
+        if (ii != srv->fd && FD_ISSET(ii, &srv->master)) {
+            net_server_drop(srv, ii);
+        }
+    }
+
+    if (srv->fd >= 0) {
+        if (srv->loop != NULL) {
+            evloop_del_fd(srv->loop, srv->fd);
+        }
+        close(srv->fd);
+    }
+    srv->fd = -1;
+} /* end net_server_close() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_server_drop()
+ * Closes a client connection of a server and forgets its subscription.
+ *----------------------------------------------------------------------------*/
+
+void net_server_drop(NET_SERVER *srv, int fd)
+{
+    if (fd < 0 || fd >= NET_MAX_FDS) {
+        return;
+    }
+
+    if (srv->loop != NULL) {
+        evloop_del_fd(srv->loop, fd);
+    }
+    FD_CLR(fd, &srv->master);
+    srv->subs[fd].topics = 0;
+    net_close(fd);
+} /* end net_server_drop() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_server_accept()
+ * Accepts a new connection for a server and adds it to the server's set.
+ *----------------------------------------------------------------------------*/
+
+static int net_server_accept(NET_SERVER *srv)
+{
+    int new_fd = -1;
+
+    if ((new_fd = net_accept(srv->fd)) == -1) {
+        return -1;
+    }
+    if (new_fd >= NET_MAX_FDS) {
+        printf("NET_SERVER_ACCEPT: WARNING!!! Client fd %d is too large.\n", new_fd);
+        net_close(new_fd);
+        return -1;
+    }
+
+    memset(&srv->subs[new_fd], 0, sizeof(NET_SUB));
+    queues[new_fd].loop = srv->loop;
+    FD_SET(new_fd, &srv->master);
+    if (new_fd > srv->fdmax) {
+        srv->fdmax = new_fd;
+    }
+
+    return new_fd;
+} /* end net_server_accept() */
+
+
 /*------------------------------------------------------------------------------
  * int net_client_setup()
  * Creates socket connection between client and server. Establishes a socket with
@@ -63,28 +161,98 @@ int net_server_setup(short port)
 
 int net_client_setup(char *address, short port)
 {
+    struct sockaddr_in addr;
     int fd = -1;
 
-    /// Make each system call. Error checking is done within the following functions.
-    net_gethostbyname(address);
-    fd = net_socket();
-    fd = net_connect(fd, port);
+    /// Daemons on the same host can use shared memory instead of TCP.
+    if (strncmp(address, SHMBUS_ADDRESS, STRING_SIZE) == 0) {
+        return shmbus_open();
+    }
+
+    /// Look up the address once so reconnecting never blocks on DNS.
+    if (net_resolve(address, port, &addr) == -1) {
+        return -1;
+    }
+    if ((fd = net_socket()) == -1) {
+        return -1;
+    }
+    if (fd >= NET_MAX_FDS) {
+        printf("NET_CLIENT_SETUP: WARNING!!! Client fd %d is too large.\n", fd);
+        close(fd);
+        return -1;
+    }
+
+    memset(&conns[fd], 0, sizeof(NET_CONN));
+    conns[fd].active = TRUE;
+    conns[fd].addr = addr;
+    conns[fd].backoff = NET_BACKOFF_MIN;
+    conns[fd].timer = -1;
+
+    /// Start connecting. The fd is returned even if the server is not up yet.
+    net_connect(fd);
 
     return fd;
 } /* end net_client_setup() */
 
 
+/*------------------------------------------------------------------------------
+ * int net_server_request()
+ * Decodes a request from a client. Returns TRUE if the request was a
+ * subscription, in which case no reply is sent. A GAIN_GET request is answered
+ * with the gains in use.
+ *----------------------------------------------------------------------------*/
+
+static int net_server_request(NET_SERVER *srv, int fd, void *buf, MSG_DATA *msg,
+    int bytes)
+{
+    NET_SUB *sub = NULL;
+    OPEN *open = &msg->open.data;
+    GAIN_MSG gain = msg->gain;
+    int ii;
+
+    /// The OPEN message ID and the gain mode are set by messages_decode() when
+    /// one arrives.
+    msg->open.hdr.msgid = 0;
+    msg->gain.data.mode = 0;
+    messages_decode(fd, (char *)buf, msg, bytes);
+
+    /// GAIN_GET asks for the gains rather than setting them, so the gains in
+    /// use are put back and sent to the client.
+    if (msg->gain.data.mode == GAIN_GET) {
+        msg->gain = gain;
+        messages_send(fd, GAIN_MSGID, msg);
+    }
+
+    if (msg->open.hdr.msgid != OPEN_MSGID || fd >= NET_MAX_FDS) {
+        return FALSE;
+    }
+
+    sub = &srv->subs[fd];
+    memset(sub, 0, sizeof(NET_SUB));
+    sub->topics = open->topics;
+    for (ii = 0; ii < NET_MAX_MSGID && ii < OPEN_MAX_TOPICS; ii++) {
+        sub->period[ii] = (open->periods[ii] != 0) ? open->periods[ii] : open->period;
+        sub->decimate[ii] = (open->decimate[ii] > 1) ? open->decimate[ii] : 1;
+    }
+    if (open->delta > 0 && open->delta < NET_MAX_MSGID) {
+        sub->delta = open->delta;
+    }
+
+    return (sub->topics != 0);
+} /* end net_server_request() */
+
+
 /*------------------------------------------------------------------------------
  * int net_server()
  * Sends and receives data on network socket using TCP. Looks for new connections
- * and adds them to the master fd set.
+ * and adds them to the master fd set. Requests are decoded into msg here since
+ * each client has its own reassembly buffer.
  *----------------------------------------------------------------------------*/
 
-int net_server(int fd, void *buf, MSG_DATA *msg, int mode)
+int net_server(NET_SERVER *srv, void *buf, MSG_DATA *msg, int mode)
 {
 	/// Declare variables.
     int ii;
-    int new_fd;
     int recv_bytes = 0;
 
     struct timeval tv;
@@ -95,47 +263,44 @@ int net_server(int fd, void *buf, MSG_DATA *msg, int mode)
 
     /// Copy the master set into the read_fds set as read_fds gets modified by
     /// the FD_ISSET() system call. */
-    memcpy(&read_fds, &master, sizeof(master));
-    net_select(tv);
+    memcpy(&srv->read_fds, &srv->master, sizeof(srv->master));
+
+    /// Only look for writable sockets that have data queued.
+    FD_ZERO(&srv->write_fds);
+    for (ii = 0; ii <= srv->fdmax && ii < NET_MAX_FDS; ii++) {
+        if (FD_ISSET(ii, &srv->master) && queues[ii].active &&
+            queues[ii].stats.depth > 0) {
+            FD_SET(ii, &srv->write_fds);
+        }
+    }
+    net_select(srv, tv);
+
+    /// Send queued data to sockets that can take it.
+    for (ii = 0; ii <= srv->fdmax; ii++) {
+        if (FD_ISSET(ii, &srv->write_fds)) {
+            net_flush(ii);
+        }
+    }
 
     /// For each socket with data available read that data and then send UUV IMU data to it.
-    for (ii = 0; ii <= fdmax; ii++) {
-        if (FD_ISSET(ii, &read_fds)) { /// Check for data on sockets.
-            if (ii == fd) { /// Check if it is remote connection.
-                new_fd = net_accept(fd); /// Accept new connections.
-                FD_SET(new_fd, &master);
+    for (ii = 0; ii <= srv->fdmax; ii++) {
+        if (FD_ISSET(ii, &srv->read_fds)) { /// Check for data on sockets.
+            if (ii == srv->fd) { /// Check if it is remote connection.
+                net_server_accept(srv); /// Accept new connections.
             }
             else {
                 /// Get the data from the socket.
                 recv_bytes = net_recv(ii, buf);
                 if (recv_bytes == 0) {
 					/// Connection lost. Close socket.
-                    net_close(ii);
-                    FD_CLR(ii, &master);
+                    net_server_drop(srv, ii);
                 }
-                else {
-                    /// Send data to clients.
-                    if (mode == MODE_STATUS) {
-                    	messages_send(ii, STATUS_MSGID, msg);
-					}
-                    else if (mode == MODE_VISION) {
-                        messages_send(ii, VISION_MSGID, msg);
-                    }
-                    else if (mode == MODE_LJ) {
-                        messages_send(ii, LJ_MSGID, msg);
-                    }
-					/* This is a hack. Both messages should be sent at once.
-					 * messages_decode() should fix this but it's not working
-					 * yet. */
-                    else if (mode == MODE_PLANNER) {
-						if (hack_msg_num == 1) {
-							messages_send(ii, LJ_MSGID, msg);
-							hack_msg_num = 2;
-						}
-						else {
-							messages_send(ii, STATUS_MSGID, msg);
-							hack_msg_num = 1;
-						}
+                else if (recv_bytes > 0) {
+                    /// Decode the request using the buffer for this client
+                    /// and send data to it. Subscribed clients are sent data
+                    /// by net_server_publish() instead.
+                    if (!net_server_request(srv, ii, buf, msg, recv_bytes)) {
+                        net_server_reply(ii, msg, mode);
                     }
                 }
             }
@@ -146,6 +311,282 @@ int net_server(int fd, void *buf, MSG_DATA *msg, int mode)
 } /* end net_server() */
 
 
+/*------------------------------------------------------------------------------
+ * void net_server_reply()
+ * Sends the reply for a server mode to a client that has sent a request.
+ *----------------------------------------------------------------------------*/
+
+void net_server_reply(int fd, MSG_DATA *msg, int mode)
+{
+    if (mode == MODE_STATUS) {
+        messages_send(fd, STATUS_MSGID, msg);
+    }
+    else if (mode == MODE_VISION) {
+        messages_send(fd, VISION_MSGID, msg);
+    }
+    else if (mode == MODE_LJ) {
+        messages_send(fd, LJ_MSGID, msg);
+    }
+    else if (mode == MODE_PLANNER) {
+        /// Reply with the whole batch in one write.
+        messages_send_batch(fd, planner_reply, 2, msg);
+    }
+} /* end net_server_reply() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_server_client_cb()
+ * Event loop callback for a connected client. Reads and decodes the request,
+ * then sends the reply for the server mode.
+ *----------------------------------------------------------------------------*/
+
+static void net_server_client_cb(int fd, unsigned int events, void *arg)
+{
+    NET_SERVER *srv = (NET_SERVER *)arg;
+    int recv_bytes = 0;
+
+    /// Send queued data if the socket can take it.
+    if (events & EVLOOP_WRITE) {
+        net_flush(fd);
+    }
+    if (!(events & (EVLOOP_READ | EVLOOP_ERROR))) {
+        return;
+    }
+
+    recv_bytes = net_recv(fd, srv->buf);
+    if (recv_bytes == 0) {
+        /// Connection lost. Close socket.
+        net_server_drop(srv, fd);
+        return;
+    }
+    else if (recv_bytes < 0) {
+        return;
+    }
+
+    if (net_server_request(srv, fd, srv->buf, srv->msg, recv_bytes)) {
+        return;
+    }
+    if (srv->cb != NULL) {
+        srv->cb(fd, srv->msg, srv->arg);
+    }
+    net_server_reply(fd, srv->msg, srv->mode);
+} /* end net_server_client_cb() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_server_accept_cb()
+ * Event loop callback for the listening socket. Accepts the new connection and
+ * adds it to the event loop.
+ *----------------------------------------------------------------------------*/
+
+static void net_server_accept_cb(int fd, unsigned int events, void *arg)
+{
+    NET_SERVER *srv = (NET_SERVER *)arg;
+    int new_fd = -1;
+
+    if ((new_fd = net_server_accept(srv)) == -1) {
+        return;
+    }
+
+    if (evloop_add_fd(srv->loop, new_fd, EVLOOP_READ, net_server_client_cb, srv) == -1) {
+        printf("NET_SERVER_ACCEPT_CB: WARNING!!! Too many clients, closing fd %d.\n", new_fd);
+        FD_CLR(new_fd, &srv->master);
+        net_close(new_fd);
+    }
+} /* end net_server_accept_cb() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_server_add()
+ * Registers a server created by net_server_setup() with an event loop. This
+ * does the same work as net_server() but only runs when a socket is ready.
+ *----------------------------------------------------------------------------*/
+
+int net_server_add(EVLOOP *loop, NET_SERVER *srv, void *buf, MSG_DATA *msg, int mode,
+    NET_RECV_CB cb, void *arg)
+{
+    srv->loop = loop;
+    srv->buf  = buf;
+    srv->msg  = msg;
+    srv->mode = mode;
+    srv->cb   = cb;
+    srv->arg  = arg;
+
+    return evloop_add_fd(loop, srv->fd, EVLOOP_READ, net_server_accept_cb, srv);
+} /* end net_server_add() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_server_publish()
+ * Pushes a message to every subscribed client whose period has elapsed.
+ *----------------------------------------------------------------------------*/
+
+void net_server_publish(NET_SERVER *srv, int msgid, MSG_DATA *msg)
+{
+    NET_SUB *sub = NULL;
+    NET_BUF *b = NULL;
+    unsigned long long now = 0;
+    char scratch[NET_FRAME_SIZE];
+    char delta[NET_FRAME_SIZE];
+    char *data = NULL;
+    int len = 0;
+    int dlen = 0;
+    int ii;
+
+    if (msgid < 0 || msgid >= NET_MAX_MSGID) {
+        return;
+    }
+
+    now = timing_now();
+    for (ii = 0; ii <= srv->fdmax && ii < NET_MAX_FDS; ii++) {
+        sub = &srv->subs[ii];
+        if (!(sub->topics & MSG_TOPIC(msgid))) {
+            continue;
+        }
+
+        /// Skip messages until the client's decimation and period are met.
+        if (++sub->count[msgid] < sub->decimate[msgid]) {
+            continue;
+        }
+        /// A message that has never been sent is always due.
+        if (sub->last[msgid] != 0 &&
+            now - sub->last[msgid] < timing_s2ns(sub->period[msgid] * 0.001)) {
+            continue;
+        }
+        sub->count[msgid] = 0;
+
+        /// Encode once for the first client that is due. Every other client
+        /// is sent the same bytes and queues hold a reference to the buffer
+        /// instead of a copy.
+        if (data == NULL) {
+            b = net_buf_get();
+            data = (b != NULL) ? b->data : scratch;
+            if ((len = messages_encode(msgid, msg, data, NET_FRAME_SIZE)) <= 0) {
+                break;
+            }
+        }
+
+        sub->last[msgid] = now;
+
+        /// Deltas depend on what each client was sent last so they are built
+        /// for each client from the shared encoding. If one is dropped the
+        /// next is a keyframe.
+        if (sub->delta == msgid &&
+            (dlen = messages_encode_delta(&sub->stream, data, delta, NET_FRAME_SIZE)) > 0) {
+            if (net_send(ii, delta, dlen) == -1) {
+                sub->stream.len = 0;
+            }
+            continue;
+        }
+
+        if (queues[ii].active) {
+            net_queue_send(ii, data, len, b);
+        }
+        else {
+            net_send(ii, data, len);
+        }
+    }
+
+    if (b != NULL) {
+        net_buf_put(b);
+    }
+} /* end net_server_publish() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_subscribe_send()
+ * Sends a subscription request to a server.
+ *----------------------------------------------------------------------------*/
+
+static void net_subscribe_send(int fd, const OPEN *sub)
+{
+    MSG_DATA msg;
+
+    memset(&msg, 0, sizeof(MSG_DATA));
+    messages_init(&msg);
+    msg.open.data = *sub;
+    messages_send(fd, OPEN_MSGID, &msg);
+} /* end net_subscribe_send() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_subscribe()
+ * Asks a server to push messages to this client.
+ *----------------------------------------------------------------------------*/
+
+void net_subscribe(int fd, int topics, int period)
+{
+    OPEN sub;
+
+    memset(&sub, 0, sizeof(OPEN));
+    sub.topics = topics;
+    sub.period = period;
+
+    /// Remember the subscription so it can be sent again after a reconnect.
+    if (fd >= 0 && fd < NET_MAX_FDS && conns[fd].active) {
+        conns[fd].sub = sub;
+        if (conns[fd].state != NET_UP) {
+            return;
+        }
+    }
+
+    net_subscribe_send(fd, &sub);
+} /* end net_subscribe() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_subscribe_topic()
+ * Adds one message with its own rate to the subscription of a client.
+ *----------------------------------------------------------------------------*/
+
+int net_subscribe_topic(int fd, int msgid, int period, int decimate)
+{
+    OPEN *sub = NULL;
+
+    if (fd < 0 || fd >= NET_MAX_FDS || !conns[fd].active) {
+        return -1;
+    }
+    if (msgid < 0 || msgid >= OPEN_MAX_TOPICS || msgid >= NET_MAX_MSGID) {
+        return -1;
+    }
+    sub = &conns[fd].sub;
+
+    sub->topics |= MSG_TOPIC(msgid);
+    sub->periods[msgid] = period;
+    sub->decimate[msgid] = decimate;
+
+    /// The whole subscription is sent. It is sent again after a reconnect.
+    if (conns[fd].state == NET_UP) {
+        net_subscribe_send(fd, sub);
+    }
+
+    return 0;
+} /* end net_subscribe_topic() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_subscribe_delta()
+ * Asks for a subscribed message to be pushed as deltas.
+ *----------------------------------------------------------------------------*/
+
+int net_subscribe_delta(int fd, int msgid)
+{
+    if (fd < 0 || fd >= NET_MAX_FDS || !conns[fd].active) {
+        return -1;
+    }
+    if (msgid < 0 || msgid >= NET_MAX_MSGID) {
+        return -1;
+    }
+
+    conns[fd].sub.delta = msgid;
+    if (conns[fd].state == NET_UP && conns[fd].sub.topics != 0) {
+        net_subscribe_send(fd, &conns[fd].sub);
+    }
+
+    return 0;
+} /* end net_subscribe_delta() */
+
+
 /*------------------------------------------------------------------------------
  * int net_client()
  * Sends and receives data on network socket using TCP.
@@ -156,6 +597,16 @@ int net_client(int fd, void *buf, MSG_DATA *msg, int mode)
 	/// Declare variables.
     int recv_bytes = 0;
 
+    /// Nothing can be exchanged until the connection is up.
+    if (!net_client_check(fd)) {
+        return 0;
+    }
+
+    /// Data is pushed by the server so there is nothing to send.
+    if (mode == MODE_PUSH) {
+        return net_poll(fd, buf);
+    }
+
     /// Send and receive data for connected socket.
     if (mode == MODE_STATUS) {
         messages_send(fd, (int)STATUS_MSGID, msg);
@@ -164,21 +615,9 @@ int net_client(int fd, void *buf, MSG_DATA *msg, int mode)
         messages_send(fd, (int)TELEOP_MSGID, msg);
     }
     else if (mode == MODE_PLANNER) {
-    	if(hack_msg_num_client == 1) {
-			messages_send(fd, (int)TARGET_MSGID, msg);
-			hack_msg_num_client = 2;
-			usleep(1000);
-		}
-		else if (hack_msg_num_client == 2) {
-			messages_send(fd, (int)GAIN_MSGID, msg);
-			hack_msg_num_client = 3;
-			usleep(1000);
-		}
-		else {
-	    	messages_send(fd, (int)LJ_MSGID, msg);
-	    	hack_msg_num_client = 1;
-			usleep(1000);
-		}
+        /// Everything the planner sends goes out together so the server sees
+        /// all of it in the same cycle.
+        messages_send_batch(fd, planner_request, 3, msg);
 	}
 	else if (mode == MODE_OPEN) {
 		messages_send(fd, (int)OPEN_MSGID, msg);
@@ -288,11 +727,6 @@ void net_listen(int *fd)
     if (listen(*fd, NET_MAX_CLIENTS) == -1) {
         perror("listen");
     }
-
-    /// Add new connection to the master set.
-    FD_SET(*fd, &master);
-
-    fdmax = *fd;
 } /* end net_listen() */
 
 
@@ -331,8 +765,13 @@ int net_accept(int fd_orig)
         perror("accept");
     }
     else {
-        if (fd_ret > fdmax) {
-            fdmax = fd_ret;
+        /// The server must never block on a client so sends go through a
+        /// queue on a non-blocking socket.
+        net_setnonblock(&fd_ret);
+        if (fd_ret < NET_MAX_FDS) {
+            memset(&queues[fd_ret], 0, sizeof(NET_QUEUE));
+            queues[fd_ret].active = TRUE;
+            memset(seqs[fd_ret], 0, sizeof(seqs[fd_ret]));
         }
     }
 
@@ -347,21 +786,38 @@ int net_accept(int fd_orig)
 
 void net_close(int fd)
 {
+    messages_reset(fd);
+    if (fd >= 0 && fd < NET_MAX_FDS) {
+        net_queue_clear(&queues[fd]);
+        queues[fd].active = FALSE;
+        queues[fd].loop = NULL;
+        if (conns[fd].active) {
+            conns[fd].active = FALSE;
+            if (conns[fd].loop != NULL) {
+                evloop_del_fd(conns[fd].loop, conns[fd].timer);
+            }
+        }
+    }
+    if (shmbus_is_bus(fd)) {
+        shmbus_close(fd);
+        return;
+    }
     close(fd);
 } /* end net_close() */
 
 
 /*------------------------------------------------------------------------------
  * int net_select()
- * Determines whether data is available on network stack. The global variables
- * read_fds and tv are modified here by the select() system call.
+ * Determines whether data is available on network stack. The server's
+ * read_fds and write_fds sets and tv are modified here by the select() system
+ * call.
  *----------------------------------------------------------------------------*/
 
-int net_select(struct timeval tv)
+int net_select(NET_SERVER *srv, struct timeval tv)
 {
     int retval = 0;
 
-    if ((retval = select(fdmax + 1, &read_fds, NULL, NULL, &tv) == -1)) {
+    if ((retval = select(srv->fdmax + 1, &srv->read_fds, &srv->write_fds, NULL, &tv) == -1)) {
         perror("select");
     }
 
@@ -370,75 +826,884 @@ int net_select(struct timeval tv)
 
 
 /*------------------------------------------------------------------------------
- * void net_gethostbyname()
- * Gets the host network information.
+ * int net_resolve()
+ * Looks up the address of a server.
  *----------------------------------------------------------------------------*/
 
-void net_gethostbyname(char *address)
+int net_resolve(char *address, short port, struct sockaddr_in *addr)
 {
-    if ((hent = gethostbyname(address)) == NULL) {
-        herror("gethostbyname");
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    char service[STRING_SIZE];
+    int status = 0;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, STRING_SIZE, "%d", (unsigned short)port);
+
+    if ((status = getaddrinfo(address, service, &hints, &res)) != 0) {
+        printf("NET_RESOLVE: WARNING!!! %s: %s\n", address, gai_strerror(status));
+        return -1;
     }
-} /* end net_gethostbyname() */
+    memcpy(addr, res->ai_addr, sizeof(struct sockaddr_in));
+    freeaddrinfo(res);
+
+    return 0;
+} /* end net_resolve() */
 
 
 /*------------------------------------------------------------------------------
- * int net_connect()
- * Connects a client TCP port to a server TCP port.
+ * void net_client_up()
+ * Called when a client connection is made. Any subscription is sent.
  *----------------------------------------------------------------------------*/
 
-int net_connect(int fd, short port)
+static void net_client_up(int fd)
 {
-    struct sockaddr_in their_addr;
+    NET_CONN *conn = &conns[fd];
+
+    /// The socket stays non-blocking so the thread running the event loop
+    /// never waits on it. A read returns what has arrived and
+    /// messages_decode() keeps a partial message until the rest of it comes
+    /// in. Sends go through a queue as they do for server connections so a
+    /// message the socket only partly takes is finished later.
+    memset(&queues[fd], 0, sizeof(NET_QUEUE));
+    queues[fd].active = TRUE;
+    memset(seqs[fd], 0, sizeof(seqs[fd]));
+
+    conn->state = NET_UP;
+    conn->backoff = NET_BACKOFF_MIN;
+    if (++conn->connects > 1) {
+        printf("NET: Reconnected fd %d.\n", fd);
+    }
 
-    /// Set socket parameters.
-    memset(&their_addr, 0, sizeof(struct sockaddr_in));
-    their_addr.sin_family = AF_INET;
-    their_addr.sin_addr = *((struct in_addr *)hent->h_addr);
-    their_addr.sin_port = htons(port);
-
-    if (connect(fd, (struct sockaddr *)&their_addr, sizeof(struct sockaddr_in)) == -1) {
-        perror("connect");
-        net_close(fd);
-        return -1;
+    if (conn->sub.topics != 0) {
+        net_subscribe_send(fd, &conn->sub);
     }
 
-    return fd;
-} /* end net_connect() */
+    if (conn->loop != NULL) {
+        evloop_add_fd(conn->loop, fd, EVLOOP_READ, conn->cb, conn->arg);
+        evloop_set_timer(conn->timer, 0);
+    }
+} /* end net_client_up() */
 
 
 /*------------------------------------------------------------------------------
- * int net_send()
- * Sends data on network socket using TCP.
+ * void net_client_down()
+ * Called when a client connection fails or is lost. The next attempt is
+ * scheduled after the backoff time. The fd is left open so its number is not
+ * reused before the new socket is put in its place.
  *----------------------------------------------------------------------------*/
 
-int net_send(int fd, const void *msg, int len)
+static void net_client_down(int fd)
 {
-    int send_bytes = 0;
+    NET_CONN *conn = &conns[fd];
 
-    if ((send_bytes = send(fd, msg, len, 0)) == -1) {
-        perror("send");
+    if (conn->state == NET_UP) {
+        printf("NET: WARNING!!! Lost connection on fd %d, reconnecting.\n", fd);
+    }
+    conn->state = NET_DOWN;
+    conn->failures++;
+    net_queue_clear(&queues[fd]);
+    queues[fd].active = FALSE;
+    conn->next_try = timing_now() + timing_s2ns(conn->backoff * 0.001);
+    conn->backoff *= 2;
+    if (conn->backoff > NET_BACKOFF_MAX) {
+        conn->backoff = NET_BACKOFF_MAX;
     }
 
-    return send_bytes;
-} /* end net_send() */
+    /// Data from the old connection is no use.
+    messages_reset(fd);
+
+    if (conn->loop != NULL) {
+        evloop_del_fd(conn->loop, fd);
+        evloop_set_timer(conn->timer, NET_RETRY_PERIOD);
+    }
+} /* end net_client_down() */
 
 
 /*------------------------------------------------------------------------------
- * int net_recv()
- * Receives data on network socket using TCP.
+ * void net_client_lost()
+ * Marks a client connection as lost if fd is a client that was up.
  *----------------------------------------------------------------------------*/
 
-int net_recv(int fd, void *buf)
+static void net_client_lost(int fd)
 {
-    int recv_bytes;
+    if (fd >= 0 && fd < NET_MAX_FDS && conns[fd].active && conns[fd].state == NET_UP) {
+        net_client_down(fd);
+    }
+} /* end net_client_lost() */
 
-    if ((recv_bytes = recv(fd, buf, MAX_MSG_SIZE, 0)) == -1) {
-        if (errno != EWOULDBLOCK) {
-            perror("recv");
-            return 0;
-        }
+
+/*------------------------------------------------------------------------------
+ * int net_connect()
+ * Starts a non-blocking connect for a client.
+ *----------------------------------------------------------------------------*/
+
+int net_connect(int fd)
+{
+    NET_CONN *conn = &conns[fd];
+
+    net_setnonblock(&fd);
+    if (connect(fd, (struct sockaddr *)&conn->addr, sizeof(struct sockaddr_in)) == 0) {
+        net_client_up(fd);
+    }
+    else if (errno == EINPROGRESS) {
+        conn->state = NET_CONNECTING;
+        conn->next_try = timing_now() + timing_s2ns(NET_CONNECT_TIMEOUT * 0.001);
+    }
+    else {
+        net_client_down(fd);
     }
 
-    return recv_bytes;
-} /* end net_recv() */
+    return conn->state;
+} /* end net_connect() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_client_check()
+ * Makes progress on a client connection without blocking.
+ *----------------------------------------------------------------------------*/
+
+int net_client_check(int fd)
+{
+    NET_CONN *conn = NULL;
+    struct pollfd pfd;
+    socklen_t len = sizeof(int);
+    int error = 0;
+    int new_fd = -1;
+
+    if (fd < 0) {
+        return FALSE;
+    }
+    if (fd >= NET_MAX_FDS || !conns[fd].active) {
+        return TRUE;
+    }
+    conn = &conns[fd];
+
+    switch (conn->state) {
+    case NET_UP:
+        /// Sends that the socket could not take are finished here.
+        if (queues[fd].error) {
+            net_client_down(fd);
+            return FALSE;
+        }
+        net_flush(fd);
+        return TRUE;
+
+    case NET_CONNECTING:
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) == 0) {
+            /// Still connecting. Give up on it if it is taking too long.
+            if (timing_deadline_passed(conn->next_try)) {
+                net_client_down(fd);
+            }
+            return FALSE;
+        }
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error != 0) {
+            net_client_down(fd);
+            return FALSE;
+        }
+        net_client_up(fd);
+        return TRUE;
+
+    case NET_DOWN:
+        if (!timing_deadline_passed(conn->next_try)) {
+            return FALSE;
+        }
+
+        /// Put a new socket in place of the old one so callers keep the same
+        /// fd.
+        if ((new_fd = net_socket()) == -1) {
+            net_client_down(fd);
+            return FALSE;
+        }
+        if (dup2(new_fd, fd) == -1) {
+            perror("dup2");
+            close(new_fd);
+            net_client_down(fd);
+            return FALSE;
+        }
+        close(new_fd);
+        return (net_connect(fd) == NET_UP);
+    }
+
+    return FALSE;
+} /* end net_client_check() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_client_state()
+ * Gets the state of a client connection.
+ *----------------------------------------------------------------------------*/
+
+int net_client_state(int fd)
+{
+    if (fd < 0) {
+        return NET_DOWN;
+    }
+    if (fd >= NET_MAX_FDS || !conns[fd].active) {
+        return NET_UP;
+    }
+
+    return conns[fd].state;
+} /* end net_client_state() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_client_retry_cb()
+ * Event loop timer that retries a client connection while it is down.
+ *----------------------------------------------------------------------------*/
+
+static void net_client_retry_cb(int fd, unsigned int expirations, void *arg)
+{
+    net_client_check((int)(long)arg);
+} /* end net_client_retry_cb() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_client_watch()
+ * Keeps a client registered with an event loop across reconnects.
+ *----------------------------------------------------------------------------*/
+
+int net_client_watch(EVLOOP *loop, int fd, EVLOOP_CB cb, void *arg)
+{
+    NET_CONN *conn = NULL;
+
+    if (fd < 0 || fd >= NET_MAX_FDS || !conns[fd].active) {
+        return evloop_add_fd(loop, fd, EVLOOP_READ, cb, arg);
+    }
+    conn = &conns[fd];
+
+    conn->loop = loop;
+    conn->cb = cb;
+    conn->arg = arg;
+    if ((conn->timer = evloop_add_timer(loop, NET_RETRY_PERIOD, net_client_retry_cb,
+        (void *)(long)fd)) == -1) {
+        return -1;
+    }
+
+    if (conn->state == NET_UP) {
+        evloop_set_timer(conn->timer, 0);
+        return evloop_add_fd(loop, fd, EVLOOP_READ, cb, arg);
+    }
+
+    return 0;
+} /* end net_client_watch() */
+
+
+/*------------------------------------------------------------------------------
+ * NET_BUF *net_buf_get()
+ * Claims a free buffer from the pool with one reference held by the caller.
+ *----------------------------------------------------------------------------*/
+
+static NET_BUF *net_buf_get()
+{
+    NET_BUF *b = NULL;
+    unsigned int start = 0;
+    int refs = 0;
+    int ii;
+
+    /// Start after the last buffer claimed so a search usually ends at once.
+    start = __atomic_fetch_add(&buf_next, 1, __ATOMIC_RELAXED);
+    for (ii = 0; ii < NET_BUF_COUNT; ii++) {
+        b = &bufs[(start + ii) % NET_BUF_COUNT];
+        refs = 0;
+        if (__atomic_load_n(&b->refs, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&b->refs, &refs, 1, FALSE,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&buf_next, start + ii + 1, __ATOMIC_RELAXED);
+            return b;
+        }
+    }
+
+    return NULL;
+} /* end net_buf_get() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_buf_hold()
+ * Adds a reference to a buffer.
+ *----------------------------------------------------------------------------*/
+
+static void net_buf_hold(NET_BUF *b)
+{
+    __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+} /* end net_buf_hold() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_buf_put()
+ * Releases a reference to a buffer. The last release returns it to the pool.
+ *----------------------------------------------------------------------------*/
+
+static void net_buf_put(NET_BUF *b)
+{
+    __atomic_sub_fetch(&b->refs, 1, __ATOMIC_RELEASE);
+} /* end net_buf_put() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_queue_clear()
+ * Drops every queued message and releases its buffer.
+ *----------------------------------------------------------------------------*/
+
+static void net_queue_clear(NET_QUEUE *q)
+{
+    NET_FRAME *f = NULL;
+    int ii;
+
+    for (ii = 0; ii < q->stats.depth; ii++) {
+        f = &q->frames[(q->head + ii) % NET_QUEUE_LEN];
+        if (f->buf != NULL) {
+            net_buf_put(f->buf);
+            f->buf = NULL;
+        }
+    }
+    q->stats.depth = 0;
+    q->head = 0;
+    q->offset = 0;
+} /* end net_queue_clear() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_policy()
+ * Gets the queue policy for a message type.
+ *----------------------------------------------------------------------------*/
+
+static int net_policy(int msgid)
+{
+    if (msgid >= 0 && msgid < NET_MAX_MSGID && policies[msgid] != NET_POLICY_DEFAULT) {
+        return policies[msgid];
+    }
+
+    /// Telemetry is only useful while it is current.
+    switch (msgid) {
+    case STATUS_MSGID:
+    case LJ_MSGID:
+    case VISION_MSGID:
+    case MSTRAIN_MSGID:
+        return NET_POLICY_LATEST;
+    }
+
+    return NET_POLICY_FIFO;
+} /* end net_policy() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_set_policy()
+ * Sets the queue policy for a message type.
+ *----------------------------------------------------------------------------*/
+
+void net_set_policy(int msgid, int policy)
+{
+    if (msgid >= 0 && msgid < NET_MAX_MSGID) {
+        policies[msgid] = policy;
+    }
+} /* end net_set_policy() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_enqueue()
+ * Adds a message to the queue for a connection. The first sent bytes of the
+ * message have already been written to the socket. If b is not NULL it holds
+ * the message and is shared, otherwise the message is copied into a new
+ * buffer. seq is the sequence number it is sent with.
+ *----------------------------------------------------------------------------*/
+
+static int net_enqueue(NET_QUEUE *q, const void *msg, int len, int sent,
+    unsigned int seq, NET_BUF *b)
+{
+    NET_FRAME *f = NULL;
+    NET_FRAME *old = NULL;
+    int msgid = MSG_WIRE_ID(msg);
+    int first = 0;
+    int ii;
+
+    /// Replace an older message of the same type that has not started sending.
+    if (sent == 0 && net_policy(msgid) == NET_POLICY_LATEST) {
+        first = (q->offset > 0) ? 1 : 0;
+        for (ii = first; ii < q->stats.depth; ii++) {
+            f = &q->frames[(q->head + ii) % NET_QUEUE_LEN];
+            if (f->msgid == msgid && f->len == len) {
+                old = f;
+                break;
+            }
+        }
+    }
+
+    if ((old == NULL && q->stats.depth == NET_QUEUE_LEN) || len > NET_FRAME_SIZE) {
+        q->stats.dropped++;
+        return -1;
+    }
+
+    if (b != NULL) {
+        net_buf_hold(b);
+    }
+    else if ((b = net_buf_get()) != NULL) {
+        memcpy(b->data, msg, len);
+    }
+    else {
+        printf("NET_ENQUEUE: WARNING!!! No free buffers.\n");
+        q->stats.dropped++;
+        return -1;
+    }
+
+    /// The older buffer may still be queued to other clients so the frame is
+    /// pointed at the new one instead of copying over it. The older message
+    /// never goes out so the receiver sees a gap in the sequence numbers.
+    if (old != NULL) {
+        net_buf_put(old->buf);
+        old->buf = b;
+        old->seq = seq;
+        q->stats.replaced++;
+        return len;
+    }
+
+    f = &q->frames[(q->head + q->stats.depth) % NET_QUEUE_LEN];
+    f->msgid = msgid;
+    f->len = len;
+    f->seq = seq;
+    f->buf = b;
+    if (q->stats.depth == 0) {
+        q->offset = sent;
+    }
+    q->stats.depth++;
+    if (q->stats.depth > q->stats.max_depth) {
+        q->stats.max_depth = q->stats.depth;
+    }
+
+    return len;
+} /* end net_enqueue() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_queue_send()
+ * Sends a message on a connection without blocking. If the socket
+ * cannot take all of it the rest is queued. b is the shared buffer holding
+ * msg, or NULL if msg has to be copied to be queued.
+ *----------------------------------------------------------------------------*/
+
+static int net_queue_send(int fd, const void *msg, int len, NET_BUF *b)
+{
+    NET_QUEUE *q = &queues[fd];
+    unsigned int seq = net_seq(fd, msg, len);
+    int send_bytes = 0;
+
+    if (q->error) {
+        q->stats.dropped++;
+        return -1;
+    }
+
+    /// Keep messages in order behind anything already queued.
+    if (q->stats.depth > 0) {
+        len = net_enqueue(q, msg, len, 0, seq, b);
+        net_flush(fd);
+        return len;
+    }
+
+    send_bytes = net_send_stamped(fd, msg, len, 0, seq, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (send_bytes == len) {
+        q->stats.sent++;
+        return len;
+    }
+    if (send_bytes == -1) {
+        if (errno != EWOULDBLOCK && errno != EAGAIN) {
+            perror("send");
+            q->error = TRUE;
+            return -1;
+        }
+        send_bytes = 0;
+    }
+
+    len = net_enqueue(q, msg, len, send_bytes, seq, b);
+    if (q->loop != NULL) {
+        evloop_mod_fd(q->loop, fd, EVLOOP_READ | EVLOOP_WRITE);
+    }
+
+    return len;
+} /* end net_queue_send() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_flush()
+ * Sends queued messages until the socket would block.
+ *----------------------------------------------------------------------------*/
+
+int net_flush(int fd)
+{
+    NET_QUEUE *q = NULL;
+    NET_FRAME *f = NULL;
+    int send_bytes = 0;
+
+    if (fd < 0 || fd >= NET_MAX_FDS || !queues[fd].active) {
+        return 0;
+    }
+    q = &queues[fd];
+
+    while (q->stats.depth > 0) {
+        f = &q->frames[q->head];
+        send_bytes = net_send_stamped(fd, f->buf->data, f->len, q->offset, f->seq,
+            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (send_bytes == -1) {
+            if (errno != EWOULDBLOCK && errno != EAGAIN) {
+                /// The client is gone. Drop what is queued, the connection is
+                /// closed when its read returns 0.
+                perror("send");
+                q->error = TRUE;
+                q->stats.dropped += q->stats.depth;
+                net_queue_clear(q);
+            }
+            break;
+        }
+
+        q->offset += send_bytes;
+        if (q->offset == f->len) {
+            net_buf_put(f->buf);
+            f->buf = NULL;
+            q->head = (q->head + 1) % NET_QUEUE_LEN;
+            q->offset = 0;
+            q->stats.depth--;
+            q->stats.sent++;
+        }
+    }
+
+    /// Only watch for writable when there is something to write.
+    if (q->loop != NULL) {
+        evloop_mod_fd(q->loop, fd, (q->stats.depth > 0) ?
+            (EVLOOP_READ | EVLOOP_WRITE) : EVLOOP_READ);
+    }
+
+    return q->stats.depth;
+} /* end net_flush() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_get_stats()
+ * Gets the queue counters for a server connection.
+ *----------------------------------------------------------------------------*/
+
+int net_get_stats(int fd, NET_STATS *stats)
+{
+    if (fd < 0 || fd >= NET_MAX_FDS || !queues[fd].active) {
+        return -1;
+    }
+
+    *stats = queues[fd].stats;
+
+    return 0;
+} /* end net_get_stats() */
+
+
+/*------------------------------------------------------------------------------
+ * void net_print_stats()
+ * Prints the queue counters for every connection.
+ *----------------------------------------------------------------------------*/
+
+void net_print_stats()
+{
+    NET_STATS *st = NULL;
+    int used = 0;
+    int ii;
+
+    for (ii = 0; ii < NET_MAX_FDS; ii++) {
+        if (!queues[ii].active) {
+            continue;
+        }
+        st = &queues[ii].stats;
+        printf("NET: fd %d queue %d/%d max %d sent %u dropped %u replaced %u\n",
+            ii, st->depth, NET_QUEUE_LEN, st->max_depth, st->sent, st->dropped,
+            st->replaced);
+    }
+
+    for (ii = 0; ii < NET_BUF_COUNT; ii++) {
+        if (__atomic_load_n(&bufs[ii].refs, __ATOMIC_RELAXED) > 0) {
+            used++;
+        }
+    }
+    printf("NET: %d/%d shared buffers in use\n", used, NET_BUF_COUNT);
+} /* end net_print_stats() */
+
+
+/*------------------------------------------------------------------------------
+ * unsigned int net_seq()
+ * Gets the sequence number for a message being handed to a connection. The
+ * numbers count each message type sent on one connection, so a receiver only
+ * sees a gap when a message meant for it was dropped and not when it was
+ * skipped for its rate or sent to someone else. 0 is returned for data that
+ * is not a message and is never given out otherwise.
+ *----------------------------------------------------------------------------*/
+
+static unsigned int net_seq(int fd, const void *msg, int len)
+{
+    const unsigned char *wire = (const unsigned char *)msg;
+    int msgid = 0;
+
+    if (fd < 0 || fd >= NET_MAX_FDS || len < MSG_HDR_SIZE || wire[0] != MSG_START) {
+        return 0;
+    }
+
+    /// A delta is counted as the message it carries.
+    msgid = (wire[1] == DELTA_MSGID && len > MSG_HDR_SIZE) ? wire[MSG_HDR_SIZE] : wire[1];
+    if (msgid >= NET_MAX_MSGID) {
+        return 0;
+    }
+
+    if (++seqs[fd][msgid] == 0) {
+        seqs[fd][msgid] = 1;
+    }
+
+    return seqs[fd][msgid];
+} /* end net_seq() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_stamp()
+ * Fills in iov to send a message from offset with its sequence number. The
+ * message may be in a buffer shared by several connections so the number goes
+ * in a copy of the header. Returns the number of iov entries used.
+ *----------------------------------------------------------------------------*/
+
+static int net_stamp(const void *msg, int len, int offset, unsigned int seq,
+    unsigned char *hdr, struct iovec *iov)
+{
+    int n = 0;
+    int ii;
+
+    if (seq != 0 && offset < MSG_HDR_SIZE) {
+        memcpy(hdr, msg, MSG_HDR_SIZE);
+        for (ii = 0; ii < 4; ii++) {
+            hdr[MSG_SEQ_OFFSET + ii] = (seq >> (8 * (3 - ii))) & 0xff;
+        }
+        iov[n].iov_base = hdr + offset;
+        iov[n].iov_len = MSG_HDR_SIZE - offset;
+        n++;
+        offset = MSG_HDR_SIZE;
+    }
+    if (offset < len) {
+        iov[n].iov_base = (char *)msg + offset;
+        iov[n].iov_len = len - offset;
+        n++;
+    }
+
+    return n;
+} /* end net_stamp() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_send_stamped()
+ * Sends a message from offset with its sequence number.
+ *----------------------------------------------------------------------------*/
+
+static int net_send_stamped(int fd, const void *msg, int len, int offset,
+    unsigned int seq, int flags)
+{
+    unsigned char hdr[MSG_HDR_SIZE];
+    struct iovec iov[2];
+    struct msghdr mh;
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = net_stamp(msg, len, offset, seq, hdr, iov);
+
+    return sendmsg(fd, &mh, flags);
+} /* end net_send_stamped() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_send()
+ * Sends data on network socket using TCP.
+ *----------------------------------------------------------------------------*/
+
+int net_send(int fd, const void *msg, int len)
+{
+    int send_bytes = 0;
+
+    /// Publish to shared memory if this is a bus handle.
+    if (shmbus_is_bus(fd)) {
+        return shmbus_write(fd, msg, len);
+    }
+
+    if (!net_client_check(fd)) {
+        return -1;
+    }
+
+    /// Server and client connections never block.
+    if (fd >= 0 && fd < NET_MAX_FDS && queues[fd].active) {
+        return net_queue_send(fd, msg, len, NULL);
+    }
+
+    /// Don't raise SIGPIPE if a client has gone away. The error is reported
+    /// here and the connection is closed when its read returns 0.
+    send_bytes = net_send_stamped(fd, msg, len, 0, net_seq(fd, msg, len), MSG_NOSIGNAL);
+    if (send_bytes == -1) {
+        perror("send");
+        net_client_lost(fd);
+    }
+
+    return send_bytes;
+} /* end net_send() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_sendv()
+ * Sends several messages on network socket using one sendmsg() call, which is
+ * writev() with flags.
+ *----------------------------------------------------------------------------*/
+
+int net_sendv(int fd, const struct iovec *iov, int count)
+{
+    NET_QUEUE *q = NULL;
+    struct msghdr mh;
+    struct iovec wire[2 * MSG_BATCH_MAX];
+    unsigned char hdrs[MSG_BATCH_MAX][MSG_HDR_SIZE];
+    unsigned int seq[MSG_BATCH_MAX];
+    int send_bytes = 0;
+    int total = 0;
+    int len = 0;
+    int ii;
+
+    for (ii = 0; ii < count; ii++) {
+        total += iov[ii].iov_len;
+    }
+
+    /// The bus carries one message per topic.
+    if (shmbus_is_bus(fd)) {
+        for (ii = 0; ii < count; ii++) {
+            if (shmbus_write(fd, iov[ii].iov_base, iov[ii].iov_len) == -1) {
+                return -1;
+            }
+        }
+        return total;
+    }
+
+    if (count > MSG_BATCH_MAX) {
+        printf("NET_SENDV: WARNING!!! Cannot send %d messages at once.\n", count);
+        return -1;
+    }
+
+    if (!net_client_check(fd)) {
+        return -1;
+    }
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = wire;
+    for (ii = 0; ii < count; ii++) {
+        seq[ii] = net_seq(fd, iov[ii].iov_base, iov[ii].iov_len);
+        mh.msg_iovlen += net_stamp(iov[ii].iov_base, iov[ii].iov_len, 0, seq[ii],
+            hdrs[ii], wire + mh.msg_iovlen);
+    }
+
+    /// Only sockets without a queue block until everything is sent.
+    if (fd < 0 || fd >= NET_MAX_FDS || !queues[fd].active) {
+        if ((send_bytes = sendmsg(fd, &mh, MSG_NOSIGNAL)) == -1) {
+            perror("sendmsg");
+            net_client_lost(fd);
+        }
+        return send_bytes;
+    }
+
+    q = &queues[fd];
+    if (q->error) {
+        q->stats.dropped += count;
+        return -1;
+    }
+
+    /// Keep messages in order behind anything already queued.
+    if (q->stats.depth == 0) {
+        send_bytes = sendmsg(fd, &mh, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (send_bytes == -1) {
+            if (errno != EWOULDBLOCK && errno != EAGAIN) {
+                perror("sendmsg");
+                q->error = TRUE;
+                return -1;
+            }
+            send_bytes = 0;
+        }
+    }
+
+    /// Queue whatever the socket did not take, including the end of a
+    /// message that was only partly sent.
+    for (ii = 0; ii < count; ii++) {
+        len = iov[ii].iov_len;
+        if (send_bytes >= len) {
+            send_bytes -= len;
+            q->stats.sent++;
+            continue;
+        }
+        net_enqueue(q, iov[ii].iov_base, len, send_bytes, seq[ii], NULL);
+        send_bytes = 0;
+    }
+    net_flush(fd);
+
+    return total;
+} /* end net_sendv() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_recv()
+ * Receives data on network socket using TCP.
+ *----------------------------------------------------------------------------*/
+
+int net_recv(int fd, void *buf)
+{
+    int recv_bytes;
+
+    /// Read changed topics from shared memory if this is a bus handle. This
+    /// never blocks and returns 0 if nothing has changed.
+    if (shmbus_is_bus(fd)) {
+        return shmbus_read(fd, buf, MAX_MSG_SIZE);
+    }
+
+    if (!net_client_check(fd)) {
+        return -1;
+    }
+
+    if ((recv_bytes = recv(fd, buf, MAX_MSG_SIZE, 0)) == -1) {
+        if (errno != EWOULDBLOCK && errno != EAGAIN) {
+            perror("recv");
+            recv_bytes = 0;
+        }
+    }
+
+    /// A client connection is reopened in the background.
+    if (recv_bytes == 0) {
+        net_client_lost(fd);
+    }
+
+    return recv_bytes;
+} /* end net_recv() */
+
+
+/*------------------------------------------------------------------------------
+ * int net_poll()
+ * Receives data on network socket without blocking.
+ *----------------------------------------------------------------------------*/
+
+int net_poll(int fd, void *buf)
+{
+    int recv_bytes;
+
+    if (shmbus_is_bus(fd)) {
+        return shmbus_read(fd, buf, MAX_MSG_SIZE);
+    }
+
+    if (!net_client_check(fd)) {
+        return 0;
+    }
+
+    if ((recv_bytes = recv(fd, buf, MAX_MSG_SIZE, MSG_DONTWAIT)) == -1) {
+        if (errno != EWOULDBLOCK && errno != EAGAIN) {
+            perror("recv");
+            net_client_lost(fd);
+        }
+        return 0;
+    }
+    if (recv_bytes == 0) {
+        net_client_lost(fd);
+    }
+
+    return recv_bytes;
+} /* end net_poll() */
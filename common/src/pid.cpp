@@ -9,9 +9,31 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 #include <math.h>
 
 #include "pid.h"
+#include "trace.h"
+
+/// Axis whose time step each axis uses. Surge and sway run with yaw since they
+/// only feed the Voiths.
+static const int pid_clock[PID_AXES] = {0, PID_PITCH, PID_ROLL, PID_YAW, PID_DEPTH, PID_YAW, PID_YAW};
+
+
+/*------------------------------------------------------------------------------
+ * float pid_bound()
+ * Bounds a value to +/- bound.
+ *----------------------------------------------------------------------------*/
+
+static float pid_bound(float value, float bound)
+{
+	if (fabsf(value) > bound) {
+		return util_sign_value(value) * bound;
+	}
+
+	return value;
+} /* end pid_bound() */
+
 
 /*------------------------------------------------------------------------------
  * void pid_init()
@@ -20,328 +42,495 @@
 
 int pid_init(PID *pid, CONF_VARS *cf)
 {
-	pid->pitch.ref		= cf->target_pitch;
-	pid->pitch.kp		= cf->kp_pitch;
-	pid->pitch.ki		= cf->ki_pitch;
-	pid->pitch.kd		= cf->kd_pitch;
-	pid->pitch.period	= cf->period_pitch;
-
-	pid->roll.ref		= cf->target_roll;
-	pid->roll.kp		= cf->kp_roll;
-	pid->roll.ki		= cf->ki_roll;
-	pid->roll.kd		= cf->kd_roll;
-	pid->roll.period	= cf->period_roll;
-
-	pid->yaw.ref		= cf->target_yaw;
-	pid->yaw.kp			= cf->kp_yaw;
-	pid->yaw.ki			= cf->ki_yaw;
-	pid->yaw.kd			= cf->kd_yaw;
-	pid->yaw.period		= cf->period_yaw;
-
-	pid->depth.ref		= cf->target_depth;
-	pid->depth.kp		= cf->kp_depth;
-	pid->depth.ki		= cf->ki_depth;
-	pid->depth.kd		= cf->kd_depth;
-	pid->depth.period	= cf->period_depth;
-
-	pid->fx.ref			= cf->target_fx;
-	pid->fx.kp			= cf->kp_fx;
-	pid->fx.ki			= cf->ki_fx;
-	pid->fx.kd			= cf->kd_fx;
-
-	pid->fy.ref			= cf->target_fy;
-	pid->fy.kp			= cf->kp_fy;
-	pid->fy.ki			= cf->ki_fy;
-	pid->fy.kd			= cf->kd_fy;
+	int ii;
+
+	memset(pid, 0, sizeof(PID));
+
+	pid->ref[PID_PITCH]		= cf->target_pitch;
+	pid->kp[PID_PITCH]		= cf->kp_pitch;
+	pid->ki[PID_PITCH]		= cf->ki_pitch;
+	pid->kd[PID_PITCH]		= cf->kd_pitch;
+	pid->period[PID_PITCH]	= cf->period_pitch;
+	pid->ilimit[PID_PITCH]	= PID_PITCH_INTEGRAL;
+	pid->olimit[PID_PITCH]	= PID_PITCH_TORQUE;
+	pid->angle[PID_PITCH]	= TRUE;
+	pid->has_rate[PID_PITCH] = TRUE;
+
+	pid->ref[PID_ROLL]		= cf->target_roll;
+	pid->kp[PID_ROLL]		= cf->kp_roll;
+	pid->ki[PID_ROLL]		= cf->ki_roll;
+	pid->kd[PID_ROLL]		= cf->kd_roll;
+	pid->period[PID_ROLL]	= cf->period_roll;
+	pid->ilimit[PID_ROLL]	= PID_ROLL_INTEGRAL;
+	pid->olimit[PID_ROLL]	= PID_ROLL_TORQUE;
+	pid->angle[PID_ROLL]	= TRUE;
+	pid->has_rate[PID_ROLL]	= TRUE;
+
+	pid->ref[PID_YAW]		= cf->target_yaw;
+	pid->kp[PID_YAW]		= cf->kp_yaw;
+	pid->ki[PID_YAW]		= cf->ki_yaw;
+	pid->kd[PID_YAW]		= cf->kd_yaw;
+	pid->period[PID_YAW]	= cf->period_yaw;
+	pid->ilimit[PID_YAW]	= PID_YAW_INTEGRAL;
+	pid->olimit[PID_YAW]	= POLOLU_MAX_YAW_TORQUE;
+	pid->angle[PID_YAW]		= TRUE;
+	pid->has_rate[PID_YAW]	= TRUE;
+
+	pid->ref[PID_DEPTH]		= cf->target_depth;
+	pid->kp[PID_DEPTH]		= cf->kp_depth;
+	pid->ki[PID_DEPTH]		= cf->ki_depth;
+	pid->kd[PID_DEPTH]		= cf->kd_depth;
+	pid->period[PID_DEPTH]	= cf->period_depth;
+	pid->ilimit[PID_DEPTH]	= PID_DEPTH_INTEGRAL;
+	pid->olimit[PID_DEPTH]	= PID_TOTAL_VERTICAL_THRUST;
+
+	pid->ref[PID_SWAY]		= cf->target_fx;
+	pid->kp[PID_SWAY]		= cf->kp_fx;
+	pid->ki[PID_SWAY]		= cf->ki_fx;
+	pid->kd[PID_SWAY]		= cf->kd_fx;
+	pid->ilimit[PID_SWAY]	= PID_FX_INTEGRAL;
+	pid->olimit[PID_SWAY]	= PID_TOTAL_FX_THRUST;
+
+	pid->ref[PID_SURGE]		= cf->target_fy;
+	pid->kp[PID_SURGE]		= cf->kp_fy;
+	pid->ki[PID_SURGE]		= cf->ki_fy;
+	pid->kd[PID_SURGE]		= cf->kd_fy;
+	pid->ilimit[PID_SURGE]	= PID_FY_INTEGRAL;
+	pid->olimit[PID_SURGE]	= PID_TOTAL_FY_THRUST;
 
 	pid->kp_roll_lateral  = cf->kp_roll_lateral;
 	pid->kp_depth_forward = cf->kp_depth_forward;
 	pid->kp_place_holder  = cf->kp_place_holder;
 
-	pid->voith_angle	= 0;
-	pid->voith_speed	= 0;
-	pid->voith_thrust	= 0;
-	pid->pitch_torque	= 0;
-	pid->roll_torque	= 0;
-	pid->yaw_torque		= 0;
+	pid->dfilter = cf->pid_dfilter;
+	pid->windup = cf->pid_windup;
 
-	return 0;
+	for (ii = 1; ii < PID_AXES; ii++) {
+		pid->base[ii][PID_KP] = pid->kp[ii];
+		pid->base[ii][PID_KI] = pid->ki[ii];
+		pid->base[ii][PID_KD] = pid->kd[ii];
+	}
+
+	return pid_sched_init(pid, cf);
 } /* end pid_init() */
 
 
+/*------------------------------------------------------------------------------
+ * int pid_sched_index()
+ * Finds the grid line nearest to a value.
+ *----------------------------------------------------------------------------*/
+
+static int pid_sched_index(const float *x, int n, float value)
+{
+	int index = 0;
+	int ii;
+
+	for (ii = 1; ii < n; ii++) {
+		if (fabsf(value - x[ii]) < fabsf(value - x[index])) {
+			index = ii;
+		}
+	}
+
+	return index;
+} /* end pid_sched_index() */
+
+
+/*------------------------------------------------------------------------------
+ * int pid_sched_grid()
+ * Copies the grid lines of one dimension. An empty grid has a single line at
+ * zero.
+ *----------------------------------------------------------------------------*/
+
+static int pid_sched_grid(float *grid, const float *conf, int n)
+{
+	int ii;
+
+	if (n <= 0) {
+		grid[0] = 0;
+		return 1;
+	}
+
+	for (ii = 0; ii < n; ii++) {
+		grid[ii] = conf[ii];
+		if (ii > 0 && grid[ii] <= grid[ii - 1]) {
+			return -1;
+		}
+	}
+
+	return n;
+} /* end pid_sched_grid() */
+
+
+/*------------------------------------------------------------------------------
+ * int pid_sched_init()
+ * Builds the gain schedule from the points in the configuration.
+ *----------------------------------------------------------------------------*/
+
+int pid_sched_init(PID *pid, CONF_VARS *cf)
+{
+	static const char *names[PID_AXES] = {"", "pitch", "roll", "yaw", "depth", "fx", "fy"};
+	PID_SCHED *sched = &pid->sched;
+	PARSE_SCHED *point = NULL;
+	float *gain = NULL;
+	int row = 0;
+	int axis = 0;
+	int id = 0;
+	int is = 0;
+	int ii;
+	int jj;
+	int kk;
+
+	memset(sched, 0, sizeof(PID_SCHED));
+	sched->depths = pid_sched_grid(sched->depth, cf->sched_depth, cf->sched_depths);
+	sched->speeds = pid_sched_grid(sched->speed, cf->sched_speed, cf->sched_speeds);
+	if (sched->depths < 0 || sched->speeds < 0) {
+		printf("PID_SCHED_INIT: WARNING!!! Schedule depths and speeds must increase.\n");
+		memset(sched, 0, sizeof(PID_SCHED));
+		return -1;
+	}
+
+	for (ii = 0; ii < cf->sched_points; ii++) {
+		point = &cf->sched[ii];
+
+		for (axis = 1; axis < PID_AXES; axis++) {
+			if (strncmp(point->axis, names[axis], PARSE_SCHED_AXIS) == 0) {
+				break;
+			}
+		}
+		if (axis == PID_AXES) {
+			printf("PID_SCHED_INIT: WARNING!!! Unknown axis %s.\n", point->axis);
+			continue;
+		}
+
+		row = 0;
+		while (row < sched->tasks && sched->task[row] != point->task) {
+			row++;
+		}
+		if (row == sched->tasks) {
+			if (row == PID_SCHED_TASKS) {
+				printf("PID_SCHED_INIT: WARNING!!! No room for task %d.\n", point->task);
+				continue;
+			}
+			sched->task[row] = point->task;
+			sched->tasks++;
+		}
+
+		/// The first point of an axis fills the whole grid.
+		id = pid_sched_index(sched->depth, sched->depths, point->depth);
+		is = pid_sched_index(sched->speed, sched->speeds, point->speed);
+		for (jj = 0; jj < sched->depths; jj++) {
+			for (kk = 0; kk < sched->speeds; kk++) {
+				if ((sched->axes[row] & PID_AXIS_BIT(axis)) && (jj != id || kk != is)) {
+					continue;
+				}
+				gain = sched->gain[row][jj][kk][axis];
+				gain[PID_KP] = point->kp;
+				gain[PID_KI] = point->ki;
+				gain[PID_KD] = point->kd;
+			}
+		}
+		sched->axes[row] |= PID_AXIS_BIT(axis);
+	}
+
+	return 0;
+} /* end pid_sched_init() */
+
+
+/*------------------------------------------------------------------------------
+ * void pid_sched_find()
+ * Finds the grid cell holding a value and how far across the cell it is.
+ * Values off the grid use the nearest edge.
+ *----------------------------------------------------------------------------*/
+
+static void pid_sched_find(const float *x, int n, float value, int *index, float *frac)
+{
+	int ii = 0;
+
+	if (n < 2 || value <= x[0]) {
+		*index = 0;
+		*frac = 0;
+		return;
+	}
+	if (value >= x[n - 1]) {
+		*index = n - 2;
+		*frac = 1;
+		return;
+	}
+
+	while (value >= x[ii + 1]) {
+		ii++;
+	}
+	*index = ii;
+	*frac = (value - x[ii]) / (x[ii + 1] - x[ii]);
+} /* end pid_sched_find() */
+
+
+/*------------------------------------------------------------------------------
+ * void pid_sched_apply()
+ * Sets the gains of the due axes for this tick. Axes the schedule has for the
+ * current task are interpolated between the four grid points around the depth
+ * and speed, and the rest use the base gains.
+ *----------------------------------------------------------------------------*/
+
+static void pid_sched_apply(PID *pid, int task, float depth, float speed, unsigned int due)
+{
+	PID_SCHED *sched = &pid->sched;
+	float *gains[PID_GAINS] = {pid->kp, pid->ki, pid->kd};
+	const float *g00 = NULL;
+	const float *g01 = NULL;
+	const float *g10 = NULL;
+	const float *g11 = NULL;
+	float fd = 0;
+	float fs = 0;
+	int row = 0;
+	int id = 0;
+	int is = 0;
+	int nd = 0;
+	int ns = 0;
+	int ii;
+	int jj;
+
+	while (row < sched->tasks && sched->task[row] != task) {
+		row++;
+	}
+	if (row < sched->tasks) {
+		pid_sched_find(sched->depth, sched->depths, depth, &id, &fd);
+		pid_sched_find(sched->speed, sched->speeds, speed, &is, &fs);
+		nd = (sched->depths > 1) ? id + 1 : id;
+		ns = (sched->speeds > 1) ? is + 1 : is;
+	}
+
+	for (ii = 1; ii < PID_AXES; ii++) {
+		if (!(due & PID_AXIS_BIT(ii))) {
+			continue;
+		}
+
+		if (row == sched->tasks || !(sched->axes[row] & PID_AXIS_BIT(ii))) {
+			for (jj = 0; jj < PID_GAINS; jj++) {
+				gains[jj][ii] = pid->base[ii][jj];
+			}
+			continue;
+		}
+
+		g00 = sched->gain[row][id][is][ii];
+		g01 = sched->gain[row][id][ns][ii];
+		g10 = sched->gain[row][nd][is][ii];
+		g11 = sched->gain[row][nd][ns][ii];
+		for (jj = 0; jj < PID_GAINS; jj++) {
+			gains[jj][ii] = (1 - fd) * ((1 - fs) * g00[jj] + fs * g01[jj]) +
+				fd * ((1 - fs) * g10[jj] + fs * g11[jj]);
+		}
+	}
+} /* end pid_sched_apply() */
+
+
+/*------------------------------------------------------------------------------
+ * void pid_set_gains()
+ * Loads the gains from the gain message. These are used for the axes the
+ * schedule has nothing for.
+ *----------------------------------------------------------------------------*/
+
+void pid_set_gains(PID *pid, CONF_VARS *cf, MSG_DATA *msg)
+{
+	pid->base[PID_PITCH][PID_KP] = msg->gain.data.kp_pitch;
+	pid->base[PID_PITCH][PID_KI] = msg->gain.data.ki_pitch;
+	pid->base[PID_PITCH][PID_KD] = msg->gain.data.kd_pitch;
+
+	pid->base[PID_ROLL][PID_KP] = msg->gain.data.kp_roll;
+	pid->base[PID_ROLL][PID_KI] = msg->gain.data.ki_roll;
+	pid->base[PID_ROLL][PID_KD] = msg->gain.data.kd_roll;
+
+	pid->base[PID_YAW][PID_KP] = msg->gain.data.kp_yaw;
+	pid->base[PID_YAW][PID_KI] = msg->gain.data.ki_yaw;
+	pid->base[PID_YAW][PID_KD] = msg->gain.data.kd_yaw;
+
+	pid->base[PID_DEPTH][PID_KP] = msg->gain.data.kp_depth;
+	pid->base[PID_DEPTH][PID_KI] = msg->gain.data.ki_depth;
+	pid->base[PID_DEPTH][PID_KD] = msg->gain.data.kd_depth;
+
+	pid->base[PID_SWAY][PID_KP] = msg->gain.data.kp_fx;
+	pid->base[PID_SWAY][PID_KI] = msg->gain.data.ki_fx;
+	pid->base[PID_SWAY][PID_KD] = msg->gain.data.kd_fx;
+
+	pid->base[PID_SURGE][PID_KP] = msg->gain.data.kp_fy;
+	pid->base[PID_SURGE][PID_KI] = msg->gain.data.ki_fy;
+	pid->base[PID_SURGE][PID_KD] = msg->gain.data.kd_fy;
+
+	pid->kp_roll_lateral   = msg->gain.data.kp_roll_lateral;
+	pid->kp_depth_forward  = msg->gain.data.kp_depth_forward;
+	pid->kp_place_holder   = msg->gain.data.kp_place_holder;
+
+	/// Use different gains for buoy task.
+	if ((msg->target.data.task == TASK_BUOY ||
+	     msg->target.data.task == TASK_GATE ||
+	     msg->target.data.task == TASK_FENCE) &&
+		msg->target.data.vision_status != TASK_NOT_DETECTED) {
+		pid->base[PID_YAW][PID_KP] = cf->kp_buoy;
+		pid->base[PID_YAW][PID_KI] = cf->ki_buoy;
+		pid->base[PID_YAW][PID_KD] = cf->kd_buoy;
+	}
+} /* end pid_set_gains() */
+
+
 /*------------------------------------------------------------------------------
  * void pid_loop()
- * Runs through one iteration of a PID controller for the axis specified in mode.
+ * Runs through one iteration of the PID controllers for the axes in due.
  *----------------------------------------------------------------------------*/
 
-void pid_loop(int pololu_fd,
+void pid_loop(POLOLU_OUT *pololu_out,
                PID *pid,
-               CONF_VARS *cf,
                MSG_DATA *msg,
-               float dt,
-               int mode,
+               unsigned int due,
+               const float *dt,
 			   int motor_init
            )
 {
+	float perr_old = 0.;
+	float derr = 0.;
+	float out = 0.;
+	unsigned long long span = trace_begin();
+	int ii;
+
 	/// Check to see if the errors should be reset to zero.
 	if (msg->target.data.mode == ZERO_PID_ERRORS) {
-		pid->pitch.perr = 0;
-		pid->pitch.ierr = 0;
-		pid->pitch.derr = 0;
-		pid->roll.perr = 0;
-		pid->roll.ierr = 0;
-		pid->roll.derr = 0;
-		pid->yaw.perr = 0;
-		pid->yaw.ierr = 0;
-		pid->yaw.derr = 0;
-		pid->depth.perr = 0;
-		pid->depth.ierr = 0;
-		pid->depth.derr = 0;
-		pid->fx.perr = 0;
-		pid->fx.ierr = 0;
-		pid->fx.derr = 0;
-		pid->fy.perr = 0;
-		pid->fy.ierr = 0;
-		pid->fy.derr = 0;
+		memset(pid->perr, 0, sizeof(pid->perr));
+		memset(pid->ierr, 0, sizeof(pid->ierr));
+		memset(pid->derr, 0, sizeof(pid->derr));
 		msg->target.data.mode = AUTONOMOUS;
 	}
 
-	/// These next three need to be set from vison, hydrophone, gui, etc. They depend on
-	/// the target values reported from those sensor systems.
-	/// Reference: float atan2f(float y, float x); theta = atan(y / x)
-	float depth_perr_old = pid->depth.perr;
-
-	if (msg->task.data.task == TASK_BOXES) {
-		float fx_perr_old = pid->fx.perr;
-		float fy_perr_old = pid->fy.perr;
-
-		/// Update the gains.
-		pid->fx.kp		= msg->gain.data.kp_fx;
-		pid->fx.ki		= msg->gain.data.ki_fx;
-		pid->fx.kd		= msg->gain.data.kd_fx;
-
-		pid->fy.kp		= msg->gain.data.kp_fy;
-		pid->fy.ki		= msg->gain.data.ki_fy;
-		pid->fy.kd		= msg->gain.data.kd_fy;
-
-		pid->kp_roll_lateral   = msg->gain.data.kp_roll_lateral;
-		pid->kp_depth_forward  = msg->gain.data.kp_depth_forward;
-		pid->kp_place_holder   = msg->gain.data.kp_place_holder;
-
-		/// Calculate the errors for fx and fy.
-		pid->fx.ref		= msg->target.data.fx;
-		pid->fx.cval	= 0;
-		pid->fx.perr	= pid->fx.cval - pid->fx.ref;
-		pid->fx.ierr	+= pid->fx.perr * dt;
-		pid->fx.ierr	= pid_bound_integral(pid->fx.ierr, pid->fx.ki, PID_FX_INTEGRAL);
-		pid->fx.derr	= pid->fx.perr - fx_perr_old;
-
-		pid->fy.ref		= msg->target.data.fy;
-		pid->fy.cval	= 0;
-		pid->fy.perr	= pid->fy.cval - pid->fy.ref;
-		pid->fy.ierr	+= pid->fy.perr * dt;
-		pid->fy.ierr	= pid_bound_integral(pid->fy.ierr, pid->fy.ki, PID_FY_INTEGRAL);
-		pid->fy.derr	= pid->fy.perr - fy_perr_old;
-
-		/// Update status message.
-		msg->status.data.fx_perr	= pid->fx.perr;
-		msg->status.data.fx_ierr	= pid->fx.ierr;
-		msg->status.data.fx_derr	= pid->fx.derr;
-
-		msg->status.data.fy_perr	= pid->fy.perr;
-		msg->status.data.fy_ierr	= pid->fy.ierr;
-		msg->status.data.fy_derr	= pid->fy.derr;
-
-
-		/// PID equations.
-		pid->lateral_thrust =	pid->fx.kp * pid->fx.perr +
-								pid->fx.ki * pid->fx.ierr +
-								pid->fx.kd * pid->fx.derr;
-
-		pid->forward_thrust =	pid->fy.kp * pid->fy.perr +
-								pid->fy.ki * pid->fy.ierr +
-								pid->fy.kd * pid->fy.derr;
-	}
-	else {
-		pid->lateral_thrust = msg->target.data.fx;
-		pid->forward_thrust = msg->target.data.fy;
+	/// Surge and sway are only closed loop for the boxes task.
+	if ((due & PID_AXIS_BIT(PID_YAW)) && msg->task.data.task == TASK_BOXES) {
+		due |= PID_AXIS_BIT(PID_SWAY) | PID_AXIS_BIT(PID_SURGE);
 	}
 
-	/// Check bounds.
-	if (fabsf(pid->forward_thrust) > PID_TOTAL_FY_THRUST) {
-		pid->forward_thrust = util_sign_value(pid->forward_thrust) * PID_TOTAL_FY_THRUST;
-	}
-	if (fabsf(pid->lateral_thrust) > PID_TOTAL_FX_THRUST) {
-		pid->lateral_thrust = util_sign_value(pid->lateral_thrust) * PID_TOTAL_FX_THRUST;
-	}
+	/// Gather the references and measurements.
+	pid->ref[PID_PITCH]		= msg->target.data.pitch;
+	pid->cval[PID_PITCH]	= msg->mstrain.data.pitch;
+	pid->rate[PID_PITCH]	= msg->mstrain.data.ang_rate[0];
+	pid->ref[PID_ROLL]		= msg->target.data.roll;
+	pid->cval[PID_ROLL]		= msg->mstrain.data.roll;
+	pid->rate[PID_ROLL]		= msg->mstrain.data.ang_rate[1];
+	pid->ref[PID_YAW]		= msg->target.data.yaw;
+	pid->cval[PID_YAW]		= msg->mstrain.data.yaw;
+	pid->rate[PID_YAW]		= msg->mstrain.data.ang_rate[2];
+	pid->ref[PID_DEPTH]		= msg->target.data.depth;
+	pid->cval[PID_DEPTH]	= msg->lj.data.pressure;
+	pid->ref[PID_SWAY]		= msg->target.data.fx;
+	pid->cval[PID_SWAY]		= 0;
+	pid->ref[PID_SURGE]		= msg->target.data.fy;
+	pid->cval[PID_SURGE]	= 0;
+
+	/// Look up the gains for the task and operating point.
+	pid_sched_apply(pid, msg->target.data.task, pid->cval[PID_DEPTH],
+		msg->target.data.speed, due);
+
+	/// Coupling between lateral thrust and roll, and the share of the wing
+	/// motors left for depth after roll.
+	pid->ff[PID_ROLL] = pid->kp_roll_lateral * pid->perr[PID_SWAY];
+	pid->olimit[PID_DEPTH] = PID_TOTAL_VERTICAL_THRUST - fabsf(pid->roll_torque);
+
+	/// Run the due axes.
+	for (ii = 1; ii < PID_AXES; ii++) {
+		if (!(due & PID_AXIS_BIT(ii))) {
+			continue;
+		}
 
-	/// Update status
-	msg->status.data.fx = pid->lateral_thrust;
-	msg->status.data.fy = pid->forward_thrust;
-
-	/// Compute voith actuator values
-	pid->voith_angle = pid_compute_sub_angle(pid->lateral_thrust, pid->forward_thrust);
-	pid->voith_speed = msg->target.data.speed;
-	pid->voith_thrust = sqrt(pid->lateral_thrust * pid->lateral_thrust +
-	                         pid->forward_thrust * pid->forward_thrust);
-
-	/// Initialize return values.
-	int r1 = -1;
-	int r2 = -1;
-
-	/// Switch based on which loop we are going to control.
-	switch (mode) {
-	case PID_PITCH:
-		/// Update the gains.
-		pid->pitch.kp	= msg->gain.data.kp_pitch;
-		pid->pitch.ki	= msg->gain.data.ki_pitch;
-		pid->pitch.kd	= msg->gain.data.kd_pitch;
-
-		/// Calculate the errors.
-		pid->pitch.ref	= msg->target.data.pitch;
-		pid->pitch.cval	= msg->mstrain.data.pitch;
-		pid->pitch.perr = pid_subtract_angles(pid->pitch.cval, pid->pitch.ref);
-		pid->pitch.ierr += pid->pitch.perr * dt;
-		pid->pitch.ierr = pid_bound_integral(pid->pitch.ierr, pid->pitch.ki, PID_PITCH_INTEGRAL);
-		pid->pitch.derr = msg->mstrain.data.ang_rate[0];
-
-		/// Update status message.
-		msg->status.data.pitch_perr	= pid->pitch.perr;
-		msg->status.data.pitch_ierr	= pid->pitch.ierr;
-		msg->status.data.pitch_derr	= pid->pitch.derr;
-
-		/// PID equations.
-		pid->pitch_torque =	pid->pitch.kp * pid->pitch.perr +
-							pid->pitch.ki * pid->pitch.ierr +
-							pid->pitch.kd * pid->pitch.derr;
-
-		/// Check bounds.
-		if (fabsf(pid->pitch_torque) > PID_PITCH_TORQUE) {
-			pid->pitch_torque = util_sign_value(pid->pitch_torque) * PID_PITCH_TORQUE;
+		perr_old = pid->perr[ii];
+		if (pid->angle[ii]) {
+			pid->perr[ii] = pid_subtract_angles(pid->cval[ii], pid->ref[ii]);
 		}
+		else {
+			pid->perr[ii] = pid->cval[ii] - pid->ref[ii];
+		}
+
+		derr = (pid->has_rate[ii]) ? pid->rate[ii] : pid->perr[ii] - perr_old;
+		pid->derr[ii] = pid->dfilter * pid->derr[ii] + (1 - pid->dfilter) * derr;
 
-		break;
-
-	case PID_ROLL:
-		/// Update the gains.
-		pid->roll.kp	= msg->gain.data.kp_roll;
-		pid->roll.ki	= msg->gain.data.ki_roll;
-		pid->roll.kd	= msg->gain.data.kd_roll;
-
-		/// Calculate the errors.
-		pid->roll.ref	= msg->target.data.roll;
-		pid->roll.cval	= msg->mstrain.data.roll;
-		pid->roll.perr	= pid_subtract_angles(pid->roll.cval, pid->roll.ref);
-		pid->roll.ierr	+= pid->roll.perr * dt;
-		pid->roll.ierr	= pid_bound_integral(pid->roll.ierr, pid->roll.ki, PID_ROLL_INTEGRAL);
-		pid->roll.derr	= msg->mstrain.data.ang_rate[1];
-
-		/// Update status message.
-		msg->status.data.roll_perr	= pid->roll.perr;
-		msg->status.data.roll_ierr	= pid->roll.ierr;
-		msg->status.data.roll_derr	= pid->roll.derr;
-
-		/// PID equations.
-		pid->roll_torque =	pid->roll.kp * pid->roll.perr +
-						   	pid->roll.ki * pid->roll.ierr +
-						   	pid->roll.kd * pid->roll.derr +
-						    pid->kp_roll_lateral * pid->fx.perr; /// Coupling between lateral thrust and roll.
-
-		/// Check bounds.
-		if (fabsf(pid->roll_torque) > PID_ROLL_TORQUE) {
-			pid->roll_torque = util_sign_value(pid->roll_torque) * PID_ROLL_TORQUE;
+		/// Conditional integration holds the integral while the output is
+		/// saturated and integrating would push it further.
+		if (pid->windup != PID_WINDUP_CONDITIONAL || !pid->sat[ii] ||
+			pid->ki[ii] * pid->perr[ii] * pid->out[ii] <= 0) {
+			pid->ierr[ii] += pid->perr[ii] * dt[pid_clock[ii]];
 		}
+		pid->ierr[ii] = pid_bound_integral(pid->ierr[ii], pid->ki[ii], pid->ilimit[ii]);
+
+		/// PID equation.
+		out =	pid->kp[ii] * pid->perr[ii] +
+				pid->ki[ii] * pid->ierr[ii] +
+				pid->kd[ii] * pid->derr[ii] +
+				pid->ff[ii];
+		pid->sat[ii] = (fabsf(out) > pid->olimit[ii]);
+		pid->out[ii] = pid_bound(out, pid->olimit[ii]);
+	}
+
+	/// Update status message.
+	msg->status.data.pitch_perr	= pid->perr[PID_PITCH];
+	msg->status.data.pitch_ierr	= pid->ierr[PID_PITCH];
+	msg->status.data.pitch_derr	= pid->derr[PID_PITCH];
+	msg->status.data.roll_perr	= pid->perr[PID_ROLL];
+	msg->status.data.roll_ierr	= pid->ierr[PID_ROLL];
+	msg->status.data.roll_derr	= pid->derr[PID_ROLL];
+	msg->status.data.yaw_perr	= pid->perr[PID_YAW];
+	msg->status.data.yaw_ierr	= pid->ierr[PID_YAW];
+	msg->status.data.yaw_derr	= pid->derr[PID_YAW];
+	msg->status.data.depth_perr	= pid->perr[PID_DEPTH];
+	msg->status.data.depth_ierr	= pid->ierr[PID_DEPTH];
+	msg->status.data.depth_derr	= pid->derr[PID_DEPTH];
+	msg->status.data.fx_perr	= pid->perr[PID_SWAY];
+	msg->status.data.fx_ierr	= pid->ierr[PID_SWAY];
+	msg->status.data.fx_derr	= pid->derr[PID_SWAY];
+	msg->status.data.fy_perr	= pid->perr[PID_SURGE];
+	msg->status.data.fy_ierr	= pid->ierr[PID_SURGE];
+	msg->status.data.fy_derr	= pid->derr[PID_SURGE];
+
+	/// Drive the actuators of the axes that ran.
+	if (due & PID_AXIS_BIT(PID_PITCH)) {
+		pid->pitch_torque = pid->out[PID_PITCH];
+	}
 
-		/// Control motors.
+	if (due & PID_AXIS_BIT(PID_ROLL)) {
+		pid->roll_torque = pid->out[PID_ROLL];
 		if (motor_init) {
-			r1 = pololu_control_vertical(pololu_fd, pid->vertical_thrust, pid->roll_torque, pid->pitch_torque);
+			pololu_control_vertical(pololu_out, pid->vertical_thrust, pid->roll_torque, pid->pitch_torque);
 		}
+	}
 
-		break;
-
-	case PID_YAW:
-		/// Update the gains.
-		pid->yaw.kp		= msg->gain.data.kp_yaw;
-		pid->yaw.ki		= msg->gain.data.ki_yaw;
-		pid->yaw.kd		= msg->gain.data.kd_yaw;
-
-		/// Use different gains for buoy task.
-		if ((msg->target.data.task == TASK_BUOY ||
-		     msg->target.data.task == TASK_GATE ||
-		     msg->target.data.task == TASK_FENCE) &&
-			msg->target.data.vision_status != TASK_NOT_DETECTED) {
-			pid->yaw.kp = cf->kp_buoy;
-			pid->yaw.ki = cf->ki_buoy;
-			pid->yaw.kd = cf->kd_buoy;
-		}
+	if (due & PID_AXIS_BIT(PID_YAW)) {
+		pid->yaw_torque = pid->out[PID_YAW];
 
-		/// Calculate the errors.
-		pid->yaw.ref	= msg->target.data.yaw;
-		pid->yaw.cval	= msg->mstrain.data.yaw;
-		pid->yaw.perr	= pid_subtract_angles(pid->yaw.cval, pid->yaw.ref);
-		pid->yaw.ierr	+= pid->yaw.perr * dt;
-		pid->yaw.ierr	= pid_bound_integral(pid->yaw.ierr, pid->yaw.ki, PID_YAW_INTEGRAL);
-		pid->yaw.derr	= msg->mstrain.data.ang_rate[2];
-
-		/// Update status message.
-		msg->status.data.yaw_perr	= pid->yaw.perr;
-		msg->status.data.yaw_ierr	= pid->yaw.ierr;
-		msg->status.data.yaw_derr	= pid->yaw.derr;
-
-		/// PID equations.
-		pid->yaw_torque =	pid->yaw.kp * pid->yaw.perr +
-						  	pid->yaw.ki * pid->yaw.ierr +
-						  	pid->yaw.kd * pid->yaw.derr;
-
-		/// Check bounds.
-		if (fabsf(pid->yaw_torque) > POLOLU_MAX_YAW_TORQUE) {
-			pid->yaw_torque = util_sign_value(pid->yaw_torque) * POLOLU_MAX_YAW_TORQUE;
+		/// The thrust vector is only needed by the Voiths.
+		if (msg->task.data.task == TASK_BOXES) {
+			pid->lateral_thrust = pid->out[PID_SWAY];
+			pid->forward_thrust = pid->out[PID_SURGE];
+		}
+		else {
+			pid->lateral_thrust = pid_bound(msg->target.data.fx, PID_TOTAL_FX_THRUST);
+			pid->forward_thrust = pid_bound(msg->target.data.fy, PID_TOTAL_FY_THRUST);
 		}
+		msg->status.data.fx = pid->lateral_thrust;
+		msg->status.data.fy = pid->forward_thrust;
+
+		/// Compute voith actuator values
+		pid->voith_angle = pid_compute_sub_angle(pid->lateral_thrust, pid->forward_thrust);
+		pid->voith_speed = msg->target.data.speed;
+		pid->voith_thrust = sqrt(pid->lateral_thrust * pid->lateral_thrust +
+		                         pid->forward_thrust * pid->forward_thrust);
 
 		/// Control Voiths.
 		if (motor_init) {
-			r2 = pololu_control_voiths(pololu_fd, pid->voith_speed, pid->voith_angle, pid->voith_thrust, pid->yaw_torque);
-		}
-
-		break;
-
-	case PID_DEPTH:
-		/// Update the gains.
-		pid->depth.kp	= msg->gain.data.kp_depth;
-		pid->depth.ki	= msg->gain.data.ki_depth;
-		pid->depth.kd	= msg->gain.data.kd_depth;
-
-		/// Calculate the errors.
-		pid->depth.ref	= msg->target.data.depth;
-		pid->depth.cval = msg->lj.data.pressure;
-		pid->depth.perr = pid->depth.cval - pid->depth.ref;
-		pid->depth.ierr += pid->depth.perr * dt;
-		pid->depth.ierr = pid_bound_integral(pid->depth.ierr, pid->depth.ki, PID_DEPTH_INTEGRAL);
-		pid->depth.derr	= pid->depth.perr - depth_perr_old;
-
-		/// Update status message.
-		msg->status.data.depth_perr	= pid->depth.perr;
-		msg->status.data.depth_ierr	= pid->depth.ierr;
-		msg->status.data.depth_derr	= pid->depth.derr;
-
-		/// PID equations.
-		pid->vertical_thrust =	pid->depth.kp * pid->depth.perr +
-							   pid->depth.ki * pid->depth.ierr +
-							   pid->depth.kd * pid->depth.derr;
-
-		/// Check bounds.
-		if ((fabsf(pid->vertical_thrust) + fabsf(pid->roll_torque)) > PID_TOTAL_VERTICAL_THRUST) {
-			pid->vertical_thrust = util_sign_value(pid->vertical_thrust) *
-				(PID_TOTAL_VERTICAL_THRUST - fabsf(pid->roll_torque));
+			pololu_control_voiths(pololu_out, pid->voith_speed, pid->voith_angle, pid->voith_thrust, pid->yaw_torque);
 		}
+	}
 
-		/// Control depth.
+	if (due & PID_AXIS_BIT(PID_DEPTH)) {
+		pid->vertical_thrust = pid->out[PID_DEPTH];
 		if (motor_init) {
-			r1 = pololu_control_vertical(pololu_fd, pid->vertical_thrust, pid->roll_torque, pid->pitch_torque);
+			pololu_control_vertical(pololu_out, pid->vertical_thrust, pid->roll_torque, pid->pitch_torque);
 		}
-
-		break;
 	}
+
+	trace_end("pid_loop", span);
 } /* end pid_loop() */
 
 
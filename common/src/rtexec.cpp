@@ -0,0 +1,289 @@
+/******************************************************************************
+ *
+ *  Title:        rtexec.c
+ *
+ *  Description:  Periodic executor for control loops. Sleeps until absolute
+ *                deadlines with clock_nanosleep() so that the rate does not
+ *                drift with the time spent in each task.
+ *
+ *****************************************************************************/
+
+#include "rtexec.h"
+
+
+/*------------------------------------------------------------------------------
+ * void rtexec_max()
+ * Raises a statistic to a new worst value.
+ *----------------------------------------------------------------------------*/
+
+static void rtexec_max(unsigned long long *stat, unsigned long long value)
+{
+	if (value > __atomic_load_n(stat, __ATOMIC_RELAXED)) {
+		__atomic_store_n(stat, value, __ATOMIC_RELAXED);
+	}
+} /* end rtexec_max() */
+
+
+/*------------------------------------------------------------------------------
+ * void rtexec_init()
+ * Clears an executor.
+ *----------------------------------------------------------------------------*/
+
+void rtexec_init(RTEXEC *ex)
+{
+	memset(ex, 0, sizeof(RTEXEC));
+	ex->cpu = -1;
+} /* end rtexec_init() */
+
+
+/*------------------------------------------------------------------------------
+ * int rtexec_add()
+ * Adds a periodic task. The table is kept sorted by period so that when
+ * several tasks are due the fastest one runs first.
+ *----------------------------------------------------------------------------*/
+
+int rtexec_add(RTEXEC *ex, const char *name, float period, RTEXEC_CB cb, void *arg)
+{
+	RTEXEC_TASK *task = NULL;
+	unsigned long long ns = timing_s2ns(period);
+	int ii;
+
+	if (ex->running) {
+		printf("RTEXEC_ADD: WARNING!!! Executor is already running.\n");
+		return -1;
+	}
+	if (ex->count >= RTEXEC_MAX_TASKS) {
+		printf("RTEXEC_ADD: WARNING!!! No room for task %s.\n", name);
+		return -1;
+	}
+	if (ns == 0) {
+		printf("RTEXEC_ADD: WARNING!!! Task %s has no period.\n", name);
+		return -1;
+	}
+
+	for (ii = ex->count; ii > 0 && ex->tasks[ii - 1].period > ns; ii--) {
+		ex->tasks[ii] = ex->tasks[ii - 1];
+	}
+	task = &ex->tasks[ii];
+	memset(task, 0, sizeof(RTEXEC_TASK));
+	task->name = name;
+	task->cb = cb;
+	task->arg = arg;
+	task->period = ns;
+	ex->count++;
+
+	return 0;
+} /* end rtexec_add() */
+
+
+/*------------------------------------------------------------------------------
+ * int rtexec_lock_memory()
+ * Locks the process into memory.
+ *----------------------------------------------------------------------------*/
+
+int rtexec_lock_memory()
+{
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+		perror("mlockall");
+		return -1;
+	}
+
+	return 0;
+} /* end rtexec_lock_memory() */
+
+
+/*------------------------------------------------------------------------------
+ * void rtexec_setup_thread()
+ * Applies the priority and CPU affinity to the calling thread.
+ *----------------------------------------------------------------------------*/
+
+static void rtexec_setup_thread(RTEXEC *ex)
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+	int status = 0;
+
+	if (ex->cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(ex->cpu, &cpus);
+		if ((status = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus)) != 0) {
+			printf("RTEXEC_SETUP_THREAD: WARNING!!! Could not pin to CPU %d: %s\n",
+				ex->cpu, strerror(status));
+		}
+	}
+
+	if (ex->priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = ex->priority;
+		if ((status = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) != 0) {
+			printf("RTEXEC_SETUP_THREAD: WARNING!!! Could not set SCHED_FIFO priority %d: %s\n",
+				ex->priority, strerror(status));
+		}
+	}
+} /* end rtexec_setup_thread() */
+
+
+/*------------------------------------------------------------------------------
+ * void *rtexec_thread()
+ * Executor thread. Sleeps until the earliest deadline and runs every task that
+ * is due. A task that has fallen more than one period behind skips the missed
+ * releases and is told how many periods have passed.
+ *----------------------------------------------------------------------------*/
+
+static void *rtexec_thread(void *arg)
+{
+	RTEXEC *ex = (RTEXEC *)arg;
+	RTEXEC_TASK *task = NULL;
+	struct timespec ts;
+	unsigned long long now = 0;
+	unsigned long long wake = 0;
+	unsigned long long start = 0;
+	unsigned int periods = 0;
+	int ii;
+
+	rtexec_setup_thread(ex);
+
+	now = timing_now();
+	for (ii = 0; ii < ex->count; ii++) {
+		ex->tasks[ii].next = now + ex->tasks[ii].period;
+	}
+
+	while (__atomic_load_n(&ex->running, __ATOMIC_ACQUIRE)) {
+		/// Sleep until the earliest deadline.
+		wake = ex->tasks[0].next;
+		for (ii = 1; ii < ex->count; ii++) {
+			if (ex->tasks[ii].next < wake) {
+				wake = ex->tasks[ii].next;
+			}
+		}
+		ts.tv_sec = wake / TIMING_NSEC;
+		ts.tv_nsec = wake % TIMING_NSEC;
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+			continue;
+		}
+
+		for (ii = 0; ii < ex->count; ii++) {
+			task = &ex->tasks[ii];
+			start = timing_now();
+			if (start < task->next) {
+				continue;
+			}
+
+			/// Count the releases that have passed and move the deadline past
+			/// all of them.
+			periods = 1 + (start - task->next) / task->period;
+			rtexec_max(&task->late, start - task->next);
+			task->next += (unsigned long long)periods * task->period;
+			if (periods > 1) {
+				__atomic_add_fetch(&task->skipped, periods - 1, __ATOMIC_RELAXED);
+			}
+
+			/// The period error is how far the time since the last run is
+			/// from the period, early or late.
+			if (task->start != 0) {
+				hist_add(&task->hist_period, start - task->start);
+				hist_add(&task->hist_error, (start - task->start > task->period) ?
+					start - task->start - task->period : task->period - (start - task->start));
+			}
+			task->start = start;
+
+			task->cb(periods, task->arg);
+
+			now = timing_now();
+			rtexec_max(&task->exec, now - start);
+			hist_add(&task->hist_exec, now - start);
+			__atomic_add_fetch(&task->runs, 1, __ATOMIC_RELAXED);
+			if (now > task->next) {
+				__atomic_add_fetch(&task->overruns, 1, __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	return NULL;
+} /* end rtexec_thread() */
+
+
+/*------------------------------------------------------------------------------
+ * int rtexec_start()
+ * Starts the executor thread.
+ *----------------------------------------------------------------------------*/
+
+int rtexec_start(RTEXEC *ex, int priority, int cpu)
+{
+	int status = 0;
+
+	if (ex->count == 0) {
+		printf("RTEXEC_START: WARNING!!! No tasks to run.\n");
+		return -1;
+	}
+
+	ex->priority = priority;
+	ex->cpu = cpu;
+	ex->running = TRUE;
+	if ((status = pthread_create(&ex->thread, NULL, rtexec_thread, ex)) != 0) {
+		printf("RTEXEC_START: WARNING!!! Could not start thread: %s\n", strerror(status));
+		ex->running = FALSE;
+		return -1;
+	}
+
+	return 0;
+} /* end rtexec_start() */
+
+
+/*------------------------------------------------------------------------------
+ * void rtexec_stop()
+ * Stops the executor thread. The thread exits after the tasks that are due at
+ * its next wakeup have run.
+ *----------------------------------------------------------------------------*/
+
+void rtexec_stop(RTEXEC *ex)
+{
+	if (!__atomic_load_n(&ex->running, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+
+	__atomic_store_n(&ex->running, FALSE, __ATOMIC_RELEASE);
+	pthread_join(ex->thread, NULL);
+} /* end rtexec_stop() */
+
+
+/*------------------------------------------------------------------------------
+ * RTEXEC_TASK *rtexec_find()
+ * Finds a task by name.
+ *----------------------------------------------------------------------------*/
+
+RTEXEC_TASK *rtexec_find(RTEXEC *ex, const char *name)
+{
+	int ii;
+
+	for (ii = 0; ii < ex->count; ii++) {
+		if (strcmp(ex->tasks[ii].name, name) == 0) {
+			return &ex->tasks[ii];
+		}
+	}
+
+	return NULL;
+} /* end rtexec_find() */
+
+
+/*------------------------------------------------------------------------------
+ * void rtexec_print_stats()
+ * Prints the statistics of each task and resets the worst latencies.
+ *----------------------------------------------------------------------------*/
+
+void rtexec_print_stats(RTEXEC *ex)
+{
+	RTEXEC_TASK *task = NULL;
+	int ii;
+
+	for (ii = 0; ii < ex->count; ii++) {
+		task = &ex->tasks[ii];
+		printf("RTEXEC: %-8s %u runs, %u overruns, %u skipped, worst late %.0f us, worst run %.0f us\n",
+			task->name,
+			__atomic_load_n(&task->runs, __ATOMIC_RELAXED),
+			__atomic_load_n(&task->overruns, __ATOMIC_RELAXED),
+			__atomic_load_n(&task->skipped, __ATOMIC_RELAXED),
+			__atomic_exchange_n(&task->late, 0, __ATOMIC_RELAXED) / 1000.,
+			__atomic_exchange_n(&task->exec, 0, __ATOMIC_RELAXED) / 1000.);
+	}
+} /* end rtexec_print_stats() */
@@ -0,0 +1,281 @@
+/******************************************************************************
+ *
+ *  Title:        shmbus.c
+ *
+ *  Description:  Shared memory publish/subscribe bus for daemons on the same
+ *                host.
+ *
+ *****************************************************************************/
+
+#include "shmbus.h"
+#include "messages.h"
+
+/// The bus is mapped once per process and shared by all bus handles.
+static SHMBUS *bus;
+static int bus_refs;
+static SHMBUS_CONN conns[SHMBUS_MAX_FDS];
+
+
+/*------------------------------------------------------------------------------
+ * int shmbus_open()
+ * Opens the shared memory object and maps it into the process.
+ *----------------------------------------------------------------------------*/
+
+int shmbus_open()
+{
+	int fd = -1;
+	struct stat st;
+	void *addr = NULL;
+
+	if ((fd = shm_open(SHMBUS_NAME, O_RDWR | O_CREAT, 0666)) == -1) {
+		perror("shm_open");
+		return -1;
+	}
+	if (fd >= SHMBUS_MAX_FDS) {
+		printf("SHMBUS_OPEN: WARNING!!! Bus fd %d is too large.\n", fd);
+		close(fd);
+		return -1;
+	}
+
+	/// The first process to open the bus sets its size. A new object is
+	/// filled with zeros so every topic starts out empty.
+	if (fstat(fd, &st) == -1) {
+		perror("fstat");
+		close(fd);
+		return -1;
+	}
+	if (st.st_size < (off_t)sizeof(SHMBUS)) {
+		if (ftruncate(fd, sizeof(SHMBUS)) == -1) {
+			perror("ftruncate");
+			close(fd);
+			return -1;
+		}
+	}
+
+	if (bus == NULL) {
+		addr = mmap(NULL, sizeof(SHMBUS), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) {
+			perror("mmap");
+			close(fd);
+			return -1;
+		}
+		bus = (SHMBUS *)addr;
+	}
+	bus_refs++;
+
+	memset(&conns[fd], 0, sizeof(SHMBUS_CONN));
+	conns[fd].open = TRUE;
+	conns[fd].topics = SHMBUS_ALL;
+
+	return fd;
+} /* end shmbus_open() */
+
+
+/*------------------------------------------------------------------------------
+ * void shmbus_close()
+ * Closes a bus handle. The mapping is removed with the last handle.
+ *----------------------------------------------------------------------------*/
+
+void shmbus_close(int fd)
+{
+	if (!shmbus_is_bus(fd)) {
+		return;
+	}
+
+	conns[fd].open = FALSE;
+	close(fd);
+
+	if (--bus_refs == 0) {
+		munmap(bus, sizeof(SHMBUS));
+		bus = NULL;
+	}
+} /* end shmbus_close() */
+
+
+/*------------------------------------------------------------------------------
+ * int shmbus_is_bus()
+ * Checks whether a file descriptor is a bus handle.
+ *----------------------------------------------------------------------------*/
+
+int shmbus_is_bus(int fd)
+{
+	return (fd >= 0 && fd < SHMBUS_MAX_FDS && conns[fd].open);
+} /* end shmbus_is_bus() */
+
+
+/*------------------------------------------------------------------------------
+ * int shmbus_subscribe()
+ * Sets the topics read by a bus handle.
+ *----------------------------------------------------------------------------*/
+
+int shmbus_subscribe(int fd, unsigned int topics)
+{
+	if (!shmbus_is_bus(fd)) {
+		return -1;
+	}
+
+	conns[fd].topics = topics & SHMBUS_ALL;
+
+	return 0;
+} /* end shmbus_subscribe() */
+
+
+/*------------------------------------------------------------------------------
+ * int shmbus_topic()
+ * Gets the topic that carries a message ID.
+ *----------------------------------------------------------------------------*/
+
+int shmbus_topic(int msgid)
+{
+	switch (msgid) {
+	case STATUS_MSGID:
+		return SHMBUS_STATUS;
+	case LJ_MSGID:
+		return SHMBUS_LJ;
+	case TARGET_MSGID:
+		return SHMBUS_TARGET;
+	case GAIN_MSGID:
+		return SHMBUS_GAIN;
+	case VISION_MSGID:
+		return SHMBUS_VISION;
+	case TASK_MSGID:
+		return SHMBUS_TASK;
+	}
+
+	return -1;
+} /* end shmbus_topic() */
+
+
+/*------------------------------------------------------------------------------
+ * int shmbus_claim()
+ * Makes this process the writer of a slot if it has no writer or its writer
+ * has exited. Returns TRUE if this process is the writer.
+ *----------------------------------------------------------------------------*/
+
+static int shmbus_claim(SHMBUS_SLOT *slot)
+{
+	int pid = getpid();
+	int owner = 0;
+
+	owner = __atomic_load_n(&slot->owner, __ATOMIC_ACQUIRE);
+	if (owner == pid) {
+		return TRUE;
+	}
+	if (owner != 0 && !(kill(owner, 0) == -1 && errno == ESRCH)) {
+		return FALSE;
+	}
+
+	return __atomic_compare_exchange_n(&slot->owner, &owner, pid, FALSE,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+} /* end shmbus_claim() */
+
+
+/*------------------------------------------------------------------------------
+ * int shmbus_write()
+ * Publishes a message. The sequence count is odd while the data is copied so
+ * readers can tell that they need to try again.
+ *----------------------------------------------------------------------------*/
+
+int shmbus_write(int fd, const void *buf, int len)
+{
+	SHMBUS_SLOT *slot = NULL;
+	unsigned int seq = 0;
+	int topic = -1;
+
+	if (!shmbus_is_bus(fd) || len < MSG_HDR_SIZE) {
+		return -1;
+	}
+
+	/// Messages that are not carried on the bus, such as OPEN requests, are
+	/// dropped.
+	if ((topic = shmbus_topic(MSG_WIRE_ID(buf))) == -1) {
+		return len;
+	}
+	if (len > SHMBUS_SLOT_SIZE) {
+		printf("SHMBUS_WRITE: WARNING!!! Message of %d bytes is too large.\n", len);
+		return -1;
+	}
+
+	slot = &bus->slots[topic];
+	if (!shmbus_claim(slot)) {
+		return len;
+	}
+
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(slot->data, buf, len);
+	slot->len = len;
+
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+
+	return len;
+} /* end shmbus_write() */
+
+
+/*------------------------------------------------------------------------------
+ * int shmbus_read()
+ * Copies every subscribed topic that changed since the last read. Topics this
+ * process writes are skipped so it does not read back its own data.
+ *----------------------------------------------------------------------------*/
+
+int shmbus_read(int fd, void *buf, int size)
+{
+	SHMBUS_CONN *conn = NULL;
+	SHMBUS_SLOT *slot = NULL;
+	char *out = (char *)buf;
+	unsigned int seq1 = 0;
+	unsigned int seq2 = 0;
+	int pid = getpid();
+	int bytes = 0;
+	int len = 0;
+	int tries = 0;
+	int ii;
+
+	if (!shmbus_is_bus(fd)) {
+		return 0;
+	}
+	conn = &conns[fd];
+
+	for (ii = 0; ii < SHMBUS_NUM_TOPICS; ii++) {
+		slot = &bus->slots[ii];
+		if (!(conn->topics & (1 << ii)) ||
+			__atomic_load_n(&slot->owner, __ATOMIC_RELAXED) == pid) {
+			continue;
+		}
+
+		len = 0;
+		for (tries = 0; tries < SHMBUS_RETRIES; tries++) {
+			seq1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+			if (seq1 == conn->seq[ii]) {
+				/// Nothing new.
+				len = 0;
+				break;
+			}
+			if (seq1 & 1) {
+				/// Writer is copying.
+				continue;
+			}
+
+			len = slot->len;
+			if (len <= 0 || len > SHMBUS_SLOT_SIZE || bytes + len > size) {
+				len = 0;
+				break;
+			}
+			memcpy(out + bytes, slot->data, len);
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			seq2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+			if (seq1 == seq2) {
+				conn->seq[ii] = seq1;
+				break;
+			}
+			len = 0;
+		}
+
+		bytes += len;
+	}
+
+	return bytes;
+} /* end shmbus_read() */
@@ -0,0 +1,65 @@
+/******************************************************************************
+ *
+ *  Title:        tribuf.c
+ *
+ *  Description:  Lock-free triple buffer. The writer fills its own buffer and
+ *                swaps it with the spare, the reader swaps its buffer with the
+ *                spare when the spare is marked new.
+ *
+ *****************************************************************************/
+
+#include "tribuf.h"
+
+
+/*------------------------------------------------------------------------------
+ * void tribuf_init()
+ * Sets up a triple buffer with nothing to read.
+ *----------------------------------------------------------------------------*/
+
+void tribuf_init(TRIBUF *tb, void *data, int size)
+{
+	memset(data, 0, 3 * size);
+	tb->data = (char *)data;
+	tb->size = size;
+	tb->read = 0;
+	tb->write = 1;
+	tb->spare = 2;
+} /* end tribuf_init() */
+
+
+/*------------------------------------------------------------------------------
+ * void tribuf_put()
+ * Fills the writer's buffer and swaps it with the spare. An unread spare is
+ * replaced, so the reader only ever sees the newest value.
+ *----------------------------------------------------------------------------*/
+
+void tribuf_put(TRIBUF *tb, const void *src)
+{
+	int old = 0;
+
+	memcpy(tb->data + tb->write * tb->size, src, tb->size);
+	old = __atomic_exchange_n(&tb->spare, tb->write | TRIBUF_NEW, __ATOMIC_ACQ_REL);
+	tb->write = old & ~TRIBUF_NEW;
+} /* end tribuf_put() */
+
+
+/*------------------------------------------------------------------------------
+ * int tribuf_get()
+ * Swaps the reader's buffer with the spare if the spare is new and copies it
+ * out.
+ *----------------------------------------------------------------------------*/
+
+int tribuf_get(TRIBUF *tb, void *dst)
+{
+	int old = 0;
+
+	if (!(__atomic_load_n(&tb->spare, __ATOMIC_RELAXED) & TRIBUF_NEW)) {
+		return FALSE;
+	}
+
+	old = __atomic_exchange_n(&tb->spare, tb->read, __ATOMIC_ACQ_REL);
+	tb->read = old & ~TRIBUF_NEW;
+	memcpy(dst, tb->data + tb->read * tb->size, tb->size);
+
+	return TRUE;
+} /* end tribuf_get() */
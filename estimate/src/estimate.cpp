@@ -88,6 +88,7 @@ int main( int argc, char *argv[] )
 	nav_fd = -1;
 	memset(&msg, 0, sizeof(MSG_DATA));
 	messages_init(&msg);
+	messages_set_producer(MSG_PRODUCER_ESTIMATE);
 
 	/// Parse command line arguments.
 	parse_default_config(&cf);
@@ -206,8 +207,8 @@ int main( int argc, char *argv[] )
         /// Get nav data.
 		if (nav_fd > 0) {
 			recv_bytes = net_client(nav_fd, nav_buf, &msg, MODE_PLANNER);
-			nav_buf[recv_bytes] = '\0';
 			if (recv_bytes > 0) {
+				nav_buf[recv_bytes] = '\0';
 				messages_decode(nav_fd, nav_buf, &msg, recv_bytes);
 			}
 			/// Check the kill switch state.
@@ -240,8 +241,8 @@ int main( int argc, char *argv[] )
 			msg.target.data.task = msg.task.data.task;
 			msg.target.data.vision_status = msg.vision.data.status;
 			recv_bytes = net_client(nav_fd, nav_buf, &msg, MODE_PLANNER);
-			nav_buf[recv_bytes] = '\0';
 			if (recv_bytes > 0) {
+				nav_buf[recv_bytes] = '\0';
 				messages_decode(nav_fd, nav_buf, &msg, recv_bytes);
 			}
 			/// Check the kill switch state.
@@ -263,8 +264,8 @@ int main( int argc, char *argv[] )
 		/// Get labjack data.
         if ((cf.enable_labjack) && (lj_fd > 0)) {
             recv_bytes = net_client(lj_fd, lj_buf, &msg, MODE_OPEN);
-            lj_buf[recv_bytes] = '\0';
             if (recv_bytes > 0) {
+                lj_buf[recv_bytes] = '\0';
                 messages_decode(lj_fd, lj_buf, &msg, recv_bytes);
 				msg.status.data.depth = msg.lj.data.pressure;
             }
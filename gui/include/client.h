@@ -52,6 +52,14 @@
 #define SSC_SYNC 255
 #endif /* SSC_SYNC */
 
+/** @name Period in ms for telemetry pushed from planner and nav. Matches the
+ * rate the status display is updated at. */
+//@{
+#ifndef CLIENT_PUSH_PERIOD
+#define CLIENT_PUSH_PERIOD 200
+#endif /* CLIENT_PUSH_PERIOD */
+//@}
+
 
 /******************************
 **
@@ -256,9 +256,20 @@ void events_vision( GtkWidget *widget,
                    gpointer data
                  );
 
-//! Called when Get Gain button is clicked.
-//!
-void events_gain_get( );
+//! Called when Get Gains button is clicked. Asks the servers for their gains.
+//! \param widget A pointer to the button widget.
+//! \param event A pointer to the event that triggered the callback.
+//! \param data A pointer to data that can be manipulated.
+void events_gain_get( GtkWidget *widget,
+                  GdkEvent *event,
+                  gpointer data
+                );
+
+//! Sets the gain buttons from a GAIN message as it is decoded.
+//! \param fd Network file descriptor the message came from.
+//! \param msg Message data holding the decoded GAIN message.
+//! \param arg Not used.
+void events_gain_hook( int fd, MSG_DATA *msg, void *arg );
 
 //! Called when Set Gain button is clicked.
 //!
@@ -77,6 +77,22 @@ void gui_set_timers( );
 //!
 void gui_update_status_text( );
 
+//! Keeps the loop timing of each PID axis as each DIAG message is decoded.
+//! \param fd Network file descriptor the message came from.
+//! \param msg Message data holding the decoded DIAG message.
+//! \param arg Not used.
+void gui_diag_hook( int fd, MSG_DATA *msg, void *arg );
+
+//! Appends the loop timing of each PID axis from nav to the status text.
+//! \param sbuff Status text.
+void gui_update_diag_text( char *sbuff );
+
+//! Gets a percentile from a loop timing histogram.
+//! \param bins DIAG_BINS counts.
+//! \param pct Percentile from 0 to 100.
+//! \return Upper edge in us of the bin holding the percentile.
+unsigned long long gui_diag_pct( const unsigned int *bins, float pct );
+
 //! Sets up a 1 second Gtk timer.
 //! Returns TRUE.
 //! \param data A pointer to data that can be manipulated.
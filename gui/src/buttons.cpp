@@ -88,6 +88,7 @@ GtkWidget *button_kp_depth_forward;
 GtkWidget *button_kp_place_holder;
 GtkWidget *button_cf_gains;
 GtkWidget *button_zero_gains;
+GtkWidget *button_get_gains;
 
 /* Target buttons. */
 GtkWidget *button_target_yaw;
@@ -1165,16 +1166,20 @@ int buttons_gains( GtkWidget *box )
     /* Create normal buttons. */
 	button_cf_gains = gtk_button_new_with_label( "Use Config File Gains" );
 	button_zero_gains = gtk_button_new_with_label( "Zero Gains" );
+	button_get_gains = gtk_button_new_with_label( "Get Gains" );
 
     /* Connect the normal buttons to callbacks. */
     g_signal_connect( button_cf_gains, "clicked",
             G_CALLBACK( events_gain_cf ), NULL );
     g_signal_connect( button_zero_gains, "clicked",
             G_CALLBACK( events_gain_zero ), NULL );
+    g_signal_connect( button_get_gains, "clicked",
+            G_CALLBACK( events_gain_get ), NULL );
 
     /* Put normal buttons into box. */
     gtk_container_add( GTK_CONTAINER( vbox16 ), button_cf_gains );
     gtk_container_add( GTK_CONTAINER( vbox16 ), button_zero_gains );
+    gtk_container_add( GTK_CONTAINER( vbox16 ), button_get_gains );
 
     /* Create the spin buttons. */
     adj = ( GtkAdjustment * )gtk_adjustment_new( msg.gain.data.kp_yaw,
@@ -36,6 +36,7 @@ int main( int argc, char *argv[] )
 	
     memset( &msg, 0, sizeof(MSG_DATA) );
 	messages_init( &msg );
+	messages_set_producer( MSG_PRODUCER_GUI );
 
     /* Parse command line arguments. */
     parse_default_config( &cf );
@@ -72,6 +73,8 @@ int main( int argc, char *argv[] )
     if( cf.enable_planner ) {
         planner_fd = net_client_setup( cf.planner_IP, cf.planner_port );
 		if( planner_fd > 0 ) {
+			net_subscribe( planner_fd, MSG_TOPIC(STATUS_MSGID) | MSG_TOPIC(LJ_MSGID),
+				CLIENT_PUSH_PERIOD );
 			printf( "MAIN: Planner client setup OK.\n" );
 		}
 		else {
@@ -94,6 +97,14 @@ int main( int argc, char *argv[] )
     if( cf.enable_nav ) {
         nav_fd = net_client_setup( cf.nav_IP, cf.nav_port );
 		if( nav_fd > 0 ) {
+			net_subscribe( nav_fd, MSG_TOPIC(STATUS_MSGID) | MSG_TOPIC(DIAG_MSGID),
+				CLIENT_PUSH_PERIOD );
+			net_subscribe_delta( nav_fd, STATUS_MSGID );
+			/* nav sends the loop timing one axis at a time. Take each one
+			 * as it arrives and copy it out as it is decoded, since several
+			 * can come in one read and each is decoded over the last. */
+			net_subscribe_topic( nav_fd, DIAG_MSGID, 1, 0 );
+			messages_set_hook( DIAG_MSGID, gui_diag_hook, NULL );
 			printf( "MAIN: Nav client setup OK.\n" );
 		}
 		else {
@@ -101,6 +112,10 @@ int main( int argc, char *argv[] )
 		}
     }
 
+    /* The servers reply to Get Gains with a GAIN message that is read with
+     * the pushed data. */
+    messages_set_hook( GAIN_MSGID, events_gain_hook, NULL );
+
     /* Send the targets to the server if not in MANUAL mode. */
 	if( planner_fd > 0 ) {
 		messages_send( planner_fd, TARGET_MSGID, &msg );
@@ -593,11 +593,17 @@ void events_gain_zero( GtkWidget *widget,
 
 /******************************************************************************
  *
- * Title:       void events_gain_get( )
+ * Title:       void events_gain_get( GtkWidget *widget,
+ *                                    GdkEvent *event,
+ *                                    gpointer data )
  *
- * Description: Called when Get Gain button is clicked.
+ * Description: Called when Get Gains button is clicked. Asks the servers for
+ *              their gains. The replies are read with the pushed data and
+ *              shown by events_gain_hook().
  *
- * Input:       None.
+ * Input:       widget: A pointer to the button widget.
+ *              event: A pointer to the event that triggered the callback.
+ *              data: A pointer to data that can be manipulated.
  *
  * Output:      None.
  *
@@ -605,54 +611,66 @@ void events_gain_zero( GtkWidget *widget,
  *
  *****************************************************************************/
 
-void events_gain_get( )
+void events_gain_get( GtkWidget *widget,
+                  GdkEvent *event,
+                  gpointer data )
 {
-	/* Set up variables. */
-    int recv_bytes = 0;
-    int mode = MODE_STATUS;
     msg.gain.data.mode = GAIN_GET;
 
     /* Send the gain message. */
- 	if( planner_fd > 0 ) {
+	if( planner_fd > 0 ) {
 		messages_send( planner_fd, GAIN_MSGID, &msg );
 	}
 	if( nav_fd > 0 ) {
 		messages_send( nav_fd, GAIN_MSGID, &msg );
 	}
-   msg.gain.data.mode = 0;
+    msg.gain.data.mode = 0;
+} /* end events_gain_get() */
 
-    /* Get network data. */
-    if( planner_fd > 0 ) {
-        recv_bytes = net_client( planner_fd, planner_buf, &msg, mode );
-        planner_buf[recv_bytes] = '\0';
-    }
-    if( recv_bytes > 0 ) {
-        messages_decode( planner_fd, planner_buf, &msg, recv_bytes );
-    }
 
-	/* Modify buttons to reflect new values. */
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_yaw, msg.gain.data.kp_yaw );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_yaw, msg.gain.data.ki_yaw );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_yaw, msg.gain.data.kd_yaw );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_pitch, msg.gain.data.kp_pitch );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_pitch, msg.gain.data.ki_pitch );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_pitch, msg.gain.data.kd_pitch );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_roll, msg.gain.data.kp_roll );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_roll, msg.gain.data.ki_roll );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_roll, msg.gain.data.kd_roll );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_depth, msg.gain.data.kp_depth );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_depth, msg.gain.data.ki_depth );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_depth, msg.gain.data.kd_depth );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_fx, msg.gain.data.kp_fx );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_fx, msg.gain.data.ki_fx );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_fx, msg.gain.data.kd_fx);
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_fy, msg.gain.data.kp_fy );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_fy, msg.gain.data.ki_fy );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_fy, msg.gain.data.kd_fy);
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_fy, msg.gain.data.kp_roll_lateral );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_fy, msg.gain.data.kp_depth_forward );
-    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_fy, msg.gain.data.kp_place_holder);
-} /* end events_gain_get() */
+/******************************************************************************
+ *
+ * Title:       void events_gain_hook( int fd, MSG_DATA *msg, void *arg )
+ *
+ * Description: Sets the gain buttons from a GAIN message sent by a server in
+ *              reply to Get Gains. Called as the message is decoded.
+ *
+ * Input:       fd: Network file descriptor the message came from.
+ *              msg: Message data holding the decoded GAIN message.
+ *              arg: Not used.
+ *
+ * Output:      None.
+ *
+ * Globals:     None.
+ *
+ *****************************************************************************/
+
+void events_gain_hook( int fd, MSG_DATA *msg, void *arg )
+{
+    GAIN *gain = &msg->gain.data;
+
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_yaw, gain->kp_yaw );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_yaw, gain->ki_yaw );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_yaw, gain->kd_yaw );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_pitch, gain->kp_pitch );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_pitch, gain->ki_pitch );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_pitch, gain->kd_pitch );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_roll, gain->kp_roll );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_roll, gain->ki_roll );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_roll, gain->kd_roll );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_depth, gain->kp_depth );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_depth, gain->ki_depth );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_depth, gain->kd_depth );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_fx, gain->kp_fx );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_fx, gain->ki_fx );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_fx, gain->kd_fx );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_fy, gain->kp_fy );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_ki_fy, gain->ki_fy );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kd_fy, gain->kd_fy );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_roll_lateral, gain->kp_roll_lateral );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_depth_forward, gain->kp_depth_forward );
+    gtk_spin_button_set_value( (GtkSpinButton *)button_kp_place_holder, gain->kp_place_holder );
+} /* end events_gain_hook() */
 
 
 /******************************************************************************
@@ -1064,8 +1082,8 @@ void events_opmode( GtkWidget *widget,
 /******************************************************************************
  *
  * Title:       void events_images( GtkWidget *widget,
- *                                  GdkEvent *event,
- *                                  gpointer data )
+ *                                    GdkEvent *event,
+ *                                    gpointer data )
  *
  * Description: Called when image mode value changes.
  *
@@ -22,6 +22,9 @@ extern GtkWidget *label_status;
 char planner_buf[MAX_MSG_SIZE];
 char nav_buf[MAX_MSG_SIZE];
 
+/// Loop timing from nav indexed by PID axis. nav sends one axis at a time.
+DIAG diag[DIAG_AXES];
+
 /// Network API messages and file descriptors.
 extern int planner_fd;
 extern int nav_fd;
@@ -31,6 +34,114 @@ extern MSG_DATA msg;
 extern CONF_VARS cf;
 
 
+/******************************************************************************
+ *
+ * Title:       unsigned long long gui_diag_pct( const unsigned int *bins,
+ *                                               float pct )
+ *
+ * Description: Gets a percentile from a loop timing histogram.
+ *
+ * Input:       bins: DIAG_BINS counts.
+ *              pct: Percentile from 0 to 100.
+ *
+ * Output:      Upper edge in us of the bin holding the percentile, 0 if the
+ *              histogram is empty.
+ *
+ * Globals:     None.
+ *
+ *****************************************************************************/
+
+unsigned long long gui_diag_pct( const unsigned int *bins, float pct )
+{
+    unsigned int count = 0;
+    unsigned int total = 0;
+    int ii;
+
+    for( ii = 0; ii < DIAG_BINS; ii++ ) {
+        count += bins[ii];
+    }
+    if( count == 0 ) {
+        return 0;
+    }
+
+    for( ii = 0; ii < DIAG_BINS - 1; ii++ ) {
+        total += bins[ii];
+        if( total > ( unsigned int )( count * pct / 100. ) ) {
+            break;
+        }
+    }
+
+    return 1ULL << ii;
+} /* end gui_diag_pct() */
+
+
+/******************************************************************************
+ *
+ * Title:       void gui_diag_hook( int fd, MSG_DATA *msg, void *arg )
+ *
+ * Description: Keeps the loop timing of each axis. Called for every DIAG
+ *              message as it is decoded since nav sends one axis at a time
+ *              and several can arrive in one read.
+ *
+ * Input:       fd: Network file descriptor the message came from.
+ *              msg: Message data holding the decoded DIAG message.
+ *              arg: Not used.
+ *
+ * Output:      None.
+ *
+ * Globals:     diag
+ *
+ *****************************************************************************/
+
+void gui_diag_hook( int fd, MSG_DATA *msg, void *arg )
+{
+    if( msg->diag.data.axis > 0 && msg->diag.data.axis < DIAG_AXES ) {
+        diag[msg->diag.data.axis] = msg->diag.data;
+    }
+} /* end gui_diag_hook() */
+
+
+/******************************************************************************
+ *
+ * Title:       void gui_update_diag_text( char *sbuff )
+ *
+ * Description: Appends the loop timing of each PID axis to the status text.
+ *              Times are the median and 99th percentile in us.
+ *
+ * Input:       sbuff: Status text.
+ *
+ * Output:      None.
+ *
+ * Globals:     diag
+ *
+ *****************************************************************************/
+
+void gui_update_diag_text( char *sbuff )
+{
+    const char *names[DIAG_AXES] = { "", "Pitch:\t\t", "Roll:\t\t\t", "Yaw:\t\t\t", "Depth:\t\t" };
+    DIAG *d = NULL;
+    int ii;
+
+    strcat( sbuff, "Loop Timing (p50/p99 us):\n"
+        "\t\t\t\t[ Period\tError\tRun\tIMU Age\tOverruns ]\n" );
+    for( ii = 1; ii < DIAG_AXES; ii++ ) {
+        d = &diag[ii];
+        if( d->runs == 0 ) {
+            continue;
+        }
+        sprintf( sbuff + strlen( sbuff ),
+            "%s\t\t[ %llu/%llu\t%llu/%llu\t%llu/%llu\t%llu/%llu\t%u ]\n"
+            , names[ii]
+            , gui_diag_pct( d->period, 50 ), gui_diag_pct( d->period, 99 )
+            , gui_diag_pct( d->error, 50 ), gui_diag_pct( d->error, 99 )
+            , gui_diag_pct( d->exec, 50 ), gui_diag_pct( d->exec, 99 )
+            , gui_diag_pct( d->age, 50 ), gui_diag_pct( d->age, 99 )
+            , d->overruns
+            );
+    }
+} /* end gui_update_diag_text() */
+
+
 /******************************************************************************
  *
  * Title:       void gui_update_status_text( )
@@ -98,6 +209,7 @@ void gui_update_status_text( )
              , msg.status.data.fy_ierr
              , msg.status.data.fy_derr
            );
+    gui_update_diag_text( sbuff );
     //printf( "GUI_UPDATE_STATUS_TEXT:\n%s\n", sbuff );
 
     gtk_label_set_text( GTK_LABEL( label_status ), sbuff );
@@ -145,17 +257,17 @@ gint gui_timer_200ms( gpointer data )
     static int bytes_left;
 	int recv_bytes;
 
-    /* Get network data from planner. */
+    /* Get network data pushed from planner. */
     if( planner_fd > 0 ) {
-        recv_bytes = net_client( planner_fd, planner_buf, &msg, MODE_OPEN );
+        recv_bytes = net_client( planner_fd, planner_buf, &msg, MODE_PUSH );
 		if( recv_bytes > 0 ) {
         	bytes_left = messages_decode( planner_fd, planner_buf, &msg, recv_bytes );
     	}
     }
 
-    /* Get network data from nav. */
+    /* Get network data pushed from nav. */
     if( nav_fd > 0 ) {
-        recv_bytes = net_client( nav_fd, nav_buf, &msg, MODE_OPEN );
+        recv_bytes = net_client( nav_fd, nav_buf, &msg, MODE_PUSH );
 		if( recv_bytes > 0 ) {
         	bytes_left = messages_decode( nav_fd, nav_buf, &msg, recv_bytes );
     	}
@@ -102,6 +102,7 @@ int main( int argc, char *argv[] )
     memset( &cf,  0, sizeof(CONF_VARS) );
     memset( &joy, 0, sizeof(JOY_DATA) );
 	messages_init( &msg );
+	messages_set_producer( MSG_PRODUCER_JOYDRIVE );
 
     /* Parse command line arguments. */
     parse_default_config( &cf );
@@ -68,6 +68,14 @@
 #define PRESSURE_BIAS			(-4.3913)
 #endif /* PRESSURE_CALIBRATION */
 
+/** @name Period in seconds for reading the Labjack. */
+//@{
+#ifndef LABJACKD_PERIODS
+#define LABJACKD_PERIODS
+#define LABJACKD_PERIOD			0.02
+#endif /* LABJACKD_PERIODS */
+//@}
+
 
 /******************************
 **
@@ -92,6 +100,12 @@ void labjackd_sigint( int signal );
 //! invoked.
 void labjackd_exit( );
 
+//! Event loop timer that reads the Labjack into the network message.
+//! \param fd Timer file descriptor.
+//! \param expirations Number of timer expirations.
+//! \param arg Not used.
+void labjackd_query_timer( int fd, unsigned int expirations, void *arg );
+
 //! Main function for the labjackd program.
 //! \param argc Number of command line arguments.
 //! \param argv Array of command line arguments.
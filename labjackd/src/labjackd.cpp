@@ -13,6 +13,13 @@
 /* Global file descriptors. Only global so that labjackd_exit() can close them. */
 int labjack_fd;
 int labjackd_fd;
+NET_SERVER server;
+int bus_fd;
+
+/* State shared by the event loop callbacks. */
+static EVLOOP loop;
+static MSG_DATA msg;
+static LABJACK_DATA lj;
 
 
 /******************************************************************************
@@ -55,16 +62,74 @@ void labjackd_exit( )
 
 	/* Close the open file descriptors. */
 	if( labjackd_fd > 0 ) {
-		close( labjackd_fd );
+		net_server_close( &server );
 	}
 	if( labjack_fd > 0 ) {
 		close( labjack_fd );
 	}
+	if( bus_fd > 0 ) {
+		net_close( bus_fd );
+	}
+	evloop_close( &loop );
 
 	printf("<OK>\n");
 } /* end labjackd_exit() */
 
 
+/******************************************************************************
+ *
+ * Title:       void labjackd_query_timer( int fd, unsigned int expirations,
+ *                                         void *arg )
+ *
+ * Description: Event loop timer that gets Labjack data and puts it in the
+ *              network message. Shuts down the computer if its battery is low.
+ *
+ * Input:       fd: Timer file descriptor.
+ *              expirations: Number of timer expirations.
+ *              arg: Not used.
+ *
+ * Output:      None.
+ *
+ *****************************************************************************/
+
+void labjackd_query_timer( int fd, unsigned int expirations, void *arg )
+{
+	int status = -1;
+	float depth;
+
+	status = query_labjack( );
+	if( status > 0 ) {
+		depth = getBatteryVoltage( AIN_2 ) * PRESSURE_SLOPE + PRESSURE_BIAS;
+
+		lj.battery1 = getBatteryVoltage( AIN_0 );
+		lj.battery2 = getBatteryVoltage( AIN_1 );
+		lj.pressure = depth; 					 	/* AIN_2, converted */
+		lj.water    = getBatteryVoltage( AIN_3 );
+
+		msg.lj.data.battery1 = lj.battery1;
+		msg.lj.data.battery2 = lj.battery2;
+		msg.lj.data.pressure = lj.pressure;
+		msg.lj.data.water    = lj.water;
+
+		/* Push to subscribed clients and publish to nav and planner on the
+		 * same host. */
+		net_server_publish( &server, LJ_MSGID, &msg );
+		if( bus_fd > 0 ) {
+			messages_send( bus_fd, LJ_MSGID, &msg );
+		}
+	}
+
+	/* Check battery voltage. Make sure it is connected. If too low then
+	 * have the computer shut down so that the battery is not damaged. */
+	//if( (lj.battery1 > BATT1_THRESH) && (lj.battery1 < BATT1_MIN) ) {
+		//status = system("shutdown -h now \"Labjackd: Motor battery has low voltage.\"");
+	//}
+	if( (lj.battery2 > BATT2_THRESH) && (lj.battery2 < BATT2_MIN) ) {
+		status = system("shutdown -h now \"Labjackd: Computer battery has low voltage.\"");
+	}
+} /* end labjackd_query_timer() */
+
+
 /******************************************************************************
  *
  * Title:       int main( int argc, char *argv[] )
@@ -90,39 +155,33 @@ int main( int argc, char *argv[] )
 	sigint_action.sa_flags = 0;
 	sigaction( SIGINT, &sigint_action, NULL );
 
-	int recv_bytes = 0;
 	int status = -1;
 	char recv_buf[MAX_MSG_SIZE];
-	MSG_DATA msg;
-	LABJACK_DATA lj;
 	CONF_VARS cf;
 
-	struct timeval sim_time = {0, 0};
-	struct timeval sim_start = {0, 0};
-	int time1s = 0;
-    int time1ms = 0;
-    int time2s = 0;
-    int time2ms = 0;
-    int dt = 0;
-    float depth;
-
 	printf("MAIN: Starting Labjack daemon ...\n");
 
 	/* Initialize variables. */
 	labjack_fd = -1;
 	labjackd_fd = -1;
+	bus_fd = -1;
 
 	memset( &msg, 0, sizeof( MSG_DATA ) );
 	memset( &cf, 0, sizeof( CONF_VARS ) );
 	memset( &lj, 0, sizeof( LABJACK_DATA ) );
 	messages_init( &msg );
+	messages_set_producer( MSG_PRODUCER_LABJACKD );
+	if( evloop_init( &loop ) == -1 ) {
+		printf("MAIN: WARNING!!! Event loop setup failed.\n");
+		exit( -1 );
+	}
 
 	/* Parse command line arguments. */
 	parse_default_config( &cf );
 	parse_cla( argc, argv, &cf, STINGRAY, ( const char * )LABJACKD_FILENAME );
 
 	/* Set up server. */
-	labjackd_fd = net_server_setup( cf.server_port );
+	labjackd_fd = net_server_setup( &server, cf.server_port );
 	if( labjackd_fd > 0 ) {
 		printf("MAIN: Server setup OK.\n");
 	}
@@ -130,82 +189,47 @@ int main( int argc, char *argv[] )
 		printf("MAIN: WARNING!!! Server setup failed.\n");
 	}
 
+	/* Set up the shared memory bus. */
+	if( cf.enable_shmbus ) {
+		bus_fd = shmbus_open( );
+		if( bus_fd > 0 ) {
+			printf("MAIN: Shared memory bus setup OK.\n");
+		}
+		else {
+			printf("MAIN: WARNING!!! Shared memory bus setup failed.\n");
+		}
+	}
+
 	/* Set up the labjack. */
 	labjack_fd = init_labjack( );
 	if( labjack_fd ) {
 		status = query_labjack( );
-		printf("MAIN: Labjack setup OK.\n");
+		if( status > 0 ) {
+			printf("MAIN: Labjack setup OK.\n");
+		}
+		else {
+			printf("MAIN: WARNING!!! Labjack query failed.\n");
+		}
 	}
 	else
 	{
-		printf("MAIN: SIMULATION MODE!!! Labjack data is simulated.\n");
-		/* Seed the random variable. */
-		srand((unsigned int) time(NULL) );
+		/* Random data does not follow the vehicle, so there is no simulation
+		 * mode here. simd serves modeled Labjack data in its place. */
+		printf("MAIN: WARNING!!! Labjack setup failed. Run simd in place of "
+			"labjackd to run without the vehicle.\n");
+		exit( -1 );
 	}
 
-	 /* Initialize timers. */
-    gettimeofday( &sim_time, NULL );
-    gettimeofday( &sim_start, NULL );
+	/* Register the server and timers with the event loop. */
+	if( labjackd_fd > 0 ) {
+		net_server_add( &loop, &server, recv_buf, &msg, MODE_LJ, NULL, NULL );
+	}
+	evloop_add_timer( &loop, LABJACKD_PERIOD, labjackd_query_timer, NULL );
 
 	printf("MAIN: Labjack server running now.\n");
 
-	/* Main loop. */
-	while( 1 ) {
-		/* Get network data. */
-		if( labjackd_fd > 0 ) {
-			recv_bytes = net_server( labjackd_fd, recv_buf, &msg, MODE_LJ );
-			if( recv_bytes > 0 ) {
-				recv_buf[recv_bytes] = '\0';
-				messages_decode( labjackd_fd, recv_buf, &msg, recv_bytes );
-			}
-		}
-
-		/* Get Labjack data and put it in network message. */
-		if( labjack_fd > 0 ) {
-			status = query_labjack( );
-			if( status > 0 ) {
-				
-				depth = getBatteryVoltage( AIN_2 ) * PRESSURE_SLOPE + PRESSURE_BIAS;
-				
-				lj.battery1 = getBatteryVoltage( AIN_0 );
-				lj.battery2 = getBatteryVoltage( AIN_1 );
-				lj.pressure = depth; 					 	/* AIN_2, converted */
-				lj.water    = getBatteryVoltage( AIN_3 );
-			
-				msg.lj.data.battery1 = lj.battery1;
-				msg.lj.data.battery2 = lj.battery2;
-				msg.lj.data.pressure = lj.pressure;
-				msg.lj.data.water    = lj.water;
-			}
-		}
-		else {
-			/* Simulation Mode. This is where the simulated data is generated. */
-			time1s =    sim_time.tv_sec;
-            time1ms =   sim_time.tv_usec;
-            time2s =    sim_start.tv_sec;
-            time2ms =   sim_start.tv_usec;
-            dt = util_calc_dt( &time1s, &time1ms, &time2s, &time2ms );
-			if( dt > 100000 ) {
-				msg.lj.data.battery1 = 10.0  + rand() / (float)RAND_MAX;
-				msg.lj.data.battery2 = 14.0  + rand() / (float)RAND_MAX;
-				msg.lj.data.pressure = 0.543 + rand() / (float)RAND_MAX;
-				msg.lj.data.water    = 0.289 + rand() / (float)RAND_MAX;
-				gettimeofday( &sim_start, NULL );
-			}
-		}
-
-		/* Check battery voltage. Make sure it is connected. If too low then
-		 * have the computer shut down so that the battery is not damaged. */
-		//if( (lj.battery1 > BATT1_THRESH) && (lj.battery1 < BATT1_MIN) ) {
-			//status = system("shutdown -h now \"Labjackd: Motor battery has low voltage.\"");
-		//}
-		if( (lj.battery2 > BATT2_THRESH) && (lj.battery2 < BATT2_MIN) ) {
-			status = system("shutdown -h now \"Labjackd: Computer battery has low voltage.\"");
-		}
-
-		/* Update timers. */
-        gettimeofday( &sim_time, NULL );
-	}
+	/* Main loop. Blocks until a client sends a request or a timer expires. */
+	evloop_run( &loop );
 
 	exit( 0 );
 } /* end main() */
@@ -10,6 +10,7 @@
  *----------------------------------------------------------------------------*/
 
 #include "microstrain.h"
+#include "trace.h"
 
 /*------------------------------------------------------------------------------
  * int mstrain_setup()
@@ -373,6 +374,7 @@ int mstrain_euler_vectors(int fd, float *roll, float *pitch, float *yaw, float *
 	int ii = 0;
 	char response[response_length];
 	char cmd = 0;
+	unsigned long long span = trace_begin();
 
 	/// Temporary variables for checksum calculation. The checksum is
 	/// found by adding up all of the values of the short ints that are
@@ -459,6 +461,8 @@ int mstrain_euler_vectors(int fd, float *roll, float *pitch, float *yaw, float *
 		*yaw += 360;
 	}
 
+	trace_end("mstrain_euler_vectors", span);
+
 	return 1;
 } /* end mstrain_euler_vectors() */
 
@@ -10,6 +10,9 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 
 #include "microstrain.h"
 #include "network.h"
@@ -22,6 +25,10 @@
 #include "pid.h"
 #include "labjackd.h"
 #include "timing.h"
+#include "evloop.h"
+#include "rtexec.h"
+#include "tribuf.h"
+#include "trace.h"
 
 #ifdef USE_SSA
 #include <sys/timeb.h>
@@ -77,6 +84,80 @@
 #define MAX_PORT_LEN 8
 #endif /* MAX_PORT_LEN */
 
+/** @name Period in seconds for reading the IMU. */
+//@{
+#ifndef NAV_IMU_PERIOD
+#define NAV_IMU_PERIOD 0.02
+#endif /* NAV_IMU_PERIOD */
+//@}
+
+/** @name Period in seconds for sending the loop timing of one PID axis. */
+//@{
+#ifndef NAV_DIAG_PERIOD
+#define NAV_DIAG_PERIOD 0.25
+#endif /* NAV_DIAG_PERIOD */
+//@}
+
+/** @name Period in seconds for reading the shared memory bus. */
+//@{
+#ifndef NAV_LJ_PERIOD
+#define NAV_LJ_PERIOD 0.05
+#endif /* NAV_LJ_PERIOD */
+//@}
+
+/** @name Time in seconds allowed for the e-stop thread to wake and take the
+ * Pololu from the control thread. The e-stop latency bound is this plus the
+ * time to send the neutral commands at the Pololu baud rate. */
+//@{
+#ifndef NAV_ESTOP_SLACK
+#define NAV_ESTOP_SLACK 0.005
+#endif /* NAV_ESTOP_SLACK */
+//@}
+
+/** @name Time in seconds each device has to come up. nav stops if the IMU
+ * is not up in time and goes on without the Pololu. */
+//@{
+#ifndef NAV_IMU_TIMEOUT
+#define NAV_IMU_TIMEOUT 3.0
+#endif /* NAV_IMU_TIMEOUT */
+
+#ifndef NAV_POLOLU_TIMEOUT
+#define NAV_POLOLU_TIMEOUT 5.0
+#endif /* NAV_POLOLU_TIMEOUT */
+//@}
+
+/** @name Printed when nav stops because there is no IMU. */
+//@{
+#ifndef NAV_NO_IMU
+#define NAV_NO_IMU "Start simd and set \"imu port\" and \"pololu port\" to its links to run without the vehicle."
+#endif /* NAV_NO_IMU */
+//@}
+
+/** @name Period in seconds for checking on the devices coming up. */
+//@{
+#ifndef NAV_BRINGUP_PERIOD
+#define NAV_BRINGUP_PERIOD 0.05
+#endif /* NAV_BRINGUP_PERIOD */
+//@}
+
+/** @name Number of devices brought up in parallel. */
+//@{
+#ifndef NAV_DEVICES
+#define NAV_DEVICES 2
+#endif /* NAV_DEVICES */
+//@}
+
+/** @name Bring-up states of a device. */
+//@{
+#ifndef NAV_DEV_STATES
+#define NAV_DEV_STATES
+#define NAV_DEV_PENDING		0
+#define NAV_DEV_UP			1
+#define NAV_DEV_FAILED		2
+#define NAV_DEV_TIMEOUT		3
+#endif /* NAV_DEV_STATES */
+//@}
+
 #ifndef SSA_SLEEP
 #define SSA_SLEEP 500000
 #endif /* SSA_SLEEP */
@@ -88,6 +169,41 @@
 **
 ******************************/
 
+#ifndef _NAV_BUFS_
+#define _NAV_BUFS_
+/*! Messages passed from the network thread to the control thread. */
+typedef struct _NAV_INPUT {
+	TARGET_MSG target;	//!< Target from the planner
+	GAIN_MSG gain;		//!< Gains from the planner
+	TASK_MSG task;		//!< Current task
+	STOP_MSG stop;		//!< Stop state
+	LJ_MSG lj;			//!< Labjack data from the labjack daemon
+} NAV_INPUT;
+
+/*! Messages passed from the control thread to the network thread. */
+typedef struct _NAV_OUTPUT {
+	STATUS_MSG status;	//!< Status with the newest IMU sample and thrusts
+	MSTRAIN_MSG mstrain;	//!< Raw IMU data
+} NAV_OUTPUT;
+#endif /* _NAV_BUFS_ */
+
+#ifndef _NAV_DEVICE_
+#define _NAV_DEVICE_
+/*! A device brought up on its own thread. The state moves once from
+ * NAV_DEV_PENDING, either on the device thread when setup returns or on the
+ * network thread when the timeout passes, so a late device is closed instead
+ * of used. */
+typedef struct _NAV_DEVICE {
+	const char *name;			//!< Device name for messages
+	int (*setup)();				//!< Opens the device, returns its fd or -1
+	void (*ready)(int fd);		//!< Hands an open device to nav
+	float timeout;				//!< Seconds the device has to come up
+	pthread_t thread;			//!< Bring-up thread
+	int state;					//!< One of the NAV_DEV_ states
+	int reported;				//!< Set once the state has been printed
+	unsigned long long time;	//!< Time setup took in ns
+} NAV_DEVICE;
+#endif /* _NAV_DEVICE_ */
 
 
 /******************************
@@ -96,15 +212,94 @@
 **
 ******************************/
 
-//! This function is called when SIGINT (ctrl-c) is invoked.
-//! \param signal The SIGINT signal.
-void nav_sigint(int signal);
+//! Event loop callback for the exit signals. Stops the event loop so main()
+//! returns and the shutdown runs on the main thread.
+//! \param fd Signal file descriptor.
+//! \param events Events on the descriptor.
+//! \param arg Not used.
+void nav_signal(int fd, unsigned int events, void *arg);
 
 //! Exit function for main program. Sets actuators to safe values and closes
-//! all file descriptors. This function is called when SIGINT (ctrl-c) is
-//! invoked.
+//! all file descriptors. Runs on the main thread when main() returns or
+//! exits.
 void nav_exit();
 
+//! Event loop timer that exchanges data on the shared memory bus.
+//! \param fd Timer file descriptor.
+//! \param expirations Number of timer expirations.
+//! \param arg Not used.
+void nav_lj_timer(int fd, unsigned int expirations, void *arg);
+
+//! Event loop callback for labjack data pushed by the labjack daemon.
+//! \param fd Labjack client file descriptor.
+//! \param events Event flags.
+//! \param arg Not used.
+void nav_lj_read(int fd, unsigned int events, void *arg);
+
+//! Called by the server after a request from the planner is decoded. Passes
+//! the new messages to the control thread and fills in the newest status for
+//! the reply.
+//! \param fd Client file descriptor.
+//! \param msg A pointer to message data.
+//! \param arg Not used.
+void nav_net_recv(int fd, MSG_DATA *msg, void *arg);
+
+//! Event loop timer that pushes the newest status to subscribed clients.
+//! \param fd Timer file descriptor.
+//! \param expirations Number of timer expirations.
+//! \param arg Not used.
+void nav_status_timer(int fd, unsigned int expirations, void *arg);
+
+//! IMU thread task that reads the IMU once it is up.
+//! \param periods Number of periods since the last run.
+//! \param arg Not used.
+void nav_imu_task(unsigned int periods, void *arg);
+
+//! Event loop timer that reports devices as they come up and gives up on
+//! those that pass their timeout. Removes itself once every device is done.
+//! \param fd Timer file descriptor.
+//! \param expirations Number of timer expirations.
+//! \param arg Not used.
+void nav_bringup_timer(int fd, unsigned int expirations, void *arg);
+
+//! Checks the kill switch and brings up the Pololu when it is closed. Runs on
+//! the control thread and hands setting the channels to the channel thread.
+void nav_lj_check();
+
+//! Channel thread. Waits for nav_lj_check() and sets every Pololu channel to
+//! neutral, then gives back the time the Pololu will be ready.
+//! \param arg Not used.
+//! \return NULL.
+void *nav_channel_thread(void *arg);
+
+//! Checks for a new stop message or the kill switch opening and wakes the
+//! e-stop thread. Runs on the network thread.
+void nav_estop_check();
+
+//! E-stop thread. Waits for nav_estop_check() and sends neutral to the
+//! thrusters, then logs the time from the trigger.
+//! \param arg Eventfd to wait on, cast to a pointer.
+//! \return NULL.
+void *nav_estop_thread(void *arg);
+
+//! Control thread task that runs the PID loop for one axis.
+//! \param periods Number of periods since the last run.
+//! \param arg The PID axis, one of PID_PITCH, PID_ROLL, PID_YAW or PID_DEPTH.
+void nav_pid_task(unsigned int periods, void *arg);
+
+//! Event loop timer that pushes the loop timing histograms of the next PID
+//! axis in a DIAG message.
+//! \param fd Timer file descriptor.
+//! \param expirations Number of timer expirations.
+//! \param arg Not used.
+void nav_diag_timer(int fd, unsigned int expirations, void *arg);
+
+//! Event loop timer that prints loop rates once a second.
+//! \param fd Timer file descriptor.
+//! \param expirations Number of timer expirations.
+//! \param arg Not used.
+void nav_print_timer(int fd, unsigned int expirations, void *arg);
+
 //! Main function for the uuv program.
 //! \param argc Number of command line arguments.
 //! \param argv Array of command line arguments.
@@ -10,37 +10,122 @@
 
 /// Global file descriptors. Only global so that nav_exit() can close them.
 int server_fd;
+NET_SERVER server;
 int pololu_fd;
 int imu_fd;
 int lj_fd;
 
+/// Exit signals are blocked on every thread and read from signal_fd by the
+/// event loop so that the shutdown runs on the main thread.
+static int signal_fd = -1;
+
+/// nav runs three threads. The network thread runs the event loop and owns
+/// net_msg. The IMU thread owns imu_msg. The control thread runs the PID
+/// loops and owns msg, pid and the Pololu. They only share data through the
+/// triple buffers.
+static EVLOOP loop;
+static RTEXEC exec;
+static RTEXEC imu_exec;
+static CONF_VARS cf;
+static MSG_DATA msg;
+static MSG_DATA net_msg;
+static MSTRAIN_MSG imu_msg;
+static LJ_MSG lj_latest;
+static PID pid;
+static POLOLU_OUT pololu_out;
+static TRIBUF imu_tb;
+static TRIBUF input_tb;
+static TRIBUF output_tb;
+static MSTRAIN_MSG imu_bufs[3];
+static NAV_INPUT input_bufs[3];
+static NAV_OUTPUT output_bufs[3];
+static char recv_buf[MAX_MSG_SIZE];
+static char lj_buf[MAX_MSG_SIZE];
+static int pololu_initialized = FALSE;
+static int pololu_starting = FALSE;
+static unsigned long long pololu_ready = 0;
+static int count_pitch = 0;
+static int count_roll = 0;
+static int count_yaw = 0;
+static int count_depth = 0;
+static int count_mstrain = 0;
+
+/// The e-stop thread sends neutral to the thrusters as soon as the network
+/// thread sees a stop, without waiting for the control thread. pololu_lock
+/// keeps the two from writing to the Pololu at once and lends the e-stop
+/// priority to the control thread while it holds the lock.
+static pthread_t estop_thread;
+static pthread_mutex_t pololu_lock;
+static int estop_fd = -1;
+static int estop_active = FALSE;
+static int estop_stopped = FALSE;
+static int estop_killed = FALSE;
+static int estop_kill_closed = FALSE;
+static unsigned long long estop_trigger = 0;
+static unsigned long long estop_bound = 0;
+static unsigned long long estop_max = 0;
+static unsigned int estop_count = 0;
+static unsigned int estop_over = 0;
+
+/// Setting every Pololu channel takes hundreds of ms at 9600 baud, so the
+/// control thread asks the channel thread to do it and only watches for the
+/// time it is done.
+static pthread_t channel_thread;
+static int channel_fd = -1;
+
+/// Devices brought up in parallel, and the times used to report how long nav
+/// took to start controlling.
+static NAV_DEVICE devices[NAV_DEVICES];
+static unsigned long long nav_start = 0;
+static unsigned long long first_tick = 0;
+
+/// Age of the IMU sample used by each PID axis, added to on the control thread
+/// and read by the network thread.
+static HIST age_hist[DIAG_AXES];
+
+/// Executor task names indexed by PID axis.
+static const char *axis_names[DIAG_AXES] = {"", "pitch", "roll", "yaw", "depth"};
+
 /*------------------------------------------------------------------------------
- * void nav_sigint()
- * Callback for when SIGINT (ctrl-c) is invoked.
+ * void nav_signal()
+ * Stops the event loop when SIGINT (ctrl-c), SIGTERM, SIGQUIT or SIGHUP
+ * arrives so main() returns and nav_exit() runs on the main thread.
  *----------------------------------------------------------------------------*/
 
-void nav_sigint(int signal)
+void nav_signal(int fd, unsigned int events, void *arg)
 {
-    exit(0);
-} /* end nav_sigint() */
+	struct signalfd_siginfo info;
+
+	if (read(fd, &info, sizeof(info)) != sizeof(info)) {
+		return;
+	}
+	evloop_stop(&loop);
+} /* end nav_signal() */
 
 
 /*------------------------------------------------------------------------------
  * void nav_exit()
  * Exit function for main program. Sets actuators to safe values and closes all
- * open file descriptors. Callback for when SIGINT (ctrl-c) is invoked.
+ * open file descriptors. Runs on the main thread since the exit signals are
+ * blocked on the others, so the threads it stops are never itself.
  *----------------------------------------------------------------------------*/
 
 void nav_exit()
 {
     printf("\nNAV_EXIT: Shutting down nav program ... ");
+	/// Stop the PID loops and the IMU thread before the actuators are made
+	/// safe and the serial ports are closed.
+	rtexec_stop(&exec);
+	rtexec_stop(&imu_exec);
     /// Sleep to let things shut down properly.
     usleep(200000);
 
     /// Close the open file descriptors.
     if (pololu_fd > 0) {
         /// Set all the actuators to safe positions.
+		pthread_mutex_lock(&pololu_lock);
         pololu_initialize_channels(pololu_fd);
+		pthread_mutex_unlock(&pololu_lock);
         usleep(200000);
         close(pololu_fd);
     }
@@ -48,16 +133,828 @@ void nav_exit()
         close(imu_fd);
     }
     if (server_fd > 0) {
-        close(server_fd);
+        net_server_close(&server);
     }
 	if (lj_fd > 0) {
-		close(lj_fd);
+		net_close(lj_fd);
+	}
+	if (signal_fd > 0) {
+		close(signal_fd);
 	}
+	if (channel_fd > 0) {
+		close(channel_fd);
+	}
+	evloop_close(&loop);
+	trace_close();
 
     printf("<OK>\n\n");
 } /* end nav_exit() */
 
 
+/*------------------------------------------------------------------------------
+ * void nav_input()
+ * Hands the messages decoded by the network thread to the control thread.
+ * Only labjack data that came from the labjack daemon is passed on.
+ *----------------------------------------------------------------------------*/
+
+static void nav_input(int fd)
+{
+	NAV_INPUT in;
+
+	if (fd == lj_fd) {
+		lj_latest = net_msg.lj;
+	}
+	else {
+		net_msg.lj = lj_latest;
+	}
+	nav_estop_check();
+
+	in.target = net_msg.target;
+	in.gain = net_msg.gain;
+	in.task = net_msg.task;
+	in.stop = net_msg.stop;
+	in.lj = lj_latest;
+	tribuf_put(&input_tb, &in);
+} /* end nav_input() */
+
+
+/*------------------------------------------------------------------------------
+ * int nav_output()
+ * Copies the newest status from the control thread into net_msg. Returns TRUE
+ * if there was a new one.
+ *----------------------------------------------------------------------------*/
+
+static int nav_output()
+{
+	NAV_OUTPUT out;
+
+	if (!tribuf_get(&output_tb, &out)) {
+		return FALSE;
+	}
+	net_msg.status = out.status;
+	net_msg.mstrain = out.mstrain;
+
+	return TRUE;
+} /* end nav_output() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_estop_check()
+ * Wakes the e-stop thread when a stop message turns on or the kill switch
+ * opens. Only the edges start an e-stop. It stays active, holding off the PID
+ * loops, until the stop is cleared and the kill switch has closed again.
+ *----------------------------------------------------------------------------*/
+
+void nav_estop_check()
+{
+	int stopped = (net_msg.stop.data.state != FALSE);
+	int closed = (lj_latest.data.battery1 > BATT1_THRESH);
+	int trigger = FALSE;
+	int fd = -1;
+	unsigned long long one = 1;
+
+	if (stopped && !estop_stopped) {
+		trigger = TRUE;
+	}
+	if (!closed && estop_kill_closed) {
+		estop_killed = TRUE;
+		trigger = TRUE;
+	}
+	if (closed) {
+		estop_killed = FALSE;
+	}
+	estop_stopped = stopped;
+	estop_kill_closed = closed;
+
+	if (trigger) {
+		__atomic_store_n(&estop_trigger, timing_now(), __ATOMIC_RELAXED);
+		__atomic_store_n(&estop_active, TRUE, __ATOMIC_RELEASE);
+		fd = __atomic_load_n(&estop_fd, __ATOMIC_ACQUIRE);
+		if (fd > 0 && write(fd, &one, sizeof(one)) < 0) {
+			perror("write");
+		}
+	}
+	else if (!stopped && !estop_killed) {
+		__atomic_store_n(&estop_active, FALSE, __ATOMIC_RELEASE);
+	}
+} /* end nav_estop_check() */
+
+
+/*------------------------------------------------------------------------------
+ * void *nav_estop_thread()
+ * Sends neutral to the thrusters each time nav_estop_check() signals on the
+ * eventfd passed in arg and logs the time from the trigger until the commands
+ * have left the port.
+ *----------------------------------------------------------------------------*/
+
+void *nav_estop_thread(void *arg)
+{
+	int fd = (int)(long)arg;
+	unsigned long long count = 0;
+	unsigned long long latency = 0;
+	unsigned long long start = 0;
+	int status = 0;
+
+	while (TRUE) {
+		if (read(fd, &count, sizeof(count)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("read");
+			break;
+		}
+
+		start = trace_begin();
+		pthread_mutex_lock(&pololu_lock);
+		status = pololu_out_neutral(&pololu_out);
+		pthread_mutex_unlock(&pololu_lock);
+		latency = timing_elapsed(__atomic_load_n(&estop_trigger, __ATOMIC_RELAXED));
+		trace_end("estop", start);
+
+		__atomic_add_fetch(&estop_count, 1, __ATOMIC_RELAXED);
+		if (latency > __atomic_load_n(&estop_max, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&estop_max, latency, __ATOMIC_RELAXED);
+		}
+
+		if (status < 0) {
+			printf("NAV_ESTOP: WARNING!!! Could not send neutral to the Pololu.\n");
+			continue;
+		}
+		printf("NAV_ESTOP: Thrusters neutral %.2f ms after the stop.\n", latency / 1000000.);
+		if (latency > estop_bound) {
+			__atomic_add_fetch(&estop_over, 1, __ATOMIC_RELAXED);
+			printf("NAV_ESTOP: WARNING!!! Stop took longer than the %.2f ms bound.\n",
+				estop_bound / 1000000.);
+		}
+	}
+
+	return NULL;
+} /* end nav_estop_thread() */
+
+
+/*------------------------------------------------------------------------------
+ * int nav_estop_start()
+ * Starts the e-stop thread one priority level above the control thread once
+ * there is a Pololu.
+ *----------------------------------------------------------------------------*/
+
+static int nav_estop_start()
+{
+	struct sched_param param;
+	int status = 0;
+	int fd = -1;
+
+	if (pololu_fd <= 0) {
+		return 0;
+	}
+
+	/// The bound is the wakeup allowance plus the neutral commands on the wire
+	/// at 10 bits per byte. It holds except while the Pololu is being brought
+	/// up, when the channels are being set to neutral anyway.
+	__atomic_store_n(&estop_bound, timing_s2ns(NAV_ESTOP_SLACK +
+		(cf.pololu_baud > 0 ? POLOLU_STOP_BYTES * 10. / cf.pololu_baud : 0)), __ATOMIC_RELAXED);
+
+	if ((fd = eventfd(0, 0)) == -1) {
+		perror("eventfd");
+		return -1;
+	}
+	if ((status = pthread_create(&estop_thread, NULL, nav_estop_thread, (void *)(long)fd)) != 0) {
+		printf("NAV_ESTOP_START: WARNING!!! Could not start thread: %s\n", strerror(status));
+		close(fd);
+		return -1;
+	}
+	pthread_setname_np(estop_thread, "nav-estop");
+
+	/// The network thread only sees the eventfd once the thread reading it
+	/// is running.
+	__atomic_store_n(&estop_fd, fd, __ATOMIC_RELEASE);
+
+	if (cf.rt_priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = cf.rt_priority + 1;
+		if ((status = pthread_setschedparam(estop_thread, SCHED_FIFO, &param)) != 0) {
+			printf("NAV_ESTOP_START: WARNING!!! Could not set SCHED_FIFO priority %d: %s\n",
+				param.sched_priority, strerror(status));
+		}
+	}
+	printf("MAIN: E-stop thread running, bound %.2f ms.\n", estop_bound / 1000000.);
+
+	return 0;
+} /* end nav_estop_start() */
+
+
+/*------------------------------------------------------------------------------
+ * void *nav_channel_thread()
+ * Sets every Pololu channel to neutral each time nav_lj_check() asks, then
+ * gives the control thread the time the Pololu will be ready.
+ *----------------------------------------------------------------------------*/
+
+void *nav_channel_thread(void *arg)
+{
+	unsigned long long count = 0;
+
+	while (TRUE) {
+		if (read(channel_fd, &count, sizeof(count)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("read");
+			break;
+		}
+
+		pthread_mutex_lock(&pololu_lock);
+		pololu_initialize_channels(__atomic_load_n(&pololu_fd, __ATOMIC_ACQUIRE));
+		pololu_out_reset(&pololu_out);
+		pthread_mutex_unlock(&pololu_lock);
+		__atomic_store_n(&pololu_ready, timing_now() + timing_s2ns(POLOLU_INIT_TIME),
+			__ATOMIC_RELEASE);
+	}
+
+	return NULL;
+} /* end nav_channel_thread() */
+
+
+/*------------------------------------------------------------------------------
+ * int nav_channel_start()
+ * Starts the channel thread. It is started from main() so it runs at normal
+ * priority, where draining the commands holds up none of the RT threads.
+ *----------------------------------------------------------------------------*/
+
+static int nav_channel_start()
+{
+	int status = 0;
+
+	if ((channel_fd = eventfd(0, 0)) == -1) {
+		perror("eventfd");
+		return -1;
+	}
+	if ((status = pthread_create(&channel_thread, NULL, nav_channel_thread, NULL)) != 0) {
+		printf("NAV_CHANNEL_START: WARNING!!! Could not start thread: %s\n", strerror(status));
+		close(channel_fd);
+		channel_fd = -1;
+		return -1;
+	}
+	pthread_setname_np(channel_thread, "nav-channels");
+
+	return 0;
+} /* end nav_channel_start() */
+
+
+/*------------------------------------------------------------------------------
+ * int nav_imu_setup()
+ * Opens the IMU and checks that it is the Microstrain nav expects.
+ *----------------------------------------------------------------------------*/
+
+static int nav_imu_setup()
+{
+	int fd = -1;
+	int serial = 0;
+
+	if ((fd = mstrain_setup(cf.imu_port, cf.imu_baud)) <= 0) {
+		return -1;
+	}
+	mstrain_serial_number(fd, &serial);
+	if (serial != MSTRAIN_SERIAL) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+} /* end nav_imu_setup() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_imu_ready()
+ * Gives the IMU to the IMU thread.
+ *----------------------------------------------------------------------------*/
+
+static void nav_imu_ready(int fd)
+{
+	__atomic_store_n(&imu_fd, fd, __ATOMIC_RELEASE);
+} /* end nav_imu_ready() */
+
+
+/*------------------------------------------------------------------------------
+ * int nav_pololu_setup()
+ * Opens the Pololu. pololu_setup() also sets every channel to neutral.
+ *----------------------------------------------------------------------------*/
+
+static int nav_pololu_setup()
+{
+	int fd = pololu_setup(cf.pololu_port, cf.pololu_baud);
+
+	return (fd > 0) ? fd : -1;
+} /* end nav_pololu_setup() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_pololu_ready()
+ * Gives the Pololu to the output stage and starts the e-stop thread.
+ *----------------------------------------------------------------------------*/
+
+static void nav_pololu_ready(int fd)
+{
+	pthread_mutex_lock(&pololu_lock);
+	pololu_out.fd = fd;
+	pololu_out_reset(&pololu_out);
+	pthread_mutex_unlock(&pololu_lock);
+	__atomic_store_n(&pololu_fd, fd, __ATOMIC_RELEASE);
+
+	if (nav_estop_start() == -1) {
+		printf("MAIN: WARNING!!! E-stop thread setup failed.\n");
+	}
+} /* end nav_pololu_ready() */
+
+
+/*------------------------------------------------------------------------------
+ * void *nav_device_thread()
+ * Runs the setup of one device. The device is only handed to nav if it came
+ * up before its timeout, otherwise it is closed.
+ *----------------------------------------------------------------------------*/
+
+static void *nav_device_thread(void *arg)
+{
+	NAV_DEVICE *dev = (NAV_DEVICE *)arg;
+	int expected = NAV_DEV_PENDING;
+	int fd = -1;
+
+	fd = dev->setup();
+	dev->time = timing_elapsed(nav_start);
+
+	if (!__atomic_compare_exchange_n(&dev->state, &expected,
+		(fd > 0) ? NAV_DEV_UP : NAV_DEV_FAILED, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		if (fd > 0) {
+			close(fd);
+		}
+		return NULL;
+	}
+	if (fd > 0) {
+		dev->ready(fd);
+	}
+
+	return NULL;
+} /* end nav_device_thread() */
+
+
+/*------------------------------------------------------------------------------
+ * int nav_device_start()
+ * Starts bringing up a device on its own thread.
+ *----------------------------------------------------------------------------*/
+
+static int nav_device_start(NAV_DEVICE *dev, const char *name, int (*setup)(),
+	void (*ready)(int fd), float timeout)
+{
+	char thread_name[16];
+	int status = 0;
+
+	memset(dev, 0, sizeof(NAV_DEVICE));
+	dev->name = name;
+	dev->setup = setup;
+	dev->ready = ready;
+	dev->timeout = timeout;
+	dev->state = NAV_DEV_PENDING;
+
+	if ((status = pthread_create(&dev->thread, NULL, nav_device_thread, dev)) != 0) {
+		printf("NAV_DEVICE_START: WARNING!!! Could not start %s thread: %s\n", name, strerror(status));
+		dev->state = NAV_DEV_FAILED;
+		return -1;
+	}
+	pthread_detach(dev->thread);
+	snprintf(thread_name, sizeof(thread_name), "up-%s", name);
+	pthread_setname_np(dev->thread, thread_name);
+
+	return 0;
+} /* end nav_device_start() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_bringup_timer()
+ * Reports each device once it is up, has failed or has passed its timeout.
+ * When every device is done and the control thread has run, prints the
+ * startup times and removes itself from the event loop.
+ *----------------------------------------------------------------------------*/
+
+void nav_bringup_timer(int fd, unsigned int expirations, void *arg)
+{
+	NAV_DEVICE *dev = NULL;
+	NAV_DEVICE *slowest = NULL;
+	unsigned long long now = timing_elapsed(nav_start);
+	unsigned long long time = 0;
+	unsigned long long slowest_time = 0;
+	int expected = NAV_DEV_PENDING;
+	int pending = FALSE;
+	int ii;
+
+	for (ii = 0; ii < NAV_DEVICES; ii++) {
+		dev = &devices[ii];
+		if (dev->name == NULL) {
+			continue;
+		}
+
+		/// A device that times out may still be writing its time, so the
+		/// timeout is used for it instead.
+		expected = NAV_DEV_PENDING;
+		if (now > timing_s2ns(dev->timeout)) {
+			__atomic_compare_exchange_n(&dev->state, &expected, NAV_DEV_TIMEOUT,
+				FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+		}
+
+		switch (__atomic_load_n(&dev->state, __ATOMIC_ACQUIRE)) {
+		case NAV_DEV_PENDING:
+			pending = TRUE;
+			continue;
+		case NAV_DEV_UP:
+			time = dev->time;
+			if (!dev->reported) {
+				printf("MAIN: %s setup OK in %.1f ms.\n", dev->name, time / 1000000.);
+			}
+			break;
+		case NAV_DEV_FAILED:
+			time = dev->time;
+			if (!dev->reported) {
+				printf("MAIN: WARNING!!! %s setup failed after %.1f ms.\n", dev->name, time / 1000000.);
+			}
+			break;
+		case NAV_DEV_TIMEOUT:
+			time = timing_s2ns(dev->timeout);
+			if (!dev->reported) {
+				printf("MAIN: WARNING!!! %s not up after %.1f s, going on without it.\n",
+					dev->name, dev->timeout);
+			}
+			break;
+		}
+		dev->reported = TRUE;
+		if (slowest == NULL || time > slowest_time) {
+			slowest = dev;
+			slowest_time = time;
+		}
+
+		/// The PID loops have nothing to run on without the IMU.
+		if (dev == &devices[0] && __atomic_load_n(&dev->state, __ATOMIC_ACQUIRE) != NAV_DEV_UP) {
+			printf("MAIN: WARNING!!! No IMU. %s\n", NAV_NO_IMU);
+			exit(-1);
+		}
+	}
+
+	if (pending || __atomic_load_n(&first_tick, __ATOMIC_RELAXED) == 0) {
+		return;
+	}
+
+	if (slowest != NULL) {
+		printf("MAIN: Devices done in %.1f ms, slowest %s.\n", slowest_time / 1000000., slowest->name);
+	}
+	printf("MAIN: First control tick %.1f ms after start.\n",
+		__atomic_load_n(&first_tick, __ATOMIC_RELAXED) / 1000000.);
+	evloop_del_fd(&loop, fd);
+} /* end nav_bringup_timer() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_lj_timer()
+ * Exchanges data on the shared memory bus. Over TCP the labjack daemon pushes
+ * its data to nav_lj_read() instead.
+ *----------------------------------------------------------------------------*/
+
+void nav_lj_timer(int fd, unsigned int expirations, void *arg)
+{
+	int recv_bytes = 0;
+
+	nav_output();
+	recv_bytes = net_client(lj_fd, lj_buf, &net_msg, MODE_STATUS);
+	if (recv_bytes > 0) {
+		messages_decode(lj_fd, lj_buf, &net_msg, recv_bytes);
+		nav_input(lj_fd);
+		net_server_publish(&server, LJ_MSGID, &net_msg);
+	}
+} /* end nav_lj_timer() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_lj_read()
+ * Decodes labjack data pushed by the labjack daemon and passes it on to
+ * subscribed clients.
+ *----------------------------------------------------------------------------*/
+
+void nav_lj_read(int fd, unsigned int events, void *arg)
+{
+	int recv_bytes = 0;
+
+	recv_bytes = net_recv(lj_fd, lj_buf);
+	if (recv_bytes == 0) {
+		/// The connection to the labjack daemon is reopened in the background
+		/// and the subscription is sent again.
+		return;
+	}
+	else if (recv_bytes > 0) {
+		messages_decode(lj_fd, lj_buf, &net_msg, recv_bytes);
+		nav_input(lj_fd);
+		net_server_publish(&server, LJ_MSGID, &net_msg);
+	}
+} /* end nav_lj_read() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_net_recv()
+ * Called after a request from the planner has been decoded. Passes the new
+ * messages to the control thread and fills in the newest status for the reply.
+ *----------------------------------------------------------------------------*/
+
+void nav_net_recv(int fd, MSG_DATA *msg, void *arg)
+{
+	nav_input(fd);
+	nav_output();
+} /* end nav_net_recv() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_status_timer()
+ * Pushes the newest status from the control thread to subscribed clients.
+ *----------------------------------------------------------------------------*/
+
+void nav_status_timer(int fd, unsigned int expirations, void *arg)
+{
+	if (nav_output()) {
+		/// Raw IMU data is only sent to clients that ask for it.
+		net_server_publish(&server, MSTRAIN_MSGID, &net_msg);
+		net_server_publish(&server, STATUS_MSGID, &net_msg);
+	}
+} /* end nav_status_timer() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_imu_task()
+ * Reads the Microstrain on the IMU thread. The serial read blocks only this
+ * thread. Nothing is passed on until the IMU is up.
+ *----------------------------------------------------------------------------*/
+
+void nav_imu_task(unsigned int periods, void *arg)
+{
+	MSTRAIN_DATA *imu = &imu_msg.data;
+
+	int fd = __atomic_load_n(&imu_fd, __ATOMIC_ACQUIRE);
+
+	if (fd <= 0) {
+		return;
+	}
+	mstrain_euler_vectors(fd, &imu->pitch, &imu->roll, &imu->yaw, imu->accel, imu->ang_rate);
+	__atomic_add_fetch(&count_mstrain, 1, __ATOMIC_RELAXED);
+
+	/// Stamp the sample so the control thread can tell how old it is.
+	imu_msg.hdr.stamp = timing_now();
+	tribuf_put(&imu_tb, &imu_msg);
+} /* end nav_imu_task() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_lj_check()
+ * Checks whether the kill switch has been closed and brings up the Pololu.
+ * The channels are set on the channel thread, so this only starts that and
+ * waits for the time it gives back to pass.
+ *----------------------------------------------------------------------------*/
+
+void nav_lj_check()
+{
+	unsigned long long one = 1;
+	unsigned long long ready = 0;
+
+	if (pololu_initialized == FALSE) {
+		/// Get the state of the kill switch.
+		if (msg.lj.data.battery1 > BATT1_THRESH && channel_fd > 0 &&
+			__atomic_load_n(&pololu_fd, __ATOMIC_ACQUIRE) > 0) {
+			if (pololu_starting == FALSE) {
+				__atomic_store_n(&pololu_ready, 0, __ATOMIC_RELAXED);
+				if (write(channel_fd, &one, sizeof(one)) < 0) {
+					perror("write");
+				}
+				pololu_starting = TRUE;
+			}
+			/// Check that 7 seconds have elapsed since initializing Pololu.
+			ready = __atomic_load_n(&pololu_ready, __ATOMIC_ACQUIRE);
+			if (ready != 0 && timing_deadline_passed(ready)) {
+				pololu_initialized = TRUE;
+				pololu_starting = FALSE;
+				memset(pid.ierr, 0, sizeof(pid.ierr));
+				msg.target.data.yaw = msg.status.data.yaw;
+				printf("MAIN: Pololu initialized.\n");
+			}
+		}
+		else {
+			pololu_initialized = FALSE;
+			pololu_starting = FALSE;
+		}
+	}
+	else {
+		/// Get the state of the kill switch.
+		if (msg.lj.data.battery1 > BATT1_THRESH) {
+			pololu_initialized = TRUE;
+		}
+		else {
+			pololu_initialized = FALSE;
+		}
+	}
+} /* end nav_lj_check() */
+
+
+/*------------------------------------------------------------------------------
+ * int nav_newer()
+ * Checks whether a decoded message is not the one nav already has.
+ *----------------------------------------------------------------------------*/
+
+static int nav_newer(const HEADER *in, const HEADER *cur)
+{
+	return (in->seq != cur->seq || in->stamp != cur->stamp ||
+		in->producer != cur->producer);
+} /* end nav_newer() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_control_update()
+ * Takes the newest IMU sample and network messages on the control thread.
+ * Messages that have not changed since the last update are left alone so that
+ * changes made by the controller, such as holding the current yaw, stick.
+ *----------------------------------------------------------------------------*/
+
+static void nav_control_update()
+{
+	NAV_INPUT in;
+	MSTRAIN_MSG imu;
+	int gains = FALSE;
+
+	if (tribuf_get(&imu_tb, &imu)) {
+		msg.mstrain.hdr.stamp = imu.hdr.stamp;
+		msg.mstrain.data = imu.data;
+		messages_update(&msg);
+	}
+
+	if (tribuf_get(&input_tb, &in)) {
+		if (nav_newer(&in.target.hdr, &msg.target.hdr)) {
+			msg.target = in.target;
+			gains = TRUE;
+		}
+		if (nav_newer(&in.gain.hdr, &msg.gain.hdr)) {
+			msg.gain = in.gain;
+			gains = TRUE;
+		}
+		if (nav_newer(&in.task.hdr, &msg.task.hdr)) {
+			msg.task = in.task;
+		}
+		if (nav_newer(&in.stop.hdr, &msg.stop.hdr)) {
+			msg.stop = in.stop;
+		}
+		if (nav_newer(&in.lj.hdr, &msg.lj.hdr)) {
+			msg.lj = in.lj;
+			msg.status.data.depth = msg.lj.data.pressure;
+		}
+	}
+
+	/// The gains are only reloaded when they change. The target is included
+	/// because the yaw gains depend on the task.
+	if (gains) {
+		pid_set_gains(&pid, &cf, &msg);
+	}
+
+	nav_lj_check();
+
+	/// Make sure that the servo and speed commands are zero if Pololu is not initialized.
+	if (pololu_initialized == FALSE) {
+		msg.target.data.fx = 0;
+		msg.target.data.fy = 0;
+		msg.target.data.speed = 0;
+	}
+} /* end nav_control_update() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_pid_task()
+ * Runs the PID loop for one axis on the control thread. The axis is passed in
+ * arg. The time step is the period times the number of periods since the last
+ * run so a skipped release is accounted for.
+ *----------------------------------------------------------------------------*/
+
+void nav_pid_task(unsigned int periods, void *arg)
+{
+	int axis = (int)(long)arg;
+	float dt[PID_AXES];
+	NAV_OUTPUT out;
+
+	switch (axis) {
+	case PID_PITCH:
+		dt[axis] = cf.period_pitch * periods;
+		__atomic_add_fetch(&count_pitch, 1, __ATOMIC_RELAXED);
+		break;
+	case PID_ROLL:
+		dt[axis] = cf.period_roll * periods;
+		__atomic_add_fetch(&count_roll, 1, __ATOMIC_RELAXED);
+		break;
+	case PID_YAW:
+		dt[axis] = cf.period_yaw * periods;
+		__atomic_add_fetch(&count_yaw, 1, __ATOMIC_RELAXED);
+		break;
+	case PID_DEPTH:
+		dt[axis] = cf.period_depth * periods;
+		__atomic_add_fetch(&count_depth, 1, __ATOMIC_RELAXED);
+		break;
+	}
+
+	if (__atomic_load_n(&first_tick, __ATOMIC_RELAXED) == 0) {
+		__atomic_store_n(&first_tick, timing_elapsed(nav_start), __ATOMIC_RELAXED);
+	}
+
+	nav_control_update();
+	if (msg.mstrain.hdr.stamp != 0) {
+		hist_add(&age_hist[axis], timing_elapsed(msg.mstrain.hdr.stamp));
+		trace_counter("imu_age_us", timing_elapsed(msg.mstrain.hdr.stamp) / 1000);
+	}
+
+	if (msg.stop.data.state == FALSE && pololu_initialized == FALSE) {
+		/// Nothing is sent to the Pololu until it is initialized, so the lock
+		/// is left to the channel thread while it sets the channels.
+		if (!__atomic_load_n(&estop_active, __ATOMIC_ACQUIRE)) {
+			pid_loop(&pololu_out, &pid, &msg, PID_AXIS_BIT(axis), dt, FALSE);
+		}
+	}
+	else if (msg.stop.data.state == FALSE) {
+		/// An e-stop can start before its stop message gets here. The check
+		/// is made under the lock so nothing is sent after the neutral
+		/// commands.
+		pthread_mutex_lock(&pololu_lock);
+		if (!__atomic_load_n(&estop_active, __ATOMIC_ACQUIRE)) {
+			pid_loop(&pololu_out, &pid, &msg, PID_AXIS_BIT(axis), dt, TRUE);
+
+			/// Send the changed actuator commands and record how old the
+			/// target was when it reached the thrusters.
+			pololu_out_flush(&pololu_out);
+			messages_used(&msg.target.hdr);
+		}
+		pthread_mutex_unlock(&pololu_lock);
+	}
+
+	/// Hand the new status to the network thread.
+	out.status = msg.status;
+	out.mstrain = msg.mstrain;
+	tribuf_put(&output_tb, &out);
+} /* end nav_pid_task() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_diag_timer()
+ * Pushes the loop timing histograms of one PID axis to subscribed clients.
+ * Each call sends the next axis so every axis is sent once per NAV_DIAG_PERIOD
+ * times the number of axes.
+ *----------------------------------------------------------------------------*/
+
+void nav_diag_timer(int fd, unsigned int expirations, void *arg)
+{
+	static int axis = PID_DEPTH;
+	DIAG *diag = &net_msg.diag.data;
+	RTEXEC_TASK *task = NULL;
+
+	axis = (axis >= PID_DEPTH) ? PID_PITCH : axis + 1;
+	if ((task = rtexec_find(&exec, axis_names[axis])) == NULL) {
+		return;
+	}
+
+	diag->axis = axis;
+	diag->runs = __atomic_load_n(&task->runs, __ATOMIC_RELAXED);
+	diag->overruns = __atomic_load_n(&task->overruns, __ATOMIC_RELAXED);
+	diag->skipped = __atomic_load_n(&task->skipped, __ATOMIC_RELAXED);
+	hist_copy(&task->hist_period, diag->period);
+	hist_copy(&task->hist_error, diag->error);
+	hist_copy(&task->hist_exec, diag->exec);
+	hist_copy(&age_hist[axis], diag->age);
+
+	net_server_publish(&server, DIAG_MSGID, &net_msg);
+} /* end nav_diag_timer() */
+
+
+/*------------------------------------------------------------------------------
+ * void nav_print_timer()
+ * Prints how many times the loops have run in the last second and the state
+ * of the client send queues.
+ *----------------------------------------------------------------------------*/
+
+void nav_print_timer(int fd, unsigned int expirations, void *arg)
+{
+	printf("MAIN: %d %d %d %d PID loops and %d Microstrain reads per second.\n",
+	    __atomic_exchange_n(&count_pitch, 0, __ATOMIC_RELAXED),
+	    __atomic_exchange_n(&count_roll, 0, __ATOMIC_RELAXED),
+	    __atomic_exchange_n(&count_yaw, 0, __ATOMIC_RELAXED),
+	    __atomic_exchange_n(&count_depth, 0, __ATOMIC_RELAXED),
+	    __atomic_exchange_n(&count_mstrain, 0, __ATOMIC_RELAXED));
+	rtexec_print_stats(&exec);
+	rtexec_print_stats(&imu_exec);
+	pololu_out_print_stats(&pololu_out);
+	if (__atomic_load_n(&estop_count, __ATOMIC_RELAXED) > 0) {
+		printf("ESTOP: %u stops, worst %.2f ms, %u over the %.2f ms bound\n",
+			__atomic_load_n(&estop_count, __ATOMIC_RELAXED),
+			__atomic_load_n(&estop_max, __ATOMIC_RELAXED) / 1000000.,
+			__atomic_load_n(&estop_over, __ATOMIC_RELAXED),
+			__atomic_load_n(&estop_bound, __ATOMIC_RELAXED) / 1000000.);
+	}
+	net_print_stats();
+} /* end nav_print_timer() */
+
+
 /*------------------------------------------------------------------------------
  * int main()
  * Initialize data. Open ports. Run main program loop.
@@ -65,45 +962,28 @@ void nav_exit()
 
 int main(int argc, char *argv[])
 {
-    /// Setup exit function. It is called when SIGINT (ctrl-c) is invoked.
+    /// Setup exit function. It is called when main() returns or exits.
     void(*exit_ptr)(void);
     exit_ptr = nav_exit;
     atexit(exit_ptr);
 
-	/// Attach signals to exit function.
-    struct sigaction sigint_action;
-    sigint_action.sa_handler = nav_sigint;
-    sigint_action.sa_flags = 0;
-    sigaction(SIGINT, &sigint_action, NULL);
-    sigaction(SIGTERM, &sigint_action, NULL);
-    sigaction(SIGQUIT, &sigint_action, NULL);
-    sigaction(SIGHUP, &sigint_action, NULL);
+	/// Block the exit signals before any thread is started so every thread
+	/// inherits the mask. They are read by the event loop instead. A handler
+	/// could run on the control thread while it holds the Pololu lock, and
+	/// nav_exit() would then wait on itself.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGQUIT);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
 
 	/// Declare variables.
     int status = -1;
-	int pololu_initialized = FALSE;
-	int pololu_starting = FALSE;
-    int recv_bytes = 0;
-    int mode = MODE_STATUS;
-	int mstrain_serial = 0;
-    char recv_buf[MAX_MSG_SIZE];
-	char lj_buf[MAX_MSG_SIZE];
-    CONF_VARS cf;
-    MSG_DATA msg;
-    PID pid;
-	float dt = 0.;
-    TIMING timer_pitch;
-    TIMING timer_roll;
-    TIMING timer_yaw;
-    TIMING timer_depth;
-	TIMING timer_pololu;
-	TIMING timer_print;
-	int count_pitch = 0;
-	int count_roll = 0;
-	int count_yaw = 0;
-	int count_depth = 0;
-	int count_mstrain = 0;
+	pthread_mutexattr_t attr;
 
+	nav_start = timing_now();
     printf("MAIN: Starting Navigation ... \n");
 
     /// Initialize variables.
@@ -112,21 +992,52 @@ int main(int argc, char *argv[])
     imu_fd = -1;
 	lj_fd = 0;
     memset(&msg, 0, sizeof(MSG_DATA));
-    memset(&pid, 0, sizeof(PID));
+    memset(&net_msg, 0, sizeof(MSG_DATA));
+    memset(&imu_msg, 0, sizeof(MSTRAIN_MSG));
+    memset(&age_hist, 0, sizeof(age_hist));
+    memset(&lj_latest, 0, sizeof(LJ_MSG));
     memset(&recv_buf, 0, MAX_MSG_SIZE);
     memset(&lj_buf, 0, MAX_MSG_SIZE);
 	messages_init(&msg);
+	messages_init(&net_msg);
+	messages_set_producer(MSG_PRODUCER_NAV);
+	if (evloop_init(&loop) == -1) {
+		printf("MAIN: WARNING!!! Event loop setup failed.\n");
+		exit(-1);
+	}
+	if ((signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC)) == -1 ||
+		evloop_add_fd(&loop, signal_fd, EVLOOP_READ, nav_signal, NULL) == -1) {
+		printf("MAIN: WARNING!!! Signal setup failed.\n");
+		exit(-1);
+	}
+	rtexec_init(&exec);
+	rtexec_init(&imu_exec);
+	tribuf_init(&imu_tb, imu_bufs, sizeof(MSTRAIN_MSG));
+	tribuf_init(&input_tb, input_bufs, sizeof(NAV_INPUT));
+	tribuf_init(&output_tb, output_bufs, sizeof(NAV_OUTPUT));
 
     /// Parse command line arguments.
     parse_default_config(&cf);
     parse_cla(argc, argv, &cf, STINGRAY, (const char *)STINGRAY_FILENAME);
 
+	/// Start tracing if a trace file is given.
+	if (cf.trace_file[0] != '\0' && trace_open(cf.trace_file) == 0) {
+		printf("MAIN: Tracing to %s.\n", cf.trace_file);
+	}
+
     /// Initialize the PID controllers with configuration file values.
     status = pid_init(&pid, &cf);
 
+	/// Keep the process in memory so the PID loops never wait on a page fault.
+	if (cf.rt_lock) {
+		if (rtexec_lock_memory() == 0) {
+			printf("MAIN: Memory locked.\n");
+		}
+	}
+
     /// Set up server.
     if (cf.enable_server) {
-        server_fd = net_server_setup(cf.server_port);
+        server_fd = net_server_setup(&server, cf.server_port);
 		if (server_fd > 0) {
 			printf("MAIN: Nav server setup OK.\n");
 		}
@@ -135,37 +1046,31 @@ int main(int argc, char *argv[])
 		}
     }
 
-    /// Set up the Microstrain IMU.
+	/// The Pololu lock lends the priority of the e-stop thread to the control
+	/// thread while it holds the lock.
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&pololu_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	pololu_out_init(&pololu_out, -1);
+
+	/// The serial devices come up on their own threads so the slowest one
+	/// sets the startup time instead of all of them in turn. The IMU and the
+	/// Pololu are left alone until they are up. There is no simulation mode
+	/// since random IMU data does not follow the thrusters; simd models the
+	/// vehicle behind the same ports instead.
     if (cf.enable_imu) {
-        imu_fd = mstrain_setup(cf.imu_port , cf.imu_baud);
-		status = mstrain_serial_number(imu_fd, &mstrain_serial);
-		if (mstrain_serial == MSTRAIN_SERIAL) {
-			printf("MAIN: IMU setup OK.\n");
-		}
-		else {
-			printf("MAIN: SIMULATION MODE!!! IMU data is simulated.\n");
-			/// Seed the random number generator.
-			srand((unsigned int)time(NULL));
-			imu_fd = 0;
-		}
+		nav_device_start(&devices[0], "imu", nav_imu_setup, nav_imu_ready, NAV_IMU_TIMEOUT);
     }
 	else {
-		printf("MAIN: SIMULATION MODE!!! IMU data is simulated.\n");
-		/// Seed the random number generator.
-		srand((unsigned int)time(NULL));
+		printf("MAIN: WARNING!!! IMU disabled. %s\n", NAV_NO_IMU);
+		exit(-1);
 	}
-
-    /// Set up the Pololu servo controller.
     if (cf.enable_pololu) {
-        pololu_fd = pololu_setup(cf.pololu_port, cf.pololu_baud);
-		if (pololu_fd > 0) {
-			/// Initialize the pololu.
-			pololu_initialize_channels(pololu_fd);
-			printf("MAIN: Pololu setup OK.\n");
-		}
-		else {
-			printf("MAIN: WARNING!!! Pololu setup failed.\n");
+		if (nav_channel_start() == -1) {
+			printf("MAIN: WARNING!!! Pololu channel thread setup failed.\n");
 		}
+		nav_device_start(&devices[1], "pololu", nav_pololu_setup, nav_pololu_ready, NAV_POLOLU_TIMEOUT);
     }
 
 	/// Connect to the labjack daemon.
@@ -179,147 +1084,51 @@ int main(int argc, char *argv[])
 		}
 	}
 
-    /// Initialize timers.
-    timing_set_timer(&timer_pitch);
-    timing_set_timer(&timer_roll);
-    timing_set_timer(&timer_yaw);
-    timing_set_timer(&timer_depth);
-    timing_set_timer(&timer_pololu);
-    timing_set_timer(&timer_print);
+    /// Register the file descriptors and timers with the event loop.
+    if ((cf.enable_server) && (server_fd > 0)) {
+        net_server_add(&loop, &server, recv_buf, &net_msg, MODE_PLANNER, nav_net_recv, NULL);
+    }
+	if ((cf.enable_pololu > 0) && (cf.enable_labjack > 0) && (lj_fd > 0)) {
+		/// The shared memory bus cannot be watched so it is read from a timer.
+		if (shmbus_is_bus(lj_fd)) {
+			evloop_add_timer(&loop, NAV_LJ_PERIOD, nav_lj_timer, NULL);
+		}
+		else {
+			net_client_watch(&loop, lj_fd, nav_lj_read, NULL);
+			net_subscribe(lj_fd, MSG_TOPIC(LJ_MSGID), 0);
+		}
+	}
+	evloop_add_timer(&loop, NAV_IMU_PERIOD, nav_status_timer, NULL);
+	evloop_add_timer(&loop, NAV_DIAG_PERIOD, nav_diag_timer, NULL);
+	evloop_add_timer(&loop, 1., nav_print_timer, NULL);
+	evloop_add_timer(&loop, NAV_BRINGUP_PERIOD, nav_bringup_timer, NULL);
 
-	printf("MAIN: Nav running now.\n");
+	/// The IMU is read on its own thread so that the blocking serial request
+	/// holds up neither the network nor the PID loops.
+	rtexec_add(&imu_exec, "imu", NAV_IMU_PERIOD, nav_imu_task, NULL);
+	if (rtexec_start(&imu_exec, 0, -1) == -1) {
+		printf("MAIN: WARNING!!! IMU thread setup failed.\n");
+		exit(-1);
+	}
+	pthread_setname_np(imu_exec.thread, "nav-imu");
 
-    /// Main loop. Will exit on <ctrl-c>.
-    while (1) {
-		/// Check labjack data to see if kill switch has been closed.
-		if ((cf.enable_pololu > 0) && (cf.enable_labjack > 0) && (lj_fd > 0)) {
-			recv_bytes = net_client(lj_fd, lj_buf, &msg, mode);
-			lj_buf[recv_bytes] = '\0';
-			if (recv_bytes > 0) {
-				messages_decode(lj_fd, lj_buf, &msg, recv_bytes);
-				msg.status.data.depth = msg.lj.data.pressure;
-			}
-			if (pololu_initialized == FALSE) {
-				/// Get the state of the kill switch.
-				if (msg.lj.data.battery1 > BATT1_THRESH) {
-					if (pololu_starting == FALSE) {
-						pololu_initialize_channels(pololu_fd);
-						pololu_starting = TRUE;
-						/// Start the timer.
-						timing_set_timer(&timer_pololu);
-					}
-					/// Check that 7 seconds have elapsed since initializing Pololu.
-					if ((dt = timing_check_period(&timer_pololu, (float)POLOLU_INIT_TIME))) {
-						pololu_initialized = TRUE;
-						pololu_starting = FALSE;
-						pid.pitch.ierr = 0;
-						pid.roll.ierr = 0;
-						pid.yaw.ierr = 0;
-						pid.depth.ierr = 0;
-						pid.fx.ierr = 0;
-						pid.fy.ierr = 0;
-						msg.target.data.yaw = msg.status.data.yaw;
-						printf("MAIN: Pololu initialized.\n");
-					}
-				}
-				else {
-					pololu_initialized = FALSE;
-					pololu_starting = FALSE;
-				}
-			}
-			else {
-				/// Get the state of the kill switch.
-				if (msg.lj.data.battery1 > BATT1_THRESH) {
-					pololu_initialized = TRUE;
-				}
-				else {
-					pololu_initialized = FALSE;
-				}
-			}
-		}
+	/// The PID loops run on the control thread at fixed rates so that network
+	/// and serial I/O cannot delay them.
+	rtexec_add(&exec, axis_names[PID_PITCH], cf.period_pitch, nav_pid_task, (void *)PID_PITCH);
+	rtexec_add(&exec, axis_names[PID_ROLL], cf.period_roll, nav_pid_task, (void *)PID_ROLL);
+	rtexec_add(&exec, axis_names[PID_YAW], cf.period_yaw, nav_pid_task, (void *)PID_YAW);
+	rtexec_add(&exec, axis_names[PID_DEPTH], cf.period_depth, nav_pid_task, (void *)PID_DEPTH);
+	if (rtexec_start(&exec, cf.rt_priority, cf.rt_cpu) == -1) {
+		printf("MAIN: WARNING!!! PID executor setup failed.\n");
+		exit(-1);
+	}
+	pthread_setname_np(exec.thread, "nav-control");
 
-        /// Get network data.
-        if ((cf.enable_server) && (server_fd > 0)) {
-            recv_bytes = net_server(server_fd, recv_buf, &msg, MODE_PLANNER);
-            if (recv_bytes > 0) {
-                recv_buf[recv_bytes] = '\0';
-                messages_decode(server_fd, recv_buf, &msg, recv_bytes);
-				/// Make sure that the servo and speed commands are zero if Pololu is not initialized.
-				if (pololu_initialized == FALSE) {
-					msg.target.data.fx = 0;
-					msg.target.data.fy = 0;
-					msg.target.data.speed = 0;
-				}
-            }
-        }
-
-        /// Get Microstrain data.
-        if ((cf.enable_imu) && (imu_fd > 0)) {
-            //recv_bytes = mstrain_euler_angles(imu_fd, &msg.mstrain.data.pitch, &msg.mstrain.data.roll, &msg.mstrain.data.yaw);
-			//recv_bytes = mstrain_vectors(imu_fd, 0, msg.mstrain.data.mag, msg.mstrain.data.accel, msg.mstrain.data.ang_rate);
-			recv_bytes = mstrain_euler_vectors(imu_fd, &msg.mstrain.data.pitch, &msg.mstrain.data.roll, &msg.mstrain.data.yaw, msg.mstrain.data.accel, msg.mstrain.data.ang_rate);
-			count_mstrain++;
-        }
-		else {
-			/// Simulation Mode. This is where the simulated data is generated.
-			msg.mstrain.data.pitch       = cf.target_pitch + rand() / (float)RAND_MAX;
-			msg.mstrain.data.roll        = cf.target_roll  + rand() / (float)RAND_MAX;
-			msg.mstrain.data.yaw         = cf.target_yaw   + rand() / (float)RAND_MAX;
-			msg.mstrain.data.accel[0]    = 0 + rand() / (float)RAND_MAX;
-			msg.mstrain.data.accel[1]    = 0 + rand() / (float)RAND_MAX;
-			msg.mstrain.data.accel[2]    = 0 + rand() / (float)RAND_MAX;
-			msg.mstrain.data.ang_rate[0] = 0 + rand() / (float)RAND_MAX;
-			msg.mstrain.data.ang_rate[1] = 0 + rand() / (float)RAND_MAX;
-			msg.mstrain.data.ang_rate[2] = 0 + rand() / (float)RAND_MAX;
-		}
-
-        /// Perform PID loops.
-        if (msg.stop.data.state == FALSE) {
-            /// Pitch.
-			if ((dt = timing_check_period(&timer_pitch, cf.period_pitch))) {
-				//printf("MAIN: Hit pitch timer at %fs.\n", dt);
-				timing_set_timer(&timer_pitch);
-                pid_loop(pololu_fd, &pid, &cf, &msg, dt, PID_PITCH, pololu_initialized);
-				count_pitch++;
-            }
-
-            /// Roll.
-			if ((dt = timing_check_period(&timer_roll, cf.period_roll))) {
-				timing_set_timer(&timer_roll);
-                pid_loop(pololu_fd, &pid, &cf, &msg, dt, PID_ROLL, pololu_initialized);
-                count_roll++;
-            }
-
-            /// Yaw.
-			if ((dt = timing_check_period(&timer_yaw, cf.period_yaw))) {
-				timing_set_timer(&timer_yaw);
-                pid_loop(pololu_fd, &pid, &cf, &msg, dt, PID_YAW, pololu_initialized);
-                count_yaw++;
-            }
-
-            /// Depth.
-			if ((dt = timing_check_period(&timer_depth, cf.period_depth))) {
-				timing_set_timer(&timer_depth);
-                pid_loop(pololu_fd, &pid, &cf, &msg, dt, PID_DEPTH, pololu_initialized);
-                count_depth++;
-            }
-        }
-
-		// Temporary check to see how fast PID loop is reached.
-		if (timing_check_period(&timer_print, 1.)) {
-			printf("MAIN: %d %d %d %d PID loops and %d Microstrain reads per second.\n",
-			    count_pitch, count_roll, count_yaw, count_depth, count_mstrain);
-			count_pitch = 0;
-			count_roll = 0;
-			count_yaw = 0;
-			count_depth = 0;
-			count_mstrain = 0;
-			timing_set_timer(&timer_print);
-		}
-
-        /// Update status message.
-        messages_update(&msg);
-    }
+	printf("MAIN: Nav running now.\n");
+
+    /// Main loop. Blocks until a socket is ready or a timer expires. Returns
+    /// when nav_signal() stops it on <ctrl-c>.
+    evloop_run(&loop);
 
     exit(0);
 } /* end main() */
@@ -33,6 +33,17 @@
 #define MAX_TOKENS  10
 #endif /* MAX_TOKENS */
 
+/** @name Gain schedule sizes. Up to PARSE_SCHED_BREAKS depths and speeds
+ * are the grid, and up to PARSE_SCHED_MAX points fill it in. */
+//@{
+#ifndef PARSE_SCHED_SIZES
+#define PARSE_SCHED_SIZES
+#define PARSE_SCHED_BREAKS	4
+#define PARSE_SCHED_MAX		64
+#define PARSE_SCHED_AXIS	8
+#endif /* PARSE_SCHED_SIZES */
+//@}
+
 #ifndef APPS
 #define APPS
 #define STINGRAY    1
@@ -49,6 +60,17 @@
 #ifndef _CONF_VARS_
 #define _CONF_VARS_
 
+//! One point of the gain schedule, from a "sched" line.
+typedef struct _PARSE_SCHED {
+	int		task;						//!< Task the gains are for
+	char	axis[PARSE_SCHED_AXIS];		//!< pitch, roll, yaw, depth, fx or fy
+	float	depth;						//!< Depth of the point
+	float	speed;						//!< Speed of the point
+	float	kp;							//!< Proportional gain
+	float	ki;							//!< Integral gain
+	float	kd;							//!< Derivative gain
+} PARSE_SCHED;
+
 //! Variables to initialize. Preferably using a configuration file that is
 //! parsed at the start of the program. Otherwise default values are used.
 
@@ -60,6 +82,7 @@ typedef struct _CONF_VARS {
     char        imu_port[STRING_SIZE];
     int         enable_server;
 	int			enable_nav;
+	int			enable_shmbus;
     int         net_mode;
     short int   nav_port;
 	short int	server_port;
@@ -193,6 +216,23 @@ typedef struct _CONF_VARS {
 	int			input_size;
 	int			input_type;
 	float		input_prob;
+	int			rt_priority;
+	int			rt_cpu;
+	int			rt_lock;
+	int			pid_windup;
+	float		pid_dfilter;
+	char		trace_file[STRING_SIZE];
+	float		sched_depth[PARSE_SCHED_BREAKS];
+	int			sched_depths;
+	float		sched_speed[PARSE_SCHED_BREAKS];
+	int			sched_speeds;
+	PARSE_SCHED	sched[PARSE_SCHED_MAX];
+	int			sched_points;
+	char		sim_imu[STRING_SIZE];
+	char		sim_pololu[STRING_SIZE];
+	int			sim_noise;
+	int			sim_seed;
+	float		sim_bench;
 } CONF_VARS;
 
 #endif /* _CONF_VARS_ */
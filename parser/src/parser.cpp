@@ -197,6 +197,9 @@ void parse_line(CONF_VARS *config)
         else if(strncmp(tokens[1], "nav", STRING_SIZE) == 0) {
             sscanf(tokens[2], "%d", &config->enable_nav);
         }
+        else if(strncmp(tokens[1], "shmbus", STRING_SIZE) == 0) {
+            sscanf(tokens[2], "%d", &config->enable_shmbus);
+        }
     }
     /// end enable parameters
 
@@ -247,6 +250,89 @@ void parse_line(CONF_VARS *config)
     }
     /// end estimation parameters
 
+    /// real-time scheduling parameters
+    else if(strncmp(tokens[0], "rt", STRING_SIZE) == 0) {
+        if(strncmp(tokens[1], "priority", STRING_SIZE) == 0) {
+            sscanf(tokens[2], "%d", &config->rt_priority);
+        }
+        else if(strncmp(tokens[1], "cpu", STRING_SIZE) == 0) {
+            sscanf(tokens[2], "%d", &config->rt_cpu);
+        }
+        else if(strncmp(tokens[1], "lock", STRING_SIZE) == 0) {
+            sscanf(tokens[2], "%d", &config->rt_lock);
+        }
+    }
+    /// end real-time scheduling parameters
+
+    /// pid engine parameters
+    else if(strncmp(tokens[0], "pid", STRING_SIZE) == 0) {
+        if(strncmp(tokens[1], "windup", STRING_SIZE) == 0) {
+            sscanf(tokens[2], "%d", &config->pid_windup);
+        }
+        else if(strncmp(tokens[1], "dfilter", STRING_SIZE) == 0) {
+            sscanf(tokens[2], "%f", &config->pid_dfilter);
+        }
+    }
+    /// end pid engine parameters
+
+    /// tracing parameters
+    else if(strncmp(tokens[0], "trace", STRING_SIZE) == 0) {
+        if(strncmp(tokens[1], "file", STRING_SIZE) == 0) {
+            strncpy(config->trace_file, tokens[2], STRING_SIZE);
+        }
+    }
+    /// end tracing parameters
+
+    /// gain schedule parameters
+    else if(strncmp(tokens[0], "sched", STRING_SIZE) == 0) {
+        if(strncmp(tokens[1], "depths", STRING_SIZE) == 0) {
+            for(ii = 0; ii < PARSE_SCHED_BREAKS && tokens[ii + 2][0] != '\0'; ii++) {
+                sscanf(tokens[ii + 2], "%f", &config->sched_depth[ii]);
+            }
+            config->sched_depths = ii;
+        }
+        else if(strncmp(tokens[1], "speeds", STRING_SIZE) == 0) {
+            for(ii = 0; ii < PARSE_SCHED_BREAKS && tokens[ii + 2][0] != '\0'; ii++) {
+                sscanf(tokens[ii + 2], "%f", &config->sched_speed[ii]);
+            }
+            config->sched_speeds = ii;
+        }
+        else if(config->sched_points < PARSE_SCHED_MAX) {
+            PARSE_SCHED *point = &config->sched[config->sched_points];
+            if(sscanf(tokens[1], "%d", &point->task) == 1 &&
+                sscanf(tokens[3], "%f", &point->depth) == 1 &&
+                sscanf(tokens[4], "%f", &point->speed) == 1 &&
+                sscanf(tokens[5], "%f", &point->kp) == 1 &&
+                sscanf(tokens[6], "%f", &point->ki) == 1 &&
+                sscanf(tokens[7], "%f", &point->kd) == 1) {
+                strncpy(point->axis, tokens[2], PARSE_SCHED_AXIS - 1);
+                point->axis[PARSE_SCHED_AXIS - 1] = '\0';
+                config->sched_points++;
+            }
+        }
+    }
+    /// end gain schedule parameters
+
+    /// simulator parameters
+    else if(strncmp(tokens[0], "sim", STRING_SIZE) == 0) {
+        if(strncmp(tokens[1], "imu", STRING_SIZE) == 0) {
+            strncpy(config->sim_imu, tokens[2], STRING_SIZE);
+        }
+        else if(strncmp(tokens[1], "pololu", STRING_SIZE) == 0) {
+            strncpy(config->sim_pololu, tokens[2], STRING_SIZE);
+        }
+        else if(strncmp(tokens[1], "noise", STRING_SIZE) == 0) {
+            sscanf(tokens[2], "%d", &config->sim_noise);
+        }
+        else if(strncmp(tokens[1], "seed", STRING_SIZE) == 0) {
+            sscanf(tokens[2], "%d", &config->sim_seed);
+        }
+        else if(strncmp(tokens[1], "bench", STRING_SIZE) == 0) {
+            sscanf(tokens[2], "%f", &config->sim_bench);
+        }
+    }
+    /// end simulator parameters
+
     /// labjackd parameters
     else if(strncmp(tokens[0], "labjackd", STRING_SIZE) == 0) {
         if(strncmp(tokens[1], "ip", STRING_SIZE) == 0) {
@@ -800,6 +886,7 @@ void parse_default_config(CONF_VARS *config)
     config->enable_server = TRUE;
 	config->server_port = 0;
     config->net_mode = 1;
+    config->enable_shmbus = FALSE;
 
 	/// nav
 	config->enable_nav = FALSE;
@@ -818,6 +905,30 @@ void parse_default_config(CONF_VARS *config)
 	config->input_type = 1;
 	config->input_prob = 0.;
 
+	/// real-time scheduling
+	config->rt_priority = 0;
+	config->rt_cpu = -1;
+	config->rt_lock = FALSE;
+
+	/// pid engine
+	config->pid_windup = 0;
+	config->pid_dfilter = 0.;
+
+	/// tracing
+	strncpy(config->trace_file, "", STRING_SIZE);
+
+	/// gain schedule
+	config->sched_depths = 0;
+	config->sched_speeds = 0;
+	config->sched_points = 0;
+
+	/// simulator
+	strncpy(config->sim_imu, "/tmp/sim-imu", STRING_SIZE);
+	strncpy(config->sim_pololu, "/tmp/sim-pololu", STRING_SIZE);
+	config->sim_noise = TRUE;
+	config->sim_seed = 1;
+	config->sim_bench = 0.;
+
     /// pid
     config->kp_yaw = 1;
     config->ki_yaw = 0;
@@ -961,6 +1072,7 @@ void parse_print_config(CONF_VARS *config)
     printf("PARSE_PRINT_CONFIG: imu_port[STRING_SIZE] = %s\n", config->imu_port);
     printf("PARSE_PRINT_CONFIG: enable_server = %d\n", config->enable_server);
 	printf("PARSE_PRINT_CONFIG: enable_nav = %d\n", config->enable_nav);
+	printf("PARSE_PRINT_CONFIG: enable_shmbus = %d\n", config->enable_shmbus);
     printf("PARSE_PRINT_CONFIG: net_mode = %d\n", config->net_mode);
     printf("PARSE_PRINT_CONFIG: nav_port = %hd\n", config->nav_port);
 	printf("PARSE_PRINT_CONFIG: server_port = %hd\n", config->server_port);
@@ -1091,4 +1203,18 @@ void parse_print_config(CONF_VARS *config)
 	printf("PARSE_PRINT_CONFIG: input_size = %d\n", config->input_size);
 	printf("PARSE_PRINT_CONFIG: input_type = %d\n", config->input_type);
 	printf("PARSE_PRINT_CONFIG: input_prob = %f\n", config->input_prob);
+	printf("PARSE_PRINT_CONFIG: rt_priority = %d\n", config->rt_priority);
+	printf("PARSE_PRINT_CONFIG: rt_cpu = %d\n", config->rt_cpu);
+	printf("PARSE_PRINT_CONFIG: rt_lock = %d\n", config->rt_lock);
+	printf("PARSE_PRINT_CONFIG: pid_windup = %d\n", config->pid_windup);
+	printf("PARSE_PRINT_CONFIG: pid_dfilter = %f\n", config->pid_dfilter);
+	printf("PARSE_PRINT_CONFIG: trace_file = %s\n", config->trace_file);
+	printf("PARSE_PRINT_CONFIG: sched_depths = %d\n", config->sched_depths);
+	printf("PARSE_PRINT_CONFIG: sched_speeds = %d\n", config->sched_speeds);
+	printf("PARSE_PRINT_CONFIG: sched_points = %d\n", config->sched_points);
+	printf("PARSE_PRINT_CONFIG: sim_imu = %s\n", config->sim_imu);
+	printf("PARSE_PRINT_CONFIG: sim_pololu = %s\n", config->sim_pololu);
+	printf("PARSE_PRINT_CONFIG: sim_noise = %d\n", config->sim_noise);
+	printf("PARSE_PRINT_CONFIG: sim_seed = %d\n", config->sim_seed);
+	printf("PARSE_PRINT_CONFIG: sim_bench = %f\n", config->sim_bench);
 } /* end parse_default_config() */
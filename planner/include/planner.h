@@ -26,6 +26,7 @@
 #include "pid.h"
 #include "task.h"
 #include "timing.h"
+#include "trace.h"
 
 
 /******************************
@@ -175,125 +175,125 @@
 //! Switch to the current task.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_run( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_run( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Find and follow the buoy.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_buoy( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_buoy( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Use dead reckoning to go straight through the gate.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time. run.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds. run.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_gate( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_gate( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Find and follow the pipe.
 //! \param msg The current message data.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_pipe( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_pipe( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Move in a square. Use the times in msg for the duration of motion in each
 //! direction.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_square( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_square( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Hold the current position.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_none( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_none( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Find and go to the boxes. Drop marbles over the correct boxes.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_boxes( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_boxes( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Find and go under the two fence pieces. Stay below the horizontal fence
 //! members but above a minimum depth.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_fence( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_fence( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Find and retrieve the suitcase. First center vehicle above the suitcase and
 //! then lower depth until the suitcase is picked up using the caribiners on
 //! the bottoms of the Voith motors.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_suitcase( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_suitcase( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Surface within the octagon.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_surface( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_surface( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Run the entire course.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_course( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_course( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Make the sub nod its head.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_nod( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_nod( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Make the sub spin in place.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_spin( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_spin( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Make the sub sweep side to side looking for obstacles
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_sweep( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_sweep( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! Operations to perform at the dock.
 //! \param msg The current message data.
 //! \param cf Configuration file variables.
-//! \param dt The task time.
-//! \param subtask_dt The subtask time.
+//! \param dt The task time in seconds.
+//! \param subtask_dt The subtask time in seconds.
 //! \return Task status: Success, failure, continuing.
-int task_dock( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt );
+int task_dock( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt );
 
 //! A placeholder task to make editing order of course task easier.
 //! \return TASK_SUCCESS.
@@ -10,6 +10,7 @@
 
 /// Global file descriptors. Only global so that planner_exit() can close them.
 int server_fd;
+NET_SERVER server;
 int vision_fd;
 int lj_fd;
 int nav_fd;
@@ -56,7 +57,7 @@ void planner_exit()
 
 	/// Close the open file descriptors.
 	if (server_fd > 0) {
-		close(server_fd);
+		net_server_close(&server);
 	}
 	if (vision_fd > 0) {
 		close(vision_fd);
@@ -77,6 +78,7 @@ void planner_exit()
 	if (bKF > 0) {
 		//close_kalman();
 	}
+	trace_close();
 
 	printf("<OK>\n\n");
 } /* end planner_exit() */
@@ -126,10 +128,11 @@ int main(int argc, char *argv[])
 	int ks_closed = FALSE;
 	int buoy_touched = FALSE;
 	int buoy_success = FALSE;
+	float task_dt = 0.;
+	float subtask_dt = 0.;
 	//CvPoint3D32f loc;
 
 	/// Declare timers.
-	TIMING timer_vision;
 	TIMING timer_plan;
 	TIMING timer_task;
 	TIMING timer_log;
@@ -154,11 +157,17 @@ int main(int argc, char *argv[])
 	memset(&pid, 0, sizeof(PID));
 	memset(&lj,  0, sizeof(LABJACK_DATA));
 	messages_init(&msg);
+	messages_set_producer(MSG_PRODUCER_PLANNER);
 
 	/// Parse command line arguments.
 	parse_default_config(&cf);
 	parse_cla(argc, argv, &cf, STINGRAY, (const char *)PLANNER_FILENAME);
 
+	/// Start tracing if a trace file is given.
+	if (cf.trace_file[0] != '\0' && trace_open(cf.trace_file) == 0) {
+		printf("MAIN: Tracing to %s.\n", cf.trace_file);
+	}
+
 	/// Set up default values for the targets, gains and tasks.
     msg.target.data.pitch   	 = cf.target_pitch;
     msg.target.data.roll    	 = cf.target_roll;
@@ -201,7 +210,7 @@ int main(int argc, char *argv[])
 
 	/// Set up server.
 	if (cf.enable_server) {
-		server_fd = net_server_setup(cf.server_port);
+		server_fd = net_server_setup(&server, cf.server_port);
 		if (server_fd > 0) {
 			printf("MAIN: Server setup OK.\n");
 		}
@@ -214,6 +223,8 @@ int main(int argc, char *argv[])
 	if (cf.enable_vision) {
 		vision_fd = net_client_setup(cf.vision_IP, cf.vision_port);
 		if (vision_fd > 0) {
+			/// Have vision push each new result instead of polling for it.
+			net_subscribe(vision_fd, MSG_TOPIC(VISION_MSGID), (int)(cf.period_vision * 1000));
 			printf("MAIN: Vision client setup OK.\n");
 		}
 		else {
@@ -225,6 +236,7 @@ int main(int argc, char *argv[])
     if (cf.enable_labjack) {
         lj_fd = net_client_setup(cf.labjackd_IP, cf.labjackd_port);
 		if (lj_fd > 0) {
+			net_subscribe(lj_fd, MSG_TOPIC(LJ_MSGID), 0);
 			printf("MAIN: Labjack client setup OK.\n");
 		}
 		else {
@@ -253,7 +265,6 @@ int main(int argc, char *argv[])
 	}
 
 	/// Initialize timers.
-	timing_set_timer(&timer_vision);
 	timing_set_timer(&timer_plan);
 	timing_set_timer(&timer_task);
 	timing_set_timer(&timer_subtask);
@@ -267,23 +278,15 @@ int main(int argc, char *argv[])
 	while (1) {
 		/// Get network data.
 		if ((cf.enable_server) && (server_fd > 0)) {
-			recv_bytes = net_server(server_fd, recv_buf, &msg, MODE_PLANNER);
-			if (recv_bytes > 0) {
-				recv_buf[recv_bytes] = '\0';
-				messages_decode(server_fd, recv_buf, &msg, recv_bytes);
-			}
+			recv_bytes = net_server(&server, recv_buf, &msg, MODE_PLANNER);
 		}
 
 		/// Get vision data.
 		if ((cf.enable_vision) && (vision_fd > 0)) {
-			if (timing_check_period(&timer_vision, cf.period_vision)) {
-				recv_bytes = net_client(vision_fd, vision_buf, &msg, MODE_OPEN);
-				vision_buf[recv_bytes] = '\0';
-				if (recv_bytes > 0) {
-					messages_decode(vision_fd, vision_buf, &msg, recv_bytes);
-                    timing_set_timer(&timer_vision);
-					msg.status.data.fps = msg.vision.data.fps;
-				}
+			recv_bytes = net_client(vision_fd, vision_buf, &msg, MODE_PUSH);
+			if (recv_bytes > 0) {
+				messages_decode(vision_fd, vision_buf, &msg, recv_bytes);
+				msg.status.data.fps = msg.vision.data.fps;
 			}
 		}
 
@@ -311,10 +314,21 @@ int main(int argc, char *argv[])
 		if (nav_fd > 0) {
 			msg.target.data.task = msg.task.data.task;
 			msg.target.data.vision_status = msg.vision.data.status;
+			/// The target is computed from the latest vision result so it
+			/// carries the time that frame was captured. Without vision it is
+			/// stamped when it is sent.
+			if ((cf.enable_vision) && (vision_fd > 0)) {
+				msg.target.hdr.stamp = msg.vision.hdr.stamp;
+				messages_used(&msg.vision.hdr);
+			}
+			else {
+				msg.target.hdr.stamp = 0;
+			}
 			recv_bytes = net_client(nav_fd, nav_buf, &msg, MODE_PLANNER);
-			nav_buf[recv_bytes] = '\0';
 			if (recv_bytes > 0) {
+				nav_buf[recv_bytes] = '\0';
 				messages_decode(nav_fd, nav_buf, &msg, recv_bytes);
+				net_server_publish(&server, STATUS_MSGID, &msg);
 			}
 			/// Check to send dropper servo value to nav here. Use old_dropper variable to see if new value needs to be sent.
 			if (msg.client.data.dropper != old_dropper) {
@@ -368,11 +382,11 @@ int main(int argc, char *argv[])
 
 		/// Get labjack data.
         if ((cf.enable_labjack) && (lj_fd > 0)) {
-            recv_bytes = net_client(lj_fd, lj_buf, &msg, MODE_OPEN);
-            lj_buf[recv_bytes] = '\0';
+            recv_bytes = net_client(lj_fd, lj_buf, &msg, MODE_PUSH);
             if (recv_bytes > 0) {
                 messages_decode(lj_fd, lj_buf, &msg, recv_bytes);
 				msg.status.data.depth = msg.lj.data.pressure;
+				net_server_publish(&server, LJ_MSGID, &msg);
             }
         }
 
@@ -402,11 +416,11 @@ int main(int argc, char *argv[])
 		}
 
 		/// Update the task and subtask elapsed times.
-		timing_get_dt(&timer_task, &timer_task);
-		timing_get_dt(&timer_subtask, &timer_subtask);
+		task_dt = timing_get_dts(&timer_task);
+		subtask_dt = timing_get_dts(&timer_subtask);
 
 		/// Run the current task.
-		status = task_run(&msg, &cf, timer_task.s, timer_subtask.s);
+		status = task_run(&msg, &cf, task_dt, subtask_dt);
 		if (msg.task.data.course) {
 			/// Set the subtask in the network message.
 			msg.task.data.subtask = subtask;
@@ -415,7 +429,7 @@ int main(int argc, char *argv[])
 					if (!buoy_touched) {
 						buoy_touched = TRUE;
 					}
-					else if (buoy_touched && timer_subtask.s < TASK_BUOY_WAIT_TIME) {
+					else if (buoy_touched && subtask_dt < TASK_BUOY_WAIT_TIME) {
 						/// Do nothing here.
 					}
 					else {
@@ -444,7 +458,7 @@ int main(int argc, char *argv[])
 				}
 			}
 			else if (task == TASK_BUOY && buoy_success) {
-				if (timer_subtask.s < TASK_BUOY_WAIT_TIME) {
+				if (subtask_dt < TASK_BUOY_WAIT_TIME) {
 					/// Do nothing here.
 				}
 				else {
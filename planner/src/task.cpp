@@ -12,23 +12,23 @@
 
 /******************************************************************************
  *
- * Title:       int task_run( MSG_DATA *msg, CONF_VARS *cf, int task, int dt, int subtask, int subtask_dt )
+ * Title:       int task_run( MSG_DATA *msg, CONF_VARS *cf, int task, float dt, int subtask, float subtask_dt )
  *
  * Description: Switch to the current task.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
  * 				task: The current task to be attempted.
- *              dt: The task time.
+ *              dt: The task time in seconds.
  *				subtask: Used to set which part of the task is to be run. Modify
  * 				upon success or failure.
- * 				subtask_dt: The subtask time.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_run( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_run( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	int status = TASK_CONTINUING;
 	switch ( msg->task.data.task ) {
@@ -111,20 +111,20 @@ int task_run( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_buoy( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+ * Title:       int task_buoy( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
  *
  * Description: Find and follow the buoy.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_buoy( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_buoy( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	if( msg->task.data.course ) {
 		/* Check if buoy touch threshold reached. */
@@ -183,20 +183,20 @@ int task_buoy( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_gate( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_gate( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Use dead reckoning to hold a heading and go straight.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_gate( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_gate( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	if( msg->task.data.course ) {
 		msg->target.data.depth = cf->depth_gate;
@@ -287,20 +287,20 @@ int task_gate( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_pipe( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_pipe( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Find and follow the pipe.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_pipe( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_pipe( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	if( msg->task.data.course ) {
 		/* Check for timeout. */
@@ -352,21 +352,21 @@ int task_pipe( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_square( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_square( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Move in a square. Use the times in msg for the duration of
  *              motion in each direction.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_square( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_square( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	msg->target.data.pitch = 0;
 	msg->target.data.roll = 0;
@@ -378,20 +378,20 @@ int task_square( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_none( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+ * Title:       int task_none( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
  *
  * Description: Hold the current position.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_none( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_none( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	/* Do nothing here. */
 
@@ -401,20 +401,20 @@ int task_none( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_boxes( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_boxes( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Find and go to the boxes. Drop marbles over the correct boxes.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_boxes( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_boxes( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	/* TODO: Fill this function in like task_buoy() and task_pipe(). */
 	if( msg->task.data.course ) {
@@ -501,21 +501,21 @@ int task_boxes( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_fence( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_fence( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Find and go under the two fence pieces. Stay below the
  * 				horizontal fence members but above a minimum depth.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_fence( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_fence( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	if( msg->task.data.course ) {
 		/* Check to see if we have detected the buoy. Else don't change yaw or
@@ -563,7 +563,7 @@ int task_fence( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_suitcase( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_suitcase( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Find and retrieve the suitcase. First center vehicle above the
  * 				suitcase and then lower depth until the suitcase is picked up
@@ -571,14 +571,14 @@ int task_fence( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_suitcase( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_suitcase( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	/* TODO: Fill this function in like task_buoy() and task_pipe(). */
 
@@ -588,20 +588,20 @@ int task_suitcase( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_surface( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_surface( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Surface within the octagon.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_surface( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_surface( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	/* Make sure fx and fy are zero. */
 	msg->target.data.fx = 0;
@@ -616,20 +616,20 @@ int task_surface( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_course( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_course( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Run the entire course.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_course( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_course( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	/* Nothing to do here. Everything is taken care of in main planner function
 	 * by incrementing the task and subtask values. The order that the course
@@ -641,20 +641,20 @@ int task_course( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_nod( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_nod( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Make the sub nod its head.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_nod( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_nod( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 
 	return TASK_CONTINUING;
@@ -663,20 +663,20 @@ int task_nod( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_spin( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_spin( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Make the sub spin in place.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_spin( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_spin( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	/* Continuously add 1 degree to yaw every time through this loop. It might
 	 * be better to only add the 1 degree if enough time has elapsed by using
@@ -689,20 +689,20 @@ int task_spin( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_spin( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_spin( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Make the sub spin in place.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_sweep( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_sweep( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	/* Check to see if we have a previous value for yaw
 	 * If not, we set it. */
@@ -725,20 +725,20 @@ int task_sweep( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
 
 /******************************************************************************
  *
- * Title:       int task_dock( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask, int subtask_dt )
+ * Title:       int task_dock( MSG_DATA *msg, CONF_VARS *cf, float dt, int subtask, float subtask_dt )
  *
  * Description: Operations to perform at dock.
  *
  * Input:       msg: Current message data.
  * 				cf: Configuration variables.
- *              dt: The task time.
- * 				subtask_dt: The subtask time.
+ *              dt: The task time in seconds.
+ * 				subtask_dt: The subtask time in seconds.
  *
  * Output:      Task status: Success, failure, continuing.
  *
  *****************************************************************************/
 
-int task_dock( MSG_DATA *msg, CONF_VARS *cf, int dt, int subtask_dt )
+int task_dock( MSG_DATA *msg, CONF_VARS *cf, float dt, float subtask_dt )
 {
 	/* This task should be the same whether we are running the competition or
 	 * just testing the individual task. */
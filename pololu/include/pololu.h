@@ -10,10 +10,15 @@
 #define POLOLU_H
 
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <math.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 
 #include "serial.h"
+#include "timing.h"
 
 
 /******************************
@@ -83,12 +88,6 @@
 #define POLOLU_INIT_TIME	7
 //@}
 
-/** @name The number of bytes expected to be sent for vertical and Voith commands. */
-//@{
-#define POLOLU_BYTES_VERTICAL	15
-#define POLOLU_BYTES_VOITH		30
-//@}
-
 /** @name The channel assignments for the servos and motors. */
 //@{
 
@@ -129,6 +128,22 @@
 #define POLOLU_CMD_ABS_POS			0x04
 #define POLOLU_CMD_NEUTRAL			0x05
 
+/** @name Output stage sizes. Commands are held back while more than
+ * POLOLU_OUT_QUEUE_LIMIT bytes are still waiting to go out on the line. */
+//@{
+#define POLOLU_CHANNELS				(POLOLU_MAX_CHANNEL + 1)
+#define POLOLU_CMD_7BIT_SIZE		5
+#define POLOLU_OUT_BUF_SIZE			(2 * POLOLU_CHANNELS * POLOLU_CMD_7BIT_SIZE)
+#define POLOLU_OUT_QUEUE_LIMIT		32
+//@}
+
+/** @name Channels set by pololu_out_neutral(). Thrusters come before the
+ * Voith servos so they are the first to stop. */
+//@{
+#define POLOLU_STOP_CHANNELS		9
+#define POLOLU_STOP_BYTES			(POLOLU_STOP_CHANNELS * POLOLU_CMD_7BIT_SIZE)
+//@}
+
 
 /******************************
  *
@@ -136,6 +151,27 @@
  *
  *****************************/
 
+#ifndef _POLOLU_OUT_
+#define _POLOLU_OUT_
+/*! Output stage for the actuator commands. Keeps the last position sent on
+ * each channel and the newest one waiting to be sent so that unchanged
+ * commands are dropped and changed ones go out in a single write. The
+ * statistics are read with atomics so another thread can print them. */
+typedef struct _POLOLU_OUT {
+	int fd;										//!< Pololu file descriptor
+	int last[POLOLU_CHANNELS];					//!< Last position sent, -1 if unknown
+	int pending[POLOLU_CHANNELS];				//!< Position waiting to be sent, -1 if none
+	unsigned char buf[POLOLU_OUT_BUF_SIZE];		//!< Bytes the port has not taken yet
+	int len;									//!< Number of bytes in buf
+	unsigned int writes;						//!< Calls to write()
+	unsigned int bytes;							//!< Bytes written
+	unsigned int dropped;						//!< Commands dropped because they did not change
+	unsigned int held;							//!< Flushes held back while the line was busy
+	unsigned long long send_max;				//!< Longest write() in ns since the last print
+	int queue_max;								//!< Most bytes in the port queue since the last print
+} POLOLU_OUT;
+#endif /* _POLOLU_OUT_ */
+
 
 
 /******************************
@@ -203,21 +239,62 @@ int pololu_set_neutral(int fd, int channel, int position);
 //! \return A value that indicates success or failure.
 int pololu_initialize_channels(int fd);
 
-//! This is a higher level function that controls both VSPs together.
+//! Sets up an output stage with nothing sent yet.
+//! \param out Pointer to output stage.
+//! \param fd A file descriptor for the Pololu port.
+void pololu_out_init(POLOLU_OUT *out, int fd);
+
+//! Forgets the positions sent so far and drops anything waiting. Call after
+//! the channels have been written to directly, such as by
+//! pololu_initialize_channels().
+//! \param out Pointer to output stage.
+void pololu_out_reset(POLOLU_OUT *out);
+
+//! Queues a 7-bit position for a channel. The command is dropped if the
+//! channel already has that position.
+//! \param out Pointer to output stage.
+//! \param channel The servo channel (0-15).
+//! \param position A 7-bit relative position value. (0-127)
+//! \return A value that indicates success or failure.
+int pololu_out_set(POLOLU_OUT *out, int channel, int position);
+
+//! Sends the queued commands in one write without waiting for them to leave
+//! the port. Call once per control tick.
+//! \param out Pointer to output stage.
+//! \return The number of bytes written, -1 on error.
+int pololu_out_flush(POLOLU_OUT *out);
+
+//! Sends neutral to every thruster and Voith channel at once for an
+//! emergency stop. Commands still waiting in the output stage or the port are
+//! thrown away first so that none of them go out after the neutral ones.
+//! Waits until the bytes have left the port.
+//! \param out Pointer to output stage.
+//! \return The number of bytes written, -1 on error.
+int pololu_out_neutral(POLOLU_OUT *out);
+
+//! Prints the output statistics and resets the worst send time and queue
+//! depth.
+//! \param out Pointer to output stage.
+void pololu_out_print_stats(POLOLU_OUT *out);
+
+//! This is a higher level function that controls both VSPs together. The
+//! commands are queued on out.
+//! \param out Pointer to output stage.
 //! \param voithThrust between 0 and 100
 //! \param thrustAngle between 0 and 360
 //! \param thrust between -100 and 100
 //! \param yawTorque between -100 and 100
 //! \return A value that indicates success or failure.
-int pololu_control_voiths(int fd, int voithThrust, float thrustAngle, int thrust, int yawTorque);
+int pololu_control_voiths(POLOLU_OUT *out, int voithThrust, float thrustAngle, int thrust, int yawTorque);
 
 //! The is a higher level function that controls the vertical
-//! thrusters together.
+//! thrusters together. The commands are queued on out.
+//! \param out Pointer to output stage.
 //! \param vertForce between 0 and 100
 //! \param rollTorque between 0 and 100
 //! \param pitchTorque between 0 and 100
 //! \return A value that indicates success or failure.
-int pololu_control_vertical(int fd, int vertForce, int rollTorque, int pitchTorque);
+int pololu_control_vertical(POLOLU_OUT *out, int vertForce, int rollTorque, int pitchTorque);
 
 
 #endif /* POLOLU_H */
@@ -325,17 +325,247 @@ int pololu_initialize_channels(int fd)
 } /* end pololu_initialize_channels() */
 
 
+/*------------------------------------------------------------------------------
+ * void pololu_out_init()
+ * Sets up an output stage.
+ *----------------------------------------------------------------------------*/
+
+void pololu_out_init(POLOLU_OUT *out, int fd)
+{
+	memset(out, 0, sizeof(POLOLU_OUT));
+	out->fd = fd;
+	pololu_out_reset(out);
+} /* end pololu_out_init() */
+
+
+/*------------------------------------------------------------------------------
+ * void pololu_out_reset()
+ * Forgets the positions sent so far and drops anything waiting.
+ *----------------------------------------------------------------------------*/
+
+void pololu_out_reset(POLOLU_OUT *out)
+{
+	int ii;
+
+	for (ii = 0; ii < POLOLU_CHANNELS; ii++) {
+		out->last[ii] = -1;
+		out->pending[ii] = -1;
+	}
+	out->len = 0;
+} /* end pololu_out_reset() */
+
+
+/*------------------------------------------------------------------------------
+ * int pololu_out_set()
+ * Queues a 7-bit position for a channel. A newer position replaces one that
+ * has not been sent yet.
+ *----------------------------------------------------------------------------*/
+
+int pololu_out_set(POLOLU_OUT *out, int channel, int position)
+{
+	/// Check ranges.
+	if ((out->fd < 0) ||
+		(channel < POLOLU_MIN_CHANNEL) ||
+	    (channel > POLOLU_MAX_CHANNEL) ||
+	    (position < POLOLU_MIN_7BIT) ||
+	    (position > POLOLU_MAX_7BIT)) {
+		return POLOLU_FAILURE;
+	}
+
+	/// Drop the command if the channel is already there.
+	if (position == out->last[channel]) {
+		out->pending[channel] = -1;
+		__atomic_add_fetch(&out->dropped, 1, __ATOMIC_RELAXED);
+	}
+	else if (position == out->pending[channel]) {
+		__atomic_add_fetch(&out->dropped, 1, __ATOMIC_RELAXED);
+	}
+	else {
+		out->pending[channel] = position;
+	}
+
+	return POLOLU_SUCCESS;
+} /* end pololu_out_set() */
+
+
+/*------------------------------------------------------------------------------
+ * int pololu_out_flush()
+ * Packs the queued commands into the buffer and writes it. The port is not
+ * drained so the caller does not wait for the bytes to go out. Whatever the
+ * port does not take is kept for the next flush.
+ *----------------------------------------------------------------------------*/
+
+int pololu_out_flush(POLOLU_OUT *out)
+{
+	unsigned long long start = 0;
+	unsigned long long ns = 0;
+	unsigned char *cmd = NULL;
+	int queued = 0;
+	int status = 0;
+	int ii;
+
+	if (out->fd < 0) {
+		return -1;
+	}
+
+	/// While the line is still busy the commands are left in the table where
+	/// newer ones replace them instead of queuing up behind old ones.
+	if (ioctl(out->fd, TIOCOUTQ, &queued) == 0) {
+		if (queued > __atomic_load_n(&out->queue_max, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&out->queue_max, queued, __ATOMIC_RELAXED);
+		}
+		if (queued > POLOLU_OUT_QUEUE_LIMIT) {
+			__atomic_add_fetch(&out->held, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+	}
+
+	/// Pack the changed channels after any bytes left from the last flush.
+	for (ii = 0; ii < POLOLU_CHANNELS; ii++) {
+		if (out->pending[ii] < 0) {
+			continue;
+		}
+		if (out->len + POLOLU_CMD_7BIT_SIZE > POLOLU_OUT_BUF_SIZE) {
+			break;
+		}
+		cmd = out->buf + out->len;
+		cmd[0] = POLOLU_START_BYTE;
+		cmd[1] = POLOLU_DEVICE_ID;
+		cmd[2] = POLOLU_CMD_7BIT;
+		cmd[3] = (unsigned char)ii;
+		cmd[4] = (unsigned char)out->pending[ii] & 127;
+		out->len += POLOLU_CMD_7BIT_SIZE;
+		out->last[ii] = out->pending[ii];
+		out->pending[ii] = -1;
+	}
+
+	if (out->len == 0) {
+		return 0;
+	}
+
+	/// Send everything in one write.
+	start = timing_now();
+	status = write(out->fd, out->buf, out->len);
+	ns = timing_elapsed(start);
+	if (ns > __atomic_load_n(&out->send_max, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&out->send_max, ns, __ATOMIC_RELAXED);
+	}
+	__atomic_add_fetch(&out->writes, 1, __ATOMIC_RELAXED);
+
+	if (status < 0) {
+		if (errno != EAGAIN) {
+			perror("write");
+			return -1;
+		}
+		return 0;
+	}
+
+	/// Keep what the port did not take.
+	out->len -= status;
+	if (out->len > 0) {
+		memmove(out->buf, out->buf + status, out->len);
+	}
+	__atomic_add_fetch(&out->bytes, status, __ATOMIC_RELAXED);
+
+	return status;
+} /* end pololu_out_flush() */
+
+
+/*------------------------------------------------------------------------------
+ * int pololu_out_neutral()
+ * Throws away the commands that have not gone out and sends neutral to the
+ * thrusters and Voiths in one write. Blocks until the bytes are on the line so
+ * the caller knows when the stop took effect.
+ *----------------------------------------------------------------------------*/
+
+int pololu_out_neutral(POLOLU_OUT *out)
+{
+	static const int channels[POLOLU_STOP_CHANNELS] = {
+		POLOLU_LEFT_VOITH_MOTOR, POLOLU_RIGHT_VOITH_MOTOR,
+		POLOLU_LEFT_WING_MOTOR, POLOLU_RIGHT_WING_MOTOR, POLOLU_TAIL_MOTOR,
+		POLOLU_LEFT_SERVO1, POLOLU_LEFT_SERVO2,
+		POLOLU_RIGHT_SERVO1, POLOLU_RIGHT_SERVO2};
+	unsigned char *cmd = NULL;
+	int sent = 0;
+	int status = 0;
+	int ii;
+
+	if (out->fd < 0) {
+		return -1;
+	}
+
+	/// Old commands in the port queue would run the thrusters again after the
+	/// neutral ones, so they are dropped along with anything not yet written.
+	tcflush(out->fd, TCOFLUSH);
+	out->len = 0;
+	for (ii = 0; ii < POLOLU_CHANNELS; ii++) {
+		out->pending[ii] = -1;
+	}
+
+	for (ii = 0; ii < POLOLU_STOP_CHANNELS; ii++) {
+		cmd = out->buf + out->len;
+		cmd[0] = POLOLU_START_BYTE;
+		cmd[1] = POLOLU_DEVICE_ID;
+		cmd[2] = POLOLU_CMD_7BIT;
+		cmd[3] = (unsigned char)channels[ii];
+		cmd[4] = POLOLU_NEUTRAL;
+		out->len += POLOLU_CMD_7BIT_SIZE;
+		out->last[channels[ii]] = POLOLU_NEUTRAL;
+	}
+
+	/// The port queue is empty so the write is normally taken whole. If it is
+	/// not, wait for the line and send the rest.
+	while (sent < out->len) {
+		status = write(out->fd, out->buf + sent, out->len - sent);
+		if (status < 0) {
+			if (errno != EAGAIN && errno != EINTR) {
+				perror("write");
+				out->len = 0;
+				return -1;
+			}
+			tcdrain(out->fd);
+			continue;
+		}
+		sent += status;
+	}
+	out->len = 0;
+	__atomic_add_fetch(&out->writes, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&out->bytes, sent, __ATOMIC_RELAXED);
+
+	tcdrain(out->fd);
+
+	return sent;
+} /* end pololu_out_neutral() */
+
+
+/*------------------------------------------------------------------------------
+ * void pololu_out_print_stats()
+ * Prints the output statistics.
+ *----------------------------------------------------------------------------*/
+
+void pololu_out_print_stats(POLOLU_OUT *out)
+{
+	printf("POLOLU: %u writes, %u bytes, %u unchanged dropped, %u held, worst send %.0f us, worst queue %d bytes\n",
+		__atomic_load_n(&out->writes, __ATOMIC_RELAXED),
+		__atomic_load_n(&out->bytes, __ATOMIC_RELAXED),
+		__atomic_load_n(&out->dropped, __ATOMIC_RELAXED),
+		__atomic_load_n(&out->held, __ATOMIC_RELAXED),
+		__atomic_exchange_n(&out->send_max, 0, __ATOMIC_RELAXED) / 1000.,
+		__atomic_exchange_n(&out->queue_max, 0, __ATOMIC_RELAXED));
+} /* end pololu_out_print_stats() */
+
+
 /*------------------------------------------------------------------------------
  * int pololu_control_voiths()
  * This is a higher level function that controls both VSPs together.
  *----------------------------------------------------------------------------*/
 
-int pololu_control_voiths(int fd, int voith_thrust, float thrust_angle, int thrust, int yaw_torque)
+int pololu_control_voiths(POLOLU_OUT *out, int voith_thrust, float thrust_angle, int thrust, int yaw_torque)
 {
 	/// The forces need to be in the range [-100,100]. They will then be scaled
 	/// to the range [0,128] before being sent to the Pololu. If any force is
 	/// outside the acceptable range then an error code will be returned.
-	if ((fd < 0) ||
+	if ((out->fd < 0) ||
 	    (voith_thrust < POLOLU_MIN_THRUST) ||
 	    (voith_thrust > POLOLU_SERVO_BOUND) ||
 	    (thrust < POLOLU_MIN_THRUST) ||
@@ -346,7 +576,7 @@ int pololu_control_voiths(int fd, int voith_thrust, float thrust_angle, int thru
 	}
 
 	/// Set up angle variables.
-	int bytes = 0;
+	int result = 0;
 
 	/// Set up the angle offset in the range [0,360].
 	float left_angle_offset = POLOLU_LEFT_ANGLE_OFFSET * (M_PI / 180);
@@ -374,16 +604,16 @@ int pololu_control_voiths(int fd, int voith_thrust, float thrust_angle, int thru
 	int scaled_voith_thrust_left  = voith_thrust_left * POLOLU_VOITH_GAIN + POLOLU_VOITH_NEUTRAL;
 	int scaled_voith_thrust_right = voith_thrust_right * POLOLU_VOITH_GAIN + POLOLU_VOITH_NEUTRAL;
 
-	/// Send the commands to the Pololu to control servo and motor positions.
-	bytes += pololu_set_position_7Bit(fd, POLOLU_LEFT_SERVO1, leftCmd1);
-	bytes += pololu_set_position_7Bit(fd, POLOLU_LEFT_SERVO2, leftCmd2);
-	bytes += pololu_set_position_7Bit(fd, POLOLU_RIGHT_SERVO1, rightCmd1);
-	bytes += pololu_set_position_7Bit(fd, POLOLU_RIGHT_SERVO2, rightCmd2);
-	bytes += pololu_set_position_7Bit(fd, POLOLU_LEFT_VOITH_MOTOR, scaled_voith_thrust_left);
-	bytes += pololu_set_position_7Bit(fd, POLOLU_RIGHT_VOITH_MOTOR, scaled_voith_thrust_right);
+	/// Queue the commands to control servo and motor positions.
+	result += pololu_out_set(out, POLOLU_LEFT_SERVO1, leftCmd1);
+	result += pololu_out_set(out, POLOLU_LEFT_SERVO2, leftCmd2);
+	result += pololu_out_set(out, POLOLU_RIGHT_SERVO1, rightCmd1);
+	result += pololu_out_set(out, POLOLU_RIGHT_SERVO2, rightCmd2);
+	result += pololu_out_set(out, POLOLU_LEFT_VOITH_MOTOR, scaled_voith_thrust_left);
+	result += pololu_out_set(out, POLOLU_RIGHT_VOITH_MOTOR, scaled_voith_thrust_right);
 
-	/// Check the number of bytes sent. There are 5 bytes for each command --> 5 * 6 = 30.
-	if (bytes == POLOLU_BYTES_VOITH) {
+	/// Check that all six commands were in range.
+	if (result == 6 * POLOLU_SUCCESS) {
 		return POLOLU_SUCCESS;
 	}
 
@@ -396,12 +626,12 @@ int pololu_control_voiths(int fd, int voith_thrust, float thrust_angle, int thru
  * This is a higher level function that controls the vertical thrusters together.
  *----------------------------------------------------------------------------*/
 
-int pololu_control_vertical(int fd, int vert_force, int roll_torque, int pitch_torque)
+int pololu_control_vertical(POLOLU_OUT *out, int vert_force, int roll_torque, int pitch_torque)
 {
 	/// The forces need to be in the range [-100,100]. They will then be scaled
 	/// to the range [0,128] before being sent to the Pololu. If any force is
 	/// outside the acceptable range then an error code will be returned. */
-	if ((fd < 0) ||
+	if ((out->fd < 0) ||
 	    (vert_force < -1 * POLOLU_SERVO_BOUND) ||
 	    (vert_force > POLOLU_SERVO_BOUND) ||
 	    (roll_torque < -1 * POLOLU_SERVO_BOUND) ||
@@ -412,7 +642,7 @@ int pololu_control_vertical(int fd, int vert_force, int roll_torque, int pitch_t
 	}
 
 	/// Set up motor command variables.
-	int bytes = 0;
+	int result = 0;
 	int leftCmd = 0;
 	int rightCmd = 0;
 	int tailCmd = 0;
@@ -445,9 +675,6 @@ int pololu_control_vertical(int fd, int vert_force, int roll_torque, int pitch_t
 		right = -1 * POLOLU_SERVO_BOUND;
 	}
 
-	/// Need a very short sleep before sending out commands.
-	usleep(POLOLU_SLEEP);
-
 	/// The range [-0.1,0.1] is our new dead zone.
 	if (left > dz_radius) {
 		left_neutral += POLOLU_DZ_NEUTRAL;
@@ -473,14 +700,13 @@ int pololu_control_vertical(int fd, int vert_force, int roll_torque, int pitch_t
 	rightCmd = (int)(right_neutral + POLOLU_NEUTRAL_GAIN * right);
 	tailCmd = (int)(tail_neutral + POLOLU_NEUTRAL_GAIN * tail);
 
-	/// Send the commands to the Pololu to control servo and motor positions.
-	bytes += pololu_set_position_7Bit(fd, POLOLU_LEFT_WING_MOTOR, leftCmd);
-	bytes += pololu_set_position_7Bit(fd, POLOLU_RIGHT_WING_MOTOR, rightCmd);
-	bytes += pololu_set_position_7Bit(fd, POLOLU_TAIL_MOTOR, tailCmd);
+	/// Queue the commands to control servo and motor positions.
+	result += pololu_out_set(out, POLOLU_LEFT_WING_MOTOR, leftCmd);
+	result += pololu_out_set(out, POLOLU_RIGHT_WING_MOTOR, rightCmd);
+	result += pololu_out_set(out, POLOLU_TAIL_MOTOR, tailCmd);
 
-	/// Check the number of bytes sent and return success or failure. There are
-	/// 5 bytes for each command --> 5 * 3 = 15.
-	if (bytes == POLOLU_BYTES_VERTICAL) {
+	/// Check that all three commands were in range.
+	if (result == 3 * POLOLU_SUCCESS) {
 		return POLOLU_SUCCESS;
 	}
 
@@ -0,0 +1,276 @@
+/**
+ *  \file sim.h
+ *  \brief Six degree of freedom model of the vehicle for testing the
+ *         controllers without it. Takes the bytes nav sends to the Pololu,
+ *         turns them back into wing, tail and Voith thrust, integrates the
+ *         rigid body and gives IMU and depth readings with noise. Replies to
+ *         Microstrain requests can be built from the state so nav talks to the
+ *         model the same way it talks to the vehicle.
+ *
+ *         The body frame has x forward, y to starboard and z down. Depth is
+ *         positive down.
+ */
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "microstrain.h"
+#include "pololu.h"
+
+
+/******************************
+ *
+ * #defines
+ *
+ *****************************/
+
+#ifndef TRUE
+#define TRUE 1
+#endif /* TRUE */
+
+#ifndef FALSE
+#define FALSE 0
+#endif /* FALSE */
+
+/** @name Indices into the state vectors. */
+//@{
+#ifndef SIM_AXES
+#define SIM_AXES
+#define SIM_X		0
+#define SIM_Y		1
+#define SIM_Z		2
+#define SIM_ROLL	0
+#define SIM_PITCH	1
+#define SIM_YAW		2
+#define SIM_DOF		6
+#endif /* SIM_AXES */
+//@}
+
+/** @name Integration step in seconds. sim_run() splits longer times into
+ * steps of this size. */
+//@{
+#ifndef SIM_STEP
+#define SIM_STEP 0.001
+#endif /* SIM_STEP */
+//@}
+
+/** @name Mass properties. Masses in kg include the added mass of the water
+ * for each direction, inertias in kg m^2 likewise. */
+//@{
+#ifndef SIM_MASS_PROPERTIES
+#define SIM_MASS_PROPERTIES
+#define SIM_GRAVITY		9.81
+#define SIM_MASS		32.0
+#define SIM_MASS_X		36.0
+#define SIM_MASS_Y		52.0
+#define SIM_MASS_Z		56.0
+#define SIM_INERTIA_X	0.9
+#define SIM_INERTIA_Y	2.6
+#define SIM_INERTIA_Z	2.8
+#endif /* SIM_MASS_PROPERTIES */
+//@}
+
+/** @name Hydrostatics. The vehicle is slightly buoyant and the centre of
+ * buoyancy is SIM_BG above the centre of gravity. Buoyancy fades out over
+ * SIM_HEIGHT as the vehicle breaks the surface. */
+//@{
+#ifndef SIM_HYDROSTATICS
+#define SIM_HYDROSTATICS
+#define SIM_BUOYANCY	3.0
+#define SIM_BG			0.02
+#define SIM_HEIGHT		0.3
+#endif /* SIM_HYDROSTATICS */
+//@}
+
+/** @name Linear and quadratic damping for surge, sway, heave, roll, pitch and
+ * yaw. */
+//@{
+#ifndef SIM_DAMPING
+#define SIM_DAMPING
+#define SIM_DAMP_LINEAR		{12.0, 25.0, 25.0, 1.5, 3.0, 3.0}
+#define SIM_DAMP_QUADRATIC	{35.0, 80.0, 80.0, 1.0, 4.0, 4.0}
+#endif /* SIM_DAMPING */
+//@}
+
+/** @name Thrusters. Forces in N at full command and positions in m from the
+ * centre of gravity. A positive wing or tail command pushes down. */
+//@{
+#ifndef SIM_THRUSTERS
+#define SIM_THRUSTERS
+#define SIM_WING_THRUST		20.0
+#define SIM_WING_Y			0.25
+#define SIM_TAIL_THRUST		12.0
+#define SIM_TAIL_X			(-0.5)
+#define SIM_VOITH_THRUST	25.0
+#define SIM_VOITH_Y			0.2
+#define SIM_MOTOR_TAU		0.1
+#endif /* SIM_THRUSTERS */
+//@}
+
+/** @name Actuator indices for the thrust after the motor lag. */
+//@{
+#ifndef SIM_ACTUATORS
+#define SIM_ACTUATORS
+#define SIM_LEFT_WING		0
+#define SIM_RIGHT_WING		1
+#define SIM_TAIL			2
+#define SIM_LEFT_VOITH_X	3
+#define SIM_LEFT_VOITH_Y	4
+#define SIM_RIGHT_VOITH_X	5
+#define SIM_RIGHT_VOITH_Y	6
+#define SIM_ACTUATOR_COUNT	7
+#endif /* SIM_ACTUATORS */
+//@}
+
+/** @name Middle of the range a truncated command stands for. The Pololu
+ * functions cast their commands to int, so a command p came from [p, p + 1). */
+//@{
+#ifndef SIM_SERVO_CENTER
+#define SIM_SERVO_CENTER (POLOLU_SERVO_NEUTRAL - 0.5)
+#endif /* SIM_SERVO_CENTER */
+//@}
+
+/** @name IMU mounting. The IMU faces aft, so its roll and pitch and the x
+ * and y axes of its vectors have the opposite sign to the body. Set to 1 for
+ * an IMU that faces forward. With -1 the gains in conf/planner.conf are
+ * stabilizing. */
+//@{
+#ifndef SIM_IMU_MOUNT
+#define SIM_IMU_MOUNT (-1)
+#endif /* SIM_IMU_MOUNT */
+//@}
+
+/** @name Sensor noise as standard deviations. Angles in degrees, rates in
+ * rad/s, accelerations in g and depth in the output units. */
+//@{
+#ifndef SIM_NOISE
+#define SIM_NOISE
+#define SIM_ANGLE_NOISE		0.2
+#define SIM_RATE_NOISE		0.005
+#define SIM_ACCEL_NOISE		0.01
+#define SIM_DEPTH_NOISE		0.02
+#endif /* SIM_NOISE */
+//@}
+
+/** @name Depth output in the units of the labjackd pressure calibration,
+ * which are feet. */
+//@{
+#ifndef SIM_DEPTH_SCALE
+#define SIM_DEPTH_SCALE 3.2808
+#endif /* SIM_DEPTH_SCALE */
+//@}
+
+/** @name Microstrain replies. The serial number is the one nav checks for and
+ * a timer tick is 6.5536 ms as on the 3DM-GX1. */
+//@{
+#ifndef SIM_IMU_REPLY
+#define SIM_IMU_REPLY
+#define SIM_IMU_SERIAL		2104
+#define SIM_IMU_TICK		0.0065536
+#define SIM_IMU_REPLY_SIZE	IMU_LENGTH_31
+#endif /* SIM_IMU_REPLY */
+//@}
+
+/** @name Longest Pololu command in bytes. */
+//@{
+#ifndef SIM_POLOLU_CMD_SIZE
+#define SIM_POLOLU_CMD_SIZE 6
+#endif /* SIM_POLOLU_CMD_SIZE */
+//@}
+
+
+/******************************
+ *
+ * Data types
+ *
+ *****************************/
+
+#ifndef _SIM_
+#define _SIM_
+/*! Pololu command decoder. Keeps the 7-bit position of every channel. */
+typedef struct _SIM_POLOLU {
+	unsigned char buf[SIM_POLOLU_CMD_SIZE];	//!< Command being received
+	int len;								//!< Bytes of the command received
+	int size;								//!< Size of the command, 0 until known
+	int pos[POLOLU_CHANNELS];				//!< 7-bit position of each channel
+	unsigned int bytes;						//!< Bytes received
+	unsigned int cmds;						//!< Position commands decoded
+	unsigned int bad;						//!< Bytes thrown away
+} SIM_POLOLU;
+
+/*! State of the vehicle. */
+typedef struct _SIM_STATE {
+	double pos[3];		//!< Position in the world frame in m, z down
+	double euler[3];	//!< Roll, pitch and yaw in rad
+	double vel[3];		//!< Body velocity in m/s
+	double rate[3];		//!< Body angular rate in rad/s
+	double accel[3];	//!< Specific force in the body frame in m/s^2
+	double time;		//!< Simulated time in s
+} SIM_STATE;
+
+/*! The model. */
+typedef struct _SIM {
+	SIM_STATE state;					//!< Rigid body state
+	SIM_POLOLU pololu;					//!< Commands from nav
+	double act[SIM_ACTUATOR_COUNT];		//!< Thrust after the motor lag in N
+	double force[SIM_DOF];				//!< Last forces and moments on the body
+	int noise;							//!< Add noise to the sensors
+	unsigned int seed;					//!< Noise generator state
+} SIM;
+#endif /* _SIM_ */
+
+
+/******************************
+ *
+ * Function prototypes
+ *
+ *****************************/
+
+//! Puts the vehicle at rest on the surface with every channel at neutral.
+//! \param sim Pointer to the model.
+//! \param seed Seed for the sensor noise so runs can be repeated.
+//! \param noise TRUE to add noise to the sensors.
+void sim_init(SIM *sim, unsigned int seed, int noise);
+
+//! Decodes bytes sent to the Pololu. Commands may be split over calls.
+//! \param pololu Pointer to the decoder.
+//! \param buf Bytes received.
+//! \param len Number of bytes.
+void sim_pololu_input(SIM_POLOLU *pololu, const unsigned char *buf, int len);
+
+//! Advances the model by one integration step.
+//! \param sim Pointer to the model.
+//! \param dt Step in seconds.
+void sim_step(SIM *sim, double dt);
+
+//! Advances the model by a time of any length in steps of SIM_STEP.
+//! \param sim Pointer to the model.
+//! \param dt Time in seconds.
+//! \return Number of steps taken.
+int sim_run(SIM *sim, double dt);
+
+//! Reads the IMU. Angles are in degrees in [0,360), accelerations in g and
+//! rates in rad/s with the pitch rate first as nav expects.
+//! \param sim Pointer to the model.
+//! \param imu Pointer to the IMU data to fill in.
+void sim_imu(SIM *sim, MSTRAIN_DATA *imu);
+
+//! Reads the depth sensor.
+//! \param sim Pointer to the model.
+//! \return Depth in SIM_DEPTH_SCALE units.
+float sim_depth(SIM *sim);
+
+//! Builds the reply of the Microstrain to a command byte.
+//! \param sim Pointer to the model.
+//! \param cmd Command byte.
+//! \param buf Buffer of at least SIM_IMU_REPLY_SIZE bytes.
+//! \return Length of the reply, 0 for commands that are not simulated.
+int sim_mstrain_reply(SIM *sim, unsigned char cmd, unsigned char *buf);
+
+
+#endif /* _SIM_H_ */
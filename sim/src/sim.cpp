@@ -0,0 +1,490 @@
+/******************************************************************************
+ *
+ *  Title:        sim.c
+ *
+ *  Description:  Six degree of freedom model of the vehicle. The thrust is
+ *                worked out from the Pololu commands by undoing what
+ *                pololu_control_vertical() and pololu_control_voiths() do, so
+ *                the model is driven by exactly what nav would send.
+ *
+ *****************************************************************************/
+
+#include "sim.h"
+
+
+/*------------------------------------------------------------------------------
+ * double sim_noise()
+ * Draws from a normal distribution with the Box-Muller transform. Returns 0
+ * when noise is off.
+ *----------------------------------------------------------------------------*/
+
+static double sim_noise(SIM *sim, double sd)
+{
+	double u1 = 0;
+	double u2 = 0;
+
+	if (!sim->noise) {
+		return 0;
+	}
+
+	u1 = (rand_r(&sim->seed) + 1.) / (RAND_MAX + 2.);
+	u2 = rand_r(&sim->seed) / (RAND_MAX + 1.);
+
+	return sd * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+} /* end sim_noise() */
+
+
+/*------------------------------------------------------------------------------
+ * double sim_clamp()
+ * Limits a value to a range.
+ *----------------------------------------------------------------------------*/
+
+static double sim_clamp(double value, double min, double max)
+{
+	if (value < min) {
+		return min;
+	}
+	if (value > max) {
+		return max;
+	}
+
+	return value;
+} /* end sim_clamp() */
+
+
+/*------------------------------------------------------------------------------
+ * void sim_init()
+ * Puts the vehicle at rest on the surface with every channel at neutral.
+ *----------------------------------------------------------------------------*/
+
+void sim_init(SIM *sim, unsigned int seed, int noise)
+{
+	int ii;
+
+	memset(sim, 0, sizeof(SIM));
+	for (ii = 0; ii < POLOLU_CHANNELS; ii++) {
+		sim->pololu.pos[ii] = POLOLU_NEUTRAL;
+	}
+	sim->seed = seed;
+	sim->noise = noise;
+} /* end sim_init() */
+
+
+/*------------------------------------------------------------------------------
+ * void sim_pololu_input()
+ * Decodes bytes sent to the Pololu. A start byte always begins a new command
+ * since no other byte has the top bit set, so the decoder finds its way back
+ * after a lost byte. Only the position commands change the channels.
+ *----------------------------------------------------------------------------*/
+
+void sim_pololu_input(SIM_POLOLU *pololu, const unsigned char *buf, int len)
+{
+	unsigned char *cmd = pololu->buf;
+	int ii;
+
+	pololu->bytes += len;
+	for (ii = 0; ii < len; ii++) {
+		if (buf[ii] == POLOLU_START_BYTE) {
+			pololu->bad += pololu->len;
+			pololu->len = 0;
+			pololu->size = 0;
+		}
+		else if (pololu->len == 0) {
+			pololu->bad++;
+			continue;
+		}
+		cmd[pololu->len++] = buf[ii];
+
+		/// The command byte gives the size.
+		if (pololu->len == 3) {
+			switch (cmd[2]) {
+			case POLOLU_CMD_PARAM:
+			case POLOLU_CMD_SPEED:
+			case POLOLU_CMD_7BIT:
+				pololu->size = 5;
+				break;
+			case POLOLU_CMD_8BIT:
+			case POLOLU_CMD_ABS_POS:
+			case POLOLU_CMD_NEUTRAL:
+				pololu->size = 6;
+				break;
+			default:
+				pololu->bad += pololu->len;
+				pololu->len = 0;
+				continue;
+			}
+		}
+
+		if (pololu->size == 0 || pololu->len < pololu->size) {
+			continue;
+		}
+		pololu->len = 0;
+		if (cmd[3] >= POLOLU_CHANNELS) {
+			pololu->bad += pololu->size;
+			continue;
+		}
+
+		/// An 8-bit position has twice the resolution of a 7-bit one.
+		if (cmd[2] == POLOLU_CMD_7BIT) {
+			pololu->pos[cmd[3]] = cmd[4];
+			pololu->cmds++;
+		}
+		else if (cmd[2] == POLOLU_CMD_8BIT) {
+			pololu->pos[cmd[3]] = ((cmd[4] & 1) << 7 | cmd[5]) / 2;
+			pololu->cmds++;
+		}
+	}
+} /* end sim_pololu_input() */
+
+
+/*------------------------------------------------------------------------------
+ * double sim_vertical()
+ * Undoes pololu_control_vertical() for one motor. Returns the force it was
+ * asked for in [-1,1].
+ *----------------------------------------------------------------------------*/
+
+static double sim_vertical(int pos)
+{
+	double cmd = pos - SIM_SERVO_CENTER;
+	double force = 0;
+
+	/// Commands either side of the dead zone are moved out by
+	/// POLOLU_DZ_NEUTRAL.
+	if (cmd > POLOLU_DZ_NEUTRAL) {
+		force = (cmd - POLOLU_DZ_NEUTRAL) / POLOLU_NEUTRAL_GAIN;
+	}
+	else if (cmd < -POLOLU_DZ_NEUTRAL) {
+		force = (cmd + POLOLU_DZ_NEUTRAL) / POLOLU_NEUTRAL_GAIN;
+	}
+
+	return sim_clamp(force / POLOLU_SERVO_BOUND, -1, 1);
+} /* end sim_vertical() */
+
+
+/*------------------------------------------------------------------------------
+ * void sim_voith()
+ * Undoes pololu_control_voiths() for one Voith. The servo offsets are the pin
+ * offset turned by the mounting angle, so turning them back gives the thrust
+ * direction with 0 forward. The thrust is the pin offset times the rotor
+ * speed.
+ *----------------------------------------------------------------------------*/
+
+static void sim_voith(int motor, int servo1, int servo2, double offset, double *thrust)
+{
+	double speed = (motor - POLOLU_VOITH_NEUTRAL) / (POLOLU_VOITH_GAIN * POLOLU_SERVO_BOUND);
+	double a = (servo1 - SIM_SERVO_CENTER) / POLOLU_SERVO_GAIN;
+	double b = (servo2 - SIM_SERVO_CENTER) / POLOLU_SERVO_GAIN;
+	double pin = 0;
+	double angle = offset * M_PI / 180;
+
+	thrust[0] = a * cos(angle) + b * sin(angle);
+	thrust[1] = b * cos(angle) - a * sin(angle);
+
+	/// The pins cannot go past the edge of the rotor.
+	pin = sqrt(thrust[0] * thrust[0] + thrust[1] * thrust[1]);
+	if (pin > POLOLU_SERVO_BOUND) {
+		thrust[0] *= POLOLU_SERVO_BOUND / pin;
+		thrust[1] *= POLOLU_SERVO_BOUND / pin;
+	}
+
+	speed = sim_clamp(speed, 0, 1) * SIM_VOITH_THRUST / POLOLU_SERVO_BOUND;
+	thrust[0] *= speed;
+	thrust[1] *= speed;
+} /* end sim_voith() */
+
+
+/*------------------------------------------------------------------------------
+ * void sim_thrust()
+ * Moves the thrust towards what the channels ask for with a first order lag
+ * and adds up the forces and moments on the body.
+ *----------------------------------------------------------------------------*/
+
+static void sim_thrust(SIM *sim, double dt, double *tau)
+{
+	double cmd[SIM_ACTUATOR_COUNT];
+	double lag = sim_clamp(dt / SIM_MOTOR_TAU, 0, 1);
+	int *pos = sim->pololu.pos;
+	double *act = sim->act;
+	int ii;
+
+	cmd[SIM_LEFT_WING] = SIM_WING_THRUST * sim_vertical(pos[POLOLU_LEFT_WING_MOTOR]);
+	cmd[SIM_RIGHT_WING] = SIM_WING_THRUST * sim_vertical(pos[POLOLU_RIGHT_WING_MOTOR]);
+	cmd[SIM_TAIL] = SIM_TAIL_THRUST * sim_vertical(pos[POLOLU_TAIL_MOTOR]);
+	sim_voith(pos[POLOLU_LEFT_VOITH_MOTOR], pos[POLOLU_LEFT_SERVO1],
+		pos[POLOLU_LEFT_SERVO2], POLOLU_LEFT_ANGLE_OFFSET, &cmd[SIM_LEFT_VOITH_X]);
+	sim_voith(pos[POLOLU_RIGHT_VOITH_MOTOR], pos[POLOLU_RIGHT_SERVO1],
+		pos[POLOLU_RIGHT_SERVO2], POLOLU_RIGHT_ANGLE_OFFSET, &cmd[SIM_RIGHT_VOITH_X]);
+
+	for (ii = 0; ii < SIM_ACTUATOR_COUNT; ii++) {
+		act[ii] += (cmd[ii] - act[ii]) * lag;
+	}
+
+	/// The Voiths are either side of the centre line and the wings and tail
+	/// push along z.
+	tau[0] = act[SIM_LEFT_VOITH_X] + act[SIM_RIGHT_VOITH_X];
+	tau[1] = act[SIM_LEFT_VOITH_Y] + act[SIM_RIGHT_VOITH_Y];
+	tau[2] = act[SIM_LEFT_WING] + act[SIM_RIGHT_WING] + act[SIM_TAIL];
+	tau[3] = SIM_WING_Y * (act[SIM_RIGHT_WING] - act[SIM_LEFT_WING]);
+	tau[4] = -SIM_TAIL_X * act[SIM_TAIL];
+	tau[5] = SIM_VOITH_Y * (act[SIM_LEFT_VOITH_X] - act[SIM_RIGHT_VOITH_X]);
+} /* end sim_thrust() */
+
+
+/*------------------------------------------------------------------------------
+ * void sim_step()
+ * Advances the model by one step with semi-implicit Euler. The velocities are
+ * updated first and the new ones move the vehicle, which keeps the
+ * oscillations from growing.
+ *----------------------------------------------------------------------------*/
+
+void sim_step(SIM *sim, double dt)
+{
+	static const double mass[SIM_DOF] = {SIM_MASS_X, SIM_MASS_Y, SIM_MASS_Z,
+		SIM_INERTIA_X, SIM_INERTIA_Y, SIM_INERTIA_Z};
+	static const double linear[SIM_DOF] = SIM_DAMP_LINEAR;
+	static const double quadratic[SIM_DOF] = SIM_DAMP_QUADRATIC;
+	SIM_STATE *s = &sim->state;
+	double tau[SIM_DOF];
+	double nu[SIM_DOF];
+	double down[3];
+	double buoyancy = 0;
+	double weight = SIM_MASS * SIM_GRAVITY;
+	double u, v, w, p, q, r;
+	double cr, sr, cp, sp, cy, sy;
+	int ii;
+
+	for (ii = 0; ii < 3; ii++) {
+		nu[ii] = s->vel[ii];
+		nu[ii + 3] = s->rate[ii];
+	}
+
+	sim_thrust(sim, dt, tau);
+
+	/// Damping.
+	for (ii = 0; ii < SIM_DOF; ii++) {
+		tau[ii] -= linear[ii] * nu[ii] + quadratic[ii] * fabs(nu[ii]) * nu[ii];
+	}
+
+	/// Buoyancy acts up through the centre of buoyancy, which gives the
+	/// restoring moments in roll and pitch.
+	cr = cos(s->euler[SIM_ROLL]);
+	sr = sin(s->euler[SIM_ROLL]);
+	cp = cos(s->euler[SIM_PITCH]);
+	sp = sin(s->euler[SIM_PITCH]);
+	down[0] = -sp;
+	down[1] = cp * sr;
+	down[2] = cp * cr;
+	buoyancy = (weight + SIM_BUOYANCY) *
+		sim_clamp(s->pos[SIM_Z] / SIM_HEIGHT + 0.5, 0, 1);
+	for (ii = 0; ii < 3; ii++) {
+		tau[ii] -= buoyancy * down[ii];
+	}
+	tau[3] -= SIM_BG * buoyancy * down[1];
+	tau[4] += SIM_BG * buoyancy * down[0];
+
+	/// The accelerometers feel everything but gravity. The added mass only
+	/// slows the vehicle, it is not carried by it.
+	for (ii = 0; ii < 3; ii++) {
+		s->accel[ii] = tau[ii] / SIM_MASS;
+		tau[ii] += weight * down[ii];
+	}
+	for (ii = 0; ii < SIM_DOF; ii++) {
+		sim->force[ii] = tau[ii];
+	}
+
+	/// Rigid body equations in the body frame.
+	u = nu[0];
+	v = nu[1];
+	w = nu[2];
+	p = nu[3];
+	q = nu[4];
+	r = nu[5];
+	s->vel[0] += (tau[0] / mass[0] + r * v - q * w) * dt;
+	s->vel[1] += (tau[1] / mass[1] + p * w - r * u) * dt;
+	s->vel[2] += (tau[2] / mass[2] + q * u - p * v) * dt;
+	s->rate[0] += (tau[3] + (mass[4] - mass[5]) * q * r) / mass[3] * dt;
+	s->rate[1] += (tau[4] + (mass[5] - mass[3]) * r * p) / mass[4] * dt;
+	s->rate[2] += (tau[5] + (mass[3] - mass[4]) * p * q) / mass[5] * dt;
+
+	/// Move the vehicle with the new velocities.
+	u = s->vel[0];
+	v = s->vel[1];
+	w = s->vel[2];
+	p = s->rate[0];
+	q = s->rate[1];
+	r = s->rate[2];
+	cy = cos(s->euler[SIM_YAW]);
+	sy = sin(s->euler[SIM_YAW]);
+	s->pos[SIM_X] += (cy * cp * u + (cy * sp * sr - sy * cr) * v + (cy * sp * cr + sy * sr) * w) * dt;
+	s->pos[SIM_Y] += (sy * cp * u + (sy * sp * sr + cy * cr) * v + (sy * sp * cr - cy * sr) * w) * dt;
+	s->pos[SIM_Z] += (-sp * u + cp * sr * v + cp * cr * w) * dt;
+
+	/// Euler angle rates. Pitch is kept off +-90 degrees where they blow up.
+	if (fabs(cp) < 0.01) {
+		cp = (cp < 0) ? -0.01 : 0.01;
+	}
+	s->euler[SIM_ROLL] += (p + (q * sr + r * cr) * sp / cp) * dt;
+	s->euler[SIM_PITCH] += (q * cr - r * sr) * dt;
+	s->euler[SIM_YAW] += (q * sr + r * cr) / cp * dt;
+	for (ii = 0; ii < 3; ii++) {
+		s->euler[ii] = atan2(sin(s->euler[ii]), cos(s->euler[ii]));
+	}
+
+	s->time += dt;
+} /* end sim_step() */
+
+
+/*------------------------------------------------------------------------------
+ * int sim_run()
+ * Advances the model in steps of SIM_STEP. The last step is shortened to end
+ * on the requested time.
+ *----------------------------------------------------------------------------*/
+
+int sim_run(SIM *sim, double dt)
+{
+	int steps = 0;
+
+	while (dt > 1e-9) {
+		sim_step(sim, (dt < SIM_STEP) ? dt : SIM_STEP);
+		dt -= SIM_STEP;
+		steps++;
+	}
+
+	return steps;
+} /* end sim_run() */
+
+
+/*------------------------------------------------------------------------------
+ * float sim_angle()
+ * Converts an angle in radians to degrees in [0,360).
+ *----------------------------------------------------------------------------*/
+
+static float sim_angle(double angle)
+{
+	angle = fmod(angle * 180 / M_PI, 360);
+	if (angle < 0) {
+		angle += 360;
+	}
+
+	return (float)angle;
+} /* end sim_angle() */
+
+
+/*------------------------------------------------------------------------------
+ * void sim_imu()
+ * Reads the IMU. The x and y axes take the sign of the mounting.
+ *----------------------------------------------------------------------------*/
+
+void sim_imu(SIM *sim, MSTRAIN_DATA *imu)
+{
+	SIM_STATE *s = &sim->state;
+
+	imu->roll = sim_angle(SIM_IMU_MOUNT * s->euler[SIM_ROLL] +
+		sim_noise(sim, SIM_ANGLE_NOISE) * M_PI / 180);
+	imu->pitch = sim_angle(SIM_IMU_MOUNT * s->euler[SIM_PITCH] +
+		sim_noise(sim, SIM_ANGLE_NOISE) * M_PI / 180);
+	imu->yaw = sim_angle(s->euler[SIM_YAW] +
+		sim_noise(sim, SIM_ANGLE_NOISE) * M_PI / 180);
+
+	imu->accel[0] = SIM_IMU_MOUNT * s->accel[0] / SIM_GRAVITY + sim_noise(sim, SIM_ACCEL_NOISE);
+	imu->accel[1] = SIM_IMU_MOUNT * s->accel[1] / SIM_GRAVITY + sim_noise(sim, SIM_ACCEL_NOISE);
+	imu->accel[2] = s->accel[2] / SIM_GRAVITY + sim_noise(sim, SIM_ACCEL_NOISE);
+
+	imu->ang_rate[0] = SIM_IMU_MOUNT * s->rate[1] + sim_noise(sim, SIM_RATE_NOISE);
+	imu->ang_rate[1] = SIM_IMU_MOUNT * s->rate[0] + sim_noise(sim, SIM_RATE_NOISE);
+	imu->ang_rate[2] = s->rate[2] + sim_noise(sim, SIM_RATE_NOISE);
+} /* end sim_imu() */
+
+
+/*------------------------------------------------------------------------------
+ * float sim_depth()
+ * Reads the depth sensor.
+ *----------------------------------------------------------------------------*/
+
+float sim_depth(SIM *sim)
+{
+	return (float)(sim->state.pos[SIM_Z] * SIM_DEPTH_SCALE + sim_noise(sim, SIM_DEPTH_NOISE));
+} /* end sim_depth() */
+
+
+/*------------------------------------------------------------------------------
+ * int sim_put_short()
+ * Writes a value as a big endian short, clipped to the range of a short.
+ * Returns the value written so it can be added to the checksum.
+ *----------------------------------------------------------------------------*/
+
+static int sim_put_short(unsigned char *buf, double value)
+{
+	int out = (int)lround(sim_clamp(value, -32768, 32767));
+
+	buf[0] = (out >> 8) & LSB_MASK;
+	buf[1] = out & LSB_MASK;
+
+	return out;
+} /* end sim_put_short() */
+
+
+/*------------------------------------------------------------------------------
+ * int sim_mstrain_reply()
+ * Builds the reply of the Microstrain to a command byte. Scale factors are the
+ * ones microstrain.cpp uses to decode them. Every reply ends with the timer
+ * ticks and the checksum, which is the sum of the command byte and the shorts.
+ *----------------------------------------------------------------------------*/
+
+int sim_mstrain_reply(SIM *sim, unsigned char cmd, unsigned char *buf)
+{
+	MSTRAIN_DATA imu;
+	float angles[3];
+	int checksum = cmd;
+	int len = 1;
+	int ii;
+
+	buf[0] = cmd;
+	switch (cmd) {
+	case IMU_SERIAL_NUMBER:
+		checksum += sim_put_short(&buf[len], SIM_IMU_SERIAL);
+		len += 2;
+		break;
+
+	case IMU_INST_EULER_ANGLES:
+	case IMU_GYRO_STAB_EULER_ANGLES:
+	case IMU_GYRO_STAB_EULER_VECTORS:
+		sim_imu(sim, &imu);
+
+		/// Angles go out in (-180,180].
+		angles[0] = imu.roll;
+		angles[1] = imu.pitch;
+		angles[2] = imu.yaw;
+		for (ii = 0; ii < 3; ii++) {
+			if (angles[ii] > 180) {
+				angles[ii] -= 360;
+			}
+			checksum += sim_put_short(&buf[len], angles[ii] * 65536. / 360.);
+			len += 2;
+		}
+
+		if (cmd == IMU_GYRO_STAB_EULER_VECTORS) {
+			for (ii = 0; ii < 3; ii++) {
+				checksum += sim_put_short(&buf[len], imu.accel[ii] * 3276800. / 7000.);
+				len += 2;
+			}
+			for (ii = 0; ii < 3; ii++) {
+				checksum += sim_put_short(&buf[len], imu.ang_rate[ii] * 32768000. / 8500.);
+				len += 2;
+			}
+		}
+
+		checksum += sim_put_short(&buf[len],
+			(short)((long long)(sim->state.time / SIM_IMU_TICK) & CHECKSUM_MASK));
+		len += 2;
+		break;
+
+	default:
+		return 0;
+	}
+
+	sim_put_short(&buf[len], (short)(checksum & CHECKSUM_MASK));
+	len += 2;
+
+	return len;
+} /* end sim_mstrain_reply() */
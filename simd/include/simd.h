@@ -0,0 +1,152 @@
+/**
+ *  \file simd.h
+ *  \brief Simulator daemon. Runs the vehicle model behind a pseudo terminal
+ *         for the Pololu and one for the Microstrain and serves depth and
+ *         battery data in place of labjackd, so nav runs unchanged against
+ *         it. With "sim bench" set it instead runs the PID loops against the
+ *         model offline, faster than real time, and prints the errors.
+ */
+
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <termios.h>
+#include <math.h>
+
+#include "evloop.h"
+#include "messages.h"
+#include "network.h"
+#include "parser.h"
+#include "pid.h"
+#include "pololu.h"
+#include "shmbus.h"
+#include "sim.h"
+#include "timing.h"
+#include "trace.h"
+
+
+/******************************
+ *
+ * #defines
+ *
+ *****************************/
+
+#ifndef TRUE
+#define TRUE 1
+#endif /* TRUE */
+
+#ifndef FALSE
+#define FALSE 0
+#endif /* FALSE */
+
+/** @name Default filename for the simulator configuration file. */
+//@{
+#ifndef SIMD_FILENAME
+#define SIMD_FILENAME "conf/simd.conf"
+#endif /* SIMD_FILENAME */
+//@}
+
+/** @name Periods in seconds for stepping the model, publishing the Labjack
+ * data and printing the state. */
+//@{
+#ifndef SIMD_PERIODS
+#define SIMD_PERIODS
+#define SIMD_PERIOD			0.005
+#define SIMD_LJ_PERIOD		0.02
+#define SIMD_PRINT_PERIOD	1.0
+#endif /* SIMD_PERIODS */
+//@}
+
+/** @name Battery voltages to report. The motor battery is above
+ * BATT1_THRESH so nav sees the kill switch closed. */
+//@{
+#ifndef SIMD_BATTERIES
+#define SIMD_BATTERIES
+#define SIMD_BATTERY1	12.0
+#define SIMD_BATTERY2	14.5
+#endif /* SIMD_BATTERIES */
+//@}
+
+/** @name Size of the buffers for reading the pseudo terminals. */
+//@{
+#ifndef SIMD_BUF_SIZE
+#define SIMD_BUF_SIZE 256
+#endif /* SIMD_BUF_SIZE */
+//@}
+
+
+/******************************
+ *
+ * Function prototypes
+ *
+ *****************************/
+
+//! This function is called when SIGINT (ctrl-c) is invoked.
+//! \param signal The SIGINT signal.
+void simd_sigint(int signal);
+
+//! Exit function for main program. Removes the links to the pseudo terminals
+//! and closes all file descriptors.
+void simd_exit();
+
+//! Opens a pseudo terminal in raw mode and links a path to it.
+//! \param link Path to link to the terminal, which nav opens as a port.
+//! \param slave Set to the terminal side, which is kept open so the
+//!              simulator side does not see a hangup when nav closes it.
+//! \return The simulator side of the terminal, -1 on error.
+int simd_pty(const char *link, int *slave);
+
+//! Decodes the bytes nav sends to the Pololu.
+//! \param fd Pololu pseudo terminal.
+//! \param events Events on the descriptor.
+//! \param arg Not used.
+void simd_pololu_read(int fd, unsigned int events, void *arg);
+
+//! Answers the requests nav sends to the Microstrain.
+//! \param fd IMU pseudo terminal.
+//! \param events Events on the descriptor.
+//! \param arg Not used.
+void simd_imu_read(int fd, unsigned int events, void *arg);
+
+//! Event loop timer that advances the model.
+//! \param fd Timer file descriptor.
+//! \param expirations Number of timer expirations.
+//! \param arg Not used.
+void simd_step_timer(int fd, unsigned int expirations, void *arg);
+
+//! Event loop timer that publishes the depth and batteries as labjackd does.
+//! \param fd Timer file descriptor.
+//! \param expirations Number of timer expirations.
+//! \param arg Not used.
+void simd_lj_timer(int fd, unsigned int expirations, void *arg);
+
+//! Event loop timer that prints the state of the model.
+//! \param fd Timer file descriptor.
+//! \param expirations Number of timer expirations.
+//! \param arg Not used.
+void simd_print_timer(int fd, unsigned int expirations, void *arg);
+
+//! Runs the PID loops against the model for cf->sim_bench simulated seconds
+//! as fast as it can. The commands go through a pipe as Pololu bytes so the
+//! same path as on the vehicle is tested. Prints the RMS and worst error of
+//! each axis and how much faster than real time it ran.
+//! \param cf Pointer to configuration variables.
+//! \return 0 on success, -1 on error.
+int simd_bench(CONF_VARS *cf);
+
+//! Main function for the simd program.
+//! \param argc Number of command line arguments.
+//! \param argv Array of command line arguments.
+//! \return Always returns 0.
+int main(int argc, char *argv[]);
+
+
+#endif /* _SIMD_H_ */
@@ -0,0 +1,444 @@
+/******************************************************************************
+ *
+ *  Title:        simd.c
+ *
+ *  Description:  Simulator daemon. Stands in for the Pololu, the Microstrain
+ *                and labjackd so nav can be run and tuned without the vehicle.
+ *
+ *****************************************************************************/
+
+#include "simd.h"
+
+/// Global file descriptors. Only global so that simd_exit() can close them.
+int server_fd;
+int bus_fd;
+int pololu_fd;
+int pololu_slave;
+int imu_fd;
+int imu_slave;
+NET_SERVER server;
+
+/// State shared by the event loop callbacks.
+static EVLOOP loop;
+static MSG_DATA msg;
+static CONF_VARS cf;
+static SIM sim;
+
+
+/*------------------------------------------------------------------------------
+ * void simd_sigint()
+ * This function is called when SIGINT (ctrl-c) is invoked.
+ *----------------------------------------------------------------------------*/
+
+void simd_sigint(int signal)
+{
+	exit(0);
+} /* end simd_sigint() */
+
+
+/*------------------------------------------------------------------------------
+ * void simd_exit()
+ * Exit function for main program. Removes the links to the pseudo terminals
+ * so nav does not open a stale one and closes all file descriptors.
+ *----------------------------------------------------------------------------*/
+
+void simd_exit()
+{
+	printf("SIMD_EXIT: Shutting down ... ");
+
+	if (pololu_fd > 0) {
+		unlink(cf.sim_pololu);
+		close(pololu_fd);
+		close(pololu_slave);
+	}
+	if (imu_fd > 0) {
+		unlink(cf.sim_imu);
+		close(imu_fd);
+		close(imu_slave);
+	}
+	if (server_fd > 0) {
+		net_server_close(&server);
+	}
+	if (bus_fd > 0) {
+		net_close(bus_fd);
+	}
+	evloop_close(&loop);
+	trace_close();
+
+	printf("<OK>\n");
+} /* end simd_exit() */
+
+
+/*------------------------------------------------------------------------------
+ * int simd_pty()
+ * Opens a pseudo terminal in raw mode and links a path to it.
+ *----------------------------------------------------------------------------*/
+
+int simd_pty(const char *link, int *slave)
+{
+	struct termios tio;
+	char name[STRING_SIZE];
+	int fd = -1;
+
+	if (openpty(&fd, slave, name, NULL, NULL) == -1) {
+		perror("openpty");
+		return -1;
+	}
+
+	/// The bytes are binary so nothing may be echoed or translated.
+	tcgetattr(*slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(*slave, TCSANOW, &tio);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	unlink(link);
+	if (symlink(name, link) == -1) {
+		perror("symlink");
+		close(fd);
+		close(*slave);
+		return -1;
+	}
+
+	return fd;
+} /* end simd_pty() */
+
+
+/*------------------------------------------------------------------------------
+ * void simd_pololu_read()
+ * Decodes the bytes nav sends to the Pololu.
+ *----------------------------------------------------------------------------*/
+
+void simd_pololu_read(int fd, unsigned int events, void *arg)
+{
+	unsigned char buf[SIMD_BUF_SIZE];
+	int len = 0;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		sim_pololu_input(&sim.pololu, buf, len);
+	}
+} /* end simd_pololu_read() */
+
+
+/*------------------------------------------------------------------------------
+ * void simd_imu_read()
+ * Answers the requests nav sends to the Microstrain. Every byte is a command
+ * and the reply goes out straight away from the current state.
+ *----------------------------------------------------------------------------*/
+
+void simd_imu_read(int fd, unsigned int events, void *arg)
+{
+	unsigned char buf[SIMD_BUF_SIZE];
+	unsigned char reply[SIM_IMU_REPLY_SIZE];
+	int len = 0;
+	int size = 0;
+	int ii;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		for (ii = 0; ii < len; ii++) {
+			if ((size = sim_mstrain_reply(&sim, buf[ii], reply)) > 0 &&
+				write(fd, reply, size) != size) {
+				perror("write");
+			}
+		}
+	}
+} /* end simd_imu_read() */
+
+
+/*------------------------------------------------------------------------------
+ * void simd_step_timer()
+ * Advances the model by the time since the last expiration.
+ *----------------------------------------------------------------------------*/
+
+void simd_step_timer(int fd, unsigned int expirations, void *arg)
+{
+	sim_run(&sim, expirations * SIMD_PERIOD);
+} /* end simd_step_timer() */
+
+
+/*------------------------------------------------------------------------------
+ * void simd_lj_timer()
+ * Publishes the depth and batteries as labjackd does.
+ *----------------------------------------------------------------------------*/
+
+void simd_lj_timer(int fd, unsigned int expirations, void *arg)
+{
+	msg.lj.data.battery1 = SIMD_BATTERY1;
+	msg.lj.data.battery2 = SIMD_BATTERY2;
+	msg.lj.data.pressure = sim_depth(&sim);
+	msg.lj.data.water    = 0;
+
+	/// Push to subscribed clients and publish to nav and planner on the same
+	/// host.
+	net_server_publish(&server, LJ_MSGID, &msg);
+	if (bus_fd > 0) {
+		messages_send(bus_fd, LJ_MSGID, &msg);
+	}
+} /* end simd_lj_timer() */
+
+
+/*------------------------------------------------------------------------------
+ * void simd_print_timer()
+ * Prints the state of the model.
+ *----------------------------------------------------------------------------*/
+
+void simd_print_timer(int fd, unsigned int expirations, void *arg)
+{
+	SIM_STATE *s = &sim.state;
+
+	printf("SIMD: t %.1f s, depth %.2f m, roll %.1f, pitch %.1f, yaw %.1f deg, speed %.2f m/s, "
+		"%u Pololu commands, %u bad bytes\n",
+		s->time, s->pos[SIM_Z],
+		s->euler[SIM_ROLL] * 180 / M_PI,
+		s->euler[SIM_PITCH] * 180 / M_PI,
+		s->euler[SIM_YAW] * 180 / M_PI,
+		s->vel[SIM_X], sim.pololu.cmds, sim.pololu.bad);
+} /* end simd_print_timer() */
+
+
+/*------------------------------------------------------------------------------
+ * void simd_targets()
+ * Loads the targets and gains from the configuration file, as the planner
+ * does when it hands a task to nav.
+ *----------------------------------------------------------------------------*/
+
+static void simd_targets(MSG_DATA *msg, CONF_VARS *cf)
+{
+	msg->target.data.pitch        = cf->target_pitch;
+	msg->target.data.roll         = cf->target_roll;
+	msg->target.data.yaw          = cf->target_yaw;
+	msg->target.data.depth        = cf->target_depth;
+	msg->target.data.fx           = cf->target_fx;
+	msg->target.data.fy           = cf->target_fy;
+	msg->target.data.speed        = cf->target_speed;
+	msg->gain.data.kp_pitch       = cf->kp_pitch;
+	msg->gain.data.ki_pitch       = cf->ki_pitch;
+	msg->gain.data.kd_pitch       = cf->kd_pitch;
+	msg->gain.data.kp_roll        = cf->kp_roll;
+	msg->gain.data.ki_roll        = cf->ki_roll;
+	msg->gain.data.kd_roll        = cf->kd_roll;
+	msg->gain.data.kp_yaw         = cf->kp_yaw;
+	msg->gain.data.ki_yaw         = cf->ki_yaw;
+	msg->gain.data.kd_yaw         = cf->kd_yaw;
+	msg->gain.data.kp_depth       = cf->kp_depth;
+	msg->gain.data.ki_depth       = cf->ki_depth;
+	msg->gain.data.kd_depth       = cf->kd_depth;
+	msg->gain.data.kp_fx          = cf->kp_fx;
+	msg->gain.data.ki_fx          = cf->ki_fx;
+	msg->gain.data.kd_fx          = cf->kd_fx;
+	msg->gain.data.kp_fy          = cf->kp_fy;
+	msg->gain.data.ki_fy          = cf->ki_fy;
+	msg->gain.data.kd_fy          = cf->kd_fy;
+	msg->gain.data.kp_roll_lateral  = cf->kp_roll_lateral;
+	msg->gain.data.kp_depth_forward = cf->kp_depth_forward;
+} /* end simd_targets() */
+
+
+/*------------------------------------------------------------------------------
+ * int simd_bench()
+ * Runs the PID loops against the model as fast as it can. Each axis runs at
+ * its configured period of simulated time and its commands are read back from
+ * the pipe before the model takes its next step. The errors are taken over
+ * the whole run, including the step from the surface at the start, so a
+ * change to the controllers shows up as a change in the numbers.
+ *----------------------------------------------------------------------------*/
+
+int simd_bench(CONF_VARS *cf)
+{
+	static const char *names[PID_AXES] = {"", "pitch", "roll", "yaw", "depth", "fx", "fy"};
+	static PID pid;
+	POLOLU_OUT out;
+	unsigned char buf[SIMD_BUF_SIZE];
+	float period[PID_AXES] = {0};
+	float dt[PID_AXES] = {0};
+	double next[PID_AXES] = {0};
+	double sum[PID_AXES] = {0};
+	double worst[PID_AXES] = {0};
+	unsigned int runs[PID_AXES] = {0};
+	unsigned long long start = 0;
+	double wall = 0;
+	int steps = 0;
+	int fds[2];
+	int len = 0;
+	int ii;
+
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return -1;
+	}
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+	sim_init(&sim, cf->sim_seed, cf->sim_noise);
+	simd_targets(&msg, cf);
+	if (pid_init(&pid, cf) == -1) {
+		printf("SIMD_BENCH: WARNING!!! PID setup failed.\n");
+	}
+	pid_set_gains(&pid, cf, &msg);
+	pololu_out_init(&out, fds[1]);
+
+	period[PID_PITCH] = cf->period_pitch;
+	period[PID_ROLL] = cf->period_roll;
+	period[PID_YAW] = cf->period_yaw;
+	period[PID_DEPTH] = cf->period_depth;
+	for (ii = PID_PITCH; ii <= PID_DEPTH; ii++) {
+		next[ii] = period[ii];
+		dt[ii] = period[ii];
+	}
+
+	start = timing_now();
+	while (sim.state.time < cf->sim_bench) {
+		for (ii = PID_PITCH; ii <= PID_DEPTH; ii++) {
+			if (sim.state.time + SIM_STEP / 2 < next[ii]) {
+				continue;
+			}
+			next[ii] += period[ii];
+
+			sim_imu(&sim, &msg.mstrain.data);
+			msg.lj.data.pressure = sim_depth(&sim);
+			pid_loop(&out, &pid, &msg, PID_AXIS_BIT(ii), dt, TRUE);
+			pololu_out_flush(&out);
+			while ((len = read(fds[0], buf, sizeof(buf))) > 0) {
+				sim_pololu_input(&sim.pololu, buf, len);
+			}
+
+			sum[ii] += pid.perr[ii] * pid.perr[ii];
+			if (fabs(pid.perr[ii]) > worst[ii]) {
+				worst[ii] = fabs(pid.perr[ii]);
+			}
+			runs[ii]++;
+		}
+		sim_step(&sim, SIM_STEP);
+		steps++;
+	}
+	wall = timing_ns2s(timing_elapsed(start));
+
+	for (ii = PID_PITCH; ii <= PID_DEPTH; ii++) {
+		printf("SIMD_BENCH: %-5s RMS error %8.3f, worst %8.3f, %u runs\n", names[ii],
+			(runs[ii] > 0) ? sqrt(sum[ii] / runs[ii]) : 0., worst[ii], runs[ii]);
+	}
+	printf("SIMD_BENCH: End depth %.2f m, roll %.1f, pitch %.1f, yaw %.1f deg, %u Pololu commands, %u bad bytes\n",
+		sim.state.pos[SIM_Z],
+		sim.state.euler[SIM_ROLL] * 180 / M_PI,
+		sim.state.euler[SIM_PITCH] * 180 / M_PI,
+		sim.state.euler[SIM_YAW] * 180 / M_PI,
+		sim.pololu.cmds, sim.pololu.bad);
+	printf("SIMD_BENCH: %.1f s simulated in %.3f s, %.0f times real time, %.0f steps/s\n",
+		sim.state.time, wall, (wall > 0) ? sim.state.time / wall : 0., (wall > 0) ? steps / wall : 0.);
+
+	close(fds[0]);
+	close(fds[1]);
+
+	return 0;
+} /* end simd_bench() */
+
+
+/*------------------------------------------------------------------------------
+ * int main()
+ * Initialize data. Open ports. Run main program loop.
+ *----------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+	/// Setup exit function. It is called when SIGINT (ctrl-c) is invoked.
+	void(*exit_ptr)(void);
+	exit_ptr = simd_exit;
+	atexit(exit_ptr);
+
+	struct sigaction sigint_action;
+	sigint_action.sa_handler = simd_sigint;
+	sigint_action.sa_flags = 0;
+	sigaction(SIGINT, &sigint_action, NULL);
+
+	char recv_buf[MAX_MSG_SIZE];
+
+	printf("MAIN: Starting simulator daemon ...\n");
+
+	/// Initialize variables.
+	server_fd = -1;
+	bus_fd = -1;
+	pololu_fd = -1;
+	pololu_slave = -1;
+	imu_fd = -1;
+	imu_slave = -1;
+
+	memset(&msg, 0, sizeof(MSG_DATA));
+	memset(&cf, 0, sizeof(CONF_VARS));
+	messages_init(&msg);
+
+	/// simd stands in for labjackd so its messages carry the same producer.
+	messages_set_producer(MSG_PRODUCER_LABJACKD);
+	if (evloop_init(&loop) == -1) {
+		printf("MAIN: WARNING!!! Event loop setup failed.\n");
+		exit(-1);
+	}
+
+	/// Parse command line arguments.
+	parse_default_config(&cf);
+	parse_cla(argc, argv, &cf, STINGRAY, (const char *)SIMD_FILENAME);
+
+	/// Start tracing if a trace file is given.
+	if (cf.trace_file[0] != '\0' && trace_open(cf.trace_file) == 0) {
+		printf("MAIN: Tracing to %s.\n", cf.trace_file);
+	}
+
+	/// The bench runs on its own without nav.
+	if (cf.sim_bench > 0) {
+		printf("MAIN: Running the controllers against the model for %.1f s.\n", cf.sim_bench);
+		exit(simd_bench(&cf));
+	}
+
+	sim_init(&sim, cf.sim_seed, cf.sim_noise);
+
+	/// Set up server.
+	server_fd = net_server_setup(&server, cf.server_port);
+	if (server_fd > 0) {
+		printf("MAIN: Server setup OK.\n");
+	}
+	else {
+		printf("MAIN: WARNING!!! Server setup failed.\n");
+	}
+
+	/// Set up the shared memory bus.
+	if (cf.enable_shmbus) {
+		bus_fd = shmbus_open();
+		if (bus_fd > 0) {
+			printf("MAIN: Shared memory bus setup OK.\n");
+		}
+		else {
+			printf("MAIN: WARNING!!! Shared memory bus setup failed.\n");
+		}
+	}
+
+	/// Set up the ports nav opens in place of the devices.
+	if ((pololu_fd = simd_pty(cf.sim_pololu, &pololu_slave)) > 0) {
+		printf("MAIN: Pololu at %s.\n", cf.sim_pololu);
+		evloop_add_fd(&loop, pololu_fd, EVLOOP_READ, simd_pololu_read, NULL);
+	}
+	else {
+		printf("MAIN: WARNING!!! Pololu port setup failed.\n");
+	}
+	if ((imu_fd = simd_pty(cf.sim_imu, &imu_slave)) > 0) {
+		printf("MAIN: IMU at %s.\n", cf.sim_imu);
+		evloop_add_fd(&loop, imu_fd, EVLOOP_READ, simd_imu_read, NULL);
+	}
+	else {
+		printf("MAIN: WARNING!!! IMU port setup failed.\n");
+	}
+
+	/// Register the server and timers with the event loop.
+	if (server_fd > 0) {
+		net_server_add(&loop, &server, recv_buf, &msg, MODE_LJ, NULL, NULL);
+	}
+	evloop_add_timer(&loop, SIMD_PERIOD, simd_step_timer, NULL);
+	evloop_add_timer(&loop, SIMD_LJ_PERIOD, simd_lj_timer, NULL);
+	if (cf.debug_level > 0) {
+		evloop_add_timer(&loop, SIMD_PRINT_PERIOD, simd_print_timer, NULL);
+	}
+
+	printf("MAIN: Simulator running now.\n");
+
+	/// Main loop. Blocks until a client sends a request or a timer expires.
+	evloop_run(&loop);
+
+	exit(0);
+} /* end main() */
@@ -0,0 +1,72 @@
+/**
+ *  \file hist.h
+ *  \brief Histograms of times in power of 2 microsecond bins. Used for the
+ *         message latencies and the control loop timing so both are reported
+ *         the same way.
+ */
+
+#ifndef _HIST_H_
+#define _HIST_H_
+
+
+/******************************
+ *
+ * #defines
+ *
+ *****************************/
+
+/** @name Number of histogram bins. Bin i counts times from 2^(i-1) up to
+ * 2^i microseconds and the last bin also counts anything longer. */
+//@{
+#ifndef HIST_BINS
+#define HIST_BINS 24
+#endif /* HIST_BINS */
+//@}
+
+
+/******************************
+ *
+ * Data types
+ *
+ *****************************/
+
+#ifndef _HIST_
+#define _HIST_
+/*! Histogram of times in microseconds. One thread adds samples and the fields
+ * are written with atomic stores so other threads can read them while it
+ * does. */
+typedef struct _HIST {
+	unsigned int count;				//!< Number of samples
+	unsigned long long min;			//!< Smallest sample in us
+	unsigned long long max;			//!< Largest sample in us
+	unsigned long long sum;			//!< Sum of samples in us
+	unsigned int bins[HIST_BINS];	//!< Samples in each power of 2 bin
+} HIST;
+#endif /* _HIST_ */
+
+
+/******************************
+ *
+ * Function prototypes
+ *
+ *****************************/
+
+//! Adds a sample to a histogram.
+//! \param hist Pointer to the histogram.
+//! \param ns Sample in nanoseconds.
+void hist_add(HIST *hist, unsigned long long ns);
+
+//! Copies the bin counts of a histogram that another thread may be adding to.
+//! \param hist Pointer to the histogram.
+//! \param bins Filled in with HIST_BINS counts.
+void hist_copy(const HIST *hist, unsigned int *bins);
+
+//! Gets a percentile from a histogram.
+//! \param hist Pointer to the histogram.
+//! \param pct Percentile from 0 to 100.
+//! \return Upper edge of the bin holding the percentile, or the largest
+//!         sample if that is smaller, in us.
+unsigned long long hist_pct(const HIST *hist, float pct);
+
+
+#endif /* _HIST_H_ */
@@ -1,10 +1,12 @@
 /**
  *  \file timing.h
  *  \brief Functions for timers and checking to see if an amount of
- * 		   time has passed.
+ * 		   time has passed. Times are CLOCK_MONOTONIC in 64-bit
+ * 		   nanoseconds so they do not jump when the wall clock is set.
  */
 
 #include <stdio.h>
+#include <errno.h>
 #include <time.h>
 #include <sys/time.h>
 
@@ -22,6 +24,13 @@
 #define TIMING_ERROR			0
 #endif /* RETURN_VALS */
 
+/** @name Nanoseconds per second. */
+//@{
+#ifndef TIMING_NSEC
+#define TIMING_NSEC 1000000000ULL
+#endif /* TIMING_NSEC */
+//@}
+
 
 /******************************
  *
@@ -33,30 +42,104 @@
 #define _TIMING_
 /*! Timer struct. */
 typedef struct _TIMING {
-	int us;	//!< Time in microseconds
-    int s;	//!< Time in seconds
+	unsigned long long ns;	//!< Monotonic time the timer was set, in nanoseconds
+	int us;	//!< Microseconds part of the time from timing_get_dt()
+    int s;	//!< Seconds part of the time from timing_get_dt()
 } TIMING;
+
+/*! Fixed rate deadline. */
+typedef struct _TIMING_PERIOD {
+	unsigned long long next;	//!< Next deadline in nanoseconds
+	unsigned long long period;	//!< Period in nanoseconds
+} TIMING_PERIOD;
 #endif /* _TIMING_ */
 
 
+/******************************
+ *
+ * Inline functions
+ *
+ *****************************/
+
+//! Gets the monotonic time.
+//! \return The time in nanoseconds.
+static inline unsigned long long timing_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * TIMING_NSEC + ts.tv_nsec;
+}
+
+//! Converts seconds to nanoseconds.
+//! \param s Time in seconds.
+//! \return The time in nanoseconds.
+static inline unsigned long long timing_s2ns(double s)
+{
+	return (unsigned long long)(s * TIMING_NSEC);
+}
+
+//! Converts nanoseconds to seconds.
+//! \param ns Time in nanoseconds.
+//! \return The time in seconds.
+static inline double timing_ns2s(unsigned long long ns)
+{
+	return (double)ns / TIMING_NSEC;
+}
+
+//! Gets the time since a start time.
+//! \param start Time from timing_now().
+//! \return The elapsed time in nanoseconds.
+static inline unsigned long long timing_elapsed(unsigned long long start)
+{
+	return timing_now() - start;
+}
+
+//! Checks whether a deadline has passed.
+//! \param deadline Time from timing_now() plus some interval.
+//! \return 1 if the deadline has passed, 0 if not.
+static inline int timing_deadline_passed(unsigned long long deadline)
+{
+	return timing_now() >= deadline;
+}
+
+
 /******************************
  *
  * Function prototypes
  *
  *****************************/
 
+//! Starts a fixed rate deadline one period from now.
+//! \param p Pointer to the deadline.
+//! \param period The period in seconds.
+void timing_period_init(TIMING_PERIOD *p, double period);
+
+//! Checks whether the deadline has passed and moves it forward by whole
+//! periods so the rate does not drift with the time it is checked at.
+//! \param p Pointer to the deadline.
+//! \return The number of periods that have passed, 0 if the deadline has not.
+unsigned int timing_period_check(TIMING_PERIOD *p);
+
+//! Sleeps until an absolute monotonic time.
+//! \param deadline Time to wake at in nanoseconds.
+//! \return 0 on success, -1 on error.
+int timing_sleep_until(unsigned long long deadline);
+
 //! Checks to see if time has elapsed.
 //! \param timer A timer value to check.
 //! \param period The amount of time to check against, in seconds.
 //! \return dt in seconds if TRUE, 0 if FALSE.
 float timing_check_period(TIMING *timer, float period);
 
-//! Sets a timer to the current system time.
+//! Sets a timer to the current monotonic time.
 //! \param timer A timer to set.
 //! \return 1 on success, 0 on failure.
 int timing_set_timer(TIMING *timer);
 
-//! Computes elapsed time for a given timer.
+//! Computes elapsed time for a given timer. Only the s and us fields of
+//! elapsed are written so timer and elapsed may be the same.
 //! \param timer A timer value to check.
 //! \param elapsed The amount of time elapsed for timer.
 //! \return 1 on success, 0 on failure.
@@ -67,7 +150,7 @@ int timing_get_dt(TIMING *timer, TIMING *elapsed);
 //! \return The time elapsed in seconds as a float.
 float timing_get_dts(TIMING *timer);
 
-//! Convert from a timing element to microseconds.
+//! Convert the time from timing_get_dt() to microseconds.
 //! \param timer A timer value to convert.
 //! \return The time in microseconds.
 int timing_s2us(TIMING *timer);
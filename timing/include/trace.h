@@ -0,0 +1,166 @@
+/**
+ *  \file trace.h
+ *  \brief Tracing of spans and counters. Each thread writes events to its own
+ *         lock-free buffer and a background thread writes them to a file in
+ *         the Chrome trace format, which chrome://tracing and Perfetto open.
+ *         When tracing is off a span costs one load and a branch.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include "timing.h"
+
+
+/******************************
+ *
+ * #defines
+ *
+ *****************************/
+
+#ifndef TRUE
+#define TRUE 1
+#endif /* TRUE */
+
+#ifndef FALSE
+#define FALSE 0
+#endif /* FALSE */
+
+/** @name Number of threads that can write events. */
+//@{
+#ifndef TRACE_MAX_THREADS
+#define TRACE_MAX_THREADS 16
+#endif /* TRACE_MAX_THREADS */
+//@}
+
+/** @name Events each thread can buffer between flushes. Must be a power of
+ * 2. Events that do not fit are counted and dropped. */
+//@{
+#ifndef TRACE_BUF_EVENTS
+#define TRACE_BUF_EVENTS 4096
+#endif /* TRACE_BUF_EVENTS */
+//@}
+
+/** @name Time between flushes in seconds. */
+//@{
+#ifndef TRACE_FLUSH_PERIOD
+#define TRACE_FLUSH_PERIOD 0.1
+#endif /* TRACE_FLUSH_PERIOD */
+//@}
+
+/** @name Event types. */
+//@{
+#ifndef TRACE_TYPES
+#define TRACE_TYPES
+#define TRACE_SPAN		0
+#define TRACE_COUNTER	1
+#endif /* TRACE_TYPES */
+//@}
+
+
+/******************************
+ *
+ * Data types
+ *
+ *****************************/
+
+#ifndef _TRACE_
+#define _TRACE_
+/*! A span or counter. The name must be a string that outlives the trace,
+ * normally a literal. */
+typedef struct _TRACE_EVENT {
+	const char *name;		//!< Event name
+	unsigned long long ts;	//!< Start time in nanoseconds
+	unsigned long long dur;	//!< Span length in nanoseconds
+	long long value;		//!< Counter value
+	int type;				//!< TRACE_SPAN or TRACE_COUNTER
+} TRACE_EVENT;
+
+/*! Event buffer of one thread. The thread adds at head and the flush thread
+ * removes at tail. */
+typedef struct _TRACE_BUF {
+	TRACE_EVENT events[TRACE_BUF_EVENTS];	//!< Ring of events
+	unsigned int head;						//!< Events added
+	unsigned int tail;						//!< Events written out
+	unsigned int dropped;					//!< Events lost to a full ring
+	int tid;								//!< Thread ID
+	char name[16];							//!< Thread name
+	int named;								//!< Set once the name has been written out
+} TRACE_BUF;
+#endif /* _TRACE_ */
+
+/// Set while a trace is open.
+extern int trace_enabled;
+
+
+/******************************
+ *
+ * Function prototypes
+ *
+ *****************************/
+
+//! Starts writing a trace. Events from all threads are written to the file
+//! until trace_close().
+//! \param filename File to write the Chrome trace JSON to.
+//! \return 0 on success, -1 on error.
+int trace_open(const char *filename);
+
+//! Stops tracing, writes the events still buffered and closes the file.
+void trace_close();
+
+//! Adds an event to the buffer of the calling thread.
+//! \param type TRACE_SPAN or TRACE_COUNTER.
+//! \param name Event name.
+//! \param ts Start time in nanoseconds.
+//! \param dur Span length in nanoseconds.
+//! \param value Counter value.
+void trace_record(int type, const char *name, unsigned long long ts,
+	unsigned long long dur, long long value);
+
+
+/******************************
+ *
+ * Inline functions
+ *
+ *****************************/
+
+//! Starts a span.
+//! \return Start time to pass to trace_end(), 0 when tracing is off.
+static inline unsigned long long trace_begin()
+{
+	if (!__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+
+	return timing_now();
+}
+
+//! Ends a span started with trace_begin().
+//! \param name Span name.
+//! \param start Value returned by trace_begin().
+static inline void trace_end(const char *name, unsigned long long start)
+{
+	if (start != 0) {
+		trace_record(TRACE_SPAN, name, start, timing_now() - start, 0);
+	}
+}
+
+//! Records the value of a counter.
+//! \param name Counter name.
+//! \param value Counter value.
+static inline void trace_counter(const char *name, long long value)
+{
+	if (__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED)) {
+		trace_record(TRACE_COUNTER, name, timing_now(), 0, value);
+	}
+}
+
+
+#endif /* _TRACE_H_ */
@@ -0,0 +1,82 @@
+/******************************************************************************
+ *
+ *  Title:        hist.c
+ *
+ *  Description:  Histograms of times in power of 2 microsecond bins.
+ *
+ *****************************************************************************/
+
+#include "hist.h"
+
+
+/*------------------------------------------------------------------------------
+ * void hist_add()
+ * Adds a sample to a histogram.
+ *----------------------------------------------------------------------------*/
+
+void hist_add(HIST *hist, unsigned long long ns)
+{
+	unsigned long long us = ns / 1000;
+	unsigned int count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+	int bin = 0;
+
+	while (bin < HIST_BINS - 1 && (1ULL << bin) <= us) {
+		bin++;
+	}
+	__atomic_add_fetch(&hist->bins[bin], 1, __ATOMIC_RELAXED);
+
+	/// Only the thread adding samples writes so the loads and stores do not
+	/// need to be one atomic step.
+	if (count == 0 || us < __atomic_load_n(&hist->min, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&hist->min, us, __ATOMIC_RELAXED);
+	}
+	if (us > __atomic_load_n(&hist->max, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&hist->max, us, __ATOMIC_RELAXED);
+	}
+	__atomic_add_fetch(&hist->sum, us, __ATOMIC_RELAXED);
+	__atomic_store_n(&hist->count, count + 1, __ATOMIC_RELAXED);
+} /* end hist_add() */
+
+
+/*------------------------------------------------------------------------------
+ * void hist_copy()
+ * Copies the bin counts of a histogram.
+ *----------------------------------------------------------------------------*/
+
+void hist_copy(const HIST *hist, unsigned int *bins)
+{
+	int ii;
+
+	for (ii = 0; ii < HIST_BINS; ii++) {
+		bins[ii] = __atomic_load_n(&hist->bins[ii], __ATOMIC_RELAXED);
+	}
+} /* end hist_copy() */
+
+
+/*------------------------------------------------------------------------------
+ * unsigned long long hist_pct()
+ * Gets a percentile from a histogram.
+ *----------------------------------------------------------------------------*/
+
+unsigned long long hist_pct(const HIST *hist, float pct)
+{
+	unsigned int count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+	unsigned long long max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+	unsigned int target = 0;
+	unsigned int total = 0;
+	int ii;
+
+	if (count == 0) {
+		return 0;
+	}
+
+	target = (unsigned int)(count * pct / 100.);
+	for (ii = 0; ii < HIST_BINS - 1; ii++) {
+		total += __atomic_load_n(&hist->bins[ii], __ATOMIC_RELAXED);
+		if (total > target) {
+			return ((1ULL << ii) < max) ? (1ULL << ii) : max;
+		}
+	}
+
+	return max;
+} /* end hist_pct() */
@@ -2,10 +2,70 @@
  *
  *  Title:        timing.c
  *
+ *  Description:  Timers on the monotonic clock in 64-bit nanoseconds. The
+ *                TIMING functions keep their old calls on top of it.
+ *
  *****************************************************************************/
 
 #include "timing.h"
 
+/*------------------------------------------------------------------------------
+ * void timing_period_init()
+ * Starts a fixed rate deadline one period from now.
+ *----------------------------------------------------------------------------*/
+
+void timing_period_init(TIMING_PERIOD *p, double period)
+{
+	p->period = timing_s2ns(period);
+	p->next = timing_now() + p->period;
+} /* end timing_period_init() */
+
+
+/*------------------------------------------------------------------------------
+ * unsigned int timing_period_check()
+ * Checks whether the deadline has passed. If it has the deadline is moved past
+ * now by whole periods and the number of periods is returned.
+ *----------------------------------------------------------------------------*/
+
+unsigned int timing_period_check(TIMING_PERIOD *p)
+{
+	unsigned long long now = timing_now();
+	unsigned int periods = 0;
+
+	if (now < p->next || p->period == 0) {
+		return 0;
+	}
+
+	periods = 1 + (now - p->next) / p->period;
+	p->next += (unsigned long long)periods * p->period;
+
+	return periods;
+} /* end timing_period_check() */
+
+
+/*------------------------------------------------------------------------------
+ * int timing_sleep_until()
+ * Sleeps until an absolute monotonic time.
+ *----------------------------------------------------------------------------*/
+
+int timing_sleep_until(unsigned long long deadline)
+{
+	struct timespec ts;
+	int status = 0;
+
+	ts.tv_sec = deadline / TIMING_NSEC;
+	ts.tv_nsec = deadline % TIMING_NSEC;
+	while ((status = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) == EINTR) {
+		/// Go back to sleep after a signal.
+	}
+	if (status != 0) {
+		return -1;
+	}
+
+	return 0;
+} /* end timing_sleep_until() */
+
+
 /*------------------------------------------------------------------------------
  * float timing_check_period()
  * Check if a period (in seconds) has elapsed for a timer. Return the elapsed
@@ -14,21 +74,11 @@
 
 float timing_check_period(TIMING *timer, float period)
 {
-	/// Declare variables.
-	struct timeval t = {0, 0};
-	int t1 = 0;
-	int t2 = 0;
-
-	/// Get the current system time.
-	gettimeofday(&t, NULL);
-
-	/// Convert times to microseconds.
-	t1 = (timer->s * 1000000) + timer->us;
-	t2 = (t.tv_sec * 1000000) + t.tv_usec;
+	unsigned long long dt = timing_elapsed(timer->ns);
 
 	/// Check to see if period has elapsed.
-	if (t2 - t1 > (period * 1000000)) {
-		return (float)(t2 - t1) / (1000000.);
+	if (dt > timing_s2ns(period)) {
+		return (float)timing_ns2s(dt);
 	}
 
 	return (float)TIMING_ERROR;
@@ -37,20 +87,14 @@ float timing_check_period(TIMING *timer, float period)
 
 /*------------------------------------------------------------------------------
  * int timing_set_timer()
- * Sets a timer to the current system time.
+ * Sets a timer to the current monotonic time.
  *----------------------------------------------------------------------------*/
 
 int timing_set_timer(TIMING *timer)
 {
-	/// Declare variables.
-	struct timeval t = {0, 0};
-
-	/// Get the current system time.
-	gettimeofday(&t, NULL);
-
-	/// Set timer to the current system time.
-	timer->s  = t.tv_sec;
-	timer->us = t.tv_usec;
+	timer->ns = timing_now();
+	timer->s  = 0;
+	timer->us = 0;
 
 	return TIMING_SUCCESS;
 } /* end timing_set_timer() */
@@ -58,30 +102,16 @@ int timing_set_timer(TIMING *timer)
 
 /*------------------------------------------------------------------------------
  * int timing_get_dt()
- * Get the time elapsed for a given timer. Return the elapsed time in another
- * TIMING element.
+ * Get the time elapsed for a given timer. Return the elapsed time in the s and
+ * us fields of another TIMING element.
  *----------------------------------------------------------------------------*/
 
 int timing_get_dt(TIMING *timer, TIMING *elapsed)
 {
-	/// Declare variables.
-	struct timeval t = {0, 0};
-
-	/// Get the current system time.
-	gettimeofday(&t, NULL);
-
-	/// Check to see which fraction of a second is larger.
-	if (t.tv_usec > timer->us) {
-		elapsed->s  = timer->s - t.tv_sec;
-		elapsed->us = 1000000 + timer->us - t.tv_usec;
-		/// This should never happen. If it does then there is a problem with the system time.
-		if(elapsed->s < 0)
-			return TIMING_ERROR;
-	}
-	else {
-		elapsed->s  = timer->s - t.tv_sec;
-		elapsed->us = timer->us - t.tv_usec;
-	}
+	unsigned long long dt = timing_elapsed(timer->ns);
+
+	elapsed->s  = dt / TIMING_NSEC;
+	elapsed->us = (dt % TIMING_NSEC) / 1000;
 
 	return TIMING_SUCCESS;
 } /* end timing_get_dt() */
@@ -94,26 +124,13 @@ int timing_get_dt(TIMING *timer, TIMING *elapsed)
 
 float timing_get_dts(TIMING *timer)
 {
-	/// Declare variables.
-	struct timeval t = {0, 0};
-	int t1 = 0;
-	int t2 = 0;
-
-	/// Get the current system time.
-	gettimeofday(&t, NULL);
-
-	/// Convert times to microseconds.
-	t1 = (timer->s * 1000000) + timer->us;
-	t2 = (t.tv_sec * 1000000) + t.tv_usec;
-
-	/// Return time in seconds.
-	return (float)(t2 - t1) / (1000000.);
+	return (float)timing_ns2s(timing_elapsed(timer->ns));
 } /* end timing_get_dts() */
 
 
 /*------------------------------------------------------------------------------
  * int timing_s2us()
- * Convert a TIMING struct to the time in microseconds.
+ * Convert the time from timing_get_dt() to microseconds.
  *----------------------------------------------------------------------------*/
 
 int timing_s2us(TIMING *timer)
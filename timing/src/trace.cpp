@@ -0,0 +1,248 @@
+/******************************************************************************
+ *
+ *  Title:        trace.c
+ *
+ *  Description:  Tracing of spans and counters. Events go into a ring per
+ *                thread without locks and a background thread writes them out
+ *                as Chrome trace JSON. Times are monotonic so traces from
+ *                several daemons line up.
+ *
+ *****************************************************************************/
+
+#include "trace.h"
+
+int trace_enabled = FALSE;
+
+static TRACE_BUF trace_bufs[TRACE_MAX_THREADS];
+static int trace_count = 0;
+static __thread TRACE_BUF *trace_buf = NULL;
+static __thread int trace_full = FALSE;
+static FILE *trace_file = NULL;
+static pthread_t trace_thread;
+static int trace_running = FALSE;
+static int trace_first = TRUE;
+static int trace_pid = 0;
+
+
+/*------------------------------------------------------------------------------
+ * TRACE_BUF *trace_register()
+ * Gives the calling thread a buffer.
+ *----------------------------------------------------------------------------*/
+
+static TRACE_BUF *trace_register()
+{
+	TRACE_BUF *buf = NULL;
+	int index = 0;
+
+	index = __atomic_fetch_add(&trace_count, 1, __ATOMIC_ACQ_REL);
+	if (index >= TRACE_MAX_THREADS) {
+		printf("TRACE_REGISTER: WARNING!!! No buffer left for thread.\n");
+		trace_full = TRUE;
+		return NULL;
+	}
+
+	/// The name and thread ID are published to the flush thread by the first
+	/// release of head.
+	buf = &trace_bufs[index];
+	buf->tid = syscall(SYS_gettid);
+	prctl(PR_GET_NAME, buf->name, 0, 0, 0);
+	trace_buf = buf;
+
+	return buf;
+} /* end trace_register() */
+
+
+/*------------------------------------------------------------------------------
+ * void trace_record()
+ * Adds an event to the ring of the calling thread. The event is dropped if the
+ * flush thread has fallen a whole ring behind.
+ *----------------------------------------------------------------------------*/
+
+void trace_record(int type, const char *name, unsigned long long ts,
+	unsigned long long dur, long long value)
+{
+	TRACE_BUF *buf = trace_buf;
+	TRACE_EVENT *ev = NULL;
+	unsigned int head = 0;
+
+	if (buf == NULL) {
+		if (trace_full || (buf = trace_register()) == NULL) {
+			return;
+		}
+	}
+
+	head = buf->head;
+	if (head - __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE) >= TRACE_BUF_EVENTS) {
+		__atomic_add_fetch(&buf->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	ev = &buf->events[head & (TRACE_BUF_EVENTS - 1)];
+	ev->type = type;
+	ev->name = name;
+	ev->ts = ts;
+	ev->dur = dur;
+	ev->value = value;
+	__atomic_store_n(&buf->head, head + 1, __ATOMIC_RELEASE);
+} /* end trace_record() */
+
+
+/*------------------------------------------------------------------------------
+ * void trace_write()
+ * Separates a JSON event from the one before it.
+ *----------------------------------------------------------------------------*/
+
+static void trace_write()
+{
+	if (!trace_first) {
+		fprintf(trace_file, ",\n");
+	}
+	trace_first = FALSE;
+} /* end trace_write() */
+
+
+/*------------------------------------------------------------------------------
+ * void trace_flush()
+ * Writes the buffered events of every thread to the file.
+ *----------------------------------------------------------------------------*/
+
+static void trace_flush()
+{
+	TRACE_BUF *buf = NULL;
+	TRACE_EVENT *ev = NULL;
+	unsigned int head = 0;
+	unsigned int tail = 0;
+	unsigned int dropped = 0;
+	int count = __atomic_load_n(&trace_count, __ATOMIC_ACQUIRE);
+	int ii;
+
+	if (count > TRACE_MAX_THREADS) {
+		count = TRACE_MAX_THREADS;
+	}
+
+	for (ii = 0; ii < count; ii++) {
+		buf = &trace_bufs[ii];
+		head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+		tail = buf->tail;
+		if (head == tail) {
+			continue;
+		}
+
+		if (!buf->named) {
+			trace_write();
+			fprintf(trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				trace_pid, buf->tid, buf->name);
+			buf->named = TRUE;
+		}
+
+		for (; tail != head; tail++) {
+			ev = &buf->events[tail & (TRACE_BUF_EVENTS - 1)];
+			trace_write();
+			if (ev->type == TRACE_SPAN) {
+				fprintf(trace_file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+					ev->name, ev->ts / 1000., ev->dur / 1000., trace_pid, buf->tid);
+			}
+			else {
+				fprintf(trace_file, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"value\":%lld}}",
+					ev->name, ev->ts / 1000., trace_pid, buf->tid, ev->value);
+			}
+		}
+		__atomic_store_n(&buf->tail, tail, __ATOMIC_RELEASE);
+
+		/// Mark lost events so gaps in the trace are explained.
+		if ((dropped = __atomic_exchange_n(&buf->dropped, 0, __ATOMIC_RELAXED)) > 0) {
+			trace_write();
+			fprintf(trace_file, "{\"name\":\"trace_dropped\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"value\":%u}}",
+				timing_now() / 1000., trace_pid, buf->tid, dropped);
+		}
+	}
+
+	fflush(trace_file);
+} /* end trace_flush() */
+
+
+/*------------------------------------------------------------------------------
+ * void *trace_flush_thread()
+ * Writes out the buffers every TRACE_FLUSH_PERIOD.
+ *----------------------------------------------------------------------------*/
+
+static void *trace_flush_thread(void *arg)
+{
+	TIMING_PERIOD period;
+
+	timing_period_init(&period, TRACE_FLUSH_PERIOD);
+	while (__atomic_load_n(&trace_running, __ATOMIC_ACQUIRE)) {
+		timing_sleep_until(period.next);
+		timing_period_check(&period);
+		trace_flush();
+	}
+
+	return NULL;
+} /* end trace_flush_thread() */
+
+
+/*------------------------------------------------------------------------------
+ * int trace_open()
+ * Opens the trace file and starts the flush thread. The file is a JSON array
+ * of events, which the viewers accept even if the closing bracket is missing
+ * after a crash.
+ *----------------------------------------------------------------------------*/
+
+int trace_open(const char *filename)
+{
+	int status = 0;
+	int ii;
+
+	if (trace_file != NULL) {
+		printf("TRACE_OPEN: WARNING!!! A trace is already open.\n");
+		return -1;
+	}
+	if ((trace_file = fopen(filename, "w")) == NULL) {
+		perror("fopen");
+		return -1;
+	}
+
+	trace_pid = getpid();
+	trace_first = TRUE;
+	for (ii = 0; ii < TRACE_MAX_THREADS; ii++) {
+		trace_bufs[ii].named = FALSE;
+	}
+	fprintf(trace_file, "[\n");
+	trace_write();
+	fprintf(trace_file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+		trace_pid, program_invocation_short_name);
+
+	trace_running = TRUE;
+	if ((status = pthread_create(&trace_thread, NULL, trace_flush_thread, NULL)) != 0) {
+		printf("TRACE_OPEN: WARNING!!! Could not start flush thread: %s\n", strerror(status));
+		trace_running = FALSE;
+		fclose(trace_file);
+		trace_file = NULL;
+		return -1;
+	}
+	__atomic_store_n(&trace_enabled, TRUE, __ATOMIC_RELEASE);
+
+	return 0;
+} /* end trace_open() */
+
+
+/*------------------------------------------------------------------------------
+ * void trace_close()
+ * Stops tracing and writes out what is left.
+ *----------------------------------------------------------------------------*/
+
+void trace_close()
+{
+	if (trace_file == NULL) {
+		return;
+	}
+
+	__atomic_store_n(&trace_enabled, FALSE, __ATOMIC_RELEASE);
+	__atomic_store_n(&trace_running, FALSE, __ATOMIC_RELEASE);
+	pthread_join(trace_thread, NULL);
+
+	trace_flush();
+	fprintf(trace_file, "\n]\n");
+	fclose(trace_file);
+	trace_file = NULL;
+} /* end trace_close() */
@@ -27,6 +27,7 @@
 #include "labjack.h"
 #include "task.h"
 #include "timing.h"
+#include "trace.h"
 
 /******************************
 **
@@ -10,6 +10,7 @@
 
 /// Global file descriptors. Only global so that visiond_exit() can close them.
 int server_fd;
+NET_SERVER server;
 CvCapture *f_cam;
 CvCapture *b_cam;
 IplImage *bin_img;
@@ -43,7 +44,7 @@ void visiond_exit( )
 
     /// Close the open file descriptors.
     if( server_fd > 0 ) {
-        close( server_fd );
+        net_server_close( &server );
     }
 
     /// Close the cameras and windows.
@@ -67,6 +68,7 @@ void visiond_exit( )
 	if ( log_file ) {
 		fclose( log_file );
 	}
+	trace_close();
 
     printf("<OK>\n\n");
 } /// end visiond_exit()
@@ -124,7 +126,7 @@ int main( int argc, char *argv[] )
 	TIMING timer_fps;
 	TIMING timer_save;
 	TIMING timer_open;
-	int dt = 0;
+	float dt = 0.;
 	int nframes = 0;
     double fps = 0.0;
 
@@ -139,6 +141,7 @@ int main( int argc, char *argv[] )
     server_fd = -1;
     memset( &msg, 0, sizeof(MSG_DATA) );
 	messages_init( &msg );
+	messages_set_producer( MSG_PRODUCER_VISIOND );
 
 	/// Initialize task to none.
 	msg.task.data.task = TASK_NONE;
@@ -147,12 +150,17 @@ int main( int argc, char *argv[] )
     parse_default_config( &cf );
     parse_cla( argc, argv, &cf, STINGRAY, (const char *)VISIOND_FILENAME );
 
+	/// Start tracing if a trace file is given.
+	if( cf.trace_file[0] != '\0' && trace_open( cf.trace_file ) == 0 ) {
+		printf("MAIN: Tracing to %s.\n", cf.trace_file);
+	}
+
     /// Initialize HSV message data to configuration values.
 	visiond_msg_cf_init( &msg, &cf );
 
     /// Set up server.
     if( cf.enable_server ) {
-        server_fd = net_server_setup( cf.server_port );
+        server_fd = net_server_setup( &server, cf.server_port );
 		if( server_fd > 0 ) {
 			printf("MAIN: Server setup OK.\n");
 		}
@@ -299,11 +307,8 @@ int main( int argc, char *argv[] )
 
     	/// Get network data.
         if( (cf.enable_server) && (server_fd > 0) ) {
-            recv_bytes = net_server( server_fd, recv_buf, &msg, MODE_VISION );
+            recv_bytes = net_server( &server, recv_buf, &msg, MODE_VISION );
             if( recv_bytes > 0 ) {
-                recv_buf[recv_bytes] = '\0';
-                messages_decode( server_fd, recv_buf, &msg, recv_bytes );
-
                 /// Force vision to look for the pipe no matter which pipe
 			    /// subtask we are currently searching for.
 				if( msg.task.data.task == TASK_PIPE1 || msg.task.data.task == TASK_PIPE2 ||
@@ -372,6 +377,8 @@ int main( int argc, char *argv[] )
 
 		/// Only handle the image if there is a valid one.
 		if ( img != NULL ) {
+			/// Stamp the result with the time the frame was grabbed.
+			msg.vision.hdr.stamp = timing_now();
 
 			if ( cf.save_log_post ) {
 				/// Write the filename
@@ -408,15 +415,16 @@ int main( int argc, char *argv[] )
 
 			/// Calculate frames per second.
 			nframes++;
-			if( timing_check_period(&timer_fps, 1.) ) {
-				timing_get_dt(&timer_fps, &timer_fps);
-				dt = timing_s2us(&timer_fps);
-				fps = (double)nframes * (1000000 / dt);
+			if( (dt = timing_check_period(&timer_fps, 1.)) > 0 ) {
+				fps = (double)nframes / dt;
 				timing_set_timer(&timer_fps);
 				nframes = 0;
 				msg.vision.data.fps = fps;
 			}
 
+			/// Push the new result to subscribed clients.
+			net_server_publish( &server, VISION_MSGID, &msg );
+
 			if ( diropen ) {
 				/// The processed images need to be saved before the live feeds.
 				if ( cf.save_image_post ) {
@@ -641,6 +649,7 @@ int visiond_translate_task( char *task_name )
 int visiond_process_image( IplImage *img, IplImage *bin_img, MSG_DATA *msg )
 {
 	int status = -1;
+	unsigned long long span = trace_begin();
 
 	/// BUOY VARIABLES.
 	int dotx = -1;
@@ -996,6 +1005,8 @@ int visiond_process_image( IplImage *img, IplImage *bin_img, MSG_DATA *msg )
 
 	}
 
+	trace_end( "visiond_process_image", span );
+
 	if ( msg->vision.data.status == TASK_GATE_DETECTED || msg->vision.data.status == TASK_BUOY_DETECTED ||
 			msg->vision.data.status == TASK_PIPE_DETECTED || msg->vision.data.status == TASK_FENCE_DETECTED ||
 			msg->vision.data.status == TASK_BOXES_DETECTED || msg->vision.data.status == TASK_SUITCASE_DETECTED ) {